@@ -20,6 +20,7 @@ void bidirectional_stream_copy( Socket& socket, string_view peer_name )
   ByteStream _inbound { buffer_size };
   bool _outbound_shutdown { false };
   bool _inbound_shutdown { false };
+  ReadBuffer _read_buffer { buffer_size }; // shared by both directions' reads, and never zero-filled
 
   socket.set_blocking( false );
   _input.set_blocking( false );
@@ -31,10 +32,7 @@ void bidirectional_stream_copy( Socket& socket, string_view peer_name )
     _input,
     Direction::In,
     [&] {
-      string data;
-      data.resize( _outbound.writer().available_capacity() );
-      _input.read( data );
-      _outbound.writer().push( move( data ) );
+      _outbound.writer().push( string { _input.read( _read_buffer, _outbound.writer().available_capacity() ) } );
       if ( _input.eof() ) {
         _outbound.writer().close();
       }
@@ -81,10 +79,7 @@ void bidirectional_stream_copy( Socket& socket, string_view peer_name )
     socket,
     Direction::In,
     [&] {
-      string data;
-      data.resize( _inbound.writer().available_capacity() );
-      socket.read( data );
-      _inbound.writer().push( move( data ) );
+      _inbound.writer().push( string { socket.read( _read_buffer, _inbound.writer().available_capacity() ) } );
       if ( socket.eof() ) {
         _inbound.writer().close();
       }
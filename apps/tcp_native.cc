@@ -1,4 +1,5 @@
 #include "bidirectional_stream_copy.hh"
+#include "resolver.hh"
 
 #include <cstdlib>
 #include <cstring>
@@ -42,7 +43,8 @@ int main( int argc, char** argv )
         return connected_socket;
       }
       TCPSocket connecting_socket;
-      const Address peer { args[1], args[2] };
+      Resolver resolver;
+      const Address peer = resolver.resolve_blocking( args[1], args[2] );
       cerr << "DEBUG: Connecting to " << peer.to_string() << "... ";
       connecting_socket.connect( peer );
       cerr << "DEBUG: Successfully connected to " << connecting_socket.peer_address().to_string() << ".\n";
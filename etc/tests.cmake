@@ -90,3 +90,28 @@ set_tests_properties(${compile_name_opt} PROPERTIES FIXTURES_SETUP compile_opt)
 
 stest(byte_stream_speed_test)
 stest(reassembler_speed_test)
+stest(checksum_speed_test)
+stest(ipv4_serialize_speed_test)
+stest(ipv4_batch_speed_test)
+stest(fragment_reassembler_speed_test)
+stest(route_table_speed_test)
+stest(flow_classifier_speed_test)
+stest(pcapng_capture_speed_test)
+stest(pcap_replay_speed_test)
+stest(tun_multiqueue_speed_test)
+stest(tun_offload_speed_test)
+stest(packet_ring_speed_test)
+stest(fake_tun_speed_test)
+stest(io_uring_relay_speed_test)
+stest(read_loop_speed_test)
+stest(fd_transfer_speed_test)
+stest(fd_table_speed_test)
+stest(io_statistics_speed_test)
+stest(mapped_file_speed_test)
+stest(datagram_batch_speed_test)
+stest(udp_gso_speed_test)
+stest(zero_copy_speed_test)
+stest(listener_group_speed_test)
+stest(tpacket_ring_speed_test)
+stest(datagram_timestamp_speed_test)
+stest(resolver_speed_test)
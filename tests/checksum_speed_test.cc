@@ -0,0 +1,108 @@
+#include "checksum.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <thread>
+
+using namespace std;
+using namespace std::chrono;
+
+// reference implementation: one byte at a time
+uint16_t reference_checksum( string_view data )
+{
+  uint32_t sum = 0;
+  for ( size_t i = 0; i < data.size(); ++i ) {
+    const uint8_t byte = data[i];
+    sum += i % 2 ? byte : byte << 8;
+    sum = ( sum >> 16 ) + static_cast<uint16_t>( sum );
+  }
+  return ~sum;
+}
+
+template<typename Function>
+double gigabits_per_second( const size_t bytes, const size_t iterations, Function&& f )
+{
+  const auto start_time = steady_clock::now();
+  for ( size_t i = 0; i < iterations; ++i ) {
+    f();
+  }
+  const auto stop_time = steady_clock::now();
+
+  const auto test_duration = duration_cast<duration<double>>( stop_time - start_time );
+  return 8.0 * static_cast<double>( bytes * iterations ) / test_duration.count() / 1e9;
+}
+
+void speed_test( const size_t input_len, const size_t iterations, const size_t random_seed )
+{
+  // Generate the data to be checksummed
+  const string data = [&random_seed, &input_len] {
+    default_random_engine rd { random_seed };
+    uniform_int_distribution<char> ud;
+    string ret;
+    for ( size_t i = 0; i < input_len; ++i ) {
+      ret += ud( rd );
+    }
+    return ret;
+  }();
+
+  const uint16_t expected = reference_checksum( data );
+
+  // partial sums split at odd and even offsets must combine to the same value
+  for ( const size_t split : { size_t { 1 }, size_t { 2 }, size_t { 1001 }, data.size() / 2 + 1 } ) {
+    InternetChecksum first, second;
+    first.add( string_view { data }.substr( 0, split ) );
+    second.add( string_view { data }.substr( split ) );
+    first.add( second );
+    if ( first.value() != expected ) {
+      throw runtime_error( "combined checksum (split at " + to_string( split ) + ") does not match" );
+    }
+  }
+
+  const size_t num_threads = max( 2U, thread::hardware_concurrency() );
+
+  uint16_t single_value {};
+  const double single_speed = gigabits_per_second( data.size(), iterations, [&] {
+    InternetChecksum check;
+    check.add( data );
+    single_value = check.value();
+  } );
+
+  uint16_t parallel_value {};
+  const double parallel_speed = gigabits_per_second(
+    data.size(), iterations, [&] { parallel_value = parallel_checksum( data, num_threads ).value(); } );
+
+  if ( single_value != expected or parallel_value != expected ) {
+    throw runtime_error( "Mismatch between checksum implementations" );
+  }
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "InternetChecksum over " << input_len << " bytes: single thread reached " << fixed << setprecision( 2 )
+       << single_speed << " Gbit/s, " << num_threads << " threads reached " << parallel_speed << " Gbit/s.\n";
+
+  debug_output << "      InternetChecksum throughput: " << fixed << setprecision( 2 ) << single_speed
+               << " Gbit/s (1 thread), " << parallel_speed << " Gbit/s (" << num_threads << " threads)\n";
+}
+
+void program_body()
+{
+  speed_test( 1 << 23, 16, 2024 );
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
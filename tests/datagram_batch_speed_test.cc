@@ -0,0 +1,167 @@
+#include "datagram_batch.hh"
+#include "exception.hh"
+#include "socket.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+using namespace std;
+using namespace std::chrono;
+
+static constexpr size_t DATAGRAMS = 200000;
+static constexpr size_t PAYLOAD_SIZE = 64;
+
+void check( const bool condition, const string& message )
+{
+  if ( not condition ) {
+    throw runtime_error( message );
+  }
+}
+
+UDPSocket bound_socket()
+{
+  UDPSocket socket;
+  socket.bind( Address { "127.0.0.1", 0 } );
+  return socket;
+}
+
+string payload( const size_t index, const size_t length )
+{
+  string data( length, 0 );
+  for ( size_t i = 0; i < length; ++i ) {
+    data[i] = static_cast<char>( index * 7 + i );
+  }
+  return data;
+}
+
+// Check that a batch sends and receives every datagram whole with its address, and truncates long ones
+void check_batches()
+{
+  UDPSocket receiver = bound_socket();
+  UDPSocket first = bound_socket();
+  UDPSocket second = bound_socket();
+
+  vector<string> payloads;
+  for ( size_t i = 0; i < 10; ++i ) {
+    payloads.push_back( payload( i, i * 100 ) );
+  }
+
+  DatagramBatch outgoing { 8 };
+  for ( size_t i = 0; i < 5; ++i ) {
+    outgoing.push_back( receiver.local_address(), payloads[i] );
+  }
+  check( first.send( outgoing ) == 5, "sendmmsg did not send the whole batch" );
+  second.connect( receiver.local_address() );
+  outgoing.clear();
+  for ( size_t i = 5; i < 10; ++i ) {
+    outgoing.push_back( payloads[i] );
+  }
+  check( second.send( outgoing ) == 5, "sendmmsg on a connected socket did not send the whole batch" );
+
+  DatagramBatch incoming { 8, 850 };
+  check( receiver.recv( incoming ) == 8, "recvmmsg did not fill the batch" );
+  for ( size_t i = 0; i < 8; ++i ) {
+    check( incoming.payload( i ) == payloads[i] and not incoming.truncated( i ), "received the wrong datagram" );
+    check( incoming.address( i ) == ( i < 5 ? first : second ).local_address(), "received the wrong sender" );
+  }
+  check( receiver.recv( incoming ) == 2, "recvmmsg did not return the rest" );
+  check( incoming.payload( 0 ) == payloads[8] and incoming.payload( 1 ).size() == 850 and incoming.truncated( 1 )
+           and incoming.payload( 1 ) == string_view { payloads[9] }.substr( 0, 850 ),
+         "a long datagram was not truncated" );
+
+  receiver.set_blocking( false );
+  check( receiver.recv( incoming ) == 0 and incoming.empty(), "recvmmsg with nothing queued returned datagrams" );
+
+  const IOStatistics stats = receiver.statistics();
+  check( stats.reads.syscalls == 3 and stats.reads.would_block == 1 and stats.reads.bytes == 2800 + 800 + 850
+           and receiver.read_count() == 2,
+         "batched receives were not accounted for" );
+}
+
+// Send and receive DATAGRAMS small datagrams over loopback, `batch_size` at a time; returns datagrams per second
+double time_batches( const size_t batch_size )
+{
+  UDPSocket receiver = bound_socket();
+  UDPSocket sender = bound_socket();
+  sender.connect( receiver.local_address() );
+
+  const string data = payload( 0, PAYLOAD_SIZE );
+  DatagramBatch outgoing { batch_size };
+  for ( size_t i = 0; i < batch_size; ++i ) {
+    outgoing.push_back( data );
+  }
+  DatagramBatch incoming { batch_size, 2048 };
+
+  size_t received = 0;
+  const auto start = steady_clock::now();
+  for ( size_t round = 0; round < DATAGRAMS / batch_size; ++round ) {
+    sender.send( outgoing );
+    for ( size_t this_round = 0; this_round < batch_size; ) {
+      this_round += receiver.recv( incoming );
+      received += incoming.payload( 0 ).size() == PAYLOAD_SIZE ? incoming.size() : 0;
+    }
+  }
+  const double seconds = duration_cast<duration<double>>( steady_clock::now() - start ).count();
+
+  check( received == DATAGRAMS / batch_size * batch_size, "datagrams were lost" );
+  return static_cast<double>( received ) / seconds;
+}
+
+// The same with a system call per datagram
+double time_single()
+{
+  UDPSocket receiver = bound_socket();
+  UDPSocket sender = bound_socket();
+  sender.connect( receiver.local_address() );
+
+  const string data = payload( 0, PAYLOAD_SIZE );
+  Address source { "0.0.0.0" };
+  string incoming;
+
+  size_t received = 0;
+  const auto start = steady_clock::now();
+  for ( size_t i = 0; i < DATAGRAMS; ++i ) {
+    sender.send( data );
+    receiver.recv( source, incoming );
+    received += incoming.size() == PAYLOAD_SIZE;
+  }
+  const double seconds = duration_cast<duration<double>>( steady_clock::now() - start ).count();
+
+  check( received == DATAGRAMS, "datagrams were lost" );
+  return static_cast<double>( received ) / seconds;
+}
+
+void program_body()
+{
+  check_batches();
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  const double single = time_single();
+  cout << fixed << setprecision( 2 ) << "Loopback UDP, " << PAYLOAD_SIZE << "-byte datagrams: send/recv "
+       << single / 1e6 << " M/s";
+  debug_output << "      udp batch: " << fixed << setprecision( 2 ) << single / 1e6 << " M/s single";
+  for ( const size_t batch_size : { 1, 2, 4, 8, 16, 32, 64 } ) {
+    const double batched = time_batches( batch_size );
+    cout << ", batch of " << batch_size << " " << batched / 1e6 << " M/s";
+    debug_output << ", " << batch_size << ": " << batched / 1e6;
+  }
+  cout << ".\n";
+  debug_output << " M/s\n";
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
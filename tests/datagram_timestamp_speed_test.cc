@@ -0,0 +1,180 @@
+#include "datagram_latency.hh"
+#include "eventloop.hh"
+#include "exception.hh"
+#include "socket.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+using namespace std;
+using namespace std::chrono;
+
+static constexpr size_t BURST = 256;
+static constexpr size_t ROUNDS = 400;
+
+void check( const bool condition, const string& message )
+{
+  if ( not condition ) {
+    throw runtime_error( message );
+  }
+}
+
+UDPSocket bound_socket()
+{
+  UDPSocket socket;
+  socket.bind( Address { "127.0.0.1", 0 } );
+  return socket;
+}
+
+// Check the timestamps on datagrams received, and those the kernel reports for datagrams sent
+void check_timestamps()
+{
+  UDPSocket receiver = bound_socket();
+  UDPSocket sender = bound_socket();
+  receiver.set_timestamping( true );
+  sender.set_timestamping( true );
+
+  DatagramLatency latency;
+  const uint64_t before = DatagramLatency::now();
+  for ( size_t i = 0; i < 100; ++i ) {
+    latency.sending();
+    sender.sendto( receiver.local_address(), "datagram " + to_string( i ) );
+  }
+
+  ReadBuffer buffer { 65536 };
+  Address source { "0.0.0.0" };
+  for ( size_t i = 0; i < 100; ++i ) {
+    const SegmentedDatagram datagram = receiver.recv( source, buffer );
+    check( datagram.data == "datagram " + to_string( i ), "received the wrong datagram" );
+    check( datagram.timestamp >= before and datagram.timestamp <= DatagramLatency::now(),
+           "a receive timestamp was not taken while the datagram was in flight" );
+    latency.received( datagram );
+  }
+
+  sender.set_blocking( false );
+  uint64_t last = before;
+  for ( uint32_t id = 0; id < 100; ++id ) {
+    const auto timestamp = sender.read_transmit_timestamp();
+    check( timestamp.has_value(), "missing transmit timestamp " + to_string( id ) );
+    check( timestamp->id == id, "transmit timestamps out of order" );
+    check( timestamp->timestamp >= last, "transmit timestamps went backwards" );
+    last = timestamp->timestamp;
+    latency.transmitted( *timestamp );
+  }
+  check( not sender.read_transmit_timestamp().has_value(), "more transmit timestamps than sends" );
+  check( latency.kernel_to_user().count() == 100 and latency.user_to_kernel().count() == 100,
+         "delays were not recorded" );
+
+  receiver.set_timestamping( false );
+  sender.sendto( receiver.local_address(), "untimed" );
+  check( receiver.recv( source, buffer ).timestamp == 0, "timestamped with timestamping off" );
+}
+
+// Datagrams sent one at a time to an EventLoop that first runs a rule taking `work` for each; returns their
+// delays, with transmit timestamps read from a Direction::ErrQueue rule
+DatagramLatency loop_latency( const microseconds work )
+{
+  UDPSocket receiver = bound_socket();
+  UDPSocket jobs = bound_socket();
+  UDPSocket sender = bound_socket();
+  UDPSocket job_sender = bound_socket(); // every send on `sender` must be recorded, to match its timestamps
+  receiver.set_timestamping( true );
+  sender.set_timestamping( true );
+  sender.set_blocking( false );
+
+  DatagramLatency latency;
+  ReadBuffer buffer { 65536 };
+  Address source { "0.0.0.0" };
+  size_t received = 0;
+
+  EventLoop loop;
+  const size_t category = loop.add_category( "timestamped" );
+  loop.add_rule( category, jobs, Direction::In, [&] {
+    jobs.recv( source, buffer );
+    this_thread::sleep_for( work );
+  } );
+  loop.add_rule( category, receiver, Direction::In, [&] {
+    latency.received( receiver.recv( source, buffer ) );
+    ++received;
+  } );
+  loop.add_rule( category, sender, Direction::ErrQueue, [&] {
+    while ( const auto timestamp = sender.read_transmit_timestamp() ) {
+      latency.transmitted( *timestamp );
+    }
+  } );
+
+  for ( size_t i = 0; i < 200; ++i ) {
+    job_sender.sendto( jobs.local_address(), "job" );
+    latency.sending();
+    sender.sendto( receiver.local_address(), "datagram" );
+    while ( received <= i or latency.user_to_kernel().count() <= i ) {
+      loop.wait_next_event( -1 );
+    }
+  }
+  return latency;
+}
+
+// Receive ROUNDS bursts of datagrams; returns ns per datagram received
+double receive_rate( const bool timestamping )
+{
+  UDPSocket receiver = bound_socket();
+  UDPSocket sender = bound_socket();
+  receiver.set_timestamping( timestamping );
+
+  ReadBuffer buffer { 65536 };
+  Address source { "0.0.0.0" };
+  const string payload( 64, 'x' );
+  uint64_t timestamps = 0;
+  nanoseconds elapsed {};
+  for ( size_t round = 0; round < ROUNDS; ++round ) {
+    for ( size_t i = 0; i < BURST; ++i ) {
+      sender.sendto( receiver.local_address(), payload );
+    }
+    const auto start = steady_clock::now();
+    for ( size_t i = 0; i < BURST; ++i ) {
+      timestamps += receiver.recv( source, buffer ).timestamp != 0;
+    }
+    elapsed += steady_clock::now() - start;
+  }
+  check( timestamps == ( timestamping ? BURST * ROUNDS : 0 ), "timestamps were missing or unwanted" );
+  return static_cast<double>( elapsed.count() ) / ( BURST * ROUNDS );
+}
+
+void program_body()
+{
+  check_timestamps();
+
+  const DatagramLatency quiet = loop_latency( microseconds { 0 } );
+  const DatagramLatency busy = loop_latency( microseconds { 1000 } );
+  check( busy.kernel_to_user().mean() >= 1'000'000, "a slow rule did not delay the datagram after it" );
+  check( quiet.kernel_to_user().mean() < busy.kernel_to_user().mean(), "delays were not told apart" );
+
+  const double plain = receive_rate( false );
+  const double timestamped = receive_rate( true );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "EventLoop over loopback, quiet: " << quiet << ".\n";
+  cout << "With a 1 ms rule ahead of the receive: " << busy << ".\n";
+  cout << fixed << setprecision( 0 ) << "recvmsg() of " << BURST * ROUNDS << " datagrams: " << plain
+       << " ns/datagram without timestamps, " << timestamped << " with.\n";
+  debug_output << "      timestamps: " << fixed << setprecision( 0 ) << plain << " vs " << timestamped
+               << " ns/datagram\n";
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,201 @@
+#include "exception.hh"
+#include "fake_tun.hh"
+#include "ipv4_datagram.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <poll.h>
+#include <thread>
+
+using namespace std;
+using namespace std::chrono;
+
+// An IPv4 datagram carrying a sequence number, padded to `length` bytes
+vector<string> make_datagram( const uint32_t seqno, const size_t length )
+{
+  IPv4Datagram dgram;
+  dgram.header.src = 0x0a000001;
+  dgram.header.dst = 0x0a000002;
+  string payload( length - IPv4Header::LENGTH, 0 );
+  memcpy( payload.data(), &seqno, sizeof( seqno ) );
+  dgram.header.len = length;
+  dgram.header.compute_checksum();
+  dgram.payload.push_back( move( payload ) );
+  return serialize( dgram );
+}
+
+// Parse a datagram and return its sequence number
+uint32_t parse_datagram( string frame )
+{
+  IPv4Datagram dgram;
+  if ( not parse( dgram, { move( frame ) } ) or dgram.payload.empty() or dgram.payload.front().size() < 4 ) {
+    throw runtime_error( "FakeTun delivered a frame that is not a test datagram" );
+  }
+  uint32_t seqno {};
+  memcpy( &seqno, dgram.payload.front().data(), sizeof( seqno ) );
+  return seqno;
+}
+
+// Read one frame, waiting at most `timeout`; returns false if none came
+bool read_frame( FakeTun& tun, string& frame, const milliseconds timeout )
+{
+  pollfd pfd { tun.fd_num(), POLLIN, 0 };
+  if ( CheckSystemCall( "poll", poll( &pfd, 1, static_cast<int>( timeout.count() ) ) ) == 0 ) {
+    return false;
+  }
+  frame.clear();
+  tun.read( frame );
+  return true;
+}
+
+// Send `count` datagrams from a to b while b's reader thread parses them; returns the sequence numbers received
+// and the wall time from the first send to the last arrival
+pair<vector<uint32_t>, double> transfer( FakeTun& a, FakeTun& b, const size_t count, const size_t length )
+{
+  vector<uint32_t> received;
+  steady_clock::time_point last_arrival;
+  thread reader( [&] {
+    string frame;
+    while ( read_frame( b, frame, milliseconds( 200 ) ) ) {
+      received.push_back( parse_datagram( move( frame ) ) );
+      last_arrival = steady_clock::now();
+    }
+  } );
+
+  const auto start = steady_clock::now();
+  for ( uint32_t i = 0; i < count; ++i ) {
+    a.write( make_datagram( i, length ) );
+  }
+  reader.join();
+
+  return { received, duration_cast<duration<double>>( last_arrival - start ).count() };
+}
+
+// Median round-trip time of a ping-pong between the two ends, in microseconds
+double round_trip_us( FakeTun& a, FakeTun& b, const size_t rounds )
+{
+  vector<double> rtts;
+  string frame;
+  for ( uint32_t i = 0; i < rounds; ++i ) {
+    const auto start = steady_clock::now();
+    a.write( make_datagram( i, 64 ) );
+    if ( not read_frame( b, frame, seconds( 1 ) ) or parse_datagram( move( frame ) ) != i ) {
+      throw runtime_error( "ping " + to_string( i ) + " was not delivered" );
+    }
+    b.write( make_datagram( i, 64 ) );
+    if ( not read_frame( a, frame, seconds( 1 ) ) or parse_datagram( move( frame ) ) != i ) {
+      throw runtime_error( "pong " + to_string( i ) + " was not delivered" );
+    }
+    rtts.push_back( duration_cast<duration<double, micro>>( steady_clock::now() - start ).count() );
+  }
+  sort( rtts.begin(), rtts.end() );
+  return rtts[rtts.size() / 2];
+}
+
+void check( const bool condition, const string& message )
+{
+  if ( not condition ) {
+    throw runtime_error( message );
+  }
+}
+
+void program_body()
+{
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+  cout << fixed;
+  debug_output << fixed;
+
+  static constexpr size_t FRAME = 1500;
+  static constexpr size_t COUNT = 20000;
+
+  // back to back, and through an ideal emulated link
+  {
+    auto [a, b] = FakeTun::pair();
+    const auto [received, elapsed] = transfer( a, b, COUNT, FRAME );
+    check( received.size() == COUNT, "FakeTun pair lost frames" );
+    const double rtt = round_trip_us( a, b, 1000 );
+    cout << "FakeTun pair: " << setprecision( 1 ) << COUNT * FRAME * 8 / elapsed / 1e9 << " Gbit/s, "
+         << COUNT / elapsed / 1e6 << " M frames/s, RTT " << rtt << " us\n";
+    debug_output << "        FakeTun pair: " << setprecision( 1 ) << COUNT * FRAME * 8 / elapsed / 1e9
+                 << " Gbit/s, RTT " << rtt << " us\n";
+  }
+  {
+    FakeTunLink link;
+    const auto [received, elapsed] = transfer( link.a(), link.b(), COUNT, FRAME );
+    check( received.size() == COUNT and is_sorted( received.begin(), received.end() ),
+           "ideal FakeTunLink lost or reordered frames" );
+    const double rtt = round_trip_us( link.a(), link.b(), 1000 );
+    cout << "FakeTunLink (ideal): " << setprecision( 1 ) << COUNT * FRAME * 8 / elapsed / 1e9 << " Gbit/s, "
+         << COUNT / elapsed / 1e6 << " M frames/s, RTT " << rtt << " us\n";
+    debug_output << "        FakeTunLink: " << setprecision( 1 ) << COUNT * FRAME * 8 / elapsed / 1e9
+                 << " Gbit/s, RTT " << rtt << " us\n";
+  }
+
+  // latency adds to the round trip in each direction
+  {
+    FakeTunLink link { LinkConditions { .latency = microseconds( 500 ) } };
+    const double rtt = round_trip_us( link.a(), link.b(), 200 );
+    check( rtt >= 1000 and rtt < 5000, "RTT of " + to_string( rtt ) + " us with 500 us of latency each way" );
+    cout << "FakeTunLink with 500 us latency: RTT " << setprecision( 1 ) << rtt << " us\n";
+  }
+
+  // the bottleneck paces the transfer
+  {
+    static constexpr uint64_t RATE = 100'000'000;
+    static constexpr size_t PACED_COUNT = 2000;
+    FakeTunLink link { LinkConditions { .bits_per_second = RATE } };
+    const auto [received, elapsed] = transfer( link.a(), link.b(), PACED_COUNT, FRAME );
+    const double rate = PACED_COUNT * FRAME * 8 / elapsed;
+    check( received.size() == PACED_COUNT, "rate-limited FakeTunLink lost frames" );
+    check( rate > 0.8 * RATE and rate < 1.05 * RATE,
+           "100 Mbit/s FakeTunLink ran at " + to_string( rate / 1e6 ) + " Mbit/s" );
+    cout << "FakeTunLink at 100 Mbit/s: measured " << setprecision( 1 ) << rate / 1e6 << " Mbit/s\n";
+  }
+
+  // a full bottleneck queue drops the rest of a burst
+  {
+    FakeTunLink link { LinkConditions { .bits_per_second = 10'000'000, .queue_bytes = 15000 } };
+    const auto received = transfer( link.a(), link.b(), 100, FRAME ).first;
+    const auto stats = link.a_to_b();
+    check( stats.delivered == received.size() and stats.delivered + stats.overflowed == 100 and stats.overflowed > 0
+             and received.size() <= 12,
+           "FakeTunLink queue delivered " + to_string( received.size() ) + " and dropped "
+             + to_string( stats.overflowed ) + " of a burst of 100" );
+  }
+
+  // random loss is reproducible from the seed
+  {
+    static constexpr size_t LOSSY_COUNT = 10000;
+    const LinkConditions lossy { .loss_rate = 0.1 };
+    vector<vector<uint32_t>> runs;
+    for ( const uint64_t seed : { 7, 7, 8 } ) {
+      FakeTunLink link { lossy, seed };
+      runs.push_back( transfer( link.a(), link.b(), LOSSY_COUNT, 100 ).first );
+      check( link.a_to_b().lost + runs.back().size() == LOSSY_COUNT, "FakeTunLink miscounted lost frames" );
+    }
+    const double loss = 1 - static_cast<double>( runs[0].size() ) / LOSSY_COUNT;
+    check( loss > 0.08 and loss < 0.12, "FakeTunLink lost " + to_string( loss * 100 ) + "% instead of 10%" );
+    check( runs[0] == runs[1], "FakeTunLink lost different frames with the same seed" );
+    check( runs[0] != runs[2], "FakeTunLink lost the same frames with different seeds" );
+    cout << "FakeTunLink with 10% loss: lost " << setprecision( 1 ) << loss * 100
+         << "%, identically for the same seed\n";
+  }
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
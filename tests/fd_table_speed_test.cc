@@ -0,0 +1,249 @@
+#include "eventloop.hh"
+#include "exception.hh"
+#include "file_descriptor.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace std;
+using namespace std::chrono;
+
+FileDescriptor make_eventfd()
+{
+  return FileDescriptor { CheckSystemCall( "eventfd", eventfd( 0, EFD_CLOEXEC | EFD_NONBLOCK ) ) };
+}
+
+bool is_open( const int fd_num )
+{
+  return fcntl( fd_num, F_GETFD ) >= 0; // NOLINT(*-vararg)
+}
+
+void check( const bool condition, const string& message )
+{
+  if ( not condition ) {
+    throw runtime_error( message );
+  }
+}
+
+// Check sharing between duplicates, closing by the last reference, and stale and moved-from handles
+void check_handles()
+{
+  int fd_num = -1;
+  {
+    FileDescriptor fd = make_eventfd();
+    fd_num = fd.fd_num();
+    {
+      const FileDescriptor copy = fd.duplicate();
+      fd.set_blocking( true );
+      fd.write( string( 8, 1 ) );
+      check( copy.write_count() == 1 and copy.fd_num() == fd_num, "duplicates do not share their state" );
+    }
+    check( is_open( fd_num ), "destroying a duplicate closed the descriptor" );
+
+    FileDescriptor moved = move( fd );
+    check( fd.closed() and fd.eof() and fd.fd_num() == -1, "a moved-from FileDescriptor does not read as closed" );
+    check( moved.write_count() == 1 and not moved.closed(), "moving a FileDescriptor lost its state" );
+  }
+  check( not is_open( fd_num ), "the last FileDescriptor did not close the descriptor" );
+
+  // an explicit close() leaves the duplicates' handles, which go stale once the number is reused
+  FileDescriptor first = make_eventfd();
+  FileDescriptor copy = first.duplicate();
+  fd_num = first.fd_num();
+  first.close();
+  check( copy.closed() and copy.fd_num() == fd_num, "duplicate of a closed FileDescriptor is not closed" );
+  const FileDescriptor reused = make_eventfd();
+  check( reused.fd_num() == fd_num, "the kernel did not reuse the descriptor number" );
+  check( not reused.closed() and reused.read_count() == 0, "a reused slot kept the old descriptor's state" );
+  check( copy.closed() and copy.eof() and copy.fd_num() == -1, "a stale FileDescriptor does not read as closed" );
+  check( copy.duplicate().fd_num() == -1, "the duplicate of a stale FileDescriptor is not stale" );
+  try {
+    copy.set_blocking( false );
+    throw runtime_error( "a stale FileDescriptor made a system call on the reused descriptor" );
+  } catch ( const unix_error& ) { // NOLINT(*-empty-catch)
+  }
+  { const FileDescriptor drop = move( copy ); } // releasing the stale handle must leave the new descriptor open
+  check( is_open( reused.fd_num() ), "releasing a stale FileDescriptor closed the reused descriptor" );
+
+  // closing again, through the handle that closed it, must not reach the reused descriptor either
+  try {
+    first.close();
+    throw runtime_error( "closing a closed FileDescriptor did not throw" );
+  } catch ( const unix_error& ) { // NOLINT(*-empty-catch)
+  }
+  check( is_open( reused.fd_num() ), "closing a closed FileDescriptor closed the reused descriptor" );
+
+  // a number that already has a FileDescriptor is not the kernel's to hand out, unless it was closed behind that
+  // FileDescriptor's back: the descriptor wrapped then is still handed over, and closed rather than leaked
+  FileDescriptor bypassed = make_eventfd();
+  ::close( bypassed.fd_num() );
+  const int fresh = CheckSystemCall( "eventfd", eventfd( 0, EFD_CLOEXEC ) );
+  check( fresh == bypassed.fd_num(), "the kernel did not reuse the descriptor number" );
+  bool threw = false;
+  try {
+    const FileDescriptor again { fresh };
+  } catch ( const runtime_error& ) {
+    threw = true;
+  }
+  check( threw, "a second FileDescriptor for an open descriptor was allowed" );
+  check( not is_open( fresh ), "a descriptor that could not be wrapped was leaked" );
+  try {
+    bypassed.close(); // its descriptor is long gone
+  } catch ( const unix_error& ) { // NOLINT(*-empty-catch)
+  }
+}
+
+// Threads opening and closing descriptors share the table's slots, as the kernel reuses numbers between them
+void check_threads()
+{
+  static constexpr size_t ROUNDS = 20000;
+  const auto churn = [] {
+    for ( size_t i = 0; i < ROUNDS; ++i ) {
+      FileDescriptor fd = make_eventfd();
+      FileDescriptor copy = fd.duplicate();
+      check( not fd.closed() and fd.read_count() == 0, "another thread's descriptor changed this one's slot" );
+      if ( i % 2 ) {
+        fd.close();
+      }
+    }
+  };
+  thread other { churn };
+  churn();
+  other.join();
+}
+
+// A reference-counted handle as it was before the descriptor table: an atomic count, and a heap node allocated
+// among the rest of its connection's state
+struct SharedHandle
+{
+  struct Wrapper
+  {
+    int fd;
+    bool eof;
+    bool closed;
+    unsigned read_count;
+  };
+  shared_ptr<Wrapper> wrapper;
+};
+
+// Time duplicating and releasing handles; returns ns per duplicate
+template<typename Handle, typename Duplicate>
+double time_duplicates( vector<Handle>& handles, const size_t rounds, Duplicate&& duplicate )
+{
+  const auto start = steady_clock::now();
+  for ( size_t round = 0; round < rounds; ++round ) {
+    vector<Handle> copies;
+    copies.reserve( handles.size() );
+    for ( const auto& handle : handles ) {
+      copies.push_back( duplicate( handle ) );
+    }
+  }
+  const auto elapsed = steady_clock::now() - start;
+  return static_cast<double>( duration_cast<nanoseconds>( elapsed ).count() )
+         / static_cast<double>( rounds * handles.size() );
+}
+
+// Time the checks EventLoop makes of every rule's descriptor before polling; returns ns per descriptor
+template<typename Handle, typename Visit>
+double time_scans( vector<Handle>& handles, const size_t rounds, Visit&& visit )
+{
+  size_t open = 0;
+  const auto start = steady_clock::now();
+  for ( size_t round = 0; round < rounds; ++round ) {
+    for ( const auto& handle : handles ) {
+      open += visit( handle );
+    }
+  }
+  const auto elapsed = steady_clock::now() - start;
+  check( open == rounds * handles.size(), "scan found closed descriptors" );
+  return static_cast<double>( duration_cast<nanoseconds>( elapsed ).count() )
+         / static_cast<double>( rounds * handles.size() );
+}
+
+void speed_test( const size_t count )
+{
+  vector<FileDescriptor> fds;
+  vector<SharedHandle> shared;
+  vector<string> connection_state;
+  for ( size_t i = 0; i < count; ++i ) {
+    fds.push_back( make_eventfd() );
+    shared.push_back( { make_shared<SharedHandle::Wrapper>( fds.back().fd_num(), false, false, 0 ) } );
+    connection_state.emplace_back( 2048, 'x' );
+  }
+
+  static constexpr size_t ROUNDS = 50;
+  const double shared_duplicate
+    = time_duplicates( shared, ROUNDS, []( const SharedHandle& handle ) { return handle; } );
+  const double table_duplicate
+    = time_duplicates( fds, ROUNDS, []( const FileDescriptor& fd ) { return fd.duplicate(); } );
+  const double shared_scan = time_scans( shared, ROUNDS, []( const SharedHandle& handle ) {
+    return handle.wrapper->fd >= 0 and not handle.wrapper->eof and not handle.wrapper->closed;
+  } );
+  const double table_scan = time_scans( fds, ROUNDS, []( const FileDescriptor& fd ) {
+    return fd.fd_num() >= 0 and not fd.eof() and not fd.closed();
+  } );
+
+  // and an EventLoop with a rule on every descriptor, one of which is readable
+  EventLoop loop;
+  const size_t category = loop.add_category( "eventfd" );
+  size_t fired = 0;
+  for ( auto& fd : fds ) {
+    loop.add_rule( category, fd, Direction::In, [&fd, &fired] {
+      string counter;
+      fd.read( counter );
+      ++fired;
+    } );
+  }
+  const auto start = steady_clock::now();
+  for ( size_t round = 0; round < ROUNDS; ++round ) {
+    fds[round % count].write( string( 8, 1 ) );
+    loop.wait_next_event( -1 );
+  }
+  const double loop_us
+    = static_cast<double>( duration_cast<microseconds>( steady_clock::now() - start ).count() ) / ROUNDS;
+  check( fired == ROUNDS, "EventLoop fired " + to_string( fired ) + " rules instead of " + to_string( ROUNDS ) );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << fixed << setprecision( 1 ) << count << " descriptors: duplicate " << shared_duplicate
+       << " ns with shared_ptr, " << table_duplicate << " ns with the table; scan " << shared_scan << " vs "
+       << table_scan << " ns per descriptor; EventLoop iteration " << loop_us << " us.\n";
+  debug_output << "      " << setw( 6 ) << count << " fds: duplicate " << fixed << setprecision( 1 )
+               << shared_duplicate << " vs " << table_duplicate << " ns, scan " << shared_scan << " vs "
+               << table_scan << " ns\n";
+}
+
+void program_body()
+{
+  check_handles();
+  check_threads();
+
+  rlimit limit {};
+  CheckSystemCall( "getrlimit", getrlimit( RLIMIT_NOFILE, &limit ) );
+  const size_t most = limit.rlim_cur > 200 ? limit.rlim_cur - 100 : 100;
+  for ( const size_t count : { size_t { 100 }, min( size_t { 10000 }, most ) } ) {
+    speed_test( count );
+  }
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,232 @@
+#include "exception.hh"
+#include "file_descriptor.hh"
+#include "splice_pipe.hh"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace std;
+using namespace std::chrono;
+
+static constexpr size_t CHUNK = 65536;
+
+pair<FileDescriptor, FileDescriptor> stream_pair()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", socketpair( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds.data() ) );
+  return { FileDescriptor { fds[0] }, FileDescriptor { fds[1] } };
+}
+
+// An unlinked temporary file
+FileDescriptor temporary_file()
+{
+  string name = "/tmp/fd_transfer_speed_test.XXXXXX";
+  FileDescriptor file { CheckSystemCall( "mkstemp", mkstemp( name.data() ) ) };
+  CheckSystemCall( "unlink", unlink( name.c_str() ) );
+  return file;
+}
+
+string contents( const size_t length )
+{
+  string data( length, 0 );
+  for ( size_t i = 0; i < length; ++i ) {
+    data[i] = static_cast<char>( ( i * 131 ) >> 8 );
+  }
+  return data;
+}
+
+void write_all( FileDescriptor& fd, string_view data )
+{
+  while ( not data.empty() ) {
+    data.remove_prefix( fd.write( data ) );
+  }
+}
+
+// Everything read from `fd` until EOF
+string read_all( FileDescriptor& fd )
+{
+  string result;
+  ReadBuffer buffer { CHUNK };
+  while ( not fd.eof() ) {
+    result.append( fd.read( buffer ) );
+  }
+  return result;
+}
+
+void rewind( FileDescriptor& file )
+{
+  CheckSystemCall( "lseek", lseek( file.fd_num(), 0, SEEK_SET ) );
+}
+
+// Move everything from `in` to `out` through user space
+void copy_loop( FileDescriptor& in, FileDescriptor& out )
+{
+  ReadBuffer buffer { CHUNK };
+  while ( true ) {
+    const string_view data = in.read( buffer );
+    if ( in.eof() ) {
+      return;
+    }
+    write_all( out, data );
+  }
+}
+
+// Move everything from `in` to `out` with one of the kernel-side transfers
+template<typename Transfer>
+void transfer_loop( FileDescriptor& in, FileDescriptor& out, Transfer&& transfer )
+{
+  while ( not in.eof() ) {
+    transfer( in, out );
+  }
+}
+
+// Run `move_all` from `in` to the sending end of a socket pair, while a thread reads the receiving end; returns
+// the seconds taken and what the thread read
+template<typename MoveAll>
+pair<double, string> to_socket( FileDescriptor& in, MoveAll&& move_all )
+{
+  auto [sender, receiver] = stream_pair();
+  string received;
+  thread reader( [&receiver, &received] { received = read_all( receiver ); } );
+
+  const auto start = steady_clock::now();
+  move_all( in, sender );
+  sender.close();
+  reader.join();
+  const auto stop = steady_clock::now();
+
+  return { duration_cast<duration<double>>( stop - start ).count(), move( received ) };
+}
+
+void check( const bool condition, const string& message )
+{
+  if ( not condition ) {
+    throw runtime_error( message );
+  }
+}
+
+struct Result
+{
+  double loop_seconds;
+  double kernel_seconds;
+};
+
+// serving a file to a socket: read/write vs. sendfile
+Result serve_file( const string& data )
+{
+  FileDescriptor file = temporary_file();
+  write_all( file, data );
+
+  rewind( file );
+  const auto [loop_seconds, loop_received] = to_socket( file, copy_loop );
+  check( loop_received == data, "read/write loop served the wrong bytes" );
+
+  FileDescriptor again = temporary_file();
+  write_all( again, data );
+  rewind( again );
+  const auto [kernel_seconds, received] = to_socket( again, []( FileDescriptor& in, FileDescriptor& out ) {
+    transfer_loop( in, out, []( FileDescriptor& from, FileDescriptor& to ) { to.sendfile( from, 1 << 20 ); } );
+  } );
+  check( received == data, "sendfile served the wrong bytes" );
+  check( again.eof() and again.read_count() > 0, "sendfile did not account for its reads" );
+
+  return { loop_seconds, kernel_seconds };
+}
+
+// relaying one connection to another: read/write vs. splice through a pipe
+Result relay( const string& data )
+{
+  const auto run = [&data]( auto&& move_all ) {
+    auto [client, relay_in] = stream_pair();
+    thread writer( [&client, &data] {
+      write_all( client, data );
+      client.close();
+    } );
+    auto result = to_socket( relay_in, move_all );
+    writer.join();
+    check( result.second == data, "relay delivered the wrong bytes" );
+    return result.first;
+  };
+
+  const double loop_seconds = run( copy_loop );
+  const double kernel_seconds = run( []( FileDescriptor& in, FileDescriptor& out ) {
+    SplicePipe pipe { 1 << 20 };
+    transfer_loop(
+      in, out, [&pipe]( FileDescriptor& from, FileDescriptor& to ) { pipe.relay( from, to, 1 << 20 ); } );
+    while ( pipe.buffered() ) {
+      pipe.drain( out );
+    }
+  } );
+
+  return { loop_seconds, kernel_seconds };
+}
+
+// copying a file: read/write vs. copy_file_range
+Result copy_file( const string& data )
+{
+  const auto run = [&data]( auto&& move_all ) {
+    FileDescriptor source = temporary_file();
+    write_all( source, data );
+    rewind( source );
+    FileDescriptor destination = temporary_file();
+
+    const auto start = steady_clock::now();
+    move_all( source, destination );
+    const auto stop = steady_clock::now();
+
+    rewind( destination );
+    check( read_all( destination ) == data, "file copy has the wrong contents" );
+    return duration_cast<duration<double>>( stop - start ).count();
+  };
+
+  const double loop_seconds = run( copy_loop );
+  const double kernel_seconds = run( []( FileDescriptor& in, FileDescriptor& out ) {
+    transfer_loop(
+      in, out, []( FileDescriptor& from, FileDescriptor& to ) { to.copy_file_range( from, 1 << 20 ); } );
+  } );
+
+  return { loop_seconds, kernel_seconds };
+}
+
+void report( const string_view name, const string_view kernel_name, const Result& result, const double megabytes )
+{
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << fixed << setprecision( 0 ) << name << ": read/write " << megabytes / result.loop_seconds << " MB/s, "
+       << kernel_name << " " << megabytes / result.kernel_seconds << " MB/s (" << setprecision( 2 )
+       << result.loop_seconds / result.kernel_seconds << "x).\n";
+  debug_output << "      " << setw( 16 ) << kernel_name << ": " << fixed << setprecision( 0 )
+               << megabytes / result.loop_seconds << " vs " << megabytes / result.kernel_seconds << " MB/s\n";
+}
+
+void program_body()
+{
+  static constexpr size_t LENGTH = 64 << 20;
+  const string data = contents( LENGTH );
+  const double megabytes = LENGTH / 1e6;
+
+  report( "file to socket", "sendfile", serve_file( data ), megabytes );
+  report( "socket to socket", "splice", relay( data ), megabytes );
+  report( "file to file", "copy_file_range", copy_file( data ), megabytes );
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,169 @@
+#include "flow_classifier.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+using namespace std;
+using namespace std::chrono;
+
+// The TCP/IPv4 example from Microsoft's RSS verification suite
+void check_test_vector()
+{
+  const FlowKey key { 0x420995bb, 0xa18e6450, 2794, 1766, IPv4Header::PROTO_TCP };
+  const uint32_t hash = ToeplitzHash {}( key );
+  if ( hash != 0x51ccc178 ) {
+    throw runtime_error( "ToeplitzHash gave " + to_string( hash ) + " for the RSS test vector" );
+  }
+}
+
+// SYMMETRIC_KEY repeats every 16 bits, so flipping bit i and bit i + 16 of an address together leaves the Toeplitz
+// hash unchanged: these flows, which a peer could choose, all share one hash (and so one shard). Indexed by that
+// hash, the table would probe O(n) slots for each; with its own seeded hash, it stays fast.
+void check_chosen_collisions()
+{
+  static constexpr uint32_t NUM_FLOWS = 1 << 16;
+  const ToeplitzHash toeplitz { ToeplitzHash::SYMMETRIC_KEY };
+  FlowClassifier classifier { 8, NUM_FLOWS };
+  const uint32_t shard = classifier.classify( FlowKey { 0, 0x0a000001, 1234, 80, IPv4Header::PROTO_TCP } );
+
+  const auto start = steady_clock::now();
+  for ( uint32_t x = 1; x < NUM_FLOWS; ++x ) {
+    const FlowKey key { x * 0x10001, 0x0a000001, 1234, 80, IPv4Header::PROTO_TCP };
+    if ( toeplitz( key ) != toeplitz( FlowKey { 0, 0x0a000001, 1234, 80, IPv4Header::PROTO_TCP } )
+         or classifier.classify( key ) != shard ) {
+      throw runtime_error( "chosen flows did not share a Toeplitz hash and shard" );
+    }
+  }
+  const double elapsed = duration_cast<duration<double>>( steady_clock::now() - start ).count();
+
+  if ( classifier.flows().size() != NUM_FLOWS ) {
+    throw runtime_error( "FlowClassifier holds " + to_string( classifier.flows().size() ) + " chosen flows" );
+  }
+  if ( elapsed > 1.0 ) { // well over 10^9 probes if the table clustered them
+    throw runtime_error( "FlowClassifier took " + to_string( elapsed ) + " s for flows sharing a Toeplitz hash" );
+  }
+}
+
+void speed_test( const size_t num_flows, const size_t num_shards, const size_t random_seed )
+{
+  default_random_engine rd { random_seed };
+  uniform_int_distribution<uint32_t> ud;
+
+  vector<FlowKey> flows( num_flows );
+  for ( auto& flow : flows ) {
+    flow = { ud( rd ), ud( rd ), static_cast<uint16_t>( ud( rd ) ), static_cast<uint16_t>( ud( rd ) ), 6 };
+  }
+
+  FlowClassifier classifier { num_shards, num_flows };
+  vector<uint32_t> shards( num_flows );
+
+  // first packet of every flow
+  const auto insert_start = steady_clock::now();
+  for ( size_t i = 0; i < num_flows; ++i ) {
+    shards[i] = classifier.classify( flows[i] );
+  }
+  const auto insert_stop = steady_clock::now();
+
+  if ( classifier.flows().size() != num_flows ) {
+    throw runtime_error( "FlowClassifier holds " + to_string( classifier.flows().size() ) + " flows, but "
+                         + to_string( num_flows ) + " were expected" );
+  }
+
+  // later packets arrive in a different order (and the indirection table has since changed)
+  vector<size_t> order( num_flows );
+  for ( size_t i = 0; i < num_flows; ++i ) {
+    order[i] = i;
+  }
+  shuffle( order.begin(), order.end(), rd );
+  for ( size_t i = 0; i < 128; ++i ) {
+    classifier.set_indirection( i, 0 );
+  }
+
+  size_t mismatches = 0;
+  const auto lookup_start = steady_clock::now();
+  for ( const size_t i : order ) {
+    mismatches += classifier.classify( flows[i] ) != shards[i];
+  }
+  const auto lookup_stop = steady_clock::now();
+
+  if ( mismatches ) {
+    throw runtime_error( to_string( mismatches ) + " flows moved to a different shard" );
+  }
+
+  // the reverse direction of a connection lands on the same shard
+  for ( size_t i = 0; i < 1000; ++i ) {
+    FlowClassifier fresh { num_shards, 16 };
+    const FlowKey& f = flows[i];
+    if ( fresh.classify( f ) != fresh.classify( FlowKey { f.dst, f.src, f.dst_port, f.src_port, f.proto } )
+         or fresh.flows().size() != 2 ) {
+      throw runtime_error( "FlowClassifier put the two directions of a flow on different shards" );
+    }
+  }
+
+  // shards receive similar numbers of flows
+  vector<size_t> per_shard( num_shards );
+  for ( const uint32_t shard : shards ) {
+    per_shard.at( shard )++;
+  }
+  const auto [fewest, most] = minmax_element( per_shard.begin(), per_shard.end() );
+  if ( static_cast<double>( *most ) > 1.1 * static_cast<double>( *fewest ) ) {
+    throw runtime_error( "FlowClassifier shards are unbalanced (" + to_string( *fewest ) + " to "
+                         + to_string( *most ) + " flows)" );
+  }
+
+  // forgetting half of the flows leaves the rest reachable
+  for ( size_t i = 0; i < num_flows; i += 2 ) {
+    if ( not classifier.forget( flows[i] ) ) {
+      throw runtime_error( "FlowClassifier failed to forget a flow" );
+    }
+  }
+  for ( size_t i = 1; i < num_flows; i += 2 ) {
+    if ( classifier.classify( flows[i] ) != shards[i] ) {
+      throw runtime_error( "FlowClassifier lost a flow after erasing others" );
+    }
+  }
+  if ( classifier.flows().size() != num_flows / 2 ) {
+    throw runtime_error( "FlowClassifier has the wrong number of flows after erasing" );
+  }
+
+  const auto seconds = []( auto start, auto stop ) {
+    return duration_cast<duration<double>>( stop - start ).count();
+  };
+  const double insert_ns = seconds( insert_start, insert_stop ) * 1e9 / static_cast<double>( num_flows );
+  const double lookup_ns = seconds( lookup_start, lookup_stop ) * 1e9 / static_cast<double>( num_flows );
+  const double memory_mib = static_cast<double>( classifier.flows().memory_usage() ) / ( 1024 * 1024 );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "FlowClassifier with " << num_flows << " flows over " << num_shards << " shards: " << fixed
+       << setprecision( 1 ) << lookup_ns << " ns/lookup, " << insert_ns << " ns/new flow, table "
+       << setprecision( 2 ) << memory_mib << " MiB.\n";
+
+  debug_output << "     FlowClassifier lookups: " << fixed << setprecision( 1 ) << lookup_ns << " ns, "
+               << setprecision( 2 ) << memory_mib << " MiB for " << num_flows << " flows\n";
+}
+
+void program_body()
+{
+  check_test_vector();
+  check_chosen_collisions();
+  speed_test( 1000000, 8, 3131 );
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
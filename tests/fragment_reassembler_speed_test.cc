@@ -0,0 +1,195 @@
+#include "fragment_reassembler.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+using namespace std;
+using namespace std::chrono;
+
+// Split a datagram's payload into fragments carrying `fragment_size` bytes each
+vector<IPv4Datagram> fragment( const IPv4Header& header, const string& payload, const size_t fragment_size )
+{
+  vector<IPv4Datagram> fragments;
+  for ( size_t offset = 0; offset < payload.size(); offset += fragment_size ) {
+    IPv4Datagram frag;
+    frag.header = header;
+    frag.header.df = false;
+    frag.header.mf = offset + fragment_size < payload.size();
+    frag.header.offset = offset / 8;
+    frag.payload.push_back( payload.substr( offset, fragment_size ) );
+    frag.header.len = 4 * frag.header.hlen + frag.payload.front().size();
+    frag.header.compute_checksum();
+    fragments.push_back( move( frag ) );
+  }
+  return fragments;
+}
+
+void check( const bool condition, const string& message )
+{
+  if ( not condition ) {
+    throw runtime_error( message );
+  }
+}
+
+// A first fragment with a 60-byte header (40 bytes of options) leaves room for 65475 bytes of payload: more
+// would overflow the reassembled datagram's length field, whether the first fragment arrives first or last
+void check_header_options()
+{
+  IPv4Header header;
+  header.src = 0x0a000001;
+  header.dst = 0x0a000002;
+  header.proto = 17;
+  header.hlen = 15;
+
+  for ( const bool first_fragment_last : { false, true } ) {
+    for ( const size_t length : { size_t { 65472 }, size_t { 65496 } } ) {
+      FragmentReassembler reassembler;
+      header.id = length;
+      auto fragments = fragment( header, string( length, 'o' ), 1480 );
+      if ( first_fragment_last ) {
+        rotate( fragments.begin(), fragments.begin() + 1, fragments.end() );
+      }
+
+      vector<IPv4Datagram> completed;
+      for ( auto& frag : fragments ) {
+        if ( auto result = reassembler.push( move( frag ) ) ) {
+          completed.push_back( move( *result ) );
+        }
+      }
+
+      const string order = first_fragment_last ? " (first fragment last)" : "";
+      if ( length <= UINT16_MAX - 60 ) {
+        check( completed.size() == 1 and completed.front().header.len == 60 + length,
+               "a datagram with header options was not reassembled" + order );
+      } else {
+        check( completed.empty() and reassembler.fragments_dropped() > 0,
+               "a datagram too long for its header options was not dropped" + order );
+      }
+      check( reassembler.datagrams_pending() == 0 and reassembler.memory_usage() == 0,
+             "a dropped datagram was kept" + order );
+    }
+  }
+}
+
+void speed_test( const size_t num_datagrams,    // NOLINT(bugprone-easily-swappable-parameters)
+                 const size_t storm_per_legit,  // NOLINT(bugprone-easily-swappable-parameters)
+                 const size_t fragments_per_dg, // NOLINT(bugprone-easily-swappable-parameters)
+                 const size_t random_seed )     // NOLINT(bugprone-easily-swappable-parameters)
+{
+  static constexpr size_t fragment_size = 1480;
+  static constexpr size_t memory_limit = 4 * 1024 * 1024;
+
+  default_random_engine rd { random_seed };
+  uniform_int_distribution<uint32_t> ud;
+
+  // legitimate datagrams, each fragmented and delivered in shuffled order, interleaved with a storm of
+  // first fragments (from random sources) that never complete
+  vector<string> payloads;
+  vector<IPv4Datagram> arrivals;
+  for ( size_t i = 0; i < num_datagrams; ++i ) {
+    string payload( fragments_per_dg * fragment_size, 0 );
+    generate( payload.begin(), payload.end(), [&] { return static_cast<char>( ud( rd ) ); } );
+
+    IPv4Header header;
+    header.src = 0x0a000001;
+    header.dst = 0x0a000002;
+    header.proto = 17;
+    header.id = i;
+    auto fragments = fragment( header, payload, fragment_size );
+    shuffle( fragments.begin(), fragments.end(), rd );
+    payloads.push_back( move( payload ) );
+
+    for ( auto& frag : fragments ) {
+      arrivals.push_back( move( frag ) );
+      for ( size_t j = 0; j < storm_per_legit; ++j ) {
+        IPv4Datagram bogus;
+        bogus.header.src = ud( rd );
+        bogus.header.dst = 0x0a000002;
+        bogus.header.proto = 17;
+        bogus.header.id = ud( rd );
+        bogus.header.df = false;
+        bogus.header.mf = true;
+        bogus.header.offset = ( ud( rd ) % 32 ) * ( fragment_size / 8 );
+        bogus.payload.emplace_back( fragment_size, 'x' );
+        bogus.header.len = IPv4Header::LENGTH + fragment_size;
+        arrivals.push_back( move( bogus ) );
+      }
+    }
+  }
+
+  FragmentReassembler reassembler { 128 * 1024, memory_limit };
+  const size_t num_fragments = arrivals.size();
+  vector<IPv4Datagram> completed;
+  size_t peak_memory = 0;
+
+  const auto start_time = steady_clock::now();
+  for ( size_t i = 0; i < num_fragments; ++i ) {
+    auto result = reassembler.push( move( arrivals[i] ) );
+    if ( result.has_value() ) {
+      completed.push_back( move( result.value() ) );
+    }
+    peak_memory = max( peak_memory, reassembler.memory_usage() );
+    if ( i % 1024 == 0 ) {
+      reassembler.tick( 1 );
+    }
+  }
+  const auto stop_time = steady_clock::now();
+
+  if ( peak_memory > memory_limit ) {
+    throw runtime_error( "FragmentReassembler exceeded its memory limit" );
+  }
+
+  if ( completed.size() != num_datagrams ) {
+    throw runtime_error( "FragmentReassembler completed " + to_string( completed.size() ) + " datagrams, but "
+                         + to_string( num_datagrams ) + " were expected" );
+  }
+
+  for ( const auto& dgram : completed ) {
+    string payload;
+    for ( const auto& buf : dgram.payload ) {
+      payload += buf;
+    }
+    if ( payload != payloads.at( dgram.header.id ) or dgram.header.mf or dgram.header.offset != 0
+         or dgram.header.payload_length() != payload.size() ) {
+      throw runtime_error( "Mismatch in reassembled datagram " + to_string( dgram.header.id ) );
+    }
+  }
+
+  const auto test_duration = duration_cast<duration<double>>( stop_time - start_time );
+  const double fragments_per_second = static_cast<double>( num_fragments ) / test_duration.count();
+  const double ns_per_fragment = test_duration.count() * 1e9 / static_cast<double>( num_fragments );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "FragmentReassembler with " << storm_per_legit << " storm fragments per legitimate fragment processed "
+       << fixed << setprecision( 2 ) << fragments_per_second / 1e6 << " M fragments/s (" << setprecision( 1 )
+       << ns_per_fragment << " ns each), peak memory " << peak_memory / 1024 << " KiB, "
+       << reassembler.datagrams_evicted() << " partial datagrams evicted.\n";
+
+  debug_output << "    FragmentReassembler (storm x" << storm_per_legit << "): " << fixed << setprecision( 2 )
+               << fragments_per_second / 1e6 << " M fragments/s, peak memory " << peak_memory / 1024 << " KiB\n";
+}
+
+void program_body()
+{
+  check_header_options();
+  speed_test( 4096, 4, 8, 1066 );
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
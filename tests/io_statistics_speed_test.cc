@@ -0,0 +1,167 @@
+#include "eventloop.hh"
+#include "exception.hh"
+#include "file_descriptor.hh"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <sys/socket.h>
+
+using namespace std;
+using namespace std::chrono;
+
+static constexpr size_t ITERATIONS = 100000;
+
+pair<FileDescriptor, FileDescriptor> stream_pair()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", socketpair( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds.data() ) );
+  return { FileDescriptor { fds[0] }, FileDescriptor { fds[1] } };
+}
+
+void check( const bool condition, const string& message )
+{
+  if ( not condition ) {
+    throw runtime_error( message );
+  }
+}
+
+// Check the counters of reads and writes, what would have blocked and short transfers, and the histograms
+void check_counters()
+{
+  auto [writer, reader] = stream_pair();
+  reader.set_blocking( false );
+
+  ReadBuffer buffer { 1000 };
+  check( reader.read( buffer ).empty(), "read with nothing written returned data" );
+
+  writer.write( string( 300, 'x' ) );
+  check( reader.read( buffer ).size() == 300, "read returned the wrong length" ); // whatever is there: not short
+  writer.write( string( 2500, 'y' ) );
+  check( reader.read( buffer ).size() == 1000, "full read returned the wrong length" );
+  string rest( 2000, 0 );
+  reader.read( rest ); // asked for 2000 bytes, got 1500
+  check( rest.size() == 1500, "explicit read returned the wrong length" );
+
+  const IOStatistics stats = reader.statistics();
+  check( stats.reads.syscalls == 4 and reader.read_count() == 3, "reads were not counted" );
+  check( stats.reads.would_block == 1, "a read that would block was not counted" );
+  check( stats.reads.bytes == 2800, "bytes read were not counted" );
+  check( stats.reads.short_transfers == 1, "a short read was not counted" );
+  check( stats.writes.syscalls == 0 and not stats.histograms, "reader has writes or histograms it never made" );
+
+  const IOStatistics written = writer.duplicate().statistics();
+  check( written.writes.syscalls == 2 and written.writes.bytes == 2800 and written.writes.short_transfers == 0,
+         "writes were not counted (or duplicates do not share them)" );
+
+  reader.set_histograms( true );
+  for ( size_t length = 1; length <= 1024; length *= 2 ) {
+    writer.write( string( length, 'z' ) );
+    reader.read( buffer );
+  }
+  reader.read( buffer ); // the 24 bytes the 1000 byte buffer left of the last write
+  reader.read( buffer ); // would block: a latency, but no size
+  const IOStatistics with_histograms = reader.statistics();
+  check( with_histograms.histograms.has_value(), "histograms were not kept" );
+  const IOHistograms& histograms = *with_histograms.histograms;
+  check( histograms.latency_ns.count() == 13 and histograms.transfer_bytes.count() == 12,
+         "histograms have the wrong number of calls" );
+  // 512 and 1000 bytes are both in [512, 1024), as are 16 and 24 in [16, 32)
+  check( histograms.transfer_bytes.bucket( 1 ) == 1 and histograms.transfer_bytes.bucket( 10 ) == 2
+           and histograms.transfer_bytes.bucket( 5 ) == 2
+           and histograms.transfer_bytes.quantile_bound( 1.0 ) == 1024,
+         "sizes are in the wrong buckets" );
+  check( histograms.latency_ns.quantile_bound( 0.5 ) > 0, "latencies were not measured" );
+
+  reader.set_histograms( false );
+  check( not reader.statistics().histograms, "histograms were not dropped" );
+
+  // each of EventLoop's categories sums the descriptors of its rules
+  EventLoop loop;
+  const size_t relay = loop.add_category( "relay" );
+  const size_t idle = loop.add_category( "idle" );
+  auto [other_writer, other_reader] = stream_pair();
+  for ( FileDescriptor* fd : { &reader, &other_reader } ) {
+    loop.add_rule( relay, *fd, Direction::In, [fd, &rest] { fd->read( rest ); } );
+    loop.add_rule( relay, *fd, Direction::Out, [] {}, [] { return false; } );
+  }
+  auto [unused, unused_peer] = stream_pair();
+  loop.add_rule( idle, unused, Direction::In, [] {} );
+
+  other_writer.write( string( 100, 'a' ) );
+  rest.clear();
+  loop.wait_next_event( -1 );
+  const IOStatistics category = loop.statistics( relay );
+  check( category.reads.syscalls == reader.statistics().reads.syscalls + 1
+           and category.reads.bytes == 2800 + 2047 + 100,
+         "a category's statistics are not the sum of its descriptors" );
+  check( loop.statistics( idle ).reads.syscalls == 0, "an idle category has reads" );
+
+  ostringstream summary;
+  loop.summary( summary );
+  check( summary.str().find( "relay: reads 18 syscalls" ) != string::npos,
+         "the summary is wrong: " + summary.str() );
+}
+
+// Time writing a small message and reading it back; returns ns per round trip
+double time_round_trips( FileDescriptor& writer, FileDescriptor& reader )
+{
+  const string data( 64, 'x' );
+  ReadBuffer buffer { 65536 };
+  size_t bytes_read = 0;
+
+  const auto start = steady_clock::now();
+  for ( size_t i = 0; i < ITERATIONS; ++i ) {
+    writer.write( data );
+    bytes_read += reader.read( buffer ).size();
+  }
+  const auto stop = steady_clock::now();
+
+  check( bytes_read == ITERATIONS * data.size(), "reads lost bytes" );
+  return static_cast<double>( duration_cast<nanoseconds>( stop - start ).count() ) / ITERATIONS;
+}
+
+void speed_test()
+{
+  auto [writer, reader] = stream_pair();
+  const double counters = time_round_trips( writer, reader );
+
+  writer.set_histograms( true );
+  reader.set_histograms( true );
+  const double histograms = time_round_trips( writer, reader );
+
+  const IOStatistics stats = reader.statistics();
+  check( stats.reads.syscalls == 2 * ITERATIONS and stats.histograms->latency_ns.count() == ITERATIONS,
+         "round trips were not counted" );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << fixed << setprecision( 0 ) << "Write and read of 64 bytes: " << counters << " ns with counters, "
+       << histograms << " ns with histograms (" << setprecision( 1 ) << histograms - counters
+       << " ns for two pairs of clock reads).\nReader: " << stats << "\n";
+  debug_output << "      round trip: " << fixed << setprecision( 0 ) << counters << " vs " << histograms
+               << " ns with histograms\n";
+}
+
+void program_body()
+{
+  check_counters();
+  speed_test();
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
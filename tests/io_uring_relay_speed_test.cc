@@ -0,0 +1,226 @@
+#include "eventloop.hh"
+#include "exception.hh"
+#include "io_uring.hh"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <sys/socket.h>
+
+using namespace std;
+using namespace std::chrono;
+
+// One relayed connection: the client writes into `client`, the relay reads `in` and writes `out`, and the sink
+// reads `sink`
+struct Connection
+{
+  FileDescriptor client;
+  FileDescriptor in;
+  FileDescriptor out;
+  FileDescriptor sink;
+  string backlog {}; // bytes the io_uring relay could not queue yet
+};
+
+pair<FileDescriptor, FileDescriptor> stream_pair()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", socketpair( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds.data() ) );
+  return { FileDescriptor { fds[0] }, FileDescriptor { fds[1] } };
+}
+
+vector<Connection> make_connections( const size_t count )
+{
+  vector<Connection> connections;
+  for ( size_t i = 0; i < count; ++i ) {
+    auto [client, in] = stream_pair();
+    auto [out, sink] = stream_pair();
+    connections.push_back( { move( client ), move( in ), move( out ), move( sink ) } );
+  }
+  return connections;
+}
+
+// The bytes the client sends on a connection in a round
+string chunk( const size_t connection, const size_t round, const size_t length )
+{
+  string data( length, 0 );
+  for ( size_t i = 0; i < length; ++i ) {
+    data[i] = static_cast<char>( connection * 31 + round * 7 + i );
+  }
+  return data;
+}
+
+// Relays one round with an EventLoop: poll, then a read and a write per readable connection
+class PollRelay
+{
+  vector<Connection>& connections_;
+  EventLoop loop_ {};
+  size_t relayed_ {};
+
+public:
+  uint64_t syscalls {};
+
+  explicit PollRelay( vector<Connection>& connections ) : connections_( connections )
+  {
+    const size_t category = loop_.add_category( "relay" );
+    for ( auto& conn : connections_ ) {
+      conn.in.set_blocking( false );
+      loop_.add_rule( category, conn.in, Direction::In, [this, &conn] {
+        string data;
+        conn.in.read( data );
+        relayed_ += data.size();
+        while ( not data.empty() ) {
+          data.erase( 0, conn.out.write( data ) );
+          ++syscalls;
+        }
+        ++syscalls;
+      } );
+    }
+  }
+
+  void relay( const size_t total )
+  {
+    relayed_ = 0;
+    while ( relayed_ < total ) {
+      loop_.wait_next_event( -1 );
+      ++syscalls;
+    }
+  }
+};
+
+// Relays one round with io_uring: a multishot receive per connection, and writes from registered buffers
+class IOUringRelay
+{
+  vector<Connection>& connections_;
+  IOUring ring_ { 256, 256, 16384 };
+  size_t relayed_ {};
+
+  void forward( Connection& conn, string_view data )
+  {
+    while ( conn.backlog.empty() and not data.empty() ) {
+      const size_t queued = ring_.write( conn.out, data, [this, queued_size = data.size()]( size_t written ) {
+        if ( written != min( queued_size, ring_.buffer_size() ) ) {
+          throw runtime_error( "io_uring relay: short write" );
+        }
+      } );
+      if ( queued == 0 ) {
+        break;
+      }
+      data.remove_prefix( queued );
+    }
+    conn.backlog.append( data );
+  }
+
+public:
+  explicit IOUringRelay( vector<Connection>& connections ) : connections_( connections )
+  {
+    for ( auto& conn : connections_ ) {
+      ring_.receive( conn.in, [this, &conn]( string_view data ) {
+        relayed_ += data.size();
+        forward( conn, data );
+      } );
+    }
+    ring_.submit();
+  }
+
+  uint64_t syscalls() const { return ring_.syscalls(); }
+
+  void relay( const size_t total )
+  {
+    relayed_ = 0;
+    while ( relayed_ < total or ring_.in_flight() > connections_.size() ) {
+      ring_.wait();
+      for ( auto& conn : connections_ ) {
+        if ( not conn.backlog.empty() ) {
+          string backlog = move( conn.backlog );
+          conn.backlog.clear();
+          forward( conn, backlog );
+        }
+      }
+    }
+  }
+};
+
+// Time relaying `rounds` rounds of `length` bytes on every connection; returns seconds spent in the relay
+template<typename Relay>
+double run( Relay& relay, vector<Connection>& connections, const size_t rounds, const size_t length )
+{
+  double elapsed = 0;
+  for ( size_t round = 0; round < rounds; ++round ) {
+    for ( size_t i = 0; i < connections.size(); ++i ) {
+      const string data = chunk( i, round, length );
+      if ( connections[i].client.write( data ) != data.size() ) {
+        throw runtime_error( "short write from client" );
+      }
+    }
+
+    const auto start = steady_clock::now();
+    relay.relay( connections.size() * length );
+    elapsed += duration_cast<duration<double>>( steady_clock::now() - start ).count();
+
+    for ( size_t i = 0; i < connections.size(); ++i ) {
+      string received;
+      while ( received.size() < length ) {
+        string data;
+        connections[i].sink.read( data );
+        received += data;
+      }
+      if ( received != chunk( i, round, length ) ) {
+        throw runtime_error( "relay corrupted connection " + to_string( i ) + " in round " + to_string( round ) );
+      }
+    }
+  }
+  return elapsed;
+}
+
+void speed_test( const size_t num_connections, const size_t rounds, const size_t length )
+{
+  const double megabytes = static_cast<double>( num_connections * rounds * length ) / 1e6;
+
+  vector<Connection> poll_connections = make_connections( num_connections );
+  PollRelay poll_relay { poll_connections };
+  const double poll_seconds = run( poll_relay, poll_connections, rounds, length );
+
+  vector<Connection> uring_connections = make_connections( num_connections );
+  optional<IOUringRelay> uring_relay;
+  try {
+    uring_relay.emplace( uring_connections );
+  } catch ( const unix_error& e ) {
+    cerr << "Skipping io_uring relay benchmark (" << e.what() << ").\n";
+    return;
+  }
+  const double uring_seconds = run( *uring_relay, uring_connections, rounds, length );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "Relay of " << num_connections << " connections, " << fixed << setprecision( 0 ) << megabytes
+       << " MB: poll+read/write " << setprecision( 2 ) << megabytes / poll_seconds << " MB/s ("
+       << setprecision( 1 ) << static_cast<double>( poll_relay.syscalls ) / megabytes << " syscalls/MB), io_uring "
+       << setprecision( 2 ) << megabytes / uring_seconds << " MB/s (" << setprecision( 1 )
+       << static_cast<double>( uring_relay->syscalls() ) / megabytes << " syscalls/MB), " << setprecision( 2 )
+       << poll_seconds / uring_seconds << "x.\n";
+  debug_output << "      io_uring relay: " << fixed << setprecision( 0 ) << megabytes / poll_seconds << " vs "
+               << megabytes / uring_seconds << " MB/s\n";
+}
+
+void program_body()
+{
+  speed_test( 32, 50, 65536 );
+  speed_test( 256, 50, 4096 );
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
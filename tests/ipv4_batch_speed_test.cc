@@ -0,0 +1,134 @@
+#include "ipv4_header.hh"
+#include "ipv4_header_batch.hh"
+#include "parser.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+using namespace std;
+using namespace std::chrono;
+
+// Generate datagrams with random headers, a fraction of which are corrupted
+vector<string> make_frames( const size_t num_frames, const size_t random_seed )
+{
+  default_random_engine rd { random_seed };
+  uniform_int_distribution<uint32_t> ud;
+
+  vector<string> frames;
+  frames.reserve( num_frames );
+  for ( size_t i = 0; i < num_frames; ++i ) {
+    IPv4Header header;
+    header.src = ud( rd );
+    header.dst = ud( rd );
+    header.proto = ud( rd ) % 2 ? 6 : 17;
+    header.ttl = ud( rd );
+    header.id = ud( rd );
+    header.len = IPv4Header::LENGTH + 64;
+    header.compute_checksum();
+
+    Serializer s;
+    header.serialize( s );
+    s.buffer( string( 64, 'x' ) );
+    string frame;
+    for ( const auto& buf : s.output() ) {
+      frame += buf;
+    }
+
+    if ( ud( rd ) % 10 == 0 ) {
+      frame.at( ud( rd ) % IPv4Header::LENGTH ) ^= 0x10; // corrupt the header
+    }
+    frames.push_back( move( frame ) );
+  }
+  return frames;
+}
+
+void speed_test( const size_t num_frames, const size_t random_seed )
+{
+  const auto frames = make_frames( num_frames, random_seed );
+
+  // one at a time through the generic Parser
+  vector<vector<string>> wrapped_frames;
+  wrapped_frames.reserve( frames.size() );
+  for ( const auto& frame : frames ) {
+    wrapped_frames.push_back( { frame } );
+  }
+
+  size_t valid_count = 0;
+  vector<IPv4Header> expected( frames.size() );
+  const auto start_time = steady_clock::now();
+  for ( size_t i = 0; i < frames.size(); ++i ) {
+    valid_count += parse( expected[i], wrapped_frames[i] );
+  }
+  const auto stop_time = steady_clock::now();
+  const auto test_duration = duration_cast<duration<double>>( stop_time - start_time );
+  const double single_mpps = static_cast<double>( frames.size() ) / test_duration.count() / 1e6;
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "IPv4Header::parse reached " << fixed << setprecision( 2 ) << single_mpps << " Mpps.\n";
+  debug_output << "         IPv4Header::parse: " << fixed << setprecision( 2 ) << single_mpps << " Mpps\n";
+
+  for ( const size_t batch_size : { 1, 8, 32, 256 } ) {
+    IPv4HeaderBatch batch;
+    size_t batch_valid_count = 0;
+
+    const auto batch_start_time = steady_clock::now();
+    for ( size_t first = 0; first < frames.size(); first += batch_size ) {
+      batch.parse( span { frames }.subspan( first, min( batch_size, frames.size() - first ) ) );
+      for ( size_t i = 0; i < batch.size(); ++i ) {
+        batch_valid_count += batch.valid[i];
+      }
+    }
+    const auto batch_stop_time = steady_clock::now();
+    const auto batch_duration = duration_cast<duration<double>>( batch_stop_time - batch_start_time );
+    const double batch_mpps = static_cast<double>( frames.size() ) / batch_duration.count() / 1e6;
+
+    if ( batch_valid_count != valid_count ) {
+      throw runtime_error( "IPv4HeaderBatch accepted " + to_string( batch_valid_count ) + " headers, but "
+                           + to_string( valid_count ) + " were expected" );
+    }
+
+    cout << "IPv4HeaderBatch with batch_size=" << batch_size << " reached " << fixed << setprecision( 2 )
+         << batch_mpps << " Mpps.\n";
+    debug_output << "   IPv4HeaderBatch (batch of " << setw( 3 ) << batch_size << "): " << fixed
+                 << setprecision( 2 ) << batch_mpps << " Mpps\n";
+  }
+
+  // compare every column against IPv4Header::parse
+  IPv4HeaderBatch batch;
+  batch.parse( span { frames } );
+  for ( size_t i = 0; i < frames.size(); ++i ) {
+    IPv4Header header;
+    const bool ok = parse( header, wrapped_frames[i] );
+    if ( ok != static_cast<bool>( batch.valid[i] ) ) {
+      throw runtime_error( "IPv4HeaderBatch validity mismatch for frame " + to_string( i ) );
+    }
+    if ( ok
+         and ( header.src != batch.src[i] or header.dst != batch.dst[i] or header.proto != batch.proto[i]
+               or header.hlen != batch.hlen[i] or header.len != batch.len[i] ) ) {
+      throw runtime_error( "IPv4HeaderBatch field mismatch for frame " + to_string( i ) );
+    }
+  }
+}
+
+void program_body()
+{
+  speed_test( 1 << 18, 1234 );
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
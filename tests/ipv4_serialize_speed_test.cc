@@ -0,0 +1,106 @@
+#include "ipv4_datagram.hh"
+#include "parser.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+using namespace std;
+using namespace std::chrono;
+
+template<typename Function>
+double nanoseconds_per_packet( const size_t num_packets, Function&& f )
+{
+  const auto start_time = steady_clock::now();
+  for ( size_t i = 0; i < num_packets; ++i ) {
+    f( i );
+  }
+  const auto stop_time = steady_clock::now();
+
+  return static_cast<double>( duration_cast<nanoseconds>( stop_time - start_time ).count() )
+         / static_cast<double>( num_packets );
+}
+
+void speed_test( const size_t num_packets, const size_t payload_len, const size_t random_seed )
+{
+  default_random_engine rd { random_seed };
+  uniform_int_distribution<uint32_t> ud;
+
+  IPv4Datagram dgram;
+  dgram.payload.emplace_back( payload_len, 'x' );
+  dgram.header.len = IPv4Header::LENGTH + payload_len;
+  dgram.header.src = ud( rd );
+  dgram.header.dst = ud( rd );
+
+  // before: compute_checksum() serializes the header once, then the packet is serialized again
+  size_t two_pass_bytes = 0;
+  const double two_pass = nanoseconds_per_packet( num_packets, [&]( const size_t i ) {
+    dgram.header.id = i;
+    dgram.header.compute_checksum();
+    two_pass_bytes += serialize( dgram ).front().size();
+  } );
+
+  // after: the checksum is summed while serializing and back-patched
+  size_t one_pass_bytes = 0;
+  const double one_pass = nanoseconds_per_packet( num_packets, [&]( const size_t i ) {
+    dgram.header.id = i;
+    Serializer s;
+    dgram.header.serialize_with_checksum( s );
+    s.buffer( dgram.payload );
+    one_pass_bytes += s.output().front().size();
+  } );
+
+  // make sure both paths produce identical (and parseable) packets
+  for ( size_t i = 0; i < 256; ++i ) {
+    dgram.header.id = ud( rd );
+    dgram.header.ttl = ud( rd );
+    dgram.header.compute_checksum();
+    const auto expected = serialize( dgram );
+
+    Serializer s;
+    dgram.header.serialize_with_checksum( s );
+    s.buffer( dgram.payload );
+    if ( s.output() != expected ) {
+      throw runtime_error( "Mismatch between one-pass and two-pass serialization" );
+    }
+
+    IPv4Datagram parsed;
+    if ( not parse( parsed, expected ) ) {
+      throw runtime_error( "Serialized datagram failed to parse" );
+    }
+  }
+
+  if ( one_pass_bytes != two_pass_bytes ) {
+    throw runtime_error( "Mismatch between one-pass and two-pass header sizes" );
+  }
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "IPv4 datagram build with " << payload_len << "-byte payload: " << fixed << setprecision( 1 )
+       << two_pass << " ns/packet with compute_checksum() + serialize(), " << one_pass
+       << " ns/packet with serialize_with_checksum().\n";
+
+  debug_output << "          IPv4 datagram build cost: " << fixed << setprecision( 1 ) << two_pass
+               << " ns (two passes), " << one_pass << " ns (one pass)\n";
+}
+
+void program_body()
+{
+  speed_test( 1000000, 1400, 4321 );
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
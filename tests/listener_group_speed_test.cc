@@ -0,0 +1,159 @@
+#include "exception.hh"
+#include "listener_group.hh"
+#include "socket.hh"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+
+using namespace std;
+using namespace std::chrono;
+
+static constexpr size_t CONNECTIONS = 5000;
+static constexpr uint64_t MOST_PENDING = 256; // connections made but not yet accepted (below the backlog)
+
+void check( const bool condition, const string& message )
+{
+  if ( not condition ) {
+    throw runtime_error( message );
+  }
+}
+
+// Connect to `address` and exchange a message with the worker that accepts the connection
+string echo( const Address& address, const string& message )
+{
+  TCPSocket client;
+  client.connect( address );
+  client.write( message );
+  string reply;
+  while ( reply.size() < message.size() and not client.eof() ) {
+    string data;
+    client.read( data );
+    reply += data;
+  }
+  return reply;
+}
+
+// Check that each listener accepts connections and serves them from its own EventLoop
+void check_group()
+{
+  ListenerGroup group { Address { "127.0.0.1", 0 }, 4 };
+  check( not group.listener( 0 ).accept_nonblocking().has_value(), "accepted a connection nobody made" );
+
+  group.start( []( size_t, EventLoop& loop, TCPSocket connection ) {
+    thread_local const size_t category = loop.add_category( "echo" ); // each worker thread has its own loop
+    auto shared = make_shared<TCPSocket>( move( connection ) );
+    loop.add_rule( category, *shared, Direction::In, [shared] {
+      string data;
+      shared->read( data );
+      if ( not data.empty() ) {
+        shared->write( data );
+      }
+    } );
+  } );
+
+  for ( size_t i = 0; i < 100; ++i ) {
+    const string message = "connection " + to_string( i );
+    check( echo( group.local_address(), message ) == message, "a worker did not echo" );
+  }
+  group.stop();
+
+  uint64_t total = 0;
+  size_t used = 0;
+  for ( size_t i = 0; i < group.size(); ++i ) {
+    total += group.accepted( i );
+    used += group.accepted( i ) > 0;
+  }
+  check( total == 100, "listeners accepted " + to_string( total ) + " connections instead of 100" );
+  check( used > 1, "the kernel gave every connection to one listener" );
+}
+
+// Make CONNECTIONS connections to `address` while something else accepts them; returns connections per second
+double connect_all( const Address& address, const atomic<uint64_t>& accepted )
+{
+  const auto start = steady_clock::now();
+  for ( size_t i = 0; i < CONNECTIONS; ++i ) {
+    while ( i > accepted.load() + MOST_PENDING ) {
+      this_thread::yield();
+    }
+    TCPSocket client;
+    client.connect( address );
+  }
+  while ( accepted.load() < CONNECTIONS ) {
+    this_thread::yield();
+  }
+  return CONNECTIONS / duration_cast<duration<double>>( steady_clock::now() - start ).count();
+}
+
+// one thread accepting, then making each connection non-blocking (the fcntl() calls accept4 saves)
+double single_acceptor()
+{
+  TCPSocket listener;
+  listener.set_reuseaddr();
+  listener.bind( Address { "127.0.0.1", 0 } );
+  listener.listen( 1024 );
+
+  atomic<uint64_t> accepted = 0;
+  thread acceptor( [&listener, &accepted] {
+    for ( size_t i = 0; i < CONNECTIONS; ++i ) {
+      TCPSocket connection = listener.accept();
+      connection.set_blocking( false );
+      accepted.fetch_add( 1 );
+    }
+  } );
+  const double rate = connect_all( listener.local_address(), accepted );
+  acceptor.join();
+  return rate;
+}
+
+double group_rate( const size_t num_listeners, const bool steer )
+{
+  ListenerGroup group { Address { "127.0.0.1", 0 }, num_listeners };
+  if ( steer ) {
+    group.steer_by_cpu();
+  }
+  atomic<uint64_t> accepted = 0;
+  group.start( [&accepted]( size_t, EventLoop&, TCPSocket ) { accepted.fetch_add( 1 ); } );
+  const double rate = connect_all( group.local_address(), accepted );
+  group.stop();
+
+  if ( steer and thread::hardware_concurrency() == 1 ) {
+    check( group.accepted( 0 ) == CONNECTIONS, "steering did not give every connection to CPU 0's listener" );
+  }
+  return rate;
+}
+
+void program_body()
+{
+  check_group();
+
+  const double single = single_acceptor();
+  const double one = group_rate( 1, false );
+  const double four = group_rate( 4, false );
+  const double steered = group_rate( 4, true );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << fixed << setprecision( 0 ) << "Connections per second over loopback: accept()+fcntl " << single
+       << ", ListenerGroup of 1 " << one << ", of 4 " << four << ", of 4 steered by CPU " << steered << " ("
+       << thread::hardware_concurrency() << " CPUs).\n";
+  debug_output << "      accept: " << fixed << setprecision( 0 ) << single << " vs " << one << " / " << four
+               << " / " << steered << " conn/s\n";
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
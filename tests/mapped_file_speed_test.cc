@@ -0,0 +1,233 @@
+#include "exception.hh"
+#include "file_descriptor.hh"
+#include "mapped_file.hh"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace std;
+using namespace std::chrono;
+
+static constexpr size_t CHUNK = 1 << 20;
+
+pair<FileDescriptor, FileDescriptor> stream_pair()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", socketpair( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds.data() ) );
+  return { FileDescriptor { fds[0] }, FileDescriptor { fds[1] } };
+}
+
+// An unlinked temporary file holding `data`, rewound to the start
+FileDescriptor temporary_file( string_view data )
+{
+  string name = "/tmp/mapped_file_speed_test.XXXXXX";
+  FileDescriptor file { CheckSystemCall( "mkstemp", mkstemp( name.data() ) ) };
+  CheckSystemCall( "unlink", unlink( name.c_str() ) );
+  while ( not data.empty() ) {
+    data.remove_prefix( file.write( data ) );
+  }
+  CheckSystemCall( "lseek", lseek( file.fd_num(), 0, SEEK_SET ) );
+  return file;
+}
+
+string contents( const size_t length )
+{
+  string data( length, 0 );
+  for ( size_t i = 0; i < length; ++i ) {
+    data[i] = static_cast<char>( ( i * 131 ) >> 8 );
+  }
+  return data;
+}
+
+void check( const bool condition, const string& message )
+{
+  if ( not condition ) {
+    throw runtime_error( message );
+  }
+}
+
+uint64_t checksum( string_view data )
+{
+  uint64_t sum = 0;
+  for ( const char c : data ) {
+    sum += static_cast<uint8_t>( c );
+  }
+  return sum;
+}
+
+// Everything read from `fd` until EOF
+string read_all( FileDescriptor& fd )
+{
+  string result;
+  ReadBuffer buffer { CHUNK };
+  while ( not fd.eof() ) {
+    result.append( fd.read( buffer ) );
+  }
+  return result;
+}
+
+// Check that views cover the file exactly, across windows and at its end, and that writes send the right bytes
+void check_views( const string& data )
+{
+  MappedFile file { temporary_file( data ), { .window_size = ( 8 << 20 ) + 1 } };
+  check( file.size() == data.size(), "MappedFile has the wrong size" );
+  check( file.window_size() > ( 8 << 20 ) and file.window_size() % sysconf( _SC_PAGESIZE ) == 0,
+         "the window was not rounded up to whole pages" );
+
+  // the window size is not a multiple of the views' length, so views keep running into the end of the window
+  string whole;
+  while ( whole.size() < file.size() ) {
+    const string_view view = file.view( whole.size(), CHUNK * 3 );
+    check( view.size() == min<size_t>( CHUNK * 3, data.size() - whole.size() ), "a view was cut short" );
+    whole.append( view );
+  }
+  check( whole == data, "views of the file do not match its contents" );
+  const size_t page = sysconf( _SC_PAGESIZE );
+  check( file.remaps() <= data.size() / ( file.window_size() - page - CHUNK * 3 ) + 1,
+         "reading sequentially remapped more windows than it needed" );
+
+  const uint64_t boundary = file.window_size() * 2;
+  check( file.view( boundary - 10, 100 ) == string_view { data }.substr( boundary - 10, 100 ),
+         "a view across a window boundary has the wrong bytes" );
+  check( file.view( 123, 7 ) == string_view { data }.substr( 123, 7 ), "a view going back has the wrong bytes" );
+  check( file.view( data.size() - 5, 100 ).size() == 5 and file.view( data.size(), 1 ).empty(),
+         "views at the end of the file have the wrong length" );
+
+  auto [sender, receiver] = stream_pair();
+  string received;
+  thread reader( [&receiver, &received] { received = read_all( receiver ); } );
+  for ( uint64_t offset = 0; offset < file.size(); ) {
+    offset += file.write( sender, offset, CHUNK );
+  }
+  sender.close();
+  reader.join();
+  check( received == data, "MappedFile::write sent the wrong bytes" );
+
+  MappedFile empty { temporary_file( {} ) };
+  check( empty.size() == 0 and empty.view( 0, 10 ).empty(), "an empty file has views" );
+}
+
+// Time `run`, which returns a checksum of what it loaded, and check it; returns MB/s
+template<typename Run>
+double throughput( const string& data, Run&& run )
+{
+  FileDescriptor file = temporary_file( data );
+  const auto start = steady_clock::now();
+  const uint64_t sum = run( file );
+  const double seconds = duration_cast<duration<double>>( steady_clock::now() - start ).count();
+  check( sum == checksum( data ), "loaded the wrong bytes" );
+  return static_cast<double>( data.size() ) / 1e6 / seconds;
+}
+
+// loading (checksumming) a file: read() into a buffer vs. views of the mapping
+void load_test( const string& data )
+{
+  const double by_read = throughput( data, []( FileDescriptor& file ) {
+    ReadBuffer buffer { CHUNK };
+    uint64_t sum = 0;
+    while ( not file.eof() ) {
+      sum += checksum( file.read( buffer ) );
+    }
+    return sum;
+  } );
+
+  const auto mapped = [&data]( const MappedFile::Options& options ) {
+    return throughput( data, [&options]( FileDescriptor& file ) {
+      MappedFile mapping { move( file ), options };
+      uint64_t sum = 0;
+      for ( uint64_t offset = 0; offset < mapping.size(); ) {
+        const string_view view = mapping.view( offset, CHUNK );
+        sum += checksum( view );
+        offset += view.size();
+      }
+      return sum;
+    } );
+  };
+  const double by_map = mapped( { .window_size = 16 << 20 } );
+  const double by_map_prefault = mapped( { .window_size = 16 << 20, .prefault = true } );
+  const double by_map_huge = mapped( { .window_size = 16 << 20, .huge_pages = true } );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << fixed << setprecision( 0 ) << "Load: read() " << by_read << " MB/s, mmap " << by_map
+       << " MB/s, mmap with prefault " << by_map_prefault << " MB/s, mmap with huge pages " << by_map_huge
+       << " MB/s.\n";
+  debug_output << "      load: " << fixed << setprecision( 0 ) << by_read << " MB/s read() vs " << by_map << " / "
+               << by_map_prefault << " / " << by_map_huge << " MB/s mmap\n";
+}
+
+// serving a file to a socket: read()/write() vs. writes straight from the mapping
+void serve_test( const string& data )
+{
+  const auto serve = [&data]( auto&& send_all ) {
+    return throughput( data, [&send_all]( FileDescriptor& file ) {
+      auto [sender, receiver] = stream_pair();
+      uint64_t sum = 0;
+      thread reader( [&receiver, &sum] {
+        ReadBuffer buffer { CHUNK };
+        while ( not receiver.eof() ) {
+          sum += checksum( receiver.read( buffer ) );
+        }
+      } );
+      send_all( file, sender );
+      sender.close();
+      reader.join();
+      return sum;
+    } );
+  };
+
+  const double by_read = serve( []( FileDescriptor& file, FileDescriptor& out ) {
+    ReadBuffer buffer { CHUNK };
+    while ( true ) {
+      string_view chunk = file.read( buffer );
+      if ( file.eof() ) {
+        return;
+      }
+      while ( not chunk.empty() ) {
+        chunk.remove_prefix( out.write( chunk ) );
+      }
+    }
+  } );
+  const double by_map = serve( []( FileDescriptor& file, FileDescriptor& out ) {
+    MappedFile mapping { move( file ), { .window_size = 16 << 20 } };
+    for ( uint64_t offset = 0; offset < mapping.size(); ) {
+      offset += mapping.write( out, offset, CHUNK );
+    }
+  } );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << fixed << setprecision( 0 ) << "Serve to a socket: read()/write() " << by_read << " MB/s, mmap " << by_map
+       << " MB/s (" << setprecision( 2 ) << by_map / by_read << "x).\n";
+  debug_output << "      serve: " << fixed << setprecision( 0 ) << by_read << " vs " << by_map << " MB/s\n";
+}
+
+void program_body()
+{
+  const string data = contents( 64 << 20 );
+  check_views( data.substr( 0, ( 40 << 20 ) + 12345 ) );
+  load_test( data );
+  serve_test( data );
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,217 @@
+#include "address.hh"
+#include "exception.hh"
+#include "packet_ring.hh"
+#include "socket.hh"
+#include "tun.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <linux/if.h>
+#include <optional>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+using namespace std;
+using namespace std::chrono;
+
+static constexpr size_t BATCH_SIZE = 64;
+
+// Check ring bookkeeping (batches, FIFO release, wrap-around, truncation, EOF) on a datagram socket pair
+void check_ring()
+{
+  int fds[2];
+  CheckSystemCall( "socketpair", socketpair( AF_UNIX, SOCK_SEQPACKET, 0, fds ) );
+  FileDescriptor sender { fds[0] };
+  FileDescriptor receiver { fds[1] };
+  receiver.set_blocking( false );
+
+  static constexpr size_t long_frame = 18;
+  const auto expected_frame
+    = []( const size_t n ) { return n == long_frame ? string( 16, 'x' ) : "frame " + to_string( n ); };
+
+  PacketRing ring { 4, 16 };
+  size_t next_sent = 0;
+  size_t next_expected = 0;
+  const auto check_batch = [&]( const span<const string_view> batch ) {
+    for ( const auto frame : batch ) {
+      if ( frame != expected_frame( next_expected ) ) {
+        throw runtime_error( "PacketRing returned \"" + string { frame } + "\" instead of \""
+                             + expected_frame( next_expected ) + "\"" );
+      }
+      ++next_expected;
+    }
+    return not batch.empty();
+  };
+
+  for ( size_t round = 0; round < 10; ++round ) {
+    for ( size_t i = 0; i < 3; ++i ) {
+      sender.write( next_sent == long_frame ? string( 40, 'x' ) : expected_frame( next_sent ) );
+      ++next_sent;
+    }
+
+    // at most two frames per call, to exercise partial batches, until the ring is full or the socket empty
+    while ( check_batch( ring.receive( receiver, 2 ) ) ) {}
+
+    // hold the newest frame back across rounds, so the slots wrap around
+    if ( ring.in_use() == 0 or ring.frame( ring.in_use() - 1 ) != expected_frame( next_expected - 1 ) ) {
+      throw runtime_error( "PacketRing::frame returned the wrong frame" );
+    }
+    ring.release( ring.in_use() - 1 );
+  }
+
+  sender.close();
+  ring.release( ring.in_use() );
+  while ( check_batch( ring.receive( receiver ) ) ) {
+    ring.release( ring.in_use() );
+  }
+  if ( next_expected != next_sent or ring.in_use() != 0 or not receiver.eof() ) {
+    throw runtime_error( "PacketRing received " + to_string( next_expected ) + " of " + to_string( next_sent )
+                         + " frames" );
+  }
+}
+
+// Give the device an address (so the kernel routes the subnet to it), a long queue, and bring it up
+void configure( const string& devname, const string& address, const string& netmask, const int queue_length )
+{
+  UDPSocket sock;
+  ifreq req {};
+  strncpy( static_cast<char*>( req.ifr_name ), devname.c_str(), IFNAMSIZ - 1 );
+
+  const Address addr { address };
+  memcpy( &req.ifr_addr, addr.raw(), sizeof( req.ifr_addr ) );
+  CheckSystemCall( "ioctl SIOCSIFADDR", ioctl( sock.fd_num(), SIOCSIFADDR, &req ) );
+
+  const Address mask { netmask };
+  memcpy( &req.ifr_netmask, mask.raw(), sizeof( req.ifr_netmask ) );
+  CheckSystemCall( "ioctl SIOCSIFNETMASK", ioctl( sock.fd_num(), SIOCSIFNETMASK, &req ) );
+
+  req.ifr_qlen = queue_length;
+  CheckSystemCall( "ioctl SIOCSIFTXQLEN", ioctl( sock.fd_num(), SIOCSIFTXQLEN, &req ) );
+
+  CheckSystemCall( "ioctl SIOCGIFFLAGS", ioctl( sock.fd_num(), SIOCGIFFLAGS, &req ) );
+  req.ifr_flags = static_cast<int16_t>( req.ifr_flags | IFF_UP );
+  CheckSystemCall( "ioctl SIOCSIFFLAGS", ioctl( sock.fd_num(), SIOCSIFFLAGS, &req ) );
+}
+
+bool is_test_datagram( const string_view frame, const size_t length )
+{
+  static constexpr uint8_t PROTO_UDP = 17;
+  return frame.size() == length and static_cast<uint8_t>( frame.front() ) == 0x45
+         and static_cast<uint8_t>( frame[9] ) == PROTO_UDP;
+}
+
+// Queue up datagrams on the TUN device, then time draining them; returns ns per frame
+template<typename Drain>
+double time_drain( UDPSocket& sender, const size_t num_datagrams, const size_t payload_length, Drain&& drain )
+{
+  static const Address destination { "10.78.0.2", 9000 };
+  const string payload( payload_length, 'x' );
+  for ( size_t i = 0; i < num_datagrams; ++i ) {
+    sender.sendto( destination, payload );
+  }
+
+  const auto start = steady_clock::now();
+  const size_t received = drain();
+  const auto stop = steady_clock::now();
+
+  if ( received != num_datagrams ) {
+    throw runtime_error( "drained " + to_string( received ) + " of " + to_string( num_datagrams )
+                         + " datagrams from the TUN device" );
+  }
+  return static_cast<double>( duration_cast<nanoseconds>( stop - start ).count() )
+         / static_cast<double>( num_datagrams );
+}
+
+void speed_test( const size_t num_rounds, const size_t num_datagrams, const size_t payload_length )
+{
+  static const string devname = "ringbench0";
+  const size_t frame_length = 20 + 8 + payload_length;
+
+  optional<TunFD> tun;
+  try {
+    tun.emplace( devname );
+    configure( devname, "10.78.0.1", "255.255.255.0", static_cast<int>( 2 * num_datagrams ) );
+  } catch ( const unix_error& e ) {
+    cerr << "Skipping batched TUN receive benchmark (" << e.what() << ").\n";
+    return;
+  }
+  tun->set_blocking( false );
+
+  UDPSocket sender;
+  sender.bind( Address { "10.78.0.1", 0 } );
+
+  // one read and one freshly allocated 16 KiB string per frame
+  const auto per_packet = [&] {
+    size_t received = 0;
+    while ( true ) {
+      const uint64_t reads = tun->read_count();
+      string frame;
+      tun->read( frame );
+      if ( tun->read_count() == reads ) {
+        return received; // nothing left to read
+      }
+      received += is_test_datagram( frame, frame_length );
+    }
+  };
+
+  // batches of frames straight into preallocated slots
+  PacketRing ring { 4 * BATCH_SIZE };
+  const auto batched = [&] {
+    size_t received = 0;
+    while ( true ) {
+      const auto batch = ring.receive( *tun, BATCH_SIZE );
+      if ( batch.empty() ) {
+        return received;
+      }
+      for ( const auto frame : batch ) {
+        received += is_test_datagram( frame, frame_length );
+      }
+      ring.release( batch.size() );
+    }
+  };
+
+  // let any traffic from bringing the device up arrive and be discarded
+  per_packet();
+
+  double per_packet_ns = 0;
+  double batched_ns = 0;
+  for ( size_t round = 0; round < num_rounds; ++round ) {
+    per_packet_ns += time_drain( sender, num_datagrams, payload_length, per_packet );
+    batched_ns += time_drain( sender, num_datagrams, payload_length, batched );
+  }
+  per_packet_ns /= static_cast<double>( num_rounds );
+  batched_ns /= static_cast<double>( num_rounds );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "TUN receive of " << num_rounds * num_datagrams << " frames of " << frame_length
+       << " bytes: per-packet read " << fixed << setprecision( 0 ) << per_packet_ns
+       << " ns/frame, PacketRing (batches of " << BATCH_SIZE << ") " << batched_ns << " ns/frame ("
+       << setprecision( 2 ) << per_packet_ns / batched_ns << "x).\n";
+  debug_output << "     TUN ring receive: " << fixed << setprecision( 0 ) << per_packet_ns << " vs " << batched_ns
+               << " ns/frame\n";
+}
+
+void program_body()
+{
+  check_ring();
+  speed_test( 25, 4000, 1400 );
+  speed_test( 25, 4000, 64 );
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,303 @@
+#include "exception.hh"
+#include "flow_classifier.hh"
+#include "ipv4_datagram.hh"
+#include "pcap_reader.hh"
+#include "pcapng_writer.hh"
+#include "route_table.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <unistd.h>
+
+using namespace std;
+using namespace std::chrono;
+
+static constexpr uint8_t PROTO_UDP = 17;
+
+// Append an integer in network byte order
+template<typename T>
+void put_be( string& out, const T value )
+{
+  for ( size_t i = sizeof( T ); i > 0; --i ) {
+    out.push_back( static_cast<char>( value >> ( 8 * ( i - 1 ) ) ) );
+  }
+}
+
+// Append an integer in host byte order (as in a pcap file written on this machine)
+template<typename T>
+void put_host( string& out, const T value )
+{
+  out.append( reinterpret_cast<const char*>( &value ), sizeof( value ) ); // NOLINT(*-reinterpret-cast)
+}
+
+// A TCP or UDP datagram with a valid transport checksum
+string make_datagram( const FlowKey& flow, const size_t payload_length, default_random_engine& rd )
+{
+  string segment;
+  put_be( segment, flow.src_port );
+  put_be( segment, flow.dst_port );
+  if ( flow.proto == PROTO_UDP ) {
+    put_be( segment, static_cast<uint16_t>( 8 + payload_length ) );
+    put_be( segment, uint16_t { 0 } ); // checksum
+  } else {
+    put_be( segment, static_cast<uint32_t>( rd() ) ); // seqno
+    put_be( segment, static_cast<uint32_t>( rd() ) ); // ackno
+    put_be( segment, uint16_t { 0x5010 } );           // header length and ACK flag
+    put_be( segment, uint16_t { 65535 } );            // window
+    put_be( segment, uint32_t { 0 } );                // checksum and urgent pointer
+  }
+  segment.resize( segment.size() + payload_length, 'x' );
+
+  IPv4Header header;
+  header.src = flow.src;
+  header.dst = flow.dst;
+  header.proto = flow.proto;
+  header.id = rd();
+  header.len = IPv4Header::LENGTH + segment.size();
+  header.compute_checksum();
+
+  InternetChecksum checksum { header.pseudo_checksum() };
+  checksum.add( segment );
+  uint16_t value = checksum.value();
+  if ( flow.proto == PROTO_UDP and value == 0 ) {
+    value = 0xffff;
+  }
+  const size_t checksum_offset = flow.proto == PROTO_UDP ? 6 : 16;
+  segment[checksum_offset] = static_cast<char>( value >> 8 );
+  segment[checksum_offset + 1] = static_cast<char>( value );
+
+  string datagram;
+  for ( const auto& buf : serialize( header ) ) {
+    datagram += buf;
+  }
+  return datagram + segment;
+}
+
+struct SyntheticTraffic
+{
+  vector<string> datagrams {};
+  vector<pair<uint32_t, uint8_t>> routes {}; // prefixes covering every destination
+};
+
+// Traffic from a set of TCP and UDP flows, with a roughly Internet-like mix of packet sizes
+SyntheticTraffic generate_traffic( const size_t num_packets, const size_t num_flows, default_random_engine& rd )
+{
+  uniform_int_distribution<uint32_t> ud;
+  SyntheticTraffic traffic;
+
+  vector<FlowKey> flows( num_flows );
+  for ( auto& flow : flows ) {
+    flow = { ud( rd ),
+             ud( rd ),
+             static_cast<uint16_t>( ud( rd ) ),
+             static_cast<uint16_t>( ud( rd ) ),
+             ud( rd ) % 4 ? IPv4Header::PROTO_TCP : PROTO_UDP };
+    traffic.routes.emplace_back( flow.dst & 0xffffff00, 24 );
+  }
+
+  for ( size_t i = 0; i < num_packets; ++i ) {
+    const uint32_t r = ud( rd ) % 10;
+    const size_t payload_length = r < 4 ? 0 : r < 6 ? 512 : 1400;
+    traffic.datagrams.push_back( make_datagram( flows[ud( rd ) % num_flows], payload_length, rd ) );
+  }
+  return traffic;
+}
+
+// The same datagrams as a classic pcap file of Ethernet frames
+string make_pcap( const vector<string>& datagrams )
+{
+  string pcap;
+  put_host( pcap, uint32_t { 0xa1b2c3d4 } );
+  put_host( pcap, uint16_t { 2 } );
+  put_host( pcap, uint16_t { 4 } );
+  put_host( pcap, uint64_t { 0 } );     // time zone and accuracy
+  put_host( pcap, uint32_t { 65535 } ); // snaplen
+  put_host( pcap, uint32_t { 1 } );     // LINKTYPE_ETHERNET
+  for ( size_t i = 0; i < datagrams.size(); ++i ) {
+    const auto length = static_cast<uint32_t>( 14 + datagrams[i].size() );
+    put_host( pcap, static_cast<uint32_t>( 1700000000 + i / 1000 ) );
+    put_host( pcap, static_cast<uint32_t>( i % 1000 ) );
+    put_host( pcap, length );
+    put_host( pcap, length );
+    pcap.append( 12, '\x02' ); // destination and source MAC addresses
+    put_be( pcap, uint16_t { 0x0800 } );
+    pcap += datagrams[i];
+  }
+  return pcap;
+}
+
+// Check that PcapReader recovers the datagrams from both a pcap and a pcapng capture of them
+void check_reader( const vector<string>& datagrams )
+{
+  const PcapReader pcap { make_pcap( datagrams ) };
+
+  string name { "/tmp/pcap_replay_speed_test.XXXXXX" };
+  FileDescriptor file { CheckSystemCall( "mkstemp", mkstemp( name.data() ) ) };
+  unlink( name.c_str() );
+  {
+    FileDescriptor output { CheckSystemCall( "dup", dup( file.fd_num() ) ) };
+    PcapngWriter writer { move( output ), PcapngWriter::LINKTYPE_RAW, 65535, 1, 64 << 20 };
+    for ( const auto& dgram : datagrams ) {
+      writer.capture( dgram, PcapngWriter::Direction::Inbound );
+    }
+    if ( writer.frames_dropped() ) {
+      throw runtime_error( "PcapngWriter dropped frames while writing the test capture" );
+    }
+  }
+  CheckSystemCall( "lseek", static_cast<int>( lseek( file.fd_num(), 0, SEEK_SET ) ) );
+  const PcapReader pcapng { move( file ) };
+
+  for ( const PcapReader* reader : { &pcap, &pcapng } ) {
+    if ( reader->frames().size() != datagrams.size() ) {
+      throw runtime_error( "PcapReader found " + to_string( reader->frames().size() ) + " frames, but "
+                           + to_string( datagrams.size() ) + " were expected" );
+    }
+    for ( size_t i = 0; i < datagrams.size(); ++i ) {
+      if ( PcapReader::ipv4_datagram( reader->frames()[i] ) != datagrams[i] ) {
+        throw runtime_error( "PcapReader returned the wrong contents for frame " + to_string( i ) );
+      }
+    }
+  }
+
+  if ( pcap.frames()[1234].timestamp_ns != 1'700'000'001'000'234'000 ) {
+    throw runtime_error( "PcapReader returned the wrong timestamp" );
+  }
+}
+
+// Time one stage of the packet path over every packet; returns ns per packet
+template<typename Function>
+double time_stage( const size_t num_packets, Function&& stage )
+{
+  const auto start = steady_clock::now();
+  stage();
+  const auto stop = steady_clock::now();
+  return static_cast<double>( duration_cast<nanoseconds>( stop - start ).count() )
+         / static_cast<double>( num_packets );
+}
+
+// Push every IPv4 datagram through parsing, checksum verification, flow classification and route lookup
+void replay( const vector<string_view>& packets, const vector<pair<uint32_t, uint8_t>>& routes, bool synthetic )
+{
+  const size_t n = packets.size();
+  vector<IPv4Datagram> dgrams( n );
+  vector<uint8_t> parsed( n );
+  size_t checksums_ok = 0;
+  vector<uint32_t> shards( n );
+  vector<uint32_t> destinations( n );
+  vector<uint32_t> next_hops( n );
+
+  RouteTable table;
+  table.insert( 0, 0, 0 ); // default route
+  for ( size_t i = 0; i < routes.size(); ++i ) {
+    table.insert( routes[i].first, routes[i].second, 1 + i % 1024 );
+  }
+  FlowClassifier classifier { 8, n };
+
+  const double parse_ns = time_stage( n, [&] {
+    for ( size_t i = 0; i < n; ++i ) {
+      parsed[i] = parse( dgrams[i], { string { packets[i] } } );
+    }
+  } );
+
+  const double checksum_ns = time_stage( n, [&] {
+    for ( size_t i = 0; i < n; ++i ) {
+      const IPv4Header& header = dgrams[i].header;
+      if ( not parsed[i] or header.mf or header.offset ) {
+        continue;
+      }
+      InternetChecksum checksum { header.pseudo_checksum() };
+      for ( const auto& buf : dgrams[i].payload ) {
+        checksum.add( buf );
+      }
+      checksums_ok += checksum.value() == 0;
+    }
+  } );
+
+  const double classify_ns = time_stage( n, [&] {
+    for ( size_t i = 0; i < n; ++i ) {
+      shards[i] = classifier.classify( dgrams[i] );
+    }
+  } );
+
+  const double route_ns = time_stage( n, [&] {
+    for ( size_t i = 0; i < n; ++i ) {
+      destinations[i] = dgrams[i].header.dst;
+    }
+    table.lookup( destinations, next_hops );
+  } );
+
+  const size_t num_parsed = count( parsed.begin(), parsed.end(), 1 );
+  if ( synthetic and ( num_parsed != n or checksums_ok != n ) ) {
+    throw runtime_error( "replay parsed " + to_string( num_parsed ) + " and verified " + to_string( checksums_ok )
+                         + " of " + to_string( n ) + " synthetic datagrams" );
+  }
+  if ( synthetic and count( next_hops.begin(), next_hops.end(), 0 ) ) {
+    throw runtime_error( "replay found synthetic datagrams without a specific route" );
+  }
+
+  const double total_ns = parse_ns + checksum_ns + classify_ns + route_ns;
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "Replayed " << n << " datagrams (" << num_parsed << " parsed, " << checksums_ok
+       << " transport checksums verified, " << classifier.flows().size() << " flows): " << fixed
+       << setprecision( 2 ) << 1e3 / total_ns << " M packets/s.\n";
+  cout << setprecision( 1 ) << "    parse " << parse_ns << " ns/packet, checksum " << checksum_ns
+       << " ns/packet, flow classification " << classify_ns << " ns/packet, route lookup " << route_ns
+       << " ns/packet\n";
+
+  debug_output << "        pcap replay: " << fixed << setprecision( 2 ) << 1e3 / total_ns << " M packets/s ("
+               << setprecision( 0 ) << parse_ns << " + " << checksum_ns << " + " << classify_ns << " + "
+               << route_ns << " ns)\n";
+}
+
+void program_body( const char* capture_file )
+{
+  if ( capture_file ) {
+    const PcapReader reader { FileDescriptor {
+      CheckSystemCall( "open", open( capture_file, O_RDONLY | O_CLOEXEC ) ) } }; // NOLINT(*-vararg)
+    vector<string_view> packets;
+    for ( const auto& frame : reader.frames() ) {
+      const auto dgram = PcapReader::ipv4_datagram( frame );
+      if ( dgram.has_value() ) {
+        packets.push_back( *dgram );
+      }
+    }
+    cout << capture_file << ": " << packets.size() << " of " << reader.frames().size()
+         << " frames are IPv4 datagrams.\n";
+    replay( packets, {}, false );
+    return;
+  }
+
+  default_random_engine rd { 4040 };
+  const SyntheticTraffic traffic = generate_traffic( 300000, 20000, rd );
+  check_reader( { traffic.datagrams.begin(), traffic.datagrams.begin() + 5000 } );
+  replay( { traffic.datagrams.begin(), traffic.datagrams.end() }, traffic.routes, true );
+}
+
+// Replays a pcap or pcapng file given as the argument, or synthetic traffic if there is none
+int main( int argc, char* argv[] )
+{
+  try {
+    if ( argc > 2 or argc <= 0 ) {
+      cerr << "Usage: " << ( argc > 0 ? argv[0] : "pcap_replay_speed_test" ) << " [capture.pcap]\n";
+      return EXIT_FAILURE;
+    }
+    program_body( argc == 2 ? argv[1] : nullptr );
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,309 @@
+#include "exception.hh"
+#include "fake_tun.hh"
+#include "ipv4_datagram.hh"
+#include "pcapng_writer.hh"
+#include "socket.hh"
+#include "tun.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <linux/if.h>
+#include <optional>
+#include <random>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace std::chrono;
+
+// A capture file that is deleted once it has been checked
+class TemporaryFile
+{
+  string name_ { "/tmp/pcapng_capture_speed_test.XXXXXX" };
+  FileDescriptor fd_ { CheckSystemCall( "mkstemp", mkstemp( name_.data() ) ) };
+
+public:
+  ~TemporaryFile() { unlink( name_.c_str() ); }
+
+  FileDescriptor duplicate() const { return FileDescriptor { CheckSystemCall( "dup", dup( fd_.fd_num() ) ) }; }
+
+  string contents() const
+  {
+    FileDescriptor reader { CheckSystemCall( "open", open( name_.c_str(), O_RDONLY ) ) }; // NOLINT(*-vararg)
+    string contents, buffer;
+    while ( not reader.eof() ) {
+      buffer.clear();
+      reader.read( buffer );
+      contents += buffer;
+    }
+    return contents;
+  }
+
+  TemporaryFile() = default;
+  TemporaryFile( const TemporaryFile& other ) = delete;
+  TemporaryFile& operator=( const TemporaryFile& other ) = delete;
+};
+
+struct Block
+{
+  uint32_t type;
+  string_view body; // everything between the length fields
+};
+
+// Split a pcapng file into its blocks
+vector<Block> parse_blocks( string_view file )
+{
+  vector<Block> blocks;
+  while ( not file.empty() ) {
+    uint32_t type {}, length {}, trailing_length {};
+    if ( file.size() < 12 ) {
+      throw runtime_error( "truncated pcapng block" );
+    }
+    memcpy( &type, file.data(), 4 );
+    memcpy( &length, file.data() + 4, 4 );
+    if ( length % 4 or length < 12 or length > file.size() ) {
+      throw runtime_error( "bad pcapng block length" );
+    }
+    memcpy( &trailing_length, file.data() + length - 4, 4 );
+    if ( trailing_length != length ) {
+      throw runtime_error( "pcapng block lengths disagree" );
+    }
+    blocks.push_back( { type, file.substr( 8, length - 12 ) } );
+    file.remove_prefix( length );
+  }
+  return blocks;
+}
+
+uint32_t field( string_view body, const size_t offset )
+{
+  uint32_t value {};
+  memcpy( &value, body.data() + offset, 4 );
+  return value;
+}
+
+// Capture frames directly and check that the file holds exactly what was captured
+void correctness_test( const uint32_t snaplen, const uint32_t sample_interval, default_random_engine& rd )
+{
+  static constexpr size_t num_frames = 20000;
+
+  // each frame starts with its index
+  vector<string> frames;
+  for ( uint32_t i = 0; i < num_frames; ++i ) {
+    string frame( 10 + rd() % 1600, 0 );
+    for ( auto& ch : frame ) {
+      ch = static_cast<char>( rd() );
+    }
+    memcpy( frame.data(), &i, sizeof( i ) );
+    frames.push_back( move( frame ) );
+  }
+
+  TemporaryFile file;
+  uint64_t dropped {};
+  {
+    PcapngWriter writer { file.duplicate(), PcapngWriter::LINKTYPE_RAW, snaplen, sample_interval, 32 << 20 };
+    for ( size_t i = 0; i < num_frames; ++i ) {
+      const string_view frame = frames[i];
+      const array<string_view, 2> pieces { frame.substr( 0, 10 ), frame.substr( 10 ) };
+      writer.capture( pieces, i % 2 ? PcapngWriter::Direction::Outbound : PcapngWriter::Direction::Inbound );
+    }
+    dropped = writer.frames_dropped();
+  }
+
+  const string contents = file.contents();
+  const auto blocks = parse_blocks( contents );
+  if ( blocks.size() < 2 or blocks[0].type != 0x0a0d0d0a or field( blocks[0].body, 0 ) != 0x1a2b3c4d
+       or blocks[1].type != 1 or field( blocks[1].body, 4 ) != snaplen ) {
+    throw runtime_error( "pcapng file does not start with a section header and interface description" );
+  }
+
+  // every record must be a correctly truncated, sampled frame, in order
+  int64_t previous = -1;
+  for ( size_t i = 2; i < blocks.size(); ++i ) {
+    const string_view body = blocks[i].body;
+    const uint32_t captured_length = field( body, 12 );
+    const uint32_t original_length = field( body, 16 );
+    const uint32_t index = field( body, 20 );
+    const uint32_t flags = field( body, 20 + ( ( captured_length + 3 ) & ~3U ) + 4 );
+    if ( blocks[i].type != 6 or index >= num_frames or index <= previous or index % sample_interval
+         or original_length != frames[index].size() or captured_length != min( original_length, snaplen )
+         or body.substr( 20, captured_length ) != string_view { frames[index] }.substr( 0, captured_length )
+         or flags != ( index % 2 ? 2U : 1U ) ) {
+      throw runtime_error( "pcapng record " + to_string( i ) + " does not match the frame captured" );
+    }
+    previous = index;
+  }
+
+  const size_t sampled = ( num_frames + sample_interval - 1 ) / sample_interval;
+  if ( blocks.size() - 2 + dropped != sampled ) {
+    throw runtime_error( "pcapng file holds " + to_string( blocks.size() - 2 ) + " records and "
+                         + to_string( dropped ) + " were dropped, but " + to_string( sampled )
+                         + " were sampled" );
+  }
+}
+
+// Capture sees the frames of every read and write, including those through a plain FileDescriptor& or a
+// duplicate (as an EventLoop rule or a helper would make them)
+void check_capture_through_base()
+{
+  auto [tun, peer] = FakeTun::pair();
+  TemporaryFile file;
+  {
+    auto writer = make_shared<PcapngWriter>( file.duplicate(), PcapngWriter::LINKTYPE_RAW );
+    tun.set_capture( writer );
+  }
+
+  FileDescriptor& base = tun;
+  base.write( "outbound" );
+  FileDescriptor copy = tun.duplicate();
+  copy.write( vector<string> { "out", "bound, too" } );
+  peer.write( "inbound" );
+  ReadBuffer buffer { 2048 };
+  const string_view frame = base.read( buffer );
+  tun.set_capture( nullptr ); // the last reference to the writer: finish writing the file
+
+  vector<string> captured;
+  for ( const auto& block : parse_blocks( file.contents() ) ) {
+    if ( block.type == 6 ) {
+      const uint32_t captured_length = field( block.body, 12 );
+      const uint32_t flags = field( block.body, 20 + ( ( captured_length + 3 ) & ~3U ) + 4 );
+      captured.push_back( ( flags == 1 ? "in: " : "out: " ) + string { block.body.substr( 20, captured_length ) } );
+    }
+  }
+  if ( frame != "inbound"
+       or captured != vector<string> { "out: outbound", "out: outbound, too", "in: inbound" } ) {
+    throw runtime_error( "capture missed frames read or written through a FileDescriptor&" );
+  }
+}
+
+// Create a TUN device and bring it up, or return nothing if that isn't permitted here
+optional<TunFD> open_tun( const string& name )
+{
+  try {
+    TunFD tun { name };
+    UDPSocket sock;
+    ifreq req {};
+    strncpy( static_cast<char*>( req.ifr_name ), name.c_str(), IFNAMSIZ - 1 );
+    CheckSystemCall( "ioctl", ioctl( sock.fd_num(), SIOCGIFFLAGS, &req ) );
+    req.ifr_flags = static_cast<int16_t>( req.ifr_flags | IFF_UP );
+    CheckSystemCall( "ioctl", ioctl( sock.fd_num(), SIOCSIFFLAGS, &req ) );
+    return tun;
+  } catch ( const exception& e ) {
+    cerr << "Skipping capture overhead measurement (" << e.what() << ").\n";
+    return {};
+  }
+}
+
+// Time writing datagrams to a TUN device with each capture configuration
+void overhead_test( const size_t num_frames, default_random_engine& rd )
+{
+  auto tun = open_tun( "pcaptest0" );
+  if ( not tun.has_value() ) {
+    return;
+  }
+
+  // datagrams to a documentation address, which the kernel receives and discards
+  IPv4Datagram dgram;
+  dgram.header.src = 0xc0000201;
+  dgram.header.dst = 0xc0000202;
+  dgram.header.proto = 17;
+  dgram.payload.emplace_back( 1400, 'x' );
+  dgram.header.len = IPv4Header::LENGTH + 1400;
+  vector<string> datagrams;
+  for ( size_t i = 0; i < 1024; ++i ) {
+    dgram.header.id = rd();
+    dgram.header.compute_checksum();
+    string serialized;
+    for ( const auto& buf : serialize( dgram ) ) {
+      serialized += buf;
+    }
+    datagrams.push_back( move( serialized ) );
+  }
+
+  struct Timing
+  {
+    double wall_ns;      // per frame, including the writer thread's work if it shares the CPU
+    double io_thread_ns; // per frame, CPU time of the thread doing the writes
+  };
+
+  const auto thread_cpu_time = [] {
+    timespec ts {};
+    CheckSystemCall( "clock_gettime", clock_gettime( CLOCK_THREAD_CPUTIME_ID, &ts ) );
+    return static_cast<double>( ts.tv_sec ) * 1e9 + static_cast<double>( ts.tv_nsec );
+  };
+
+  const auto time_writes = [&] {
+    const auto start = steady_clock::now();
+    const double cpu_start = thread_cpu_time();
+    for ( size_t i = 0; i < num_frames; ++i ) {
+      tun->write( datagrams[i % datagrams.size()] );
+    }
+    const double cpu_ns = thread_cpu_time() - cpu_start;
+    const auto wall_ns = static_cast<double>( duration_cast<nanoseconds>( steady_clock::now() - start ).count() );
+    return Timing { wall_ns / static_cast<double>( num_frames ), cpu_ns / static_cast<double>( num_frames ) };
+  };
+
+  const Timing baseline = time_writes();
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "Writing " << num_frames << " datagrams to a TUN device without capture: " << fixed << setprecision( 0 )
+       << baseline.wall_ns << " ns/frame (" << baseline.io_thread_ns << " ns on the I/O thread).\n";
+
+  struct Configuration
+  {
+    const char* name;
+    uint32_t snaplen;
+    uint32_t sample_interval;
+  };
+
+  for ( const auto& config : { Configuration { "full frames", 65535, 1 },
+                               Configuration { "snaplen 128", 128, 1 },
+                               Configuration { "1 in 16 sampled", 65535, 16 } } ) {
+    TemporaryFile file;
+    auto writer = make_shared<PcapngWriter>(
+      file.duplicate(), PcapngWriter::LINKTYPE_RAW, config.snaplen, config.sample_interval );
+    tun->set_capture( writer );
+    const Timing with_capture = time_writes();
+    tun->set_capture( nullptr );
+
+    const uint64_t dropped = writer->frames_dropped();
+    writer.reset(); // finish writing the file
+    const double overhead = ( with_capture.io_thread_ns - baseline.io_thread_ns ) / baseline.io_thread_ns * 100;
+
+    cout << "    capturing " << config.name << ": " << with_capture.wall_ns << " ns/frame ("
+         << with_capture.io_thread_ns << " ns on the I/O thread, " << showpos << overhead << noshowpos << "%), "
+         << dropped << " frames dropped from the capture.\n";
+    debug_output << "   PcapngWriter (" << config.name << "): " << showpos << overhead << noshowpos
+                 << "% I/O thread overhead on TUN writes\n";
+  }
+}
+
+void program_body()
+{
+  default_random_engine rd { 3232 };
+  correctness_test( 65535, 1, rd );
+  correctness_test( 96, 1, rd );
+  correctness_test( 256, 7, rd );
+  check_capture_through_base();
+  overhead_test( 200000, rd );
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,167 @@
+#include "exception.hh"
+#include "file_descriptor.hh"
+#include "socket.hh"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sys/socket.h>
+
+using namespace std;
+using namespace std::chrono;
+
+static constexpr size_t ITERATIONS = 100000;
+
+pair<FileDescriptor, FileDescriptor> stream_pair()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "socketpair", socketpair( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds.data() ) );
+  return { FileDescriptor { fds[0] }, FileDescriptor { fds[1] } };
+}
+
+string message( const size_t length )
+{
+  string data( length, 0 );
+  for ( size_t i = 0; i < length; ++i ) {
+    data[i] = static_cast<char>( 'a' + i % 26 );
+  }
+  return data;
+}
+
+void check( const bool condition, const string& message_text )
+{
+  if ( not condition ) {
+    throw runtime_error( message_text );
+  }
+}
+
+// Check that every read overload returns exactly the bytes written, and reports EOF and would-block the same way
+void check_reads()
+{
+  auto [writer, reader] = stream_pair();
+  const string data = message( 3000 );
+
+  writer.write( data );
+  string into_empty;
+  reader.read( into_empty );
+  check( into_empty == data, "read into an empty string returned the wrong bytes" );
+
+  writer.write( data );
+  string presized( 1000, 0 );
+  reader.read( presized );
+  check( presized == data.substr( 0, 1000 ), "read into a presized string returned the wrong bytes" );
+  string rest;
+  reader.read( rest );
+  check( rest == data.substr( 1000 ), "read into an empty string returned the wrong remainder" );
+
+  writer.write( data );
+  vector<string> pieces { string( 10, 0 ), string( 20, 0 ), "leftover from before" };
+  reader.read( pieces );
+  check( pieces[0] + pieces[1] + pieces[2] == data and pieces[2].size() == data.size() - 30,
+         "read into a vector of strings returned the wrong bytes" );
+
+  writer.write( data );
+  ReadBuffer buffer { 65536 };
+  check( reader.read( buffer, 100 ) == data.substr( 0, 100 ), "limited read into a ReadBuffer was wrong" );
+  check( reader.read( buffer ) == data.substr( 100 ), "read into a ReadBuffer was wrong" );
+
+  reader.set_blocking( false );
+  const uint64_t reads = reader.read_count();
+  string would_block;
+  reader.read( would_block );
+  check( would_block.empty() and reader.read_count() == reads and reader.read( buffer ).empty()
+           and not reader.eof(),
+         "a read that would block returned data" );
+
+  writer.close();
+  string at_eof;
+  reader.read( at_eof );
+  check( at_eof.empty() and reader.eof(), "read at EOF returned data" );
+
+  UDPSocket receiver;
+  receiver.bind( Address { "127.0.0.1", 0 } );
+  UDPSocket sender;
+  sender.bind( Address { "127.0.0.1", 0 } );
+  sender.sendto( receiver.local_address(), data );
+  Address source { "0.0.0.0" };
+  string datagram( 5, 'x' );
+  receiver.recv( source, datagram );
+  check( datagram == data and source == sender.local_address(),
+         "DatagramSocket::recv returned the wrong datagram" );
+}
+
+// Time writing a message and reading it back with `read`; returns ns per read
+template<typename Read>
+double time_reads( const size_t length, Read&& read )
+{
+  auto [writer, reader] = stream_pair();
+  const string data = message( length );
+  size_t bytes_read = 0;
+
+  const auto start = steady_clock::now();
+  for ( size_t i = 0; i < ITERATIONS; ++i ) {
+    writer.write( data );
+    bytes_read += read( reader );
+  }
+  const auto stop = steady_clock::now();
+
+  check( bytes_read == ITERATIONS * length, "reads lost bytes" );
+  return static_cast<double>( duration_cast<nanoseconds>( stop - start ).count() ) / ITERATIONS;
+}
+
+void speed_test( const size_t length )
+{
+  // how reads used to go: a string zero-filled to the read size (16 KiB, or 1 MiB of ByteStream capacity)
+  const double zero_filled = time_reads( length, []( FileDescriptor& fd ) {
+    string data( 16384, 0 );
+    fd.read( data );
+    return data.size();
+  } );
+  const double zero_filled_large = time_reads( length, []( FileDescriptor& fd ) {
+    string data( 1048576, 0 );
+    fd.read( data );
+    return data.size();
+  } );
+
+  const double into_string = time_reads( length, []( FileDescriptor& fd ) {
+    string data;
+    fd.read( data );
+    return data.size();
+  } );
+  ReadBuffer buffer { 1048576 };
+  const double into_buffer
+    = time_reads( length, [&buffer]( FileDescriptor& fd ) { return fd.read( buffer ).size(); } );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << fixed << setprecision( 0 ) << "Reads of " << length << " bytes: zero-filled 16 KiB string " << zero_filled
+       << " ns, zero-filled 1 MiB string " << zero_filled_large << " ns, empty string " << into_string
+       << " ns, ReadBuffer " << into_buffer << " ns.\n";
+  debug_output << "      read " << setw( 5 ) << length << " bytes: " << fixed << setprecision( 0 ) << zero_filled
+               << " / " << zero_filled_large << " ns zero-filled, " << into_string << " / " << into_buffer
+               << " ns without\n";
+}
+
+void program_body()
+{
+  check_reads();
+  for ( const size_t length : { 64, 1500, 16384 } ) {
+    speed_test( length );
+  }
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,300 @@
+#include "dns_message.hh"
+#include "eventloop.hh"
+#include "exception.hh"
+#include "resolver.hh"
+#include "socket.hh"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <poll.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace std;
+using namespace std::chrono;
+
+static constexpr size_t NAMES = 100;
+static constexpr size_t LOOKUPS = 400; // each name looked up LOOKUPS / NAMES times
+static constexpr milliseconds NETWORK_DELAY { 2 };
+
+void check( const bool condition, const string& message )
+{
+  if ( not condition ) {
+    throw runtime_error( message );
+  }
+}
+
+UDPSocket bound_socket()
+{
+  UDPSocket socket;
+  socket.bind( Address { "127.0.0.1", 0 } );
+  return socket;
+}
+
+// A stand-in DNS server on 127.0.0.1, so lookups work offline: it answers A queries for the names it knows
+// (after a delay, as if across a network), and "no such name" for the rest
+class StandInServer
+{
+  struct Reply
+  {
+    steady_clock::time_point due;
+    Address destination;
+    string payload;
+  };
+
+  UDPSocket socket_ = bound_socket();
+  map<string, pair<uint32_t, uint32_t>> records_; // name -> (address, TTL)
+  milliseconds delay_;
+  atomic<uint64_t> queries_ {};
+  atomic<bool> stopping_ {};
+  thread thread_ {};
+
+  string reply_to( const string& query ) const
+  {
+    DNSMessage message;
+    if ( not parse( message, { query } ) ) {
+      return {};
+    }
+    message.response = true;
+    if ( const auto record = records_.find( message.name ); record != records_.end() ) {
+      Serializer address;
+      address.integer( record->second.first );
+      string data;
+      for ( const auto& buffer : address.output() ) {
+        data += buffer;
+      }
+      message.answers.push_back( { DNSMessage::TYPE_A, DNSMessage::CLASS_IN, record->second.second, data } );
+    } else {
+      message.rcode = DNSMessage::RCODE_NAME_ERROR;
+      // an SOA whose MINIMUM (its last four bytes) is 30 s, under a TTL of 60 s
+      message.authority.push_back(
+        { DNSMessage::TYPE_SOA, DNSMessage::CLASS_IN, 60, string( 16, 0 ) + "\0\0\0\x1e"s } );
+    }
+    string payload;
+    for ( const auto& buffer : serialize( message ) ) {
+      payload += buffer;
+    }
+    return payload;
+  }
+
+  void run()
+  {
+    deque<Reply> replies; // all delayed equally, so already in order of when they're due
+    ReadBuffer buffer { 65536 };
+    Address source { "0.0.0.0" };
+    while ( not stopping_ ) {
+      int wait_ms = 10;
+      if ( not replies.empty() ) {
+        wait_ms = static_cast<int>( max<int64_t>(
+          0, duration_cast<milliseconds>( replies.front().due - steady_clock::now() ).count() ) );
+      }
+      pollfd readable { socket_.fd_num(), POLLIN, 0 };
+      CheckSystemCall( "poll", ::poll( &readable, 1, wait_ms ) );
+
+      for ( auto query = socket_.recv( source, buffer ); not query.data.empty();
+            query = socket_.recv( source, buffer ) ) {
+        ++queries_;
+        replies.push_back( { steady_clock::now() + delay_, source, reply_to( string { query.data } ) } );
+      }
+      while ( not replies.empty() and replies.front().due <= steady_clock::now() ) {
+        socket_.sendto( replies.front().destination, replies.front().payload );
+        replies.pop_front();
+      }
+    }
+  }
+
+public:
+  StandInServer( map<string, pair<uint32_t, uint32_t>> records, const milliseconds delay )
+    : records_( move( records ) ), delay_( delay )
+  {
+    socket_.set_blocking( false );
+    thread_ = thread( [this] { run(); } );
+  }
+
+  ~StandInServer()
+  {
+    stopping_ = true;
+    thread_.join();
+  }
+
+  Address address() const { return socket_.local_address(); }
+  uint64_t queries() const { return queries_.load(); }
+
+  StandInServer( const StandInServer& other ) = delete;
+  StandInServer& operator=( const StandInServer& other ) = delete;
+  StandInServer( StandInServer&& other ) = delete;
+  StandInServer& operator=( StandInServer&& other ) = delete;
+};
+
+// Deliver a Resolver's answers from an EventLoop, as an application would
+class LoopResolver
+{
+  EventLoop loop_ {};
+
+public:
+  Resolver resolver;
+
+  LoopResolver( Resolver::Backend backend, const Resolver::Options& options )
+    : resolver( move( backend ), options )
+  {
+    loop_.add_rule( "resolver", resolver.notifications(), Direction::In, [this] { resolver.deliver(); } );
+  }
+
+  void wait_until( const function<bool()>& done )
+  {
+    while ( not done() ) {
+      check( loop_.wait_next_event( 2000 ) != EventLoop::Result::Timeout, "timed out waiting for an answer" );
+    }
+  }
+
+  Resolver::Result resolve( const string& hostname, const string& service )
+  {
+    optional<Resolver::Result> answer;
+    resolver.resolve( hostname, service, [&answer]( const Resolver::Result& result ) { answer = result; } );
+    wait_until( [&answer] { return answer.has_value(); } );
+    return *answer;
+  }
+};
+
+string address_of( const Resolver::Result& result )
+{
+  return result.address.has_value() ? result.address->to_string() : "(" + result.error + ")";
+}
+
+void check_resolver()
+{
+  const string hosts_file = "/tmp/resolver_speed_test_hosts." + to_string( getpid() );
+  ofstream { hosts_file } << "# a comment\n10.1.2.3 intranet.test intranet # the intranet\n::1 six.test\n";
+
+  StandInServer server { { { "a.test", { 0xc0000201, 1 } }, { "b.test", { 0xc0000202, 300 } } },
+                         milliseconds { 0 } };
+  LoopResolver loop { Resolver::dns_backend( server.address() ),
+                      { .threads = 2, .hosts_file = hosts_file } };
+  Resolver& resolver = loop.resolver;
+  const Resolver::Statistics& stats = resolver.statistics();
+  unlink( hosts_file.c_str() );
+
+  check( address_of( loop.resolve( "1.2.3.4", "80" ) ) == "1.2.3.4:80", "numeric address" );
+  check( address_of( loop.resolve( "INTRANET", "http" ) ) == "10.1.2.3:80", "hosts file alias and service name" );
+  check( stats.numeric == 1 and stats.hosts == 1 and server.queries() == 0, "answers from memory made queries" );
+
+  check( address_of( loop.resolve( "a.test", "443" ) ) == "192.0.2.1:443", "DNS answer" );
+  check( address_of( loop.resolve( "A.test.", "22" ) ) == "192.0.2.1:22", "cached answer" );
+  check( stats.lookups == 1 and stats.cached == 1 and server.queries() == 1, "the positive answer was not cached" );
+
+  const auto missing = loop.resolve( "missing.test", "80" );
+  check( not missing.address.has_value() and missing.error == "missing.test: no such host", "NXDOMAIN" );
+  check( not loop.resolve( "missing.test", "80" ).address.has_value(), "cached NXDOMAIN" );
+  check( stats.lookups == 2 and stats.cached == 2 and server.queries() == 2, "the negative answer was not cached" );
+
+  size_t answers = 0;
+  for ( size_t i = 0; i < 10; ++i ) {
+    resolver.resolve( "b.test", "80", [&answers]( const Resolver::Result& result ) {
+      check( address_of( result ) == "192.0.2.2:80", "coalesced answer" );
+      ++answers;
+    } );
+  }
+  loop.wait_until( [&answers] { return answers == 10; } );
+  check( stats.lookups == 3 and stats.coalesced == 9 and server.queries() == 3, "lookups were not coalesced" );
+
+  this_thread::sleep_for( milliseconds { 1100 } ); // a.test's TTL is 1 s
+  check( address_of( loop.resolve( "a.test", "80" ) ) == "192.0.2.1:80", "answer after expiry" );
+  check( stats.lookups == 4 and server.queries() == 4, "an expired answer was used" );
+
+  check( resolver.resolve_blocking( "b.test", "80" ).to_string() == "192.0.2.2:80", "resolve_blocking" );
+  bool threw = false;
+  try {
+    resolver.resolve_blocking( "missing.test", "80" );
+  } catch ( const runtime_error& ) {
+    threw = true;
+  }
+  check( threw, "resolve_blocking() of a missing name did not throw" );
+
+  // a server that never answers: the failure is reported, and not cached
+  const UDPSocket silent = bound_socket();
+  LoopResolver unanswered { Resolver::dns_backend( silent.local_address(), milliseconds { 20 }, 2 ),
+                            { .threads = 1, .hosts_file = "" } };
+  const auto timed_out = unanswered.resolve( "a.test", "80" );
+  check( timed_out.error == "DNS lookup of a.test timed out", "timeout: " + address_of( timed_out ) );
+  unanswered.resolve( "a.test", "80" );
+  check( unanswered.resolver.statistics().failures == 2 and unanswered.resolver.statistics().lookups == 2,
+         "a failed lookup was cached" );
+}
+
+// LOOKUPS lookups of NAMES names, each answered after NETWORK_DELAY
+void speed_test()
+{
+  map<string, pair<uint32_t, uint32_t>> records;
+  for ( size_t i = 0; i < NAMES; ++i ) {
+    records["host" + to_string( i ) + ".test"] = { 0x0a000000 + static_cast<uint32_t>( i ), 300 };
+  }
+  StandInServer server { records, NETWORK_DELAY };
+  const auto name = []( const size_t i ) { return "host" + to_string( i % NAMES ) + ".test"; };
+
+  // before: each lookup blocks the thread asking, one after another
+  const Resolver::Backend backend = Resolver::dns_backend( server.address() );
+  auto start = steady_clock::now();
+  for ( size_t i = 0; i < LOOKUPS; ++i ) {
+    check( backend( name( i ) ).addresses.size() == 1, "blocking lookup" );
+  }
+  const double blocking = duration_cast<duration<double>>( steady_clock::now() - start ).count();
+
+  // after: every lookup is asked for at once, and answered as they come back
+  LoopResolver loop { Resolver::dns_backend( server.address() ), { .threads = 4, .hosts_file = "" } };
+  size_t answered = 0;
+  nanoseconds longest_call {};
+  const auto resolve_all = [&] {
+    answered = 0;
+    const auto pass_start = steady_clock::now();
+    for ( size_t i = 0; i < LOOKUPS; ++i ) {
+      const auto call_start = steady_clock::now();
+      loop.resolver.resolve( name( i ), "80", [&answered]( const Resolver::Result& result ) {
+        check( result.address.has_value(), "asynchronous lookup" );
+        ++answered;
+      } );
+      longest_call = max( longest_call, steady_clock::now() - call_start );
+    }
+    loop.wait_until( [&answered] { return answered == LOOKUPS; } );
+    return duration_cast<duration<double>>( steady_clock::now() - pass_start ).count();
+  };
+  const double asynchronous = resolve_all();
+  const Resolver::Statistics first = loop.resolver.statistics();
+  const double cached = resolve_all();
+  check( first.lookups == NAMES and loop.resolver.statistics().lookups == NAMES,
+         "each name was not looked up exactly once" );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << fixed << setprecision( 1 ) << LOOKUPS << " lookups of " << NAMES << " names, " << NETWORK_DELAY.count()
+       << " ms from the stand-in server: blocking " << blocking * 1000 << " ms; Resolver " << asynchronous * 1000
+       << " ms (" << first.lookups << " queries, " << first.coalesced << " coalesced), then " << cached * 1000
+       << " ms from its cache; the longest resolve() call took "
+       << duration_cast<duration<double, micro>>( longest_call ).count() << " us.\n";
+  debug_output << "      resolver: " << fixed << setprecision( 1 ) << blocking * 1000 << " vs "
+               << asynchronous * 1000 << " ms\n";
+}
+
+void program_body()
+{
+  check_resolver();
+  speed_test();
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
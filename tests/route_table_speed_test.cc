@@ -0,0 +1,210 @@
+#include "route_table.hh"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <unordered_map>
+#include <unordered_set>
+
+using namespace std;
+using namespace std::chrono;
+
+struct Route
+{
+  uint32_t prefix;
+  uint8_t prefix_length;
+  uint32_t next_hop;
+};
+
+// Prefix lengths roughly shaped like a full Internet routing table (mostly /24s, a few longer than /24)
+uint8_t random_prefix_length( default_random_engine& rd )
+{
+  const uint32_t r = rd() % 1000;
+  if ( r < 5 ) {
+    return 8 + rd() % 8;
+  }
+  if ( r < 100 ) {
+    return 16 + rd() % 6;
+  }
+  if ( r < 250 ) {
+    return 22;
+  }
+  if ( r < 400 ) {
+    return 23;
+  }
+  if ( r < 990 ) {
+    return 24;
+  }
+  return 25 + rd() % 8;
+}
+
+// Straightforward reference: probe each prefix length from longest to shortest
+class ReferenceTable
+{
+  array<unordered_map<uint32_t, uint32_t>, 33> routes_ {};
+
+  static uint32_t mask( uint32_t address, uint8_t len )
+  {
+    return len == 0 ? 0 : address & ( UINT32_MAX << ( 32 - len ) );
+  }
+
+public:
+  void insert( const Route& r ) { routes_.at( r.prefix_length )[mask( r.prefix, r.prefix_length )] = r.next_hop; }
+  void erase( const Route& r ) { routes_.at( r.prefix_length ).erase( mask( r.prefix, r.prefix_length ) ); }
+  uint32_t lookup( uint32_t address ) const
+  {
+    for ( int len = 32; len >= 0; --len ) {
+      const auto it = routes_.at( len ).find( mask( address, len ) );
+      if ( it != routes_.at( len ).end() ) {
+        return it->second;
+      }
+    }
+    return RouteTable::NO_ROUTE;
+  }
+};
+
+void check( const RouteTable& table, const ReferenceTable& reference, default_random_engine& rd )
+{
+  for ( size_t i = 0; i < 100000; ++i ) {
+    const uint32_t address = rd();
+    if ( table.lookup( address ).value_or( RouteTable::NO_ROUTE ) != reference.lookup( address ) ) {
+      throw runtime_error( "RouteTable lookup does not match reference" );
+    }
+  }
+}
+
+// Routes longer than /24 that together cover a whole /24 with one next hop, then erased one by one. The next hop
+// is also the index of the other /24's group, which an erase that mistook it for a group would clobber.
+void check_covered_group()
+{
+  RouteTable table;
+  table.insert( 0x0a000000, 25, 1 );
+  table.insert( 0x0a000080, 25, 1 );
+  table.insert( 0x0a000000, 26, 7 );
+  table.insert( 0x0a000100, 25, 9 ); // group 1
+  table.erase( 0x0a000000, 26 );
+  table.erase( 0x0a000000, 25 );
+
+  if ( table.lookup( 0x0a000001 ).has_value() or table.lookup( 0x0a000081 ) != 1U
+       or table.lookup( 0x0a000101 ) != 9U ) {
+    throw runtime_error( "RouteTable erase within a group of identical entries" );
+  }
+  table.erase( 0x0a000080, 25 );
+  if ( table.lookup( 0x0a000081 ).has_value() or table.lookup( 0x0a000101 ) != 9U ) {
+    throw runtime_error( "RouteTable erase of the last route in a group" );
+  }
+}
+
+void speed_test( const size_t num_routes, const size_t num_lookups, const size_t random_seed )
+{
+  default_random_engine rd { random_seed };
+
+  // distinct routes with random next hops
+  vector<Route> routes;
+  routes.reserve( num_routes );
+  unordered_set<uint64_t> seen;
+  while ( routes.size() < num_routes ) {
+    const uint8_t len = random_prefix_length( rd );
+    const uint32_t prefix = rd() & ( UINT32_MAX << ( 32 - len ) );
+    if ( seen.insert( ( static_cast<uint64_t>( prefix ) << 8 ) | len ).second ) {
+      routes.push_back( { prefix, len, static_cast<uint32_t>( rd() % RouteTable::MAX_NEXT_HOP ) } );
+    }
+  }
+
+  RouteTable table;
+  ReferenceTable reference;
+
+  const auto insert_start = steady_clock::now();
+  for ( const auto& r : routes ) {
+    table.insert( r.prefix, r.prefix_length, r.next_hop );
+  }
+  const auto insert_stop = steady_clock::now();
+  const size_t memory_mib = table.memory_usage() / ( 1024 * 1024 );
+
+  for ( const auto& r : routes ) {
+    reference.insert( r );
+  }
+  check( table, reference, rd );
+
+  vector<uint32_t> addresses( num_lookups );
+  for ( auto& address : addresses ) {
+    address = rd();
+  }
+
+  // one at a time
+  uint64_t checksum = 0;
+  const auto single_start = steady_clock::now();
+  for ( const auto address : addresses ) {
+    checksum += table.lookup( address ).value_or( 0 );
+  }
+  const auto single_stop = steady_clock::now();
+
+  // in batches
+  static constexpr size_t batch_size = 64;
+  vector<uint32_t> next_hops( num_lookups );
+  const auto batch_start = steady_clock::now();
+  for ( size_t i = 0; i < num_lookups; i += batch_size ) {
+    table.lookup( span { addresses }.subspan( i, batch_size ), span { next_hops }.subspan( i, batch_size ) );
+  }
+  const auto batch_stop = steady_clock::now();
+
+  uint64_t batch_checksum = 0;
+  for ( const auto next_hop : next_hops ) {
+    batch_checksum += next_hop == RouteTable::NO_ROUTE ? 0 : next_hop;
+  }
+  if ( checksum != batch_checksum ) {
+    throw runtime_error( "Mismatch between single and batch lookups" );
+  }
+
+  // withdraw a tenth of the routes, and make sure lookups still agree
+  const auto erase_start = steady_clock::now();
+  for ( size_t i = 0; i < routes.size(); i += 10 ) {
+    table.erase( routes[i].prefix, routes[i].prefix_length );
+  }
+  const auto erase_stop = steady_clock::now();
+  for ( size_t i = 0; i < routes.size(); i += 10 ) {
+    reference.erase( routes[i] );
+  }
+  check( table, reference, rd );
+
+  const auto seconds = []( auto start, auto stop ) {
+    return duration_cast<duration<double>>( stop - start ).count();
+  };
+  const double single_mlps = static_cast<double>( num_lookups ) / seconds( single_start, single_stop ) / 1e6;
+  const double batch_mlps = static_cast<double>( num_lookups ) / seconds( batch_start, batch_stop ) / 1e6;
+  const double insert_ns = seconds( insert_start, insert_stop ) * 1e9 / static_cast<double>( num_routes );
+  const double erase_ns = seconds( erase_start, erase_stop ) * 1e9 / static_cast<double>( num_routes / 10 );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "RouteTable with " << num_routes << " routes: " << fixed << setprecision( 2 ) << single_mlps
+       << " M lookups/s, " << batch_mlps << " M lookups/s in batches of " << batch_size << ", "
+       << setprecision( 0 ) << insert_ns << " ns/insert, " << erase_ns << " ns/erase, " << memory_mib
+       << " MiB.\n";
+
+  debug_output << "         RouteTable lookups: " << fixed << setprecision( 2 ) << single_mlps << " M/s (single), "
+               << batch_mlps << " M/s (batched), " << memory_mib << " MiB\n";
+}
+
+void program_body()
+{
+  check_covered_group();
+  speed_test( 1000000, 1 << 24, 1918 );
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
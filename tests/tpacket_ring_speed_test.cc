@@ -0,0 +1,230 @@
+#include "eventloop.hh"
+#include "exception.hh"
+#include "ipv4_header.hh"
+#include "parser.hh"
+#include "socket.hh"
+#include "tpacket_ring.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <linux/if_ether.h>
+
+using namespace std;
+using namespace std::chrono;
+
+static constexpr size_t ETHERNET_HEADER = 14; // loopback frames carry an all-zero Ethernet header
+static constexpr size_t PAYLOAD_OFFSET = 8 + IPv4Header::LENGTH + ETHERNET_HEADER;
+static constexpr size_t BURST = 256;
+static constexpr size_t ROUNDS = 200;
+
+void check( const bool condition, const string& message )
+{
+  if ( not condition ) {
+    throw runtime_error( message );
+  }
+}
+
+PacketSocket capture_socket()
+{
+  PacketSocket socket { SOCK_RAW, htons( ETH_P_ALL ) };
+  socket.bind_to_interface( "lo" );
+  socket.set_blocking( false );
+  return socket;
+}
+
+UDPSocket bound_socket()
+{
+  UDPSocket socket;
+  socket.bind( Address { "127.0.0.1", 0 } );
+  return socket;
+}
+
+// The destination port of an IPv4 UDP frame (0 for anything else)
+uint16_t udp_destination( const string_view frame )
+{
+  if ( frame.size() < PAYLOAD_OFFSET or frame.substr( 12, 2 ) != "\x08\x00"sv or frame[23] != 17 ) {
+    return 0;
+  }
+  return static_cast<uint16_t>( static_cast<uint8_t>( frame[36] ) << 8 | static_cast<uint8_t>( frame[37] ) );
+}
+
+// An Ethernet frame holding a UDP datagram from 127.0.0.1:`source_port` to 127.0.0.1:`destination_port`
+string udp_frame( const uint16_t source_port, const uint16_t destination_port, const string& payload )
+{
+  IPv4Header ip;
+  ip.proto = 17;
+  ip.len = IPv4Header::LENGTH + 8 + payload.size();
+  ip.src = ip.dst = 0x7f000001;
+
+  Serializer s;
+  s.buffer( string( 12, 0 ) + "\x08\x00"s );
+  ip.serialize_with_checksum( s );
+  s.integer( source_port );
+  s.integer( destination_port );
+  s.integer( static_cast<uint16_t>( 8 + payload.size() ) );
+  s.integer( uint16_t {} ); // no UDP checksum
+  s.buffer( payload );
+
+  string frame;
+  for ( const auto& buffer : s.output() ) {
+    frame += buffer;
+  }
+  return frame;
+}
+
+// Capture datagrams sent over loopback from the ring, then send a frame through the transmit ring and capture it
+// coming back in (the kernel would drop it before UDP: a 127.0.0.1 source arriving without a route is martian)
+void check_ring()
+{
+  PacketSocket capture = capture_socket();
+  TPacketRing ring { capture, { .block_size = 65536, .rx_blocks = 8, .tx_blocks = 1, .block_timeout_ms = 1 } };
+
+  UDPSocket receiver = bound_socket();
+  UDPSocket sender = bound_socket();
+  const string injected = udp_frame( sender.local_address().port(), receiver.local_address().port(), "injected" );
+
+  // on loopback, each datagram is captured twice: going out, and coming back in
+  vector<size_t> seen( 100 );
+  size_t captured = 0;
+  size_t injected_captured = 0;
+  EventLoop loop;
+  loop.add_rule( "capture", capture, Direction::In, [&] {
+    for ( auto frames = ring.next_block(); not frames.empty(); frames = ring.next_block() ) {
+      for ( const auto& frame : frames ) {
+        if ( udp_destination( frame.data ) != receiver.local_address().port() ) {
+          continue;
+        }
+        check( frame.length == frame.data.size(), "a short frame was truncated" );
+        if ( frame.data == injected ) {
+          ++injected_captured;
+          continue;
+        }
+        const string_view payload = frame.data.substr( PAYLOAD_OFFSET );
+        check( payload.starts_with( "datagram " ), "captured the wrong bytes" );
+        ++seen.at( stoul( string { payload.substr( 9 ) } ) );
+        ++captured;
+      }
+    }
+  } );
+  const auto capture_until = [&]( const auto& done ) {
+    while ( not done() ) {
+      check( loop.wait_next_event( 1000 ) != EventLoop::Result::Timeout, "timed out capturing" );
+    }
+  };
+
+  for ( size_t i = 0; i < seen.size(); ++i ) {
+    sender.sendto( receiver.local_address(), "datagram " + to_string( i ) );
+  }
+  capture_until( [&] { return captured == 2 * seen.size(); } );
+  for ( const size_t count : seen ) {
+    check( count == 2, "a datagram was not captured going out and coming in" );
+  }
+  check( ring.frames_received() >= captured, "frames were not counted" );
+
+  // the sending socket doesn't capture its own frame going out, only coming back in
+  check( ring.push( injected ), "the transmit ring had no free slot" );
+  ring.flush();
+  capture_until( [&] { return injected_captured == 1; } );
+}
+
+struct Result
+{
+  size_t frames;
+  uint64_t drops;
+  double seconds; // spent capturing
+};
+
+// Send ROUNDS bursts of small datagrams over loopback (the receiver never reads them: once its queue fills, they
+// are dropped after capture), capturing after each burst with `drain`
+template<typename Drain>
+Result capture_bursts( PacketSocket& capture, Drain&& drain )
+{
+  UDPSocket receiver = bound_socket();
+  UDPSocket sender = bound_socket();
+  const string payload( 64, 'x' );
+  capture.statistics();
+
+  Result result {};
+  for ( size_t round = 0; round < ROUNDS; ++round ) {
+    for ( size_t i = 0; i < BURST; ++i ) {
+      sender.sendto( receiver.local_address(), payload );
+    }
+
+    const auto start = steady_clock::now();
+    result.frames += drain();
+    result.seconds += duration_cast<duration<double>>( steady_clock::now() - start ).count();
+  }
+  result.drops = capture.statistics().tp_drops;
+  return result;
+}
+
+void speed_test()
+{
+  Result recvfrom {};
+  {
+    PacketSocket plain = capture_socket(); // closed before the next capture, so it stops copying frames
+    ReadBuffer buffer { 65536 };
+    recvfrom = capture_bursts( plain, [&] {
+      size_t frames = 0;
+      while ( not plain.read( buffer ).empty() ) {
+        ++frames;
+      }
+      return frames;
+    } );
+  }
+
+  PacketSocket mapped = capture_socket();
+  TPacketRing ring { mapped };
+  const Result tpacket = capture_bursts( mapped, [&] {
+    size_t frames = 0;
+    for ( auto block = ring.next_block(); not block.empty(); block = ring.next_block() ) {
+      frames += block.size();
+    }
+    return frames;
+  } );
+
+  // blocks still being filled are only handed over once the block timeout passes
+  EventLoop loop;
+  size_t last_frames = 0;
+  loop.add_rule( "capture", mapped, Direction::In, [&] { last_frames += ring.next_block().size(); } );
+  loop.wait_next_event( 100 );
+  ring.release_block();
+
+  const auto per_frame = []( const Result& r ) { return r.seconds * 1e9 / static_cast<double>( r.frames ); };
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << fixed << setprecision( 0 ) << "Capturing " << 2 * BURST * ROUNDS << " loopback frames in bursts of "
+       << 2 * BURST << ": recvfrom() " << per_frame( recvfrom ) << " ns/frame (" << recvfrom.frames
+       << " captured, " << recvfrom.drops << " dropped); TPACKET_V3 ring " << per_frame( tpacket ) << " ns/frame ("
+       << tpacket.frames + last_frames << " captured, " << tpacket.drops << " dropped).\n";
+  debug_output << "      tpacket: " << fixed << setprecision( 0 ) << per_frame( recvfrom ) << " vs "
+               << per_frame( tpacket ) << " ns/frame\n";
+}
+
+void program_body()
+{
+  try {
+    capture_socket();
+  } catch ( const unix_error& e ) {
+    cerr << "Skipping TPACKET_V3 test (" << e.what() << ").\n";
+    return;
+  }
+  check_ring();
+  speed_test();
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,190 @@
+#include "address.hh"
+#include "exception.hh"
+#include "ipv4_header.hh"
+#include "socket.hh"
+#include "tun_queue_group.hh"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <linux/if.h>
+#include <optional>
+#include <sys/ioctl.h>
+#include <thread>
+
+using namespace std;
+using namespace std::chrono;
+
+static constexpr size_t MAX_QUEUES = 16;
+
+// Give the device an address (so the kernel routes the subnet to it) and bring it up
+void configure( const string& devname, const string& address, const string& netmask )
+{
+  UDPSocket sock;
+  ifreq req {};
+  strncpy( static_cast<char*>( req.ifr_name ), devname.c_str(), IFNAMSIZ - 1 );
+
+  const Address addr { address };
+  memcpy( &req.ifr_addr, addr.raw(), sizeof( req.ifr_addr ) );
+  CheckSystemCall( "ioctl SIOCSIFADDR", ioctl( sock.fd_num(), SIOCSIFADDR, &req ) );
+
+  const Address mask { netmask };
+  memcpy( &req.ifr_netmask, mask.raw(), sizeof( req.ifr_netmask ) );
+  CheckSystemCall( "ioctl SIOCSIFNETMASK", ioctl( sock.fd_num(), SIOCSIFNETMASK, &req ) );
+
+  CheckSystemCall( "ioctl SIOCGIFFLAGS", ioctl( sock.fd_num(), SIOCGIFFLAGS, &req ) );
+  req.ifr_flags = static_cast<int16_t>( req.ifr_flags | IFF_UP );
+  CheckSystemCall( "ioctl SIOCSIFFLAGS", ioctl( sock.fd_num(), SIOCSIFFLAGS, &req ) );
+}
+
+struct alignas( 64 ) QueueCounter
+{
+  atomic<uint64_t> frames {};
+};
+
+class Benchmark
+{
+  array<QueueCounter, MAX_QUEUES> received_ {}; // outlives group_, whose threads update it
+  TunQueueGroup group_;
+  vector<UDPSocket> senders_ {};
+  vector<Address> destinations_ {};
+
+  uint64_t total_received() const
+  {
+    uint64_t total = 0;
+    for ( size_t i = 0; i < group_.size(); ++i ) {
+      total += received_.at( i ).frames.load();
+    }
+    return total;
+  }
+
+public:
+  Benchmark( const string& devname, const size_t num_queues, const size_t num_flows )
+    : group_( devname, num_queues )
+  {
+    configure( devname, "10.77.0.1", "255.255.255.0" );
+
+    // every sender socket gets its own source port, so the flows spread over the queues
+    for ( size_t i = 0; i < num_flows; ++i ) {
+      senders_.emplace_back();
+      senders_.back().bind( Address { "10.77.0.1", 0 } );
+      destinations_.emplace_back( "10.77.0." + to_string( 2 + i % 200 ), 9000 );
+    }
+
+    // each queue's thread drains its queue and validates every datagram
+    group_.start( [this]( const size_t index, TunFD& queue ) {
+      string frame;
+      while ( true ) {
+        const uint64_t reads = queue.read_count();
+        frame.clear();
+        queue.read( frame );
+        if ( queue.read_count() == reads ) {
+          return; // nothing left to read
+        }
+        IPv4Header header;
+        if ( parse( header, { move( frame ) } ) ) {
+          received_.at( index ).frames.fetch_add( 1, memory_order_relaxed );
+        }
+      }
+    } );
+  }
+
+  uint64_t received( const size_t queue ) const { return received_.at( queue ).frames.load(); }
+  TunQueueGroup& group() { return group_; }
+
+  // Send datagrams round-robin over the flows; returns the rate at which the queues received them
+  double run( const size_t num_datagrams )
+  {
+    const string payload( 64, 'x' );
+    const uint64_t before = total_received();
+    const auto start = steady_clock::now();
+    for ( size_t i = 0; i < num_datagrams; ++i ) {
+      const size_t flow = i % senders_.size();
+      senders_[flow].sendto( destinations_[flow], payload );
+    }
+
+    // wait for the queues to go quiet
+    uint64_t received = total_received();
+    auto last_arrival = steady_clock::now();
+    while ( steady_clock::now() - last_arrival < milliseconds( 50 ) ) {
+      this_thread::sleep_for( milliseconds( 5 ) );
+      const uint64_t now_received = total_received();
+      if ( now_received != received ) {
+        received = now_received;
+        last_arrival = steady_clock::now();
+      }
+    }
+
+    const auto seconds = duration_cast<duration<double>>( last_arrival - start ).count();
+    return static_cast<double>( received - before ) / seconds;
+  }
+};
+
+void speed_test( const size_t num_queues, const size_t num_flows, const size_t num_datagrams )
+{
+  static const string devname = "mqbench0";
+
+  optional<double> single_rate;
+  try {
+    Benchmark single { devname, 1, num_flows };
+    single_rate = single.run( num_datagrams );
+  } catch ( const unix_error& e ) {
+    cerr << "Skipping multi-queue TUN benchmark (" << e.what() << ").\n";
+    return;
+  }
+
+  Benchmark multi { devname, num_queues, num_flows };
+  const double multi_rate = multi.run( num_datagrams );
+
+  // flows are spread over every queue
+  for ( size_t i = 0; i < num_queues; ++i ) {
+    if ( multi.received( i ) == 0 ) {
+      throw runtime_error( "TUN queue " + to_string( i ) + " received no traffic" );
+    }
+  }
+
+  // a detached queue receives nothing, and the remaining queues take over its flows
+  const uint64_t detached_before = multi.received( num_queues - 1 );
+  multi.group().detach( num_queues - 1 );
+  const double detached_rate = multi.run( num_datagrams / 4 );
+  if ( multi.received( num_queues - 1 ) != detached_before or detached_rate == 0 ) {
+    throw runtime_error( "detached TUN queue still received traffic" );
+  }
+  multi.group().attach( num_queues - 1 );
+  multi.run( num_datagrams / 4 );
+  if ( multi.received( num_queues - 1 ) == detached_before ) {
+    throw runtime_error( "reattached TUN queue received no traffic" );
+  }
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "TUN receive with " << num_flows << " flows on " << thread::hardware_concurrency()
+       << " CPUs: 1 queue " << fixed << setprecision( 2 ) << *single_rate / 1e6 << " M datagrams/s, "
+       << num_queues << " queues " << multi_rate / 1e6 << " M datagrams/s (" << setprecision( 2 )
+       << multi_rate / *single_rate << "x).\n";
+  debug_output << "    TUN queues (1 vs " << num_queues << "): " << fixed << setprecision( 2 )
+               << *single_rate / 1e6 << " vs " << multi_rate / 1e6 << " M datagrams/s\n";
+}
+
+void program_body()
+{
+  speed_test( 4, 64, 100000 );
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
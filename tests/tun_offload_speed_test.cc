@@ -0,0 +1,259 @@
+#include "address.hh"
+#include "checksum.hh"
+#include "exception.hh"
+#include "socket.hh"
+#include "tun.hh"
+#include "virtio_net_header.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <linux/if.h>
+#include <linux/if_tun.h>
+#include <optional>
+#include <random>
+#include <sys/ioctl.h>
+
+using namespace std;
+using namespace std::chrono;
+
+static constexpr uint8_t PROTO_UDP = 17;
+static constexpr uint16_t MSS = 1448;
+
+// A TCP or UDP datagram carrying `payload`, with a complete transport checksum
+IPv4Datagram make_datagram( const uint8_t proto, const string& payload )
+{
+  string segment;
+  if ( proto == IPv4Header::PROTO_TCP ) {
+    // ports 4000 -> 5000, seqno 0xfffff000 (so segmenting wraps it), ack, header length 20, ACK|PSH|FIN
+    segment = string( "\x0f\xa0\x13\x88\xff\xff\xf0\x00\x00\x00\x00\x01\x50\x19\xff\xff\x00\x00\x00\x00", 20 );
+  } else {
+    segment = string( "\x0f\xa0\x13\x88\x00\x00\x00\x00", 8 );
+    segment[4] = static_cast<char>( ( 8 + payload.size() ) >> 8 );
+    segment[5] = static_cast<char>( 8 + payload.size() );
+  }
+  segment += payload;
+
+  IPv4Datagram dgram;
+  dgram.header.src = 0x0a4e0002;
+  dgram.header.dst = 0x0a4e0063;
+  dgram.header.proto = proto;
+  dgram.header.id = 777;
+  dgram.header.len = IPv4Header::LENGTH + segment.size();
+  dgram.header.compute_checksum();
+
+  const size_t checksum_offset = proto == PROTO_UDP ? 6 : 16;
+  InternetChecksum checksum { dgram.header.pseudo_checksum() };
+  checksum.add( segment );
+  segment[checksum_offset] = static_cast<char>( checksum.value() >> 8 );
+  segment[checksum_offset + 1] = static_cast<char>( checksum.value() );
+  dgram.payload.push_back( move( segment ) );
+  return dgram;
+}
+
+bool transport_checksum_ok( const IPv4Datagram& dgram )
+{
+  InternetChecksum checksum { dgram.header.pseudo_checksum() };
+  for ( const auto& buf : dgram.payload ) {
+    checksum.add( buf );
+  }
+  return checksum.value() == 0;
+}
+
+string serialize_frame( const VirtioNetHeader& vnet, const IPv4Datagram& dgram )
+{
+  Serializer s;
+  vnet.serialize( s );
+  dgram.serialize( s );
+  string frame;
+  for ( const auto& buf : s.output() ) {
+    frame += buf;
+  }
+  return frame;
+}
+
+// Check header round-trips, checksum completion and software segmentation against the expected results
+void correctness_test( const string& payload )
+{
+  // TCP super-segment, as it would be written with offloads
+  IPv4Datagram tcp = make_datagram( IPv4Header::PROTO_TCP, payload );
+  const IPv4Datagram original_tcp = tcp;
+  const VirtioNetHeader vnet = VirtioNetHeader::offload_tcp( tcp, MSS );
+  const bool gso_expected = payload.size() > MSS;
+  if ( vnet.is_gso() != gso_expected or vnet.hdr_len != 40 or vnet.csum_start != 20 or vnet.csum_offset != 16 ) {
+    throw runtime_error( "offload_tcp produced the wrong virtio-net header" );
+  }
+
+  const string frame = serialize_frame( vnet, tcp );
+  if ( frame.substr( 0, 4 ) != string( gso_expected ? "\x01\x01\x28\x00" : "\x01\x00\x28\x00", 4 ) ) {
+    throw runtime_error( "virtio-net header is not little-endian" );
+  }
+  VirtioNetHeader parsed_vnet;
+  IPv4Datagram parsed_dgram;
+  Parser parser { { frame } };
+  parsed_vnet.parse( parser );
+  parsed_dgram.parse( parser );
+  if ( parser.has_error() or parsed_vnet.gso_size != vnet.gso_size or parsed_vnet.gso_type != vnet.gso_type
+       or parsed_vnet.hdr_len != vnet.hdr_len ) {
+    throw runtime_error( "virtio-net header did not survive serializing and parsing" );
+  }
+
+  // completing the checksum of the whole super-segment gives the normal checksum
+  VirtioNetHeader checksum_only = vnet;
+  checksum_only.gso_type = VirtioNetHeader::GSO_NONE;
+  const auto completed = segment_datagram( checksum_only, tcp );
+  if ( completed.size() != 1 or completed.front().payload.front() != original_tcp.payload.front() ) {
+    throw runtime_error( "completing the offloaded checksum gave the wrong result" );
+  }
+
+  for ( const uint8_t proto : { IPv4Header::PROTO_TCP, PROTO_UDP } ) {
+    VirtioNetHeader gso;
+    gso.gso_type = proto == PROTO_UDP ? VirtioNetHeader::GSO_UDP_L4 : VirtioNetHeader::GSO_TCPV4;
+    gso.gso_size = MSS;
+    const size_t header_length = proto == PROTO_UDP ? 8 : 20;
+
+    const auto segments = segment_datagram( gso, proto == PROTO_UDP ? make_datagram( proto, payload ) : tcp );
+    if ( segments.size() != ( payload.size() + MSS - 1 ) / MSS ) {
+      throw runtime_error( "segment_datagram produced " + to_string( segments.size() ) + " segments" );
+    }
+
+    string reassembled;
+    for ( size_t i = 0; i < segments.size(); ++i ) {
+      const IPv4Datagram& seg = segments[i];
+      const string& bytes = seg.payload.front();
+      IPv4Datagram reparsed;
+      if ( not parse( reparsed, serialize( seg ) ) or not transport_checksum_ok( seg )
+           or bytes.size() - header_length > MSS or seg.header.id != 777 + i ) {
+        throw runtime_error( "segment " + to_string( i ) + " is malformed" );
+      }
+      if ( proto == IPv4Header::PROTO_TCP ) {
+        uint32_t seqno {};
+        memcpy( &seqno, bytes.data() + 4, 4 );
+        const auto flags = static_cast<uint8_t>( bytes[13] );
+        const bool last = i + 1 == segments.size();
+        if ( be32toh( seqno ) != static_cast<uint32_t>( 0xfffff000 + reassembled.size() )
+             or flags != ( last ? 0x19 : 0x10 ) ) {
+          throw runtime_error( "TCP segment " + to_string( i ) + " has the wrong seqno or flags" );
+        }
+      }
+      reassembled += bytes.substr( header_length );
+    }
+    if ( reassembled != payload ) {
+      throw runtime_error( "segments do not add up to the original payload" );
+    }
+  }
+}
+
+// Give the device an address and bring it up
+void configure( const string& devname, const string& address )
+{
+  UDPSocket sock;
+  ifreq req {};
+  strncpy( static_cast<char*>( req.ifr_name ), devname.c_str(), IFNAMSIZ - 1 );
+
+  const Address addr { address };
+  memcpy( &req.ifr_addr, addr.raw(), sizeof( req.ifr_addr ) );
+  CheckSystemCall( "ioctl SIOCSIFADDR", ioctl( sock.fd_num(), SIOCSIFADDR, &req ) );
+
+  CheckSystemCall( "ioctl SIOCGIFFLAGS", ioctl( sock.fd_num(), SIOCGIFFLAGS, &req ) );
+  req.ifr_flags = static_cast<int16_t>( req.ifr_flags | IFF_UP );
+  CheckSystemCall( "ioctl SIOCSIFFLAGS", ioctl( sock.fd_num(), SIOCSIFFLAGS, &req ) );
+}
+
+optional<TunFD> open_tun( const string& devname )
+{
+  try {
+    TunFD tun { devname, IFF_VNET_HDR };
+    tun.set_offload( TUN_F_CSUM | TUN_F_TSO4 );
+    configure( devname, "10.78.0.1" );
+    return tun;
+  } catch ( const unix_error& e ) {
+    cerr << "Skipping TUN write measurement (" << e.what() << ").\n";
+    return {};
+  }
+}
+
+void speed_test( const string& payload, const size_t iterations )
+{
+  const IPv4Datagram dgram = make_datagram( IPv4Header::PROTO_TCP, payload );
+
+  // the software fallback alone
+  VirtioNetHeader gso;
+  gso.gso_type = VirtioNetHeader::GSO_TCPV4;
+  gso.gso_size = MSS;
+  size_t segments_made = 0;
+  const auto segment_start = steady_clock::now();
+  for ( size_t i = 0; i < iterations; ++i ) {
+    segments_made += segment_datagram( gso, dgram ).size();
+  }
+  const double segment_us = duration_cast<duration<double>>( steady_clock::now() - segment_start ).count() * 1e6
+                            / static_cast<double>( iterations );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << "Software segmentation of " << payload.size() << " bytes into " << segments_made / iterations
+       << " segments: " << fixed << setprecision( 1 ) << segment_us << " us.\n";
+
+  auto tun = open_tun( "gsobench0" );
+  if ( not tun.has_value() ) {
+    return;
+  }
+
+  // without offload: one write (and one IP and TCP header, with a full checksum) per MSS
+  const auto no_offload_start = steady_clock::now();
+  size_t writes = 0;
+  for ( size_t i = 0; i < iterations; ++i ) {
+    for ( const auto& seg : segment_datagram( gso, dgram ) ) {
+      tun->write( serialize_frame( VirtioNetHeader {}, seg ) );
+      ++writes;
+    }
+  }
+  const double no_offload_s = duration_cast<duration<double>>( steady_clock::now() - no_offload_start ).count();
+
+  // with offload: one write per super-segment, checksum and segmentation left to the kernel
+  IPv4Datagram super_segment = dgram;
+  const VirtioNetHeader vnet = VirtioNetHeader::offload_tcp( super_segment, MSS );
+  const string frame = serialize_frame( vnet, super_segment );
+  const auto offload_start = steady_clock::now();
+  for ( size_t i = 0; i < iterations; ++i ) {
+    tun->write( frame );
+  }
+  const double offload_s = duration_cast<duration<double>>( steady_clock::now() - offload_start ).count();
+
+  const double bytes = static_cast<double>( payload.size() * iterations );
+  cout << "Writing TCP data to TUN: " << setprecision( 2 ) << bytes / no_offload_s / 1e9 * 8 << " Gbit/s in "
+       << writes / iterations << " writes per " << payload.size() << " bytes without offload, "
+       << bytes / offload_s / 1e9 * 8 << " Gbit/s in 1 write with GSO (" << setprecision( 1 )
+       << no_offload_s / offload_s << "x).\n";
+  debug_output << "   TUN GSO offload: " << fixed << setprecision( 2 ) << bytes / offload_s / 1e9 * 8
+               << " Gbit/s vs " << bytes / no_offload_s / 1e9 * 8 << " Gbit/s segmented in software\n";
+}
+
+void program_body()
+{
+  default_random_engine rd { 3535 };
+  string payload( 65000, 0 );
+  for ( auto& ch : payload ) {
+    ch = static_cast<char>( rd() );
+  }
+
+  correctness_test( payload );
+  correctness_test( payload.substr( 0, 1000 ) );
+  speed_test( payload, 2000 );
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
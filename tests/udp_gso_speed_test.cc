@@ -0,0 +1,160 @@
+#include "exception.hh"
+#include "socket.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+using namespace std;
+using namespace std::chrono;
+
+static constexpr size_t SEGMENT_SIZE = 1400;
+static constexpr size_t SEGMENTS_PER_SEND = 46; // the most that fit in a 64 KiB datagram
+static constexpr size_t ROUNDS = 4000;
+
+void check( const bool condition, const string& message )
+{
+  if ( not condition ) {
+    throw runtime_error( message );
+  }
+}
+
+UDPSocket bound_socket()
+{
+  UDPSocket socket;
+  socket.bind( Address { "127.0.0.1", 0 } );
+  return socket;
+}
+
+string contents( const size_t length )
+{
+  string data( length, 0 );
+  for ( size_t i = 0; i < length; ++i ) {
+    data[i] = static_cast<char>( ( i * 131 ) >> 8 );
+  }
+  return data;
+}
+
+// Send one segmented buffer and receive its datagrams; returns how many buffers they arrived in
+size_t check_segments( const bool gro )
+{
+  UDPSocket receiver = bound_socket();
+  receiver.set_gro( gro );
+  UDPSocket sender = bound_socket();
+
+  const string data = contents( 20500 );
+  sender.sendto( receiver.local_address(), data, 1000 );
+
+  ReadBuffer buffer { 65536 };
+  Address source { "0.0.0.0" };
+  vector<string> datagrams;
+  size_t buffers = 0;
+  while ( datagrams.size() < 21 ) {
+    const SegmentedDatagram received = receiver.recv( source, buffer );
+    check( source == sender.local_address(), "received from the wrong sender" );
+    check( gro or received.count() == 1, "datagrams were coalesced without GRO" );
+    for ( size_t i = 0; i < received.count(); ++i ) {
+      datagrams.emplace_back( received.segment( i ) );
+    }
+    ++buffers;
+  }
+
+  for ( size_t i = 0; i < datagrams.size(); ++i ) {
+    check( datagrams[i] == data.substr( i * 1000, 1000 ), "segment " + to_string( i ) + " has the wrong bytes" );
+  }
+  check( datagrams.back().size() == 500, "the last segment has the wrong length" );
+
+  // a datagram sent without a segment size is received alone
+  sender.sendto( receiver.local_address(), string_view { data }.substr( 0, 1234 ) );
+  const SegmentedDatagram single = receiver.recv( source, buffer );
+  check( single.count() == 1 and single.segment_size == 1234 and single.segment( 0 ) == data.substr( 0, 1234 ),
+         "a single datagram was received wrong" );
+
+  return buffers;
+}
+
+// Send ROUNDS * SEGMENTS_PER_SEND datagrams and receive them; returns datagrams per second
+template<typename Send, typename Receive>
+double throughput( const bool gro, Send&& send, Receive&& receive )
+{
+  UDPSocket receiver = bound_socket();
+  receiver.set_gro( gro );
+  UDPSocket sender = bound_socket();
+  sender.connect( receiver.local_address() );
+
+  const string data = contents( SEGMENT_SIZE * SEGMENTS_PER_SEND );
+  ReadBuffer buffer { 65536 };
+  size_t bytes = 0;
+
+  const auto start = steady_clock::now();
+  for ( size_t round = 0; round < ROUNDS; ++round ) {
+    send( sender, data );
+    for ( size_t this_round = 0; this_round < data.size(); ) {
+      this_round += receive( receiver, buffer );
+    }
+    bytes += data.size();
+  }
+  const double seconds = duration_cast<duration<double>>( steady_clock::now() - start ).count();
+
+  check( bytes == ROUNDS * data.size(), "datagrams were lost" );
+  return static_cast<double>( ROUNDS * SEGMENTS_PER_SEND ) / seconds;
+}
+
+void speed_test()
+{
+  const auto send_each = []( UDPSocket& sender, string_view data ) {
+    for ( size_t offset = 0; offset < data.size(); offset += SEGMENT_SIZE ) {
+      sender.send( data.substr( offset, SEGMENT_SIZE ) );
+    }
+  };
+  const auto send_segmented
+    = []( UDPSocket& sender, string_view data ) { sender.send( data, uint16_t { SEGMENT_SIZE } ); };
+  const auto receive = []( UDPSocket& receiver, ReadBuffer& buffer ) {
+    Address source { "0.0.0.0" };
+    return receiver.recv( source, buffer ).data.size();
+  };
+
+  const double plain = throughput( false, send_each, receive );
+  const double gso = throughput( false, send_segmented, receive );
+  const double gso_gro = throughput( true, send_segmented, receive );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  const double megabytes_per_datagram = SEGMENT_SIZE / 1e6;
+  cout << fixed << setprecision( 2 ) << "Loopback UDP, " << SEGMENT_SIZE << "-byte datagrams: per-datagram "
+       << plain / 1e6 << " M/s (" << setprecision( 0 ) << plain * megabytes_per_datagram << " MB/s), GSO "
+       << setprecision( 2 ) << gso / 1e6 << " M/s (" << setprecision( 0 ) << gso * megabytes_per_datagram
+       << " MB/s), GSO+GRO " << setprecision( 2 ) << gso_gro / 1e6 << " M/s (" << setprecision( 0 )
+       << gso_gro * megabytes_per_datagram << " MB/s), " << setprecision( 1 ) << gso_gro / plain << "x.\n";
+  debug_output << "      udp gso/gro: " << fixed << setprecision( 2 ) << plain / 1e6 << " vs " << gso / 1e6
+               << " vs " << gso_gro / 1e6 << " M datagrams/s\n";
+}
+
+void program_body()
+{
+  try {
+    check_segments( false );
+  } catch ( const unix_error& e ) {
+    cerr << "Skipping UDP GSO test (" << e.what() << ").\n";
+    return;
+  }
+  const size_t buffers = check_segments( true );
+  cout << "21 segments sent with GSO arrived with GRO in " << buffers << " buffer(s).\n";
+
+  speed_test();
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,243 @@
+#include "eventloop.hh"
+#include "exception.hh"
+#include "socket.hh"
+#include "zero_copy_sender.hh"
+
+#include <chrono>
+#include <cstddef>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+using namespace std;
+using namespace std::chrono;
+
+static constexpr size_t CHUNK = 1 << 20;
+
+void check( const bool condition, const string& message )
+{
+  if ( not condition ) {
+    throw runtime_error( message );
+  }
+}
+
+// A connected pair of TCP sockets over loopback
+pair<TCPSocket, TCPSocket> tcp_pair()
+{
+  TCPSocket listener;
+  listener.set_reuseaddr();
+  listener.bind( Address { "127.0.0.1", 0 } );
+  listener.listen();
+  TCPSocket client;
+  client.connect( listener.local_address() );
+  return { move( client ), listener.accept() };
+}
+
+string contents( const size_t length, const size_t seed )
+{
+  string data( length, 0 );
+  for ( size_t i = 0; i < length; ++i ) {
+    data[i] = static_cast<char>( ( i * 131 + seed ) >> 8 );
+  }
+  return data;
+}
+
+double cpu_seconds()
+{
+  timespec now {};
+  CheckSystemCall( "clock_gettime", clock_gettime( CLOCK_PROCESS_CPUTIME_ID, &now ) );
+  return static_cast<double>( now.tv_sec ) + static_cast<double>( now.tv_nsec ) / 1e9;
+}
+
+// Send everything queued on `sender` with an EventLoop, as an application would
+void run_loop( TCPSocket& socket, ZeroCopySender& sender, bool& in_rule_cancelled )
+{
+  EventLoop loop;
+  const size_t category = loop.add_category( "zero-copy send" );
+  loop.add_rule(
+    category, socket, Direction::Out, [&] { sender.send(); }, [&] { return sender.bytes_unsent() > 0; } );
+  loop.add_rule(
+    category,
+    socket,
+    Direction::ErrQueue,
+    [&] { sender.read_completions(); },
+    [&] { return sender.awaiting_completions(); } );
+  // the peer never sends, but POLLERR from the error queue must not cancel this rule
+  loop.add_rule(
+    category, socket, Direction::In, [] {}, [] { return true; }, [&] { in_rule_cancelled = true; } );
+
+  while ( sender.bytes_unsent() > 0 or sender.awaiting_completions() ) {
+    loop.wait_next_event( -1 );
+  }
+}
+
+// A socket error (here, a refused connection) on a socket with an ErrQueue rule goes to every rule's error
+// callback, whether or not the ErrQueue rule is interested, rather than spinning or escaping from a callback
+void check_socket_error( const bool error_queue_interested )
+{
+  TCPSocket closed_port;
+  closed_port.bind( Address { "127.0.0.1", 0 } ); // bound, but not listening: connecting to it is refused
+  TCPSocket socket;
+  socket.set_blocking( false );
+  socket.connect( closed_port.local_address() );
+
+  EventLoop loop;
+  const size_t category = loop.add_category( "refused" );
+  size_t errors = 0;
+  loop.add_rule(
+    category,
+    socket,
+    Direction::ErrQueue,
+    [&] { socket.read_zerocopy_completion(); },
+    [&] { return error_queue_interested; },
+    [] {},
+    [&] { ++errors; } );
+  loop.add_rule(
+    category, socket, Direction::In, [] {}, [] { return true; }, [] {}, [&] { ++errors; } );
+
+  check( loop.wait_next_event( 1000 ) == EventLoop::Result::Success and errors == 2,
+         "a socket error did not reach every rule's error callback" );
+  check( loop.wait_next_event( 0 ) == EventLoop::Result::Exit, "a socket error did not cancel every rule" );
+}
+
+// Check that every byte arrives in order, and that each buffer is held until the kernel has completed its sends
+void check_sender()
+{
+  auto [client, server] = tcp_pair();
+  client.set_blocking( false );
+
+  string received;
+  thread reader( [&server, &received] {
+    ReadBuffer buffer { CHUNK };
+    while ( not server.eof() ) {
+      received.append( server.read( buffer ) );
+    }
+  } );
+
+  string expected;
+  vector<weak_ptr<const string>> sent;
+  bool in_rule_cancelled = false;
+  {
+    ZeroCopySender sender { client };
+    for ( size_t i = 0; i < 20; ++i ) {
+      auto buffer = make_shared<const string>( contents( CHUNK / 2 + i * 1000, i ) );
+      expected += *buffer;
+      sent.push_back( buffer );
+      sender.push( move( buffer ) );
+    }
+    check( sender.bytes_unsent() == expected.size(), "queued bytes were not counted" );
+    check( not sent.front().expired(), "the sender did not keep its buffers" );
+
+    run_loop( client, sender, in_rule_cancelled );
+    check( sender.bytes_unsent() == 0 and sender.bytes_pinned() == 0, "the sender kept bytes after completion" );
+  }
+  for ( const auto& buffer : sent ) {
+    check( buffer.expired(), "a buffer outlived its completions" );
+  }
+  check( not in_rule_cancelled, "POLLERR from the error queue cancelled another rule on the socket" );
+
+  client.shutdown( SHUT_WR );
+  reader.join();
+  check( received == expected, "zero-copy sends delivered the wrong bytes" );
+}
+
+struct Result
+{
+  double seconds;
+  double cpu_seconds;
+};
+
+// Send `total` bytes of a shared buffer to a reading thread with `send_all`
+template<typename SendAll>
+Result transfer( const size_t total, SendAll&& send_all )
+{
+  auto [client, server] = tcp_pair();
+  size_t received = 0;
+  thread reader( [&server, &received] {
+    ReadBuffer buffer { CHUNK };
+    while ( not server.eof() ) {
+      received += server.read( buffer ).size();
+    }
+  } );
+
+  const auto data = make_shared<const string>( contents( CHUNK, 0 ) );
+  const double cpu_start = cpu_seconds();
+  const auto start = steady_clock::now();
+  send_all( client, data, total / CHUNK );
+  client.shutdown( SHUT_WR );
+  reader.join();
+  const double seconds = duration_cast<duration<double>>( steady_clock::now() - start ).count();
+  const double cpu = cpu_seconds() - cpu_start;
+
+  check( received == total / CHUNK * CHUNK, "transfer lost bytes" );
+  return { seconds, cpu };
+}
+
+void speed_test()
+{
+  static constexpr size_t TOTAL = size_t { 512 } << 20;
+  const double gigabytes = TOTAL / 1e9;
+
+  const Result copied = transfer( TOTAL, []( TCPSocket& socket, const auto& data, const size_t count ) {
+    for ( size_t i = 0; i < count; ++i ) {
+      string_view remaining { *data };
+      while ( not remaining.empty() ) {
+        remaining.remove_prefix( socket.write( remaining ) );
+      }
+    }
+  } );
+
+  uint64_t kernel_copied = 0;
+  uint64_t sends = 0;
+  const Result zero_copy
+    = transfer( TOTAL, [&kernel_copied, &sends]( TCPSocket& socket, const auto& data, const size_t count ) {
+        socket.set_blocking( false );
+        ZeroCopySender sender { socket };
+        for ( size_t i = 0; i < count; ++i ) {
+          sender.push( data );
+        }
+        bool in_rule_cancelled = false;
+        run_loop( socket, sender, in_rule_cancelled );
+        kernel_copied = sender.copied();
+        sends = socket.write_count();
+      } );
+
+  fstream debug_output;
+  debug_output.open( "/dev/tty" );
+
+  cout << fixed << setprecision( 0 ) << "TCP over loopback, " << CHUNK / 1024 << " KiB sends: write() "
+       << gigabytes * 1000 / copied.seconds << " MB/s, " << setprecision( 2 ) << copied.cpu_seconds / gigabytes
+       << " CPU s/GB; MSG_ZEROCOPY " << setprecision( 0 ) << gigabytes * 1000 / zero_copy.seconds << " MB/s, "
+       << setprecision( 2 ) << zero_copy.cpu_seconds / gigabytes << " CPU s/GB (" << kernel_copied << " of "
+       << sends << " sends copied by the kernel anyway, as loopback always does).\n";
+  debug_output << "      zero-copy: " << fixed << setprecision( 0 ) << gigabytes * 1000 / copied.seconds << " vs "
+               << gigabytes * 1000 / zero_copy.seconds << " MB/s\n";
+}
+
+void program_body()
+{
+  check_socket_error( false );
+  check_socket_error( true );
+  try {
+    check_sender();
+  } catch ( const unix_error& e ) {
+    cerr << "Skipping MSG_ZEROCOPY test (" << e.what() << ").\n";
+    return;
+  }
+  speed_test();
+}
+
+int main()
+{
+  try {
+    program_body();
+  } catch ( const exception& e ) {
+    cerr << "Exception: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
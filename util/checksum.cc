@@ -0,0 +1,46 @@
+#include "checksum.hh"
+
+#include <algorithm>
+#include <thread>
+
+using namespace std;
+
+//! \param[in] data is the buffer to checksum
+//! \param[in] num_threads is the number of threads to split `data` across
+//! \note Chunk boundaries need not be 16-bit aligned; the partial sums are combined in order.
+InternetChecksum parallel_checksum( string_view data, size_t num_threads )
+{
+  static constexpr size_t min_chunk_size = 65536; // not worth starting a thread for less
+
+  num_threads = min( num_threads, data.size() / min_chunk_size );
+  if ( num_threads <= 1 ) {
+    InternetChecksum check;
+    check.add( data );
+    return check;
+  }
+
+  const size_t chunk_size = data.size() / num_threads;
+  vector<InternetChecksum> partials( num_threads );
+  vector<thread> threads;
+  threads.reserve( num_threads - 1 );
+
+  for ( size_t i = 0; i < num_threads; ++i ) {
+    const bool last = i + 1 == num_threads;
+    const auto chunk = data.substr( i * chunk_size, last ? string_view::npos : chunk_size );
+    if ( last ) {
+      partials[i].add( chunk ); // the calling thread takes the last chunk
+    } else {
+      threads.emplace_back( [&partial = partials[i], chunk] { partial.add( chunk ); } );
+    }
+  }
+
+  for ( auto& t : threads ) {
+    t.join();
+  }
+
+  InternetChecksum check;
+  for ( const auto& partial : partials ) {
+    check.add( partial );
+  }
+  return check;
+}
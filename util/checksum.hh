@@ -1,20 +1,57 @@
 #pragma once
 
 #include <cstdint>
+#include <cstring>
+#include <endian.h>
 #include <string>
+#include <string_view>
 #include <vector>
 
 //! The internet checksum algorithm
+//! \details Partial sums over disjoint byte ranges can be computed independently (e.g. on different threads)
+//! and then combined in order with add( const InternetChecksum& ).
 class InternetChecksum
 {
 private:
-  uint32_t sum_;
-  bool parity_ {};
+  uint64_t sum_;
+  bool parity_ {}; // true if an odd number of bytes has been added so far
+
+  // fold the running sum into 16 bits (without complementing)
+  uint16_t folded() const
+  {
+    uint64_t ret = sum_;
+
+    while ( ret > 0xffff ) {
+      ret = ( ret >> 16 ) + static_cast<uint16_t>( ret );
+    }
+
+    return ret;
+  }
 
 public:
   explicit InternetChecksum( const uint32_t sum = 0 ) : sum_( sum ) {}
+
   void add( std::string_view data )
   {
+    if ( data.empty() ) {
+      return;
+    }
+
+    // finish the 16-bit word left half-filled by the previous call
+    if ( parity_ ) {
+      sum_ += static_cast<uint8_t>( data.front() );
+      data.remove_prefix( 1 );
+      parity_ = false;
+    }
+
+    // sum 32-bit big-endian words; since 2^16 = 1 (mod 2^16 - 1), this folds to the same 16-bit sum
+    while ( data.size() >= sizeof( uint32_t ) ) {
+      uint32_t word {};
+      memcpy( &word, data.data(), sizeof( word ) );
+      sum_ += be32toh( word );
+      data.remove_prefix( sizeof( word ) );
+    }
+
     for ( const uint8_t i : data ) {
       uint16_t val = i;
       if ( not parity_ ) {
@@ -25,17 +62,20 @@ public:
     }
   }
 
-  uint16_t value() const
+  //! Append the partial sum of the bytes that immediately follow the ones already added
+  void add( const InternetChecksum& other )
   {
-    uint32_t ret = sum_;
-
-    while ( ret > 0xffff ) {
-      ret = ( ret >> 16 ) + static_cast<uint16_t>( ret );
+    uint16_t other_sum = other.folded();
+    if ( parity_ ) {
+      // `other` was summed starting on an even offset, but its bytes begin at an odd offset here
+      other_sum = static_cast<uint16_t>( ( other_sum << 8 ) | ( other_sum >> 8 ) );
     }
-
-    return ~ret;
+    sum_ += other_sum;
+    parity_ = parity_ != other.parity_;
   }
 
+  uint16_t value() const { return ~folded(); }
+
   void add( const std::vector<std::string>& data )
   {
     for ( const auto& x : data ) {
@@ -50,3 +90,6 @@ public:
     }
   }
 };
+
+//! Compute the checksum of a large buffer by splitting it across several threads
+InternetChecksum parallel_checksum( std::string_view data, size_t num_threads );
@@ -0,0 +1,88 @@
+#include "datagram_batch.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+DatagramBatch::DatagramBatch( const size_t capacity, const size_t datagram_size )
+  : datagram_size_( datagram_size )
+  , storage_( make_unique_for_overwrite<char[]>( capacity * datagram_size ) )
+  , headers_( capacity )
+  , iovecs_( capacity )
+  , addresses_( capacity )
+{
+  if ( capacity == 0 or datagram_size == 0 ) {
+    throw runtime_error( "DatagramBatch: capacity and datagram size must be nonzero" );
+  }
+}
+
+void DatagramBatch::prepare_receive( const size_t count )
+{
+  for ( size_t i = 0; i < count; ++i ) {
+    iovecs_[i] = { storage_.get() + i * datagram_size_, datagram_size_ }; // NOLINT(*-pointer-arithmetic)
+    msghdr& header = headers_[i].msg_hdr;
+    header = {};
+    header.msg_name = &addresses_[i];
+    header.msg_namelen = sizeof( sockaddr_storage );
+    header.msg_iov = &iovecs_[i];
+    header.msg_iovlen = 1;
+  }
+  size_ = 0;
+}
+
+void DatagramBatch::push_back( const string_view payload )
+{
+  if ( size_ >= capacity() ) {
+    throw runtime_error( "DatagramBatch: batch is full" );
+  }
+
+  iovecs_[size_] = { const_cast<char*>( payload.data() ), payload.size() }; // NOLINT(*-const-cast)
+  msghdr& header = headers_[size_].msg_hdr;
+  header = {};
+  header.msg_iov = &iovecs_[size_];
+  header.msg_iovlen = 1;
+  headers_[size_].msg_len = 0;
+  ++size_;
+}
+
+void DatagramBatch::push_back( const Address& destination, const string_view payload )
+{
+  push_back( payload );
+  const size_t index = size_ - 1;
+  memcpy( &addresses_[index], destination.raw(), destination.size() );
+  headers_[index].msg_hdr.msg_name = &addresses_[index];
+  headers_[index].msg_hdr.msg_namelen = destination.size();
+}
+
+// the kernel leaves the iovecs alone, so trim each to the length received
+void DatagramBatch::finish_receive( const size_t count )
+{
+  for ( size_t i = 0; i < count; ++i ) {
+    iovecs_[i].iov_len = min<size_t>( headers_[i].msg_len, datagram_size_ );
+  }
+  size_ = count;
+}
+
+string_view DatagramBatch::payload( const size_t index ) const
+{
+  if ( index >= size_ ) {
+    throw out_of_range( "DatagramBatch: no such datagram" );
+  }
+  return { static_cast<const char*>( iovecs_[index].iov_base ), iovecs_[index].iov_len };
+}
+
+bool DatagramBatch::truncated( const size_t index ) const
+{
+  return headers_.at( index ).msg_hdr.msg_flags & MSG_TRUNC; // NOLINT(*-bitwise)
+}
+
+Address DatagramBatch::address( const size_t index ) const
+{
+  const msghdr& header = headers_.at( index ).msg_hdr;
+  if ( header.msg_name == nullptr ) {
+    throw runtime_error( "DatagramBatch: datagram has no address" );
+  }
+  return { static_cast<const sockaddr*>( header.msg_name ), header.msg_namelen };
+}
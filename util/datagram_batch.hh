@@ -0,0 +1,65 @@
+#pragma once
+
+#include "address.hh"
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <vector>
+
+//! \brief Datagrams to receive or send with a single [recvmmsg(2)](\ref man2::recvmmsg) or
+//! [sendmmsg(2)](\ref man2::sendmmsg) call (see DatagramSocket::recv and DatagramSocket::send)
+//! \details Received datagrams land in preallocated slots and are handed back as views, so receiving a batch
+//! costs one system call and no allocation. Datagrams to send are queued as views of the caller's memory,
+//! which must stay valid until they are sent. The message headers are allocated once and reused by every batch.
+class DatagramBatch
+{
+  size_t datagram_size_;
+  std::unique_ptr<char[]> storage_; // received datagrams' slots, left uninitialized until the kernel fills them
+  std::vector<mmsghdr> headers_;
+  std::vector<iovec> iovecs_;
+  std::vector<sockaddr_storage> addresses_;
+  size_t size_ = 0;
+
+  friend class DatagramSocket;
+
+  // Point the first `count` headers at their own slots and addresses, ready for recvmmsg
+  void prepare_receive( size_t count );
+
+  // Record that recvmmsg filled the first `count` headers
+  void finish_receive( size_t count );
+
+public:
+  //! \param[in] capacity is the most datagrams in a batch
+  //! \param[in] datagram_size is the largest datagram received whole (longer ones are truncated)
+  explicit DatagramBatch( size_t capacity, size_t datagram_size = 65536 );
+
+  //! Empty the batch (to queue datagrams to send)
+  void clear() { size_ = 0; }
+
+  //! Queue a datagram to `destination`, or to the socket's connected address if none is given
+  void push_back( std::string_view payload );
+  void push_back( const Address& destination, std::string_view payload );
+
+  size_t size() const { return size_; }               //!< datagrams in the batch
+  bool empty() const { return size_ == 0; }           //!< whether the batch holds no datagrams
+  size_t capacity() const { return headers_.size(); } //!< most datagrams in a batch
+  size_t datagram_size() const { return datagram_size_; }
+
+  //! The `index`th datagram (received: valid until the next receive into this batch)
+  std::string_view payload( size_t index ) const;
+
+  //! Whether the `index`th received datagram was longer than datagram_size() and lost its end
+  bool truncated( size_t index ) const;
+
+  //! The sender of the `index`th received datagram (or the destination of one queued to send)
+  Address address( size_t index ) const;
+
+  // headers point into the batch's own storage
+  DatagramBatch( const DatagramBatch& other ) = delete;
+  DatagramBatch& operator=( const DatagramBatch& other ) = delete;
+  DatagramBatch( DatagramBatch&& other ) = delete;
+  DatagramBatch& operator=( DatagramBatch&& other ) = delete;
+};
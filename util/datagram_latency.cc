@@ -0,0 +1,71 @@
+#include "datagram_latency.hh"
+#include "exception.hh"
+
+#include <algorithm>
+#include <cstddef>
+#include <ctime>
+#include <string_view>
+
+using namespace std;
+
+void DatagramLatency::Delays::add( const uint64_t delay )
+{
+  histogram.add( delay );
+  total += delay;
+  max = std::max( max, delay );
+}
+
+uint64_t DatagramLatency::now()
+{
+  timespec time {};
+  CheckSystemCall( "clock_gettime", clock_gettime( CLOCK_REALTIME, &time ) );
+  return static_cast<uint64_t>( time.tv_sec ) * 1'000'000'000 + static_cast<uint64_t>( time.tv_nsec );
+}
+
+// the clock can step backwards between the two timestamps; such a delay counts as zero
+static uint64_t delay( const uint64_t from, const uint64_t to )
+{
+  return to > from ? to - from : 0;
+}
+
+void DatagramLatency::received( const SegmentedDatagram& datagram )
+{
+  if ( datagram.timestamp ) {
+    kernel_to_user_.add( delay( datagram.timestamp, now() ) );
+  }
+}
+
+void DatagramLatency::sending()
+{
+  send_times_.push_back( now() );
+}
+
+// The kernel's ids are 32 bits and wrap: the id is taken as the first send at or after first_pending_ that it
+// could be. Sends before it got no timestamp (e.g. the datagram was dropped before the device), so they are
+// given up on.
+void DatagramLatency::transmitted( const TransmitTimestamp& timestamp )
+{
+  const uint32_t ahead = timestamp.id - static_cast<uint32_t>( first_pending_ );
+  if ( ahead >= send_times_.size() ) {
+    return; // not a send that was recorded
+  }
+
+  send_times_.erase( send_times_.begin(), send_times_.begin() + static_cast<ptrdiff_t>( ahead ) );
+  user_to_kernel_.add( delay( send_times_.front(), timestamp.timestamp ) );
+  send_times_.pop_front();
+  first_pending_ += ahead + 1;
+}
+
+static void print( ostream& out, const string_view name, const DatagramLatency::Delays& delays )
+{
+  out << name << " " << delays.count() << " datagrams, mean " << delays.mean() << " ns, p50 < "
+      << delays.histogram.quantile_bound( 0.5 ) << " ns, p99 < " << delays.histogram.quantile_bound( 0.99 )
+      << " ns, max " << delays.max << " ns";
+}
+
+ostream& operator<<( ostream& out, const DatagramLatency& latency )
+{
+  print( out, "kernel-to-user", latency.kernel_to_user() );
+  print( out << "; ", "user-to-kernel", latency.user_to_kernel() );
+  return out;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "io_statistics.hh"
+#include "socket.hh"
+
+#include <cstdint>
+#include <deque>
+#include <ostream>
+
+//! \brief Per-datagram delays between the kernel and the application, from the kernel's software timestamps
+//! \details Kernel-to-user is from the kernel receiving a datagram to the application handling it: time queued
+//! on the socket, plus however long the EventLoop took to get to its rule. User-to-kernel is from the
+//! application sending a datagram to the kernel handing it to the device. Both need timestamping on (see
+//! DatagramSocket::set_timestamping).
+class DatagramLatency
+{
+public:
+  //! The distribution of one kind of delay, in nanoseconds
+  struct Delays
+  {
+    Log2Histogram histogram {};
+    uint64_t total {};
+    uint64_t max {};
+
+    void add( uint64_t delay );
+    uint64_t count() const { return histogram.count(); }
+    uint64_t mean() const { return count() ? total / count() : 0; }
+  };
+
+private:
+  Delays kernel_to_user_ {};
+  Delays user_to_kernel_ {};
+
+  std::deque<uint64_t> send_times_ {}; // when each send still waiting for its transmit timestamp was made
+  uint64_t first_pending_ {};          // the id of the send at the front of send_times_
+
+public:
+  //! The clock the kernel's timestamps are taken from (CLOCK_REALTIME), in ns since the epoch
+  static uint64_t now();
+
+  //! Record a datagram (or GRO buffer) as handled now; one without a timestamp is ignored
+  void received( const SegmentedDatagram& datagram );
+
+  //! \brief Record a send as made now: call just before each send on a socket with timestamping on
+  //! \details Sends are matched to their transmit timestamps by order, so every send has to be recorded, and
+  //! timestamping turned on before the first.
+  void sending();
+
+  //! Record the delay up to a transmit timestamp read from the socket
+  void transmitted( const TransmitTimestamp& timestamp );
+
+  const Delays& kernel_to_user() const { return kernel_to_user_; }
+  const Delays& user_to_kernel() const { return user_to_kernel_; }
+};
+
+//! One line: count, mean, p50 and p99 bounds and max of each kind of delay, in nanoseconds
+std::ostream& operator<<( std::ostream& out, const DatagramLatency& latency );
@@ -0,0 +1,155 @@
+#include "dns_message.hh"
+
+#include <array>
+#include <stdexcept>
+
+using namespace std;
+
+static constexpr uint16_t QUESTION_POINTER = 0xc000 | 12; // the question's name starts right after the header
+
+static constexpr size_t MAX_LABEL = 63;
+static constexpr size_t MAX_NAME = 255;
+
+// Read a name as dotted labels. A compression pointer ends the name, and is not followed (Parser only reads
+// forward): it is only expected after the question, in records whose names aren't kept.
+static string parse_name( Parser& parser )
+{
+  string name;
+  while ( not parser.has_error() ) {
+    uint8_t length {};
+    parser.integer( length );
+    if ( length == 0 ) {
+      break;
+    }
+    if ( ( length & 0xc0 ) == 0xc0 ) { // NOLINT(*-bitwise)
+      parser.remove_prefix( 1 );
+      break;
+    }
+    if ( length > MAX_LABEL or name.size() + length + 1 > MAX_NAME ) {
+      parser.set_error();
+      break;
+    }
+
+    array<char, MAX_LABEL> label {};
+    parser.string( { label.data(), length } );
+    if ( not name.empty() ) {
+      name += '.';
+    }
+    name.append( label.data(), length );
+  }
+  return name;
+}
+
+static void serialize_name( Serializer& serializer, const string& name )
+{
+  size_t start = 0;
+  while ( start < name.size() ) {
+    const size_t dot = min( name.find( '.', start ), name.size() );
+    if ( dot == start or dot - start > MAX_LABEL ) {
+      throw runtime_error( "invalid DNS name: " + name );
+    }
+    serializer.integer( static_cast<uint8_t>( dot - start ) );
+    serializer.buffer( name.substr( start, dot - start ) );
+    start = dot + 1;
+  }
+  serializer.integer( uint8_t {} );
+}
+
+static void parse_records( Parser& parser, const uint16_t count, vector<DNSMessage::Record>& records )
+{
+  records.clear();
+  for ( uint16_t i = 0; i < count and not parser.has_error(); ++i ) {
+    parse_name( parser );
+    DNSMessage::Record record;
+    uint16_t length {};
+    parser.integer( record.type );
+    parser.integer( record.rclass );
+    parser.integer( record.ttl );
+    parser.integer( length );
+    if ( parser.has_error() ) {
+      return;
+    }
+    record.data.resize( length );
+    parser.string( record.data );
+    records.push_back( move( record ) );
+  }
+}
+
+static void serialize_records( Serializer& serializer, const vector<DNSMessage::Record>& records )
+{
+  for ( const auto& record : records ) {
+    serializer.integer( QUESTION_POINTER );
+    serializer.integer( record.type );
+    serializer.integer( record.rclass );
+    serializer.integer( record.ttl );
+    serializer.integer( static_cast<uint16_t>( record.data.size() ) );
+    serializer.buffer( record.data );
+  }
+}
+
+vector<uint32_t> DNSMessage::addresses() const
+{
+  vector<uint32_t> result;
+  for ( const auto& record : answers ) {
+    if ( record.type == TYPE_A and record.rclass == CLASS_IN and record.data.size() == 4 ) {
+      uint32_t address {};
+      Parser parser { { record.data } };
+      parser.integer( address );
+      result.push_back( address );
+    }
+  }
+  return result;
+}
+
+// Parse from string.
+void DNSMessage::parse( Parser& parser )
+{
+  uint16_t flags {};
+  uint16_t question_count {};
+  uint16_t answer_count {};
+  uint16_t authority_count {};
+  uint16_t additional_count {};
+  parser.integer( id );
+  parser.integer( flags );
+  parser.integer( question_count );
+  parser.integer( answer_count );
+  parser.integer( authority_count );
+  parser.integer( additional_count );
+
+  response = static_cast<bool>( flags & 0x8000 );          // QR
+  truncated = static_cast<bool>( flags & 0x0200 );         // TC
+  recursion_desired = static_cast<bool>( flags & 0x0100 ); // RD
+  rcode = flags & 0x000f;
+
+  if ( question_count != 1 ) {
+    parser.set_error();
+    return;
+  }
+  name = parse_name( parser );
+  parser.integer( qtype );
+  parser.integer( qclass );
+
+  parse_records( parser, answer_count, answers );
+  parse_records( parser, authority_count, authority );
+}
+
+// Serialize the DNSMessage to a string.
+void DNSMessage::serialize( Serializer& serializer ) const
+{
+  // a response also says recursion is available (RA)
+  const uint16_t flags = ( response ? 0x8080U : 0 ) | ( truncated ? 0x0200U : 0 )
+                         | ( recursion_desired ? 0x0100U : 0 ) | ( rcode & 0x000fU );
+  serializer.integer( id );
+  serializer.integer( static_cast<uint16_t>( flags ) );
+  serializer.integer( uint16_t { 1 } );
+  serializer.integer( static_cast<uint16_t>( answers.size() ) );
+  serializer.integer( static_cast<uint16_t>( authority.size() ) );
+  serializer.integer( uint16_t {} );
+
+  serialize_name( serializer, name );
+  serializer.integer( qtype );
+  serializer.integer( qclass );
+
+  serialize_records( serializer, answers );
+  serialize_records( serializer, authority );
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "parser.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A DNS message (RFC 1035), limited to what a stub resolver asks and needs from the answer: one question, and
+// the answer and authority records about it (additional records are ignored)
+struct DNSMessage
+{
+  static constexpr uint16_t TYPE_A = 1;
+  static constexpr uint16_t TYPE_CNAME = 5;
+  static constexpr uint16_t TYPE_SOA = 6;
+  static constexpr uint16_t CLASS_IN = 1;
+  static constexpr uint8_t RCODE_NO_ERROR = 0;
+  static constexpr uint8_t RCODE_SERVER_FAILURE = 2;
+  static constexpr uint8_t RCODE_NAME_ERROR = 3; // the name does not exist (NXDOMAIN)
+
+  // A resource record. Its owner name is not kept: every record here is about the question's name (or a name it
+  // is an alias for), and is serialized with a pointer to the question's name.
+  struct Record
+  {
+    uint16_t type = TYPE_A;
+    uint16_t rclass = CLASS_IN;
+    uint32_t ttl = 0;    // seconds the record may be cached
+    std::string data {}; // the record's data, e.g. the four bytes of an IPv4 address
+  };
+
+  uint16_t id = 0;               // matches a response to its query
+  bool response = false;         // QR flag
+  bool truncated = false;        // TC flag: the response did not fit in a datagram
+  bool recursion_desired = true; // RD flag
+  uint8_t rcode = RCODE_NO_ERROR;
+
+  std::string name {}; // the name asked about, e.g. "example.com"
+  uint16_t qtype = TYPE_A;
+  uint16_t qclass = CLASS_IN;
+
+  std::vector<Record> answers {};
+  std::vector<Record> authority {};
+
+  // The IPv4 addresses among the answers (host byte order)
+  std::vector<uint32_t> addresses() const;
+
+  void parse( Parser& parser );
+  void serialize( Serializer& serializer ) const;
+};
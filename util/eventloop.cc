@@ -2,15 +2,17 @@
 #include "exception.hh"
 #include "socket.hh"
 
+#include <algorithm>
 #include <cstring>
 #include <iomanip>
 #include <iostream>
+#include <set>
 
 using namespace std;
 
-unsigned int EventLoop::FDRule::service_count() const
+uint64_t EventLoop::FDRule::service_count() const
 {
-  return direction == Direction::In ? fd.read_count() : fd.write_count();
+  return direction == Direction::Out ? fd.write_count() : fd.read_count();
 }
 
 size_t EventLoop::add_category( const string& name )
@@ -23,6 +25,30 @@ size_t EventLoop::add_category( const string& name )
   return _rule_categories.size() - 1;
 }
 
+// a descriptor with rules for both directions is counted once
+IOStatistics EventLoop::statistics( const size_t category_id ) const
+{
+  if ( category_id >= _rule_categories.size() ) {
+    throw out_of_range( "bad category_id" );
+  }
+
+  IOStatistics total;
+  set<int> seen;
+  for ( const auto& rule : _fd_rules ) {
+    if ( rule->category_id == category_id and seen.insert( rule->fd.fd_num() ).second ) {
+      total += rule->fd.statistics();
+    }
+  }
+  return total;
+}
+
+void EventLoop::summary( ostream& out ) const
+{
+  for ( size_t category_id = 0; category_id < _rule_categories.size(); ++category_id ) {
+    out << "  " << _rule_categories[category_id].name << ": " << statistics( category_id ) << "\n";
+  }
+}
+
 EventLoop::BasicRule::BasicRule( size_t s_category_id, InterestT s_interest, CallbackT s_callback )
   : category_id( s_category_id ), interest( move( s_interest ) ), callback( move( s_callback ) )
 {}
@@ -117,6 +143,7 @@ EventLoop::Result EventLoop::wait_next_event( const int timeout_ms )
   vector<pollfd> pollfds {};
   pollfds.reserve( _fd_rules.size() );
   bool something_to_poll = false;
+  vector<int> error_queue_fds {}; // fds with an interested ErrQueue rule, whose error queue POLLERR may mean
 
   // set up the pollfd for each rule
   for ( auto it = _fd_rules.begin(); it != _fd_rules.end(); ) { // NOTE: it gets erased or incremented in loop body
@@ -143,7 +170,12 @@ EventLoop::Result EventLoop::wait_next_event( const int timeout_ms )
       continue;
     }
 
-    if ( this_rule.interest() ) {
+    const bool interested = this_rule.interest();
+    if ( this_rule.direction == Direction::ErrQueue and interested ) {
+      error_queue_fds.push_back( this_rule.fd.fd_num() );
+    }
+
+    if ( interested ) {
       pollfds.push_back( { this_rule.fd.fd_num(), static_cast<int16_t>( this_rule.direction ), 0 } );
       something_to_poll = true;
     } else {
@@ -162,17 +194,47 @@ EventLoop::Result EventLoop::wait_next_event( const int timeout_ms )
     return Result::Timeout;
   }
 
+  // POLLERR also means a pending socket error, which goes to every rule on the fd (as on any other fd): reading it
+  // clears it, so it is kept for the error path below
+  vector<pair<int, int>> socket_errors {}; // (fd, error)
+  ranges::sort( error_queue_fds );
+  error_queue_fds.erase( unique( error_queue_fds.begin(), error_queue_fds.end() ), error_queue_fds.end() );
+  erase_if( error_queue_fds, [&]( const int fd ) {
+    if ( not( ranges::find( pollfds, fd, &pollfd::fd )->revents & POLLERR ) ) {
+      return false;
+    }
+    int socket_error = 0;
+    socklen_t optlen = sizeof( socket_error );
+    if ( getsockopt( fd, SOL_SOCKET, SO_ERROR, &socket_error, &optlen ) == 0 and socket_error != 0 ) {
+      socket_errors.emplace_back( fd, socket_error );
+      return true;
+    }
+    return false;
+  } );
+
   // go through the poll results
   for ( auto [it, idx] = make_pair( _fd_rules.begin(), static_cast<size_t>( 0 ) ); it != _fd_rules.end(); ++idx ) {
-    const auto& this_pollfd = pollfds.at( idx );
+    auto this_pollfd = pollfds.at( idx );
     auto& this_rule = **it;
 
-    const auto poll_error = static_cast<bool>( this_pollfd.revents & ( POLLERR | POLLNVAL ) );
+    // otherwise, on a fd with an interested ErrQueue rule, POLLERR means its error queue has messages, which only
+    // that rule serves
+    const bool error_queue = ranges::find( error_queue_fds, this_pollfd.fd ) != error_queue_fds.end();
+    if ( error_queue and this_rule.direction != Direction::ErrQueue ) {
+      this_pollfd.revents &= ~POLLERR;
+    }
+
+    const auto poll_error = static_cast<bool>( this_pollfd.revents & POLLNVAL )
+                            or ( not error_queue and ( this_pollfd.revents & POLLERR ) );
     if ( poll_error ) {
       /* see if fd is a socket */
       int socket_error = 0;
       socklen_t optlen = sizeof( socket_error );
       const int ret = getsockopt( this_rule.fd.fd_num(), SOL_SOCKET, SO_ERROR, &socket_error, &optlen );
+      if ( const auto read = ranges::find( socket_errors, this_pollfd.fd, &pair<int, int>::first );
+           ret == 0 and socket_error == 0 and read != socket_errors.end() ) {
+        socket_error = read->second; // already read (and cleared) above
+      }
       if ( ret == -1 and errno == ENOTSOCK ) {
         cerr << "error on polled file descriptor for rule \"" << _rule_categories.at( this_rule.category_id ).name
              << "\"\n";
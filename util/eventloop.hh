@@ -16,8 +16,11 @@ public:
   //! Indicates interest in reading (In) or writing (Out) a polled fd.
   enum class Direction : int16_t
   {
-    In = POLLIN,  //!< Callback will be triggered when Rule::fd is readable.
-    Out = POLLOUT //!< Callback will be triggered when Rule::fd is writable.
+    In = POLLIN,       //!< Callback will be triggered when Rule::fd is readable.
+    Out = POLLOUT,     //!< Callback will be triggered when Rule::fd is writable.
+    ErrQueue = POLLERR //!< Callback will be triggered when Rule::fd's error queue has messages (e.g.
+                       //!< MSG_ZEROCOPY completions); while it is interested, the fd's other rules ignore
+                       //!< POLLERR, unless the socket has a pending error (which cancels all of them).
   };
 
 private:
@@ -48,9 +51,10 @@ private:
 
     FDRule( BasicRule&& base, FileDescriptor&& s_fd, Direction s_direction, CallbackT s_cancel, CallbackT s_error );
 
-    //! Returns the number of times fd has been read or written, depending on the value of Rule::direction.
+    //! Returns the number of times fd has been read or written, depending on the value of Rule::direction
+    //! (reading the error queue counts as a read).
     //! \details This function is used internally by EventLoop; you will not need to call it
-    unsigned int service_count() const;
+    uint64_t service_count() const;
   };
 
   std::vector<RuleCategory> _rule_categories {};
@@ -100,6 +104,13 @@ public:
   //! Calls [poll(2)](\ref man2::poll) and then executes callback for each ready fd.
   Result wait_next_event( int timeout_ms );
 
+  //! I/O telemetry summed over the descriptors of a category's current rules
+  //! \note A descriptor's counts leave the sum when its last rule is cancelled (e.g. at EOF)
+  IOStatistics statistics( size_t category_id ) const;
+
+  //! Print each category's statistics, one line each
+  void summary( std::ostream& out ) const;
+
   // convenience function to add category and rule at the same time
   template<typename... Targs>
   auto add_rule( const std::string& name, Targs&&... Fargs )
@@ -0,0 +1,201 @@
+#include "fake_tun.hh"
+#include "exception.hh"
+
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <optional>
+#include <poll.h>
+#include <span>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+using namespace std;
+using namespace std::chrono;
+
+static constexpr int SOCKET_BUFFER_SIZE = 4 << 20; // the kernel caps this at net.core.wmem_max
+static constexpr size_t MAX_FRAME = 65536;
+static constexpr size_t MAX_BURST = 64; // frames taken from one end before delivering again
+
+pair<FakeTun, FakeTun> FakeTun::pair()
+{
+  array<int, 2> fds {};
+  ::CheckSystemCall( "socketpair", socketpair( AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0, fds.data() ) );
+  std::pair<FakeTun, FakeTun> ends { FakeTun { FileDescriptor { fds[0] } }, FakeTun { FileDescriptor { fds[1] } } };
+
+  // a unix datagram sender is limited by its own send buffer, until the receiver reads
+  for ( const int fd : fds ) {
+    ::CheckSystemCall( "setsockopt",
+                       setsockopt( fd, SOL_SOCKET, SO_SNDBUF, &SOCKET_BUFFER_SIZE, sizeof( SOCKET_BUFFER_SIZE ) ) );
+  }
+  return ends;
+}
+
+static const LinkConditions& checked( const LinkConditions& conditions )
+{
+  if ( conditions.loss_rate < 0 or conditions.loss_rate > 1 ) {
+    throw runtime_error( "FakeTunLink: loss rate must be between 0 and 1" );
+  }
+  if ( conditions.latency < nanoseconds::zero() ) {
+    throw runtime_error( "FakeTunLink: negative latency" );
+  }
+  return conditions;
+}
+
+// An independent, reproducible random stream for each direction of the link
+static default_random_engine seeded( const uint64_t seed, const uint32_t stream )
+{
+  seed_seq sequence { static_cast<uint32_t>( seed ), static_cast<uint32_t>( seed >> 32 ), stream };
+  return default_random_engine( sequence );
+}
+
+FakeTunLink::Channel::Channel( const LinkConditions& s_conditions,
+                               FileDescriptor s_input,
+                               FileDescriptor s_output,
+                               default_random_engine s_random )
+  : conditions( checked( s_conditions ) )
+  , input( move( s_input ) )
+  , output( move( s_output ) )
+  , random( s_random )
+  , loss( conditions.loss_rate )
+{
+  input.set_blocking( false );
+}
+
+// Queue a frame at the bottleneck, serialize it, maybe lose it, and schedule its arrival
+void FakeTunLink::Channel::transmit( const string_view frame, const Clock::time_point now )
+{
+  Clock::time_point departure = now;
+  if ( conditions.bits_per_second ) {
+    const Clock::time_point start = max( now, link_free );
+    const double backlog_bytes = static_cast<double>( duration_cast<nanoseconds>( start - now ).count() )
+                                 * static_cast<double>( conditions.bits_per_second ) / 8e9;
+    if ( conditions.queue_bytes
+         and backlog_bytes + static_cast<double>( frame.size() ) > static_cast<double>( conditions.queue_bytes ) ) {
+      ++overflowed;
+      return;
+    }
+    link_free = start + nanoseconds( frame.size() * 8 * 1'000'000'000 / conditions.bits_per_second );
+    departure = link_free;
+  }
+
+  // a lost frame still took its turn on the link
+  if ( conditions.loss_rate > 0 and loss( random ) ) {
+    ++lost;
+    return;
+  }
+
+  in_flight.emplace_back( departure + conditions.latency, frame );
+}
+
+// Hand every frame that has arrived to the receiving end, until it stops accepting them
+void FakeTunLink::Channel::deliver( const Clock::time_point now )
+{
+  output_blocked = false;
+  while ( not in_flight.empty() and in_flight.front().first <= now ) {
+    const string& frame = in_flight.front().second;
+    if ( ::send( output.fd_num(), frame.data(), frame.size(), MSG_DONTWAIT ) < 0 ) {
+      if ( errno == EAGAIN or errno == EWOULDBLOCK ) {
+        output_blocked = true;
+        return;
+      }
+      throw unix_error { "send" };
+    }
+    in_flight.pop_front();
+    ++delivered;
+  }
+}
+
+FakeTunLink::FakeTunLink( const LinkConditions& a_to_b, const LinkConditions& b_to_a, const uint64_t seed )
+  : FakeTunLink( FakeTun::pair(), FakeTun::pair(), a_to_b, b_to_a, seed )
+{}
+
+FakeTunLink::FakeTunLink( std::pair<FakeTun, FakeTun> side_a,
+                          std::pair<FakeTun, FakeTun> side_b,
+                          const LinkConditions& a_to_b,
+                          const LinkConditions& b_to_a,
+                          const uint64_t seed )
+  : a_( move( side_a.first ) )
+  , b_( move( side_b.first ) )
+  , a_to_b_( a_to_b, side_a.second.duplicate(), side_b.second.duplicate(), seeded( seed, 0 ) )
+  , b_to_a_( b_to_a, move( side_b.second ), move( side_a.second ), seeded( seed, 1 ) )
+  , wakeup_( CheckSystemCall( "eventfd", eventfd( 0, EFD_CLOEXEC ) ) )
+{
+  thread_ = thread( [this] { run(); } );
+}
+
+FakeTunLink::~FakeTunLink()
+{
+  try {
+    static constexpr uint64_t one = 1;
+    wakeup_.write( { reinterpret_cast<const char*>( &one ), sizeof( one ) } ); // NOLINT(*-reinterpret-cast)
+    thread_.join();
+  } catch ( const exception& e ) {
+    cerr << "Exception stopping FakeTunLink: " << e.what() << endl;
+  }
+}
+
+// NOLINTBEGIN(*-cognitive-complexity)
+void FakeTunLink::run()
+{
+  try {
+    const array<Channel*, 2> channels { &a_to_b_, &b_to_a_ };
+    array<bool, 2> inputs_open { true, true };
+    vector<char> buffer( MAX_FRAME );
+
+    while ( true ) {
+      Clock::time_point now = Clock::now();
+      optional<Clock::time_point> next_arrival;
+      for ( Channel* channel : channels ) {
+        channel->deliver( now );
+        if ( not channel->output_blocked and not channel->in_flight.empty() ) {
+          next_arrival = min( next_arrival.value_or( Clock::time_point::max() ), channel->in_flight.front().first );
+        }
+      }
+
+      // sleep until a frame arrives, a frame is sent, a blocked end can take frames again, or it's time to stop
+      array<pollfd, 5> fds {};
+      for ( size_t i = 0; i < channels.size(); ++i ) {
+        fds.at( i ) = { inputs_open.at( i ) ? channels.at( i )->input.fd_num() : -1, POLLIN, 0 };
+        fds.at( 2 + i ) = { channels.at( i )->output_blocked ? channels.at( i )->output.fd_num() : -1, POLLOUT, 0 };
+      }
+      fds.at( 4 ) = { wakeup_.fd_num(), POLLIN, 0 };
+
+      timespec timeout {};
+      if ( next_arrival.has_value() ) {
+        const int64_t wait_ns = max<int64_t>( 0, duration_cast<nanoseconds>( *next_arrival - now ).count() );
+        timeout = { wait_ns / 1'000'000'000, wait_ns % 1'000'000'000 };
+      }
+      if ( ppoll( fds.data(), fds.size(), next_arrival.has_value() ? &timeout : nullptr, nullptr ) < 0 ) {
+        if ( errno == EINTR ) {
+          continue;
+        }
+        throw unix_error { "ppoll" };
+      }
+
+      if ( fds.at( 4 ).revents & POLLIN ) {
+        return;
+      }
+
+      now = Clock::now();
+      for ( size_t i = 0; i < channels.size(); ++i ) {
+        const short events = fds.at( i ).revents;
+        if ( events & ( POLLERR | POLLHUP | POLLNVAL ) ) {
+          inputs_open.at( i ) = false; // the sender's end was closed
+        } else if ( events & POLLIN ) {
+          for ( size_t frames = 0; frames < MAX_BURST; ++frames ) {
+            const size_t length = channels.at( i )->input.read( span<char> { buffer } );
+            if ( length == 0 ) {
+              break;
+            }
+            channels.at( i )->transmit( { buffer.data(), length }, now );
+          }
+        }
+      }
+    }
+  } catch ( const exception& e ) {
+    cerr << "Exception in FakeTunLink: " << e.what() << endl;
+  }
+}
+// NOLINTEND(*-cognitive-complexity)
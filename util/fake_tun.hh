@@ -0,0 +1,122 @@
+#pragma once
+
+#include "tun.hh"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+//! \brief A rootless, in-memory stand-in for a TUN device
+//! \details A FakeTun is one end of a datagram socket pair, so every read or write carries exactly one frame, as
+//! on a TunFD. It is a TunTapFD (reads, writes and packet capture behave the same, and it works with EventLoop and
+//! PacketRing), but needs no device, no root and no scripts/tun.sh. Frames written to a FakeTun come out of its
+//! peer: either directly (pair()), or through a FakeTunLink that emulates the network in between.
+class FakeTun : public TunTapFD
+{
+public:
+  explicit FakeTun( FileDescriptor fd ) : TunTapFD( std::move( fd ) ) {}
+
+  //! Two FakeTuns connected back to back, with nothing in between
+  static std::pair<FakeTun, FakeTun> pair();
+};
+
+//! How a FakeTunLink treats frames in one direction
+struct LinkConditions
+{
+  std::chrono::nanoseconds latency {}; //!< one-way propagation delay
+  double loss_rate {};                 //!< probability that a frame is lost
+  uint64_t bits_per_second {};         //!< rate of the bottleneck (0 means unlimited)
+  size_t queue_bytes {};               //!< bytes the bottleneck queues before dropping (0 means unlimited)
+};
+
+//! \brief Two FakeTuns connected through an emulated link with latency, random loss and a rate-limited bottleneck
+//! \details A thread moves frames between the two ends. Each frame waits in the bottleneck queue behind the frames
+//! before it, is serialized at the link rate, may be lost, and then arrives one latency later. Loss draws from a
+//! seeded generator per direction, so a given seed and sequence of frames always loses the same frames. If an
+//! end is not being read, arriving frames wait for it rather than being dropped.
+class FakeTunLink
+{
+public:
+  //! Counts of frames that crossed (or failed to cross) the link in one direction
+  struct Statistics
+  {
+    uint64_t delivered {};
+    uint64_t lost {};       //!< dropped at random (LinkConditions::loss_rate)
+    uint64_t overflowed {}; //!< dropped because the bottleneck queue was full
+  };
+
+private:
+  using Clock = std::chrono::steady_clock;
+
+  // One direction of the link
+  struct Channel
+  {
+    LinkConditions conditions;
+    FileDescriptor input;  // the emulator's end of the sender's socket pair
+    FileDescriptor output; // the emulator's end of the receiver's socket pair
+    std::default_random_engine random;
+    std::bernoulli_distribution loss;
+
+    std::deque<std::pair<Clock::time_point, std::string>> in_flight {}; // frames and their arrival times
+    Clock::time_point link_free {}; // when the bottleneck finishes serializing the frames before
+    bool output_blocked {};
+
+    std::atomic<uint64_t> delivered {};
+    std::atomic<uint64_t> lost {};
+    std::atomic<uint64_t> overflowed {};
+
+    Channel( const LinkConditions& s_conditions,
+             FileDescriptor s_input,
+             FileDescriptor s_output,
+             std::default_random_engine s_random );
+
+    void transmit( std::string_view frame, Clock::time_point now );
+    void deliver( Clock::time_point now );
+    Statistics statistics() const { return { delivered.load(), lost.load(), overflowed.load() }; }
+  };
+
+  FakeTun a_;
+  FakeTun b_;
+  Channel a_to_b_;
+  Channel b_to_a_;
+  FileDescriptor wakeup_; // eventfd that tells the thread to stop
+  std::thread thread_ {};
+
+  FakeTunLink( std::pair<FakeTun, FakeTun> side_a,
+               std::pair<FakeTun, FakeTun> side_b,
+               const LinkConditions& a_to_b,
+               const LinkConditions& b_to_a,
+               uint64_t seed );
+
+  void run();
+
+public:
+  //! A link with the given conditions in each direction (and loss drawn from `seed`)
+  FakeTunLink( const LinkConditions& a_to_b, const LinkConditions& b_to_a, uint64_t seed = 0 );
+
+  //! A symmetric link
+  explicit FakeTunLink( const LinkConditions& conditions = {}, uint64_t seed = 0 )
+    : FakeTunLink( conditions, conditions, seed )
+  {}
+
+  //! Stops the thread; frames still in flight are discarded
+  ~FakeTunLink();
+
+  FakeTun& a() { return a_; }
+  FakeTun& b() { return b_; }
+
+  Statistics a_to_b() const { return a_to_b_.statistics(); }
+  Statistics b_to_a() const { return b_to_a_.statistics(); }
+
+  FakeTunLink( const FakeTunLink& other ) = delete;
+  FakeTunLink& operator=( const FakeTunLink& other ) = delete;
+  FakeTunLink( FakeTunLink&& other ) = delete;
+  FakeTunLink& operator=( FakeTunLink&& other ) = delete;
+};
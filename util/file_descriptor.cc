@@ -6,12 +6,15 @@
 #include <fcntl.h>
 #include <iostream>
 #include <stdexcept>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/uio.h>
 #include <unistd.h>
+#include <utility>
 
 using namespace std;
+using namespace std::chrono;
 
 template<typename T>
 T FileDescriptor::FDWrapper::CheckSystemCall( string_view s_attempt, T return_value ) const
@@ -30,66 +33,147 @@ T FileDescriptor::FDWrapper::CheckSystemCall( string_view s_attempt, T return_va
 template<typename T>
 T FileDescriptor::CheckSystemCall( std::string_view s_attempt, T return_value ) const
 {
-  if ( not internal_fd_ ) {
-    throw runtime_error( "internal error: missing internal_fd_" );
-  }
-  return internal_fd_->CheckSystemCall( s_attempt, return_value );
+  return wrapper().CheckSystemCall( s_attempt, return_value );
 }
 
-// fd is the file descriptor number returned by [open(2)](\ref man2::open) or similar
-FileDescriptor::FDWrapper::FDWrapper( int fd ) : fd_( fd )
+FileDescriptor::FDWrapper& FileDescriptor::FDTable::take( const int fd )
 {
   if ( fd < 0 ) {
     throw runtime_error( "invalid fd number:" + to_string( fd ) );
   }
+  if ( fd >= kChunks << kChunkBits ) {
+    throw runtime_error( "fd number too large for the descriptor table: " + to_string( fd ) );
+  }
 
-  const int flags = CheckSystemCall( "fcntl", fcntl( fd, F_GETFL ) ); // NOLINT(*-vararg)
-  non_blocking_ = flags & O_NONBLOCK;                                 // NOLINT(*-bitwise)
+  atomic<FDWrapper*>& chunk = chunks_.at( fd >> kChunkBits );
+  if ( not chunk.load( memory_order_acquire ) ) {
+    const lock_guard lock { growing_ };
+    if ( not chunk.load( memory_order_relaxed ) ) {
+      chunk.store( make_unique<FDWrapper[]>( 1 << kChunkBits ).release(), memory_order_release ); // never freed
+    }
+  }
+  return ( *this )[fd];
 }
 
-void FileDescriptor::FDWrapper::close()
+// The descriptor has been handed over, so if its FileDescriptor can't be made, it is closed before throwing
+[[noreturn]] static void close_and_rethrow( const int fd )
 {
-  CheckSystemCall( "close", ::close( fd_ ) );
-  eof_ = closed_ = true;
+  if ( fd >= 0 ) {
+    ::close( fd );
+  }
+  throw;
 }
 
-FileDescriptor::FDWrapper::~FDWrapper()
+static int status_flags_of( const int fd )
 {
   try {
-    if ( closed_ ) {
-      return;
+    return ::CheckSystemCall( "fcntl", fcntl( fd, F_GETFL ) ); // NOLINT(*-vararg)
+  } catch ( ... ) {
+    close_and_rethrow( fd );
+  }
+}
+
+FileDescriptor::FDWrapper& FileDescriptor::claim( const int fd )
+{
+  try {
+    FDWrapper& slot = table_.take( fd );
+    // the kernel only hands out a number that is not open, so an open slot means someone else closed it behind
+    // its FileDescriptor's back (or is wrapping a number it doesn't own)
+    if ( not slot.closed_.load( memory_order_acquire ) ) {
+      throw runtime_error( "FileDescriptor: fd " + to_string( fd ) + " already has a FileDescriptor" );
     }
-    close();
+    return slot;
+  } catch ( ... ) {
+    close_and_rethrow( fd );
+  }
+}
+
+// A descriptor's FileDescriptor starts a new generation of its slot (making any handles left from an earlier
+// descriptor with the same number stale)
+// fd is the file descriptor number returned by [open(2)](\ref man2::open) or similar
+FileDescriptor::FileDescriptor( int fd ) : FileDescriptor( fd, status_flags_of( fd ) ) {}
+
+FileDescriptor::FileDescriptor( int fd, int status_flags ) : slot_( &claim( fd ) )
+{
+  slot_->open( fd, status_flags );
+  generation_ = slot_->generation_.load( std::memory_order_relaxed );
+}
+
+// the closed flag is cleared last, so a handle that sees it cleared also sees the new generation (see release())
+void FileDescriptor::FDWrapper::open( const int fd, const int status_flags )
+{
+  fd_ = fd;
+  generation_.fetch_add( 1, memory_order_relaxed );
+  refs_ = 1;
+  eof_ = false;
+  non_blocking_ = status_flags & O_NONBLOCK; // NOLINT(*-bitwise)
+  read_count_ = write_count_ = 0;
+  reads_ = writes_ = {};
+  histograms_.reset();
+  tap_.reset();
+  closed_.store( false, memory_order_release );
+}
+
+// Another thread may reuse the number (and take the slot) as soon as close(2) is called, so everything written to
+// the slot is written first
+void FileDescriptor::FDWrapper::close()
+{
+  const int fd = fd_;
+  eof_ = true;
+  closed_.store( true, memory_order_release );
+  ::CheckSystemCall( "close", ::close( fd ) );
+}
+
+// What a stale or moved-from handle sees: a closed descriptor (on which every system call fails with EBADF)
+FileDescriptor::FDWrapper& FileDescriptor::stale_wrapper()
+{
+  thread_local FDWrapper stale;
+  stale.fd_ = -1;
+  stale.eof_ = true;
+  stale.closed_ = true;
+  stale.non_blocking_ = false;
+  stale.read_count_ = stale.write_count_ = 0;
+  stale.reads_ = stale.writes_ = {};
+  stale.histograms_.reset();
+  stale.tap_.reset();
+  return stale;
+}
+
+void FileDescriptor::close_last( FDWrapper& slot )
+{
+  try {
+    slot.close();
   } catch ( const exception& e ) {
     // don't throw an exception from the destructor
     cerr << "Exception destructing FDWrapper: " << e.what() << endl;
   }
 }
 
-// fd is the file descriptor number returned by [open(2)](\ref man2::open) or similar
-FileDescriptor::FileDescriptor( int fd ) : internal_fd_( make_shared<FDWrapper>( fd ) ) {}
-
-// Private constructor used by duplicate()
-FileDescriptor::FileDescriptor( shared_ptr<FDWrapper> other_shared_ptr ) : internal_fd_( move( other_shared_ptr ) )
+ReadBuffer::ReadBuffer( const size_t capacity )
+  : storage_( make_unique_for_overwrite<char[]>( capacity ) ), capacity_( capacity )
 {}
 
-// returns a copy of this FileDescriptor
-FileDescriptor FileDescriptor::duplicate() const
+// Reading into the scratch buffer and copying only the bytes read is cheaper than zero-filling (and then
+// shrinking) a kReadBufferSize string for every read
+ReadBuffer& FileDescriptor::scratch_buffer()
 {
-  return FileDescriptor { internal_fd_ };
+  thread_local ReadBuffer scratch { kReadBufferSize };
+  return scratch;
 }
 
 // buffer is the string to be read into
 void FileDescriptor::read( string& buffer )
 {
   if ( buffer.empty() ) {
-    buffer.clear();
-    buffer.resize( kReadBufferSize );
+    buffer.assign( read( scratch_buffer() ) );
+    return;
   }
 
+  const auto start = syscall_start();
   const ssize_t bytes_read = ::read( fd_num(), buffer.data(), buffer.size() );
+  account_read( bytes_read, buffer.size(), start );
   if ( bytes_read < 0 ) {
-    if ( internal_fd_->non_blocking_ and ( errno == EAGAIN or errno == EINPROGRESS ) ) {
+    if ( wrapper().non_blocking_ and ( errno == EAGAIN or errno == EINPROGRESS ) ) {
       return;
     }
     throw unix_error { "read" };
@@ -98,7 +182,7 @@ void FileDescriptor::read( string& buffer )
   register_read();
 
   if ( bytes_read == 0 ) {
-    internal_fd_->eof_ = true;
+    wrapper().eof_ = true;
   }
 
   if ( bytes_read > static_cast<ssize_t>( buffer.size() ) ) {
@@ -106,6 +190,46 @@ void FileDescriptor::read( string& buffer )
   }
 
   buffer.resize( bytes_read );
+  if ( const auto& tap = wrapper().tap_; tap and bytes_read > 0 ) {
+    const string_view data = buffer;
+    tap->on_read( { &data, 1 } );
+  }
+}
+
+size_t FileDescriptor::read( span<char> buffer )
+{
+  return read( buffer, buffer.size() );
+}
+
+size_t FileDescriptor::read( span<char> buffer, const size_t requested )
+{
+  const auto start = syscall_start();
+  const ssize_t bytes_read = ::read( fd_num(), buffer.data(), buffer.size() );
+  account_read( bytes_read, requested, start );
+  if ( bytes_read < 0 ) {
+    if ( wrapper().non_blocking_ and ( errno == EAGAIN or errno == EINPROGRESS ) ) {
+      return 0;
+    }
+    throw unix_error { "read" };
+  }
+
+  register_read();
+
+  if ( bytes_read == 0 and not buffer.empty() ) {
+    wrapper().eof_ = true;
+  }
+
+  if ( const auto& tap = wrapper().tap_; tap and bytes_read > 0 ) {
+    const string_view data { buffer.data(), static_cast<size_t>( bytes_read ) };
+    tap->on_read( { &data, 1 } );
+  }
+  return bytes_read;
+}
+
+string_view FileDescriptor::read( ReadBuffer& buffer, const size_t limit )
+{
+  const span<char> space = buffer.space().first( min( limit, buffer.capacity() ) );
+  return { space.data(), read( space, limit == numeric_limits<size_t>::max() ? 0 : space.size() ) };
 }
 
 void FileDescriptor::read( vector<string>& buffers )
@@ -114,20 +238,23 @@ void FileDescriptor::read( vector<string>& buffers )
     return;
   }
 
-  buffers.back().clear();
-  buffers.back().resize( kReadBufferSize );
-
+  // the last buffer is read through scratch space, then copied, so it need not be zero-filled to its full size
+  const span<char> scratch = scratch_buffer().space();
   vector<iovec> iovecs;
   iovecs.reserve( buffers.size() );
   size_t total_size = 0;
-  for ( const auto& x : buffers ) {
-    iovecs.push_back( { const_cast<char*>( x.data() ), x.size() } ); // NOLINT(*-const-cast)
-    total_size += x.size();
+  for ( auto it = buffers.begin(); it != buffers.end() - 1; ++it ) {
+    iovecs.push_back( { it->data(), it->size() } );
+    total_size += it->size();
   }
+  iovecs.push_back( { scratch.data(), scratch.size() } );
+  total_size += scratch.size();
 
+  const auto start = syscall_start();
   const ssize_t bytes_read = ::readv( fd_num(), iovecs.data(), static_cast<int>( iovecs.size() ) );
+  account_read( bytes_read, 0, start ); // the last buffer takes whatever is there
   if ( bytes_read < 0 ) {
-    if ( internal_fd_->non_blocking_ and ( errno == EAGAIN or errno == EINPROGRESS ) ) {
+    if ( wrapper().non_blocking_ and ( errno == EAGAIN or errno == EINPROGRESS ) ) {
       return;
     }
     throw unix_error { "read" };
@@ -140,14 +267,20 @@ void FileDescriptor::read( vector<string>& buffers )
   }
 
   size_t remaining_size = bytes_read;
-  for ( auto& buf : buffers ) {
-    if ( remaining_size >= buf.size() ) {
-      remaining_size -= buf.size();
+  for ( auto it = buffers.begin(); it != buffers.end() - 1; ++it ) {
+    if ( remaining_size >= it->size() ) {
+      remaining_size -= it->size();
     } else {
-      buf.resize( remaining_size );
+      it->resize( remaining_size );
       remaining_size = 0;
     }
   }
+  buffers.back().assign( scratch.data(), remaining_size );
+
+  if ( const auto& tap = wrapper().tap_; tap and bytes_read > 0 ) {
+    const vector<string_view> data { buffers.begin(), buffers.end() };
+    tap->on_read( data );
+  }
 }
 
 size_t FileDescriptor::write( string_view buffer )
@@ -175,8 +308,10 @@ size_t FileDescriptor::write( const vector<string_view>& buffers )
     total_size += x.size();
   }
 
-  const ssize_t bytes_written
-    = CheckSystemCall( "writev", ::writev( fd_num(), iovecs.data(), static_cast<int>( iovecs.size() ) ) );
+  const auto start = syscall_start();
+  const ssize_t result = ::writev( fd_num(), iovecs.data(), static_cast<int>( iovecs.size() ) );
+  account_write( result, total_size, start );
+  const ssize_t bytes_written = CheckSystemCall( "writev", result );
   register_write();
 
   if ( bytes_written == 0 and total_size != 0 ) {
@@ -187,9 +322,147 @@ size_t FileDescriptor::write( const vector<string_view>& buffers )
     throw runtime_error( "write wrote more than length of input buffer" );
   }
 
+  if ( const auto& tap = wrapper().tap_; tap and bytes_written > 0 ) {
+    vector<string_view> data;
+    size_t remaining = bytes_written;
+    for ( auto it = buffers.begin(); remaining > 0; ++it ) {
+      data.push_back( it->substr( 0, remaining ) );
+      remaining -= data.back().size();
+    }
+    tap->on_write( data );
+  }
   return bytes_written;
 }
 
+steady_clock::time_point FileDescriptor::syscall_start() const
+{
+  return wrapper().histograms_ ? steady_clock::now() : steady_clock::time_point {};
+}
+
+// a transfer's latency is recorded if either descriptor keeps histograms
+steady_clock::time_point FileDescriptor::transfer_start( const FileDescriptor& in ) const
+{
+  return wrapper().histograms_ or in.wrapper().histograms_ ? steady_clock::now() : steady_clock::time_point {};
+}
+
+static void account( IOCounters& counters,
+                     IOHistograms* histograms,
+                     const ssize_t result,
+                     const size_t requested,
+                     const steady_clock::time_point start )
+{
+  ++counters.syscalls;
+  if ( result < 0 ) {
+    counters.would_block += ( errno == EAGAIN );
+  } else {
+    counters.bytes += result;
+    counters.short_transfers += ( result > 0 and static_cast<size_t>( result ) < requested );
+  }
+
+  if ( histograms ) {
+    if ( start != steady_clock::time_point {} ) {
+      const int saved_errno = errno; // the caller still needs it
+      histograms->latency_ns.add( duration_cast<nanoseconds>( steady_clock::now() - start ).count() );
+      errno = saved_errno;
+    }
+    if ( result > 0 ) {
+      histograms->transfer_bytes.add( result );
+    }
+  }
+}
+
+void FileDescriptor::account_read( const ssize_t result,
+                                   const size_t requested,
+                                   const steady_clock::time_point start )
+{
+  FDWrapper& slot = wrapper();
+  account( slot.reads_, slot.histograms_.get(), result, requested, start );
+}
+
+void FileDescriptor::account_write( const ssize_t result,
+                                    const size_t requested,
+                                    const steady_clock::time_point start )
+{
+  FDWrapper& slot = wrapper();
+  account( slot.writes_, slot.histograms_.get(), result, requested, start );
+}
+
+IOStatistics FileDescriptor::statistics() const
+{
+  const FDWrapper& slot = wrapper();
+  IOStatistics stats { slot.reads_, slot.writes_ };
+  if ( slot.histograms_ ) {
+    stats.histograms = *slot.histograms_;
+  }
+  return stats;
+}
+
+void FileDescriptor::set_histograms( const bool enabled )
+{
+  FDWrapper& slot = wrapper();
+  if ( not enabled ) {
+    slot.histograms_.reset();
+  } else if ( not slot.histograms_ ) {
+    slot.histograms_ = make_unique<IOHistograms>();
+  }
+}
+
+// A transfer that would block on either descriptor moves nothing; one that reaches EOF on `in` sets its eof()
+size_t FileDescriptor::finish_transfer( string_view s_attempt,
+                                        FileDescriptor& in,
+                                        size_t count,
+                                        ssize_t moved,
+                                        steady_clock::time_point start )
+{
+  in.account_read( moved, count, start );
+  account_write( moved, count, start );
+
+  if ( moved < 0 ) {
+    if ( ( wrapper().non_blocking_ or in.wrapper().non_blocking_ ) and errno == EAGAIN ) {
+      return 0;
+    }
+    throw unix_error { s_attempt };
+  }
+
+  in.register_read();
+  register_write();
+
+  if ( moved == 0 and count != 0 ) {
+    in.set_eof();
+  }
+
+  if ( moved > static_cast<ssize_t>( count ) ) {
+    throw runtime_error( string { s_attempt } + " moved more than requested" );
+  }
+
+  return moved;
+}
+
+// moves from the current offset of `in`, and advances it
+size_t FileDescriptor::sendfile( FileDescriptor& in, size_t count )
+{
+  const auto start = transfer_start( in );
+  return finish_transfer( "sendfile", in, count, ::sendfile( fd_num(), in.fd_num(), nullptr, count ), start );
+}
+
+size_t FileDescriptor::splice( FileDescriptor& in, size_t count )
+{
+  // SPLICE_F_NONBLOCK only makes the pipe's side non-blocking; the other side blocks unless it's non-blocking
+  const bool non_blocking = wrapper().non_blocking_ or in.wrapper().non_blocking_;
+  const unsigned int flags = SPLICE_F_MOVE | ( non_blocking ? SPLICE_F_NONBLOCK : 0 ); // NOLINT(*-bitwise)
+  const auto start = transfer_start( in );
+  return finish_transfer(
+    "splice", in, count, ::splice( in.fd_num(), nullptr, fd_num(), nullptr, count, flags ), start );
+}
+
+// moves between the current offsets of both files, and advances them
+size_t FileDescriptor::copy_file_range( FileDescriptor& in, size_t count )
+{
+  const auto start = transfer_start( in );
+  const ssize_t moved = ::copy_file_range( in.fd_num(), nullptr, fd_num(), nullptr, count, 0 );
+  return finish_transfer( "copy_file_range", in, count, moved, start );
+}
+
 void FileDescriptor::set_blocking( bool blocking )
 {
   int flags = CheckSystemCall( "fcntl", fcntl( fd_num(), F_GETFL ) ); // NOLINT(*-vararg)
@@ -201,5 +474,17 @@ void FileDescriptor::set_blocking( bool blocking )
 
   CheckSystemCall( "fcntl", fcntl( fd_num(), F_SETFL, flags ) ); // NOLINT(*-vararg)
 
-  internal_fd_->non_blocking_ = not blocking;
+  wrapper().non_blocking_ = not blocking;
 }
+
+off_t FileDescriptor::size() const
+{
+  struct stat file_info
+  {};
+  CheckSystemCall( "fstat", fstat( fd_num(), &file_info ) );
+  return file_info.st_size;
+}
+
+// instantiated for the derived classes' system calls
+template int FileDescriptor::CheckSystemCall( string_view, int ) const;
+template ssize_t FileDescriptor::CheckSystemCall( string_view, ssize_t ) const;
@@ -1,81 +1,236 @@
 #pragma once
 
+#include "io_statistics.hh"
+
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
 #include <limits>
 #include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
+// Storage for reads that is allocated once, never zero-filled, and reused by every read into it
+class ReadBuffer
+{
+  std::unique_ptr<char[]> storage_;
+  size_t capacity_;
+
+public:
+  explicit ReadBuffer( size_t capacity );
+
+  std::span<char> space() const { return { storage_.get(), capacity_ }; } // the whole (uninitialized) buffer
+  size_t capacity() const { return capacity_; }
+};
+
+// Sees the bytes of every read() and write() of a FileDescriptor and its duplicates (see FileDescriptor::set_tap)
+class IOTap
+{
+public:
+  virtual void on_read( std::span<const std::string_view> data ) = 0;  // after a read of at least one byte
+  virtual void on_write( std::span<const std::string_view> data ) = 0; // the bytes a write actually wrote
+
+  IOTap() = default;
+  virtual ~IOTap() = default;
+  IOTap( const IOTap& other ) = delete;
+  IOTap& operator=( const IOTap& other ) = delete;
+  IOTap( IOTap&& other ) = delete;
+  IOTap& operator=( IOTap&& other ) = delete;
+};
+
 // A reference-counted handle to a file descriptor
+//
+// The state of every descriptor lives in a table indexed by descriptor number, so a FileDescriptor is only a
+// pointer to its slot and the slot's generation. Each time a new descriptor takes a slot, the slot's generation
+// goes up: a handle from an earlier generation (whose descriptor was closed, and whose number the kernel has since
+// reused) is stale, and reads as closed. Reference counts are not atomic: a descriptor and its duplicates must be
+// created and destroyed by one thread at a time (as their read and write counts always had to be). The slot's
+// generation and closed flag are atomic, because a descriptor on another thread may take over the slot as soon as
+// this one is closed: closing finishes with the slot before calling close(2), and a closed slot is never touched
+// again by the handles of its old generation.
 class FileDescriptor
 {
-  // FDWrapper: A handle on a kernel file descriptor.
-  // FileDescriptor objects contain a std::shared_ptr to a FDWrapper.
+  // FDWrapper: the state of a kernel file descriptor, in the table slot for its number
   class FDWrapper
   {
   public:
-    int fd_;                    // The file descriptor number returned by the kernel
-    bool eof_ = false;          // Flag indicating whether FDWrapper::fd_ is at EOF
-    bool closed_ = false;       // Flag indicating whether FDWrapper::fd_ has been closed
-    bool non_blocking_ = false; // Flag indicating whether FDWrapper::fd_ is non-blocking
-    unsigned read_count_ = 0;   // The number of times FDWrapper::fd_ has been read
-    unsigned write_count_ = 0;  // The numberof times FDWrapper::fd_ has been written
-
-    // Construct from a file descriptor number returned by the kernel
-    explicit FDWrapper( int fd );
-    // Closes the file descriptor upon destruction
-    ~FDWrapper();
-    // Calls [close(2)](\ref man2::close) on FDWrapper::fd_
+    int fd_ = -1;                                 // The file descriptor number returned by the kernel
+    std::atomic<uint32_t> generation_ = 0;        // Incremented each time a new descriptor takes this slot
+    uint32_t refs_ = 0;                           // The number of FileDescriptors (of this generation) using it
+    bool eof_ = false;                            // Flag indicating whether FDWrapper::fd_ is at EOF
+    std::atomic<bool> closed_ = true;             // Flag indicating whether FDWrapper::fd_ is closed (or unopened)
+    bool non_blocking_ = false;                   // Flag indicating whether FDWrapper::fd_ is non-blocking
+    uint64_t read_count_ = 0;                     // The number of times FDWrapper::fd_ has been read
+    uint64_t write_count_ = 0;                    // The numberof times FDWrapper::fd_ has been written
+    IOCounters reads_ {};                         // Telemetry of the system calls reading FDWrapper::fd_
+    IOCounters writes_ {};                        // Telemetry of the system calls writing FDWrapper::fd_
+    std::unique_ptr<IOHistograms> histograms_ {}; // Kept only if enabled with set_histograms()
+    std::shared_ptr<IOTap> tap_ {};               // Sees every read and write, if set with set_tap()
+
+    // Take the slot for a new file descriptor returned by the kernel, with its status flags (O_NONBLOCK etc.)
+    void open( int fd, int status_flags );
+    // Marks the slot closed, then calls [close(2)](\ref man2::close) on FDWrapper::fd_
     void close();
 
     template<typename T>
     T CheckSystemCall( std::string_view s_attempt, T return_value ) const;
+  };
+
+  // The slots, indexed by descriptor number. The table grows a chunk at a time, and chunks never move (or go
+  // away), so a slot stays put while other threads open descriptors.
+  class FDTable
+  {
+    static constexpr int kChunkBits = 12;
+    static constexpr int kChunks = 256; // enough for descriptor numbers below 2^20, Linux's default fs.nr_open
+
+    std::array<std::atomic<FDWrapper*>, kChunks> chunks_ {};
+    std::mutex growing_ {};
 
-    // An FDWrapper cannot be copied or moved
-    FDWrapper( const FDWrapper& other ) = delete;
-    FDWrapper& operator=( const FDWrapper& other ) = delete;
-    FDWrapper( FDWrapper&& other ) = delete;
-    FDWrapper& operator=( FDWrapper&& other ) = delete;
+  public:
+    // The slot for `fd`, growing the table if need be
+    FDWrapper& take( int fd );
+
+    // The slot for `fd`, which some FileDescriptor has already taken
+    FDWrapper& operator[]( int fd ) const
+    {
+      return chunks_[fd >> kChunkBits].load( std::memory_order_acquire )[fd & ( ( 1 << kChunkBits ) - 1 )];
+    }
   };
 
-  // A reference-counted handle to a shared FDWrapper
-  std::shared_ptr<FDWrapper> internal_fd_;
+  static FDTable table_;
+
+  FDWrapper* slot_ {};     // the slot in table_ (nullptr once moved from)
+  uint32_t generation_ {}; // the generation of the slot this handle refers to
+
+  // private constructor used to duplicate the FileDescriptor (the caller increases the reference count)
+  FileDescriptor( FDWrapper* slot, uint32_t generation ) : slot_( slot ), generation_( generation ) {}
+
+  // the slot, or (for a stale or moved-from handle) a closed placeholder
+  FDWrapper& wrapper() const
+  {
+    if ( slot_ and slot_->generation_.load( std::memory_order_relaxed ) == generation_ ) [[likely]] {
+      return *slot_;
+    }
+    return stale_wrapper();
+  }
+  static FDWrapper& stale_wrapper();
+
+  // The slot, if this handle's descriptor is still open in it. Once closed, the slot may belong to a new
+  // descriptor, whose references are not ours to count. Reading the closed flag first (with acquire) means a slot
+  // that has been taken over shows its new generation.
+  FDWrapper* open_slot() const
+  {
+    if ( not slot_ or slot_->closed_.load( std::memory_order_acquire )
+         or slot_->generation_.load( std::memory_order_relaxed ) != generation_ ) {
+      return nullptr;
+    }
+    return slot_;
+  }
+
+  // release this handle's reference, closing the descriptor if it was the last one
+  void release()
+  {
+    if ( FDWrapper* slot = open_slot(); slot and --slot->refs_ == 0 ) {
+      close_last( *slot );
+    }
+  }
+  static void close_last( FDWrapper& slot );
+
+  // The slot for a descriptor being handed to a new FileDescriptor (closing the descriptor if it can't be had)
+  static FDWrapper& claim( int fd );
 
-  // private constructor used to duplicate the FileDescriptor (increase the reference count)
-  explicit FileDescriptor( std::shared_ptr<FDWrapper> other_shared_ptr );
+  // Read into `buffer`, accounted as a read of `requested` bytes (0 if the caller asked for whatever is there)
+  size_t read( std::span<char> buffer, size_t requested );
 
 protected:
   // size of buffer to allocate for read()
   static constexpr size_t kReadBufferSize = 16384;
 
-  void set_eof() { internal_fd_->eof_ = true; }
-  void register_read() { ++internal_fd_->read_count_; }   // increment read count
-  void register_write() { ++internal_fd_->write_count_; } // increment write count
+  // per-thread scratch space of kReadBufferSize bytes, for reads that then copy out only the bytes read
+  static ReadBuffer& scratch_buffer();
+
+  void set_eof() { wrapper().eof_ = true; }
+  void register_read() { ++wrapper().read_count_; }   // increment read count
+  void register_write() { ++wrapper().write_count_; } // increment write count
 
   template<typename T>
   T CheckSystemCall( std::string_view s_attempt, T return_value ) const;
 
+  // When a read or write system call starts, for the latency histogram (the clock is only read if it's kept)
+  std::chrono::steady_clock::time_point syscall_start() const;
+
+  // When a transfer between this descriptor and `in` starts
+  std::chrono::steady_clock::time_point transfer_start( const FileDescriptor& in ) const;
+
+  // Account for a read or write system call that returned `result` when asked for `requested` bytes (errno is
+  // left unchanged). Reads that take whatever is there (into scratch space, a ReadBuffer without a limit, or a
+  // datagram's worth) pass 0, so they are never counted as short.
+  void account_read( ssize_t result, size_t requested, std::chrono::steady_clock::time_point start );
+  void account_write( ssize_t result, size_t requested, std::chrono::steady_clock::time_point start );
+
+  // Account for a kernel-side transfer of `moved` bytes (the return value of a system call) from `in`
+  size_t finish_transfer( std::string_view s_attempt,
+                          FileDescriptor& in,
+                          size_t count,
+                          ssize_t moved,
+                          std::chrono::steady_clock::time_point start );
+
 public:
-  // Construct from a file descriptor number returned by the kernel
+  // Construct from a file descriptor number returned by the kernel (which can't already have a FileDescriptor:
+  // throws if it does). The descriptor is handed over even if this throws: it is closed before the exception
+  // leaves the constructor.
   explicit FileDescriptor( int fd );
 
-  // Free the std::shared_ptr; the FDWrapper destructor calls close() when the refcount goes to zero.
-  ~FileDescriptor() = default;
+  // Construct from a descriptor whose status flags are already known (e.g. O_NONBLOCK, given to accept4() or
+  // socket()), saving the fcntl() that would ask the kernel for them; also closes the descriptor if it throws
+  FileDescriptor( int fd, int status_flags );
 
-  // Read into `buffer`
+  // Release the reference; the last FileDescriptor referring to an open descriptor closes it
+  ~FileDescriptor() { release(); }
+
+  // Read into `buffer`: up to its size, or if it's empty, up to kReadBufferSize (without zero-filling it first)
   void read( std::string& buffer );
   void read( std::vector<std::string>& buffers );
 
+  // Read at most `limit` bytes into a reusable buffer; returns the bytes read (valid until its next read)
+  std::string_view read( ReadBuffer& buffer, size_t limit = std::numeric_limits<size_t>::max() );
+
+  // Read into caller-provided memory; returns bytes read (0 at EOF, or if a non-blocking read would block)
+  size_t read( std::span<char> buffer );
+
   // Attempt to write a buffer
   // returns number of bytes written
   size_t write( std::string_view buffer );
   size_t write( const std::vector<std::string_view>& buffers );
   size_t write( const std::vector<std::string>& buffers );
 
-  // Close the underlying file descriptor
-  void close() { internal_fd_->close(); }
+  // Move up to `count` bytes from `in` to this descriptor inside the kernel, without copying them through user
+  // space; like read(), each returns the bytes moved, and 0 if a non-blocking descriptor would block or at EOF
+  size_t sendfile( FileDescriptor& in, size_t count );        // `in` is a regular file (e.g. served to a socket)
+  size_t splice( FileDescriptor& in, size_t count );          // `in` or this descriptor is a pipe (see SplicePipe)
+  size_t copy_file_range( FileDescriptor& in, size_t count ); // both are regular files
 
-  // Copy a FileDescriptor explicitly, increasing the FDWrapper refcount
-  FileDescriptor duplicate() const;
+  // Close the underlying file descriptor (throws, with EBADF, if it is already closed)
+  void close()
+  {
+    FDWrapper* slot = open_slot();
+    ( slot ? *slot : stale_wrapper() ).close();
+  }
+
+  // Copy a FileDescriptor explicitly, increasing the FDWrapper refcount (the copy of a stale handle is stale)
+  FileDescriptor duplicate() const
+  {
+    if ( FDWrapper* slot = open_slot() ) {
+      ++slot->refs_;
+    }
+    return { slot_, generation_ };
+  }
 
   // Set blocking(true) or non-blocking(false)
   void set_blocking( bool blocking );
@@ -84,16 +239,38 @@ public:
   off_t size() const;
 
   // FDWrapper accessors
-  int fd_num() const { return internal_fd_->fd_; }                        // underlying descriptor number
-  bool eof() const { return internal_fd_->eof_; }                         // EOF flag state
-  bool closed() const { return internal_fd_->closed_; }                   // closed flag state
-  unsigned int read_count() const { return internal_fd_->read_count_; }   // number of reads
-  unsigned int write_count() const { return internal_fd_->write_count_; } // number of writes
+  int fd_num() const { return wrapper().fd_; }                    // underlying descriptor number
+  bool eof() const { return wrapper().eof_; }                     // EOF flag state
+  bool closed() const { return wrapper().closed_; }               // closed flag state
+  uint64_t read_count() const { return wrapper().read_count_; }   // number of reads
+  uint64_t write_count() const { return wrapper().write_count_; } // number of writes
+
+  // Telemetry of the reads and writes of this descriptor (and its duplicates) so far
+  IOStatistics statistics() const;
+
+  // Keep (or stop keeping) histograms of the latency and size of every read and write
+  void set_histograms( bool enabled );
+
+  // Show the bytes of every read() and write() from now on, through this handle or any duplicate, to `tap` (or
+  // stop, given nullptr); transfers inside the kernel (sendfile() etc.) are not seen
+  void set_tap( std::shared_ptr<IOTap> tap ) { wrapper().tap_ = std::move( tap ); }
 
   // Copy/move constructor/assignment operators
   // FileDescriptor can be moved, but cannot be copied implicitly (see duplicate())
   FileDescriptor( const FileDescriptor& other ) = delete;            // copy construction is forbidden
   FileDescriptor& operator=( const FileDescriptor& other ) = delete; // copy assignment is forbidden
-  FileDescriptor( FileDescriptor&& other ) = default;                // move construction is allowed
-  FileDescriptor& operator=( FileDescriptor&& other ) = default;     // move assignment is allowed
+  FileDescriptor( FileDescriptor&& other ) noexcept                  // move construction is allowed
+    : slot_( std::exchange( other.slot_, nullptr ) ), generation_( other.generation_ )
+  {}
+  FileDescriptor& operator=( FileDescriptor&& other ) noexcept // move assignment is allowed
+  {
+    if ( this != &other ) {
+      release();
+      slot_ = std::exchange( other.slot_, nullptr );
+      generation_ = other.generation_;
+    }
+    return *this;
+  }
 };
+
+inline FileDescriptor::FDTable FileDescriptor::table_ {}; // constant-initialized, so usable by any static
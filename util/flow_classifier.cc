@@ -0,0 +1,191 @@
+#include "flow_classifier.hh"
+#include "random.hh"
+
+#include <bit>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+FlowKey FlowKey::from_datagram( const IPv4Datagram& dgram )
+{
+  static constexpr uint8_t PROTO_UDP = 17;
+
+  FlowKey key { dgram.header.src, dgram.header.dst, 0, 0, dgram.header.proto };
+
+  // only the first fragment of a TCP or UDP datagram carries the port numbers
+  if ( ( key.proto != IPv4Header::PROTO_TCP and key.proto != PROTO_UDP ) or dgram.header.offset != 0 ) {
+    return key;
+  }
+
+  array<uint8_t, 4> ports {};
+  size_t have = 0;
+  for ( const auto& buf : dgram.payload ) {
+    for ( size_t i = 0; i < buf.size() and have < ports.size(); ++i ) {
+      ports.at( have++ ) = buf[i];
+    }
+  }
+  if ( have == ports.size() ) {
+    key.src_port = ( ports[0] << 8 ) | ports[1];
+    key.dst_port = ( ports[2] << 8 ) | ports[3];
+  }
+  return key;
+}
+
+ToeplitzHash::ToeplitzHash( span<const uint8_t> key )
+{
+  if ( key.size() < INPUT_LENGTH + sizeof( uint32_t ) ) {
+    throw runtime_error( "ToeplitzHash key must be at least " + to_string( INPUT_LENGTH + 4 ) + " bytes" );
+  }
+
+  // the 32 key bits starting at bit `position` (counting from the most significant bit of key[0])
+  const auto window = [&]( const size_t position ) {
+    uint64_t bits = 0;
+    for ( size_t i = 0; i < 5; ++i ) {
+      const size_t index = position / 8 + i;
+      bits = ( bits << 8 ) | ( index < key.size() ? key[index] : 0 );
+    }
+    return static_cast<uint32_t>( bits >> ( 8 - position % 8 ) );
+  };
+
+  // each input bit that is set XORs in the key window starting at that bit
+  for ( size_t byte = 0; byte < INPUT_LENGTH; ++byte ) {
+    for ( size_t value = 0; value < 256; ++value ) {
+      uint32_t result = 0;
+      for ( size_t bit = 0; bit < 8; ++bit ) {
+        if ( value & ( 0x80U >> bit ) ) {
+          result ^= window( byte * 8 + bit );
+        }
+      }
+      table_.at( byte ).at( value ) = result;
+    }
+  }
+}
+
+uint32_t ToeplitzHash::operator()( const FlowKey& key ) const
+{
+  const array<uint32_t, 3> words { key.src, key.dst, ( uint32_t { key.src_port } << 16 ) | key.dst_port };
+
+  uint32_t result = 0;
+  for ( size_t word = 0; word < words.size(); ++word ) {
+    for ( size_t i = 0; i < 4; ++i ) {
+      result ^= table_[word * 4 + i][( words[word] >> ( 24 - 8 * i ) ) & 0xffU];
+    }
+  }
+  return result;
+}
+
+FlowTable::FlowTable( const size_t expected_flows )
+  : slots_( bit_ceil( max( expected_flows + expected_flows / 3, size_t { 16 } ) ) ), seed_( random_seed() )
+{}
+
+uint32_t FlowTable::hash( const FlowKey& key ) const
+{
+  const uint64_t addresses = ( static_cast<uint64_t>( key.src ) << 32 ) | key.dst;
+  const uint64_t ports = ( uint32_t { key.src_port } << 16 ) | key.dst_port;
+  const uint64_t rest = ( ports << 8 ) | key.proto;
+  return static_cast<uint32_t>( splitmix64( splitmix64( seed_ ^ addresses ) ^ rest ) );
+}
+
+const uint32_t* FlowTable::find( const FlowKey& key ) const
+{
+  const uint32_t hash = this->hash( key );
+  for ( size_t i = hash & mask();; i = ( i + 1 ) & mask() ) {
+    const Slot& slot = slots_[i];
+    if ( slot.value == EMPTY ) {
+      return nullptr;
+    }
+    if ( slot.hash == hash and slot.key == key ) {
+      return &slot.value;
+    }
+  }
+}
+
+void FlowTable::insert( const FlowKey& key, const uint32_t hash, const uint32_t value )
+{
+  if ( value == EMPTY ) {
+    throw runtime_error( "FlowTable::insert: reserved value" );
+  }
+
+  // keep the load factor at or below 3/4
+  if ( ( size_ + 1 ) * 4 > slots_.size() * 3 ) {
+    grow();
+  }
+
+  for ( size_t i = hash & mask();; i = ( i + 1 ) & mask() ) {
+    Slot& slot = slots_[i];
+    if ( slot.value == EMPTY ) {
+      slot = { key, hash, value };
+      ++size_;
+      return;
+    }
+    if ( slot.hash == hash and slot.key == key ) {
+      slot.value = value;
+      return;
+    }
+  }
+}
+
+bool FlowTable::erase( const FlowKey& key )
+{
+  const uint32_t hash = this->hash( key );
+  size_t i = hash & mask();
+  for ( ;; i = ( i + 1 ) & mask() ) {
+    const Slot& slot = slots_[i];
+    if ( slot.value == EMPTY ) {
+      return false;
+    }
+    if ( slot.hash == hash and slot.key == key ) {
+      break;
+    }
+  }
+
+  // shift back any later entries of the probe run that would otherwise become unreachable
+  for ( size_t j = ( i + 1 ) & mask(); slots_[j].value != EMPTY; j = ( j + 1 ) & mask() ) {
+    const size_t home = slots_[j].hash & mask();
+    const bool can_move = ( j > i ) ? ( home <= i or home > j ) : ( home <= i and home > j );
+    if ( can_move ) {
+      slots_[i] = slots_[j];
+      i = j;
+    }
+  }
+
+  slots_[i] = Slot {};
+  --size_;
+  return true;
+}
+
+void FlowTable::grow()
+{
+  vector<Slot> old_slots( slots_.size() * 2 );
+  swap( old_slots, slots_ );
+  size_ = 0;
+  for ( const auto& slot : old_slots ) {
+    if ( slot.value != EMPTY ) {
+      insert( slot.key, slot.hash, slot.value );
+    }
+  }
+}
+
+FlowClassifier::FlowClassifier( const size_t num_shards, const size_t expected_flows, span<const uint8_t> key )
+  : hash_( key ), flows_( expected_flows )
+{
+  if ( num_shards == 0 ) {
+    throw runtime_error( "FlowClassifier needs at least one shard" );
+  }
+
+  for ( size_t i = 0; i < indirection_.size(); ++i ) {
+    indirection_.at( i ) = i % num_shards;
+  }
+}
+
+uint32_t FlowClassifier::classify( const FlowKey& key )
+{
+  if ( const uint32_t* shard = flows_.find( key ) ) {
+    return *shard;
+  }
+
+  const uint32_t shard = indirection_[hash_( key ) % INDIRECTION_SIZE];
+  flows_.insert( key, shard );
+  return shard;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "ipv4_datagram.hh"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+//! The 5-tuple identifying a transport-layer flow
+struct FlowKey
+{
+  uint32_t src {};
+  uint32_t dst {};
+  uint16_t src_port {};
+  uint16_t dst_port {};
+  uint8_t proto {};
+
+  bool operator==( const FlowKey& other ) const = default;
+
+  //! Extract the 5-tuple from a datagram (ports are zero unless it is TCP or UDP and carries the port numbers)
+  static FlowKey from_datagram( const IPv4Datagram& dgram );
+};
+
+//! \brief The Toeplitz hash that NICs compute for receive-side scaling (RSS)
+//! \details Hashes (src, dst, src_port, dst_port) as RSS does for TCP and UDP over IPv4, so the result matches
+//! the hash a NIC reports for the same packet. The bit-serial definition is precomputed into one 256-entry
+//! table per input byte, so hashing costs twelve table lookups.
+class ToeplitzHash
+{
+  static constexpr size_t INPUT_LENGTH = 12;
+
+  std::array<std::array<uint32_t, 256>, INPUT_LENGTH> table_ {};
+
+public:
+  //! The key most NIC drivers use by default
+  static constexpr std::array<uint8_t, 40> DEFAULT_KEY
+    = { 0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2, 0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3,
+        0x8f, 0xb0, 0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4, 0x77, 0xcb, 0x2d, 0xa3,
+        0x80, 0x30, 0xf2, 0x0c, 0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa };
+
+  //! A key under which both directions of a connection hash to the same value
+  static constexpr std::array<uint8_t, 40> SYMMETRIC_KEY
+    = { 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+        0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a,
+        0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a, 0x6d, 0x5a };
+
+  //! \param[in] key is the secret key (at least 16 bytes)
+  explicit ToeplitzHash( std::span<const uint8_t> key = DEFAULT_KEY );
+
+  uint32_t operator()( const FlowKey& key ) const;
+};
+
+//! \brief Open-addressing hash table from flows to 32-bit values
+//! \details Slots hold the key, its hash and the value inline in one array and are probed linearly, so a lookup
+//! usually touches a single cache line. Erasing shifts later entries back rather than leaving tombstones.
+//!
+//! The table hashes keys itself, with a seed randomized for each table, rather than indexing by the Toeplitz
+//! hash: that is linear in the key's bits, and under a public key (SYMMETRIC_KEY even repeats every 16 bits) a
+//! peer can choose any number of flows that share one home slot.
+class FlowTable
+{
+  static constexpr uint32_t EMPTY = UINT32_MAX; // value marking an unused slot
+
+  struct Slot
+  {
+    FlowKey key {};
+    uint32_t hash {};
+    uint32_t value { EMPTY };
+  };
+
+  std::vector<Slot> slots_;
+  size_t size_ {};
+  uint64_t seed_;
+
+  size_t mask() const { return slots_.size() - 1; }
+  uint32_t hash( const FlowKey& key ) const;
+  void insert( const FlowKey& key, uint32_t hash, uint32_t value );
+  void grow();
+
+public:
+  //! \param[in] expected_flows is how many flows to make room for without rehashing
+  explicit FlowTable( size_t expected_flows = 1024 );
+
+  //! Pointer to the value stored for `key` (or nullptr)
+  const uint32_t* find( const FlowKey& key ) const;
+
+  //! Add or replace the value for `key` (`value` must not be UINT32_MAX)
+  void insert( const FlowKey& key, uint32_t value ) { insert( key, hash( key ), value ); }
+
+  //! Remove `key`; returns false if it was not present
+  bool erase( const FlowKey& key );
+
+  size_t size() const { return size_; }
+  size_t memory_usage() const { return slots_.capacity() * sizeof( Slot ); }
+};
+
+//! \brief Steers datagrams to worker shards, keeping every datagram of a flow on the same shard
+//! \details New flows are assigned a shard through an RSS-style indirection table indexed by the low bits of the
+//! Toeplitz hash, and the assignment is remembered in a FlowTable, so flows stay put even if the indirection
+//! table is later rebalanced. Only a flow's first datagram is Toeplitz-hashed.
+class FlowClassifier
+{
+  static constexpr size_t INDIRECTION_SIZE = 128;
+
+  ToeplitzHash hash_;
+  std::array<uint32_t, INDIRECTION_SIZE> indirection_ {};
+  FlowTable flows_;
+
+public:
+  FlowClassifier( size_t num_shards,
+                  size_t expected_flows,
+                  std::span<const uint8_t> key = ToeplitzHash::SYMMETRIC_KEY );
+
+  //! The shard for the datagram's flow
+  uint32_t classify( const IPv4Datagram& dgram ) { return classify( FlowKey::from_datagram( dgram ) ); }
+  uint32_t classify( const FlowKey& key );
+
+  //! Point part of the hash space at a different shard (affects only flows not seen before)
+  void set_indirection( size_t index, uint32_t shard ) { indirection_.at( index ) = shard; }
+
+  //! Forget a flow (e.g. once its connection has closed)
+  bool forget( const FlowKey& key ) { return flows_.erase( key ); }
+
+  const FlowTable& flows() const { return flows_; }
+};
@@ -0,0 +1,179 @@
+#include "fragment_reassembler.hh"
+#include "random.hh"
+
+#include <algorithm>
+#include <iterator>
+
+using namespace std;
+
+// largest payload an IPv4 datagram can carry (with no options in its header)
+static constexpr size_t MAX_PAYLOAD_LENGTH = UINT16_MAX - IPv4Header::LENGTH;
+
+size_t FragmentReassembler::KeyHash::operator()( const Key& key ) const
+{
+  const uint64_t addresses = ( static_cast<uint64_t>( key.src ) << 32 ) | key.dst;
+  const uint64_t rest = ( static_cast<uint64_t>( key.id ) << 8 ) | key.proto;
+  return splitmix64( splitmix64( seed ^ addresses ) ^ rest );
+}
+
+FragmentReassembler::FragmentReassembler( size_t datagram_memory_limit,
+                                          size_t total_memory_limit,
+                                          uint64_t timeout_ms )
+  : datagram_memory_limit_( datagram_memory_limit )
+  , total_memory_limit_( total_memory_limit )
+  , timeout_ms_( timeout_ms )
+  , partials_( 0, KeyHash { random_seed() } )
+{}
+
+void FragmentReassembler::erase( const Key& key )
+{
+  const auto it = partials_.find( key );
+  if ( it == partials_.end() ) {
+    return;
+  }
+
+  memory_ -= it->second.memory;
+  age_order_.erase( it->second.age_position );
+  partials_.erase( it );
+}
+
+// NOLINTBEGIN(*-cognitive-complexity)
+optional<IPv4Datagram> FragmentReassembler::push( IPv4Datagram dgram )
+{
+  const IPv4Header& header = dgram.header;
+  if ( not header.mf and header.offset == 0 ) {
+    return dgram; // not a fragment
+  }
+
+  // gather the fragment's payload into one buffer (normally it already is one) and trim any padding
+  string payload;
+  if ( dgram.payload.size() == 1 ) {
+    payload = move( dgram.payload.front() );
+  } else {
+    for ( const auto& buf : dgram.payload ) {
+      payload.append( buf );
+    }
+  }
+
+  const size_t offset = static_cast<size_t>( header.offset ) * 8;
+  if ( header.len < 4 * header.hlen or payload.size() < header.payload_length() ) {
+    ++fragments_dropped_; // truncated
+    return {};
+  }
+  payload.resize( header.payload_length() );
+
+  const size_t end = offset + payload.size();
+  if ( payload.empty() or end > MAX_PAYLOAD_LENGTH or ( header.mf and payload.size() % 8 ) ) {
+    ++fragments_dropped_; // malformed
+    return {};
+  }
+
+  const Key key { header.src, header.dst, header.id, header.proto };
+  auto [it, inserted] = partials_.try_emplace( key );
+  PartialDatagram& partial = it->second;
+  if ( inserted ) {
+    partial.deadline = now_ + timeout_ms_;
+    partial.age_position = age_order_.insert( age_order_.end(), key );
+  }
+
+  const auto drop_fragment = [&] {
+    ++fragments_dropped_;
+    if ( partial.fragments.empty() ) {
+      erase( key );
+    }
+    return optional<IPv4Datagram> {};
+  };
+
+  // the last fragment fixes the total length, which every other fragment must respect
+  size_t known_end = 0; // end of the highest fragment held so far
+  if ( not partial.fragments.empty() ) {
+    const auto& [last_offset, last_payload] = *partial.fragments.rbegin();
+    known_end = last_offset + last_payload.size();
+  }
+
+  // the reassembled datagram carries the first fragment's header, options and all, and its length must still
+  // fit in 16 bits: once both that header and a fragment ending past the limit are seen, it can never complete
+  const IPv4Header* first_header = offset == 0 ? &header : partial.first_header ? &*partial.first_header : nullptr;
+  if ( first_header and max( end, known_end ) > UINT16_MAX - 4 * size_t { first_header->hlen } ) {
+    ++fragments_dropped_;
+    erase( key );
+    return {};
+  }
+  if ( not header.mf ) {
+    if ( ( partial.total_length.has_value() and *partial.total_length != end ) or known_end > end ) {
+      return drop_fragment();
+    }
+  } else if ( partial.total_length.has_value() and end >= *partial.total_length ) {
+    return drop_fragment();
+  }
+
+  // reject fragments that overlap ones already held (an exact duplicate is simply ignored)
+  const auto next = partial.fragments.lower_bound( offset );
+  if ( next != partial.fragments.end() and next->first == offset and next->second.size() == payload.size() ) {
+    return {};
+  }
+  if ( ( next != partial.fragments.end() and next->first < end )
+       or ( next != partial.fragments.begin() and prev( next )->first + prev( next )->second.size() > offset ) ) {
+    return drop_fragment();
+  }
+
+  // a datagram that would exceed its own memory limit can never complete
+  const size_t cost = payload.capacity() + FRAGMENT_OVERHEAD;
+  if ( partial.memory + cost > datagram_memory_limit_ ) {
+    ++fragments_dropped_;
+    erase( key );
+    return {};
+  }
+
+  partial.payload_bytes += payload.size();
+  partial.memory += cost;
+  memory_ += cost;
+  partial.fragments.emplace_hint( next, offset, move( payload ) );
+  if ( offset == 0 ) {
+    partial.first_header = header;
+  }
+  if ( not header.mf ) {
+    partial.total_length = end;
+  }
+
+  // fragments never overlap, so the datagram is complete once the byte count reaches the total length
+  if ( partial.first_header.has_value() and partial.total_length.has_value()
+       and partial.payload_bytes == *partial.total_length ) {
+    IPv4Datagram result;
+    result.header = *partial.first_header;
+    result.header.mf = false;
+    result.header.offset = 0;
+    result.header.len = 4 * result.header.hlen + *partial.total_length;
+    result.header.compute_checksum();
+
+    result.payload.reserve( partial.fragments.size() );
+    for ( auto& [fragment_offset, buf] : partial.fragments ) {
+      result.payload.push_back( move( buf ) );
+    }
+
+    erase( key );
+    return result;
+  }
+
+  // stay within the total memory limit by evicting the oldest partial datagrams
+  while ( memory_ > total_memory_limit_ and not age_order_.empty() ) {
+    const Key oldest = age_order_.front();
+    erase( oldest );
+    ++datagrams_evicted_;
+  }
+
+  return {};
+}
+// NOLINTEND(*-cognitive-complexity)
+
+void FragmentReassembler::tick( const uint64_t ms_since_last_tick )
+{
+  now_ += ms_since_last_tick;
+
+  // partial datagrams all have the same timeout, so age order is also deadline order
+  while ( not age_order_.empty() and partials_.at( age_order_.front() ).deadline <= now_ ) {
+    const Key oldest = age_order_.front();
+    erase( oldest );
+    ++datagrams_expired_;
+  }
+}
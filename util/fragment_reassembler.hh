@@ -0,0 +1,88 @@
+#pragma once
+
+#include "ipv4_datagram.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+//! \brief Reassembles fragmented [IPv4](\ref rfc::rfc791) datagrams within bounded memory
+//! \details Partial datagrams are keyed on (src, dst, proto, id). Fragment payloads are moved in and handed
+//! back out as the reassembled datagram's payload buffers, so bytes are never copied, and each fragment costs
+//! O(log k) work: one lookup (which also finds any overlap) and insert in an ordered map of the k fragments its
+//! datagram holds. Memory is capped per datagram and in total (the oldest partial datagrams are evicted first),
+//! and partial datagrams expire after a timeout, so a fragment storm cannot exhaust memory.
+class FragmentReassembler
+{
+public:
+  struct Key
+  {
+    uint32_t src;
+    uint32_t dst;
+    uint16_t id;
+    uint8_t proto;
+
+    bool operator==( const Key& other ) const = default;
+  };
+
+  // bookkeeping charged against the memory limits for each stored fragment, on top of its payload
+  static constexpr size_t FRAGMENT_OVERHEAD = 128;
+
+private:
+  struct KeyHash
+  {
+    uint64_t seed; // randomized, so that peers cannot aim fragments at a single hash bucket
+    size_t operator()( const Key& key ) const;
+  };
+
+  struct PartialDatagram
+  {
+    std::optional<IPv4Header> first_header {};  // header of the fragment at offset 0
+    std::optional<size_t> total_length {};      // payload length, known once the last fragment arrives
+    std::map<size_t, std::string> fragments {}; // payload of each fragment, by byte offset
+    size_t payload_bytes {};                    // sum of the fragments' sizes
+    size_t memory {};                           // bytes charged against the limits
+    uint64_t deadline {};                       // time at which the partial datagram expires
+    std::list<Key>::iterator age_position {};   // position in age_order_
+  };
+
+  size_t datagram_memory_limit_;
+  size_t total_memory_limit_;
+  uint64_t timeout_ms_;
+
+  std::unordered_map<Key, PartialDatagram, KeyHash> partials_;
+  std::list<Key> age_order_ {}; // oldest partial datagram (the first to expire or be evicted) at the front
+  size_t memory_ {};
+  uint64_t now_ {};
+
+  uint64_t fragments_dropped_ {};
+  uint64_t datagrams_evicted_ {};
+  uint64_t datagrams_expired_ {};
+
+  void erase( const Key& key );
+
+public:
+  //! \param[in] datagram_memory_limit is the most memory one partial datagram may use
+  //! \param[in] total_memory_limit is the most memory all partial datagrams together may use
+  //! \param[in] timeout_ms is how long a partial datagram is kept waiting for its remaining fragments
+  explicit FragmentReassembler( size_t datagram_memory_limit = 128 * 1024,
+                                size_t total_memory_limit = 4 * 1024 * 1024,
+                                uint64_t timeout_ms = 30000 );
+
+  //! Accept a received datagram; returns it (reassembled if it was a fragment) once it is complete
+  std::optional<IPv4Datagram> push( IPv4Datagram dgram );
+
+  //! Advance time, expiring partial datagrams whose timeout has passed
+  void tick( uint64_t ms_since_last_tick );
+
+  size_t datagrams_pending() const { return partials_.size(); }
+  size_t memory_usage() const { return memory_; }
+
+  uint64_t fragments_dropped() const { return fragments_dropped_; } // malformed, overlapping or over limits
+  uint64_t datagrams_evicted() const { return datagrams_evicted_; } // to stay within the total memory limit
+  uint64_t datagrams_expired() const { return datagrams_expired_; } // timed out before completion
+};
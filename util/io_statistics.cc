@@ -0,0 +1,90 @@
+#include "io_statistics.hh"
+
+#include <cmath>
+#include <limits>
+#include <string_view>
+
+using namespace std;
+
+uint64_t Log2Histogram::count() const
+{
+  uint64_t total = 0;
+  for ( const auto n : buckets_ ) {
+    total += n;
+  }
+  return total;
+}
+
+uint64_t Log2Histogram::quantile_bound( const double fraction ) const
+{
+  const uint64_t total = count();
+  if ( total == 0 ) {
+    return 0;
+  }
+
+  const auto rank = static_cast<uint64_t>( ceil( fraction * static_cast<double>( total ) ) );
+  uint64_t seen = 0;
+  for ( size_t i = 0; i < buckets_.size(); ++i ) {
+    seen += buckets_[i]; // NOLINT(*-array-index)
+    if ( seen >= rank and seen > 0 ) {
+      return i == buckets_.size() - 1 ? numeric_limits<uint64_t>::max() : uint64_t { 1 } << i;
+    }
+  }
+  return numeric_limits<uint64_t>::max();
+}
+
+Log2Histogram& Log2Histogram::operator+=( const Log2Histogram& other )
+{
+  for ( size_t i = 0; i < buckets_.size(); ++i ) {
+    buckets_[i] += other.buckets_[i]; // NOLINT(*-array-index)
+  }
+  return *this;
+}
+
+IOCounters& IOCounters::operator+=( const IOCounters& other )
+{
+  syscalls += other.syscalls;
+  bytes += other.bytes;
+  would_block += other.would_block;
+  short_transfers += other.short_transfers;
+  return *this;
+}
+
+IOHistograms& IOHistograms::operator+=( const IOHistograms& other )
+{
+  latency_ns += other.latency_ns;
+  transfer_bytes += other.transfer_bytes;
+  return *this;
+}
+
+IOStatistics& IOStatistics::operator+=( const IOStatistics& other )
+{
+  reads += other.reads;
+  writes += other.writes;
+  if ( other.histograms ) {
+    if ( histograms ) {
+      *histograms += *other.histograms;
+    } else {
+      histograms = other.histograms;
+    }
+  }
+  return *this;
+}
+
+static void print( ostream& out, const string_view name, const IOCounters& counters )
+{
+  out << name << " " << counters.syscalls << " syscalls, " << counters.bytes << " bytes, " << counters.would_block
+      << " EAGAIN, " << counters.short_transfers << " short";
+}
+
+ostream& operator<<( ostream& out, const IOStatistics& stats )
+{
+  print( out, "reads", stats.reads );
+  print( out << "; ", "writes", stats.writes );
+  if ( stats.histograms ) {
+    const Log2Histogram& latency = stats.histograms->latency_ns;
+    out << "; latency p50 < " << latency.quantile_bound( 0.5 ) << " ns, p99 < " << latency.quantile_bound( 0.99 )
+        << " ns";
+  }
+  return out;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+
+//! \brief A histogram with a bucket per power of two
+//! \details Bucket 0 counts zeros, and bucket i counts values in [2^(i-1), 2^i), so adding a value is a single
+//! increment and any 64-bit value fits.
+class Log2Histogram
+{
+  std::array<uint64_t, 65> buckets_ {};
+
+public:
+  void add( uint64_t value ) { ++buckets_[std::bit_width( value )]; } // NOLINT(*-array-index)
+
+  uint64_t count() const;                                                //!< values added
+  uint64_t bucket( size_t index ) const { return buckets_.at( index ); } //!< values in bucket `index`
+
+  //! A bound the `fraction` quantile (e.g. 0.99) is below: the top of its bucket (0 if the histogram is empty)
+  uint64_t quantile_bound( double fraction ) const;
+
+  Log2Histogram& operator+=( const Log2Histogram& other );
+};
+
+//! Counts of the system calls reading (or writing) a descriptor
+struct IOCounters
+{
+  uint64_t syscalls {};        //!< system calls made, including those that failed or would have blocked
+  uint64_t bytes {};           //!< bytes moved
+  uint64_t would_block {};     //!< calls that returned EAGAIN (the peer or the network was not keeping up)
+  uint64_t short_transfers {}; //!< calls moving some bytes, but fewer than asked (writes, reads of a set length)
+
+  IOCounters& operator+=( const IOCounters& other );
+};
+
+//! Distributions of the system calls on a descriptor, kept only when enabled (they cost two clock reads per call)
+struct IOHistograms
+{
+  Log2Histogram latency_ns {};     //!< time spent in each system call, in nanoseconds
+  Log2Histogram transfer_bytes {}; //!< bytes moved by each system call that moved any
+
+  IOHistograms& operator+=( const IOHistograms& other );
+};
+
+//! \brief I/O telemetry of a descriptor (see FileDescriptor::statistics()), or the sum over several
+//! \details Many EAGAINs mean the descriptor is peer-bound; transfers that fill the buffer each time (few short
+//! transfers) mean it is buffer-bound; many syscalls moving few bytes each mean it is syscall-bound.
+struct IOStatistics
+{
+  IOCounters reads {};
+  IOCounters writes {};
+  std::optional<IOHistograms> histograms {}; //!< if any descriptor summed had them enabled
+
+  IOStatistics& operator+=( const IOStatistics& other );
+};
+
+//! One line: syscalls, bytes, EAGAINs and short transfers in each direction, and the latency quantiles if known
+std::ostream& operator<<( std::ostream& out, const IOStatistics& stats );
@@ -0,0 +1,389 @@
+#include "io_uring.hh"
+#include "exception.hh"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <utility>
+
+using namespace std;
+
+// Ring indices are shared with the kernel: it reads what we publish with a release store, and we read what it
+// publishes with an acquire load
+static unsigned load_acquire( unsigned* index )
+{
+  return atomic_ref<unsigned> { *index }.load( memory_order_acquire );
+}
+
+static void store_release( unsigned* index, const unsigned value )
+{
+  atomic_ref<unsigned> { *index }.store( value, memory_order_release );
+}
+
+static int io_uring_setup( const unsigned entries, io_uring_params& params )
+{
+  return static_cast<int>( syscall( __NR_io_uring_setup, entries, &params ) );
+}
+
+static int io_uring_register( const int fd, const unsigned opcode, const void* arg, const unsigned nr_args )
+{
+  return static_cast<int>( syscall( __NR_io_uring_register, fd, opcode, arg, nr_args ) );
+}
+
+static void* map_or_throw( const size_t length, const int fd, const off_t offset )
+{
+  const int flags = fd < 0 ? MAP_PRIVATE | MAP_ANONYMOUS : MAP_SHARED | MAP_POPULATE;
+  void* const address = mmap( nullptr, length, PROT_READ | PROT_WRITE, flags, fd, offset );
+  if ( address == MAP_FAILED ) {
+    throw unix_error { "mmap" };
+  }
+  return address;
+}
+
+IOUring::Mapping::~Mapping()
+{
+  if ( address_ ) {
+    munmap( address_, length_ );
+  }
+}
+
+IOUring::Mapping::Mapping( Mapping&& other ) noexcept
+  : address_( exchange( other.address_, nullptr ) ), length_( exchange( other.length_, 0 ) )
+{}
+
+IOUring::Mapping& IOUring::Mapping::operator=( Mapping&& other ) noexcept
+{
+  swap( address_, other.address_ );
+  swap( length_, other.length_ );
+  return *this;
+}
+
+struct IOUring::Setup
+{
+  int fd;
+  io_uring_params params;
+};
+
+// Create the ring, deferring completion work to io_uring_enter() where the kernel supports it, so completions
+// are processed in batches on our own thread rather than interrupting whatever it's doing
+IOUring::Setup IOUring::create_ring( const unsigned entries )
+{
+  Setup setup {};
+  setup.params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+  setup.fd = io_uring_setup( entries, setup.params );
+  if ( setup.fd < 0 and errno == EINVAL ) {
+    setup.params = {};
+    setup.fd = io_uring_setup( entries, setup.params );
+  }
+  CheckSystemCall( "io_uring_setup", setup.fd );
+  return setup;
+}
+
+IOUring::IOUring( const unsigned entries, const size_t num_buffers, const size_t buffer_size )
+  : IOUring( create_ring( entries ), num_buffers, buffer_size )
+{}
+
+IOUring::IOUring( const Setup& setup, const size_t num_buffers, const size_t buffer_size )
+  : ring_fd_( setup.fd ), buffer_size_( buffer_size )
+{
+  if ( num_buffers == 0 or num_buffers > 32768 or buffer_size == 0 or buffer_size > UINT32_MAX ) {
+    throw runtime_error( "IOUring: need 1 to 32768 buffers of a nonzero size" );
+  }
+  map_rings( setup );
+  register_buffers( num_buffers );
+}
+
+void IOUring::map_rings( const Setup& setup )
+{
+  const io_uring_params& params = setup.params;
+  const size_t sq_length = params.sq_off.array + params.sq_entries * sizeof( unsigned );
+  const size_t cq_length = params.cq_off.cqes + params.cq_entries * sizeof( io_uring_cqe );
+  const bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  const size_t rings_length = single_mmap ? max( sq_length, cq_length ) : sq_length;
+
+  rings_ = { map_or_throw( rings_length, ring_fd_.fd_num(), IORING_OFF_SQ_RING ), rings_length };
+  if ( not single_mmap ) {
+    cq_mapping_ = { map_or_throw( cq_length, ring_fd_.fd_num(), IORING_OFF_CQ_RING ), cq_length };
+  }
+  const size_t sqes_length = params.sq_entries * sizeof( io_uring_sqe );
+  sqe_mapping_ = { map_or_throw( sqes_length, ring_fd_.fd_num(), IORING_OFF_SQES ), sqes_length };
+
+  char* const sq = rings_.data();
+  char* const cq = single_mmap ? rings_.data() : cq_mapping_.data();
+  // NOLINTBEGIN(*-reinterpret-cast)
+  sq_head_ = reinterpret_cast<unsigned*>( sq + params.sq_off.head );
+  sq_tail_ = reinterpret_cast<unsigned*>( sq + params.sq_off.tail );
+  sq_array_ = reinterpret_cast<unsigned*>( sq + params.sq_off.array );
+  sq_mask_ = *reinterpret_cast<unsigned*>( sq + params.sq_off.ring_mask );
+  sqes_ = reinterpret_cast<io_uring_sqe*>( sqe_mapping_.data() );
+  cq_head_ = reinterpret_cast<unsigned*>( cq + params.cq_off.head );
+  cq_tail_ = reinterpret_cast<unsigned*>( cq + params.cq_off.tail );
+  cq_mask_ = *reinterpret_cast<unsigned*>( cq + params.cq_off.ring_mask );
+  cqes_ = reinterpret_cast<io_uring_cqe*>( cq + params.cq_off.cqes );
+  // NOLINTEND(*-reinterpret-cast)
+  sq_entries_ = params.sq_entries;
+  sq_queued_tail_ = *sq_tail_;
+}
+
+void IOUring::register_buffers( const size_t num_buffers )
+{
+  // the fixed buffers, registered once for every read and write
+  fixed_buffers_ = { map_or_throw( num_buffers * buffer_size_, -1, 0 ), num_buffers * buffer_size_ };
+  vector<iovec> iovecs( num_buffers );
+  for ( size_t i = 0; i < num_buffers; ++i ) {
+    iovecs[i] = { fixed_buffers_.data() + i * buffer_size_, buffer_size_ };
+    free_buffers_.push_back( static_cast<uint16_t>( num_buffers - 1 - i ) );
+  }
+  CheckSystemCall( "io_uring_register buffers",
+                   io_uring_register( ring_fd_.fd_num(),
+                                      IORING_REGISTER_BUFFERS,
+                                      iovecs.data(),
+                                      static_cast<unsigned>( num_buffers ) ) );
+
+  // the buffers the kernel picks from for multishot receives, in buffer group 0
+  const unsigned ring_entries = bit_ceil( static_cast<unsigned>( num_buffers ) );
+  const size_t ring_length = ring_entries * sizeof( io_uring_buf );
+  provided_ring_mapping_ = { map_or_throw( ring_length, -1, 0 ), ring_length };
+  // (indexed as an array of io_uring_buf, as io_uring_buf_ring::bufs is at the wrong offset when compiled as C++)
+  provided_ring_ = reinterpret_cast<io_uring_buf*>( provided_ring_mapping_.data() ); // NOLINT(*-cast)
+  provided_mask_ = ring_entries - 1;
+  provided_buffers_ = { map_or_throw( num_buffers * buffer_size_, -1, 0 ), num_buffers * buffer_size_ };
+
+  io_uring_buf_reg reg {};
+  reg.ring_addr = reinterpret_cast<uint64_t>( provided_ring_ ); // NOLINT(*-reinterpret-cast)
+  reg.ring_entries = ring_entries;
+  reg.bgid = 0;
+  CheckSystemCall( "io_uring_register pbuf_ring",
+                   io_uring_register( ring_fd_.fd_num(), IORING_REGISTER_PBUF_RING, &reg, 1 ) );
+  for ( size_t i = 0; i < num_buffers; ++i ) {
+    provide_buffer( static_cast<uint16_t>( i ) );
+  }
+}
+
+// Return a buffer to the provided-buffer ring
+void IOUring::provide_buffer( const uint16_t id )
+{
+  io_uring_buf& entry = provided_ring_[provided_tail_ & provided_mask_]; // NOLINT(*-array-index)
+  entry.addr = reinterpret_cast<uint64_t>( provided_buffers_.data() + id * buffer_size_ ); // NOLINT(*-cast)
+  entry.len = static_cast<uint32_t>( buffer_size_ );
+  entry.bid = id;
+  ++provided_tail_;
+  atomic_ref<uint16_t> { provided_ring_[0].resv }.store( provided_tail_, memory_order_release );
+}
+
+io_uring_sqe& IOUring::next_sqe( const uint32_t operation )
+{
+  if ( sq_queued_tail_ - load_acquire( sq_head_ ) == sq_entries_ ) {
+    submit(); // the queue is full
+  }
+  const unsigned index = sq_queued_tail_++ & sq_mask_;
+  io_uring_sqe& sqe = sqes_[index]; // NOLINT(*-pointer-arithmetic)
+  memset( &sqe, 0, sizeof( sqe ) );
+  sqe.user_data = operation;
+  sq_array_[index] = index; // NOLINT(*-pointer-arithmetic)
+  ++to_submit_;
+  return sqe;
+}
+
+uint32_t IOUring::new_operation( const Kind kind, const int fd )
+{
+  uint32_t id {};
+  if ( free_operations_.empty() ) {
+    id = static_cast<uint32_t>( operations_.size() );
+    operations_.emplace_back();
+  } else {
+    id = free_operations_.back();
+    free_operations_.pop_back();
+  }
+  Operation& op = operations_[id];
+  op.kind = kind;
+  op.fd = fd;
+  ++in_flight_;
+  return id;
+}
+
+void IOUring::finish( const uint32_t operation )
+{
+  Operation& op = operations_[operation];
+  if ( op.kind != Kind::Receive ) {
+    free_buffers_.push_back( op.buffer );
+  }
+  op.on_data = nullptr;
+  op.on_write = nullptr;
+  free_operations_.push_back( operation );
+  --in_flight_;
+}
+
+bool IOUring::read( const FileDescriptor& fd, DataCallback on_data )
+{
+  if ( free_buffers_.empty() ) {
+    return false;
+  }
+  const uint32_t id = new_operation( Kind::Read, fd.fd_num() );
+  Operation& op = operations_[id];
+  op.buffer = free_buffers_.back();
+  free_buffers_.pop_back();
+  op.on_data = move( on_data );
+
+  io_uring_sqe& sqe = next_sqe( id );
+  sqe.opcode = IORING_OP_READ_FIXED;
+  sqe.fd = fd.fd_num();
+  sqe.addr = reinterpret_cast<uint64_t>( fixed_buffers_.data() + op.buffer * buffer_size_ ); // NOLINT(*-cast)
+  sqe.len = static_cast<uint32_t>( buffer_size_ );
+  sqe.off = UINT64_MAX; // the current file position, or none for a pipe or socket
+  sqe.buf_index = op.buffer;
+  return true;
+}
+
+size_t IOUring::write( const FileDescriptor& fd, string_view data, WriteCallback on_written )
+{
+  if ( free_buffers_.empty() or data.empty() ) {
+    return 0;
+  }
+  data = data.substr( 0, buffer_size_ );
+  const uint32_t id = new_operation( Kind::Write, fd.fd_num() );
+  Operation& op = operations_[id];
+  op.buffer = free_buffers_.back();
+  free_buffers_.pop_back();
+  op.on_write = move( on_written );
+
+  char* const buffer = fixed_buffers_.data() + op.buffer * buffer_size_;
+  memcpy( buffer, data.data(), data.size() );
+
+  io_uring_sqe& sqe = next_sqe( id );
+  sqe.opcode = IORING_OP_WRITE_FIXED;
+  sqe.fd = fd.fd_num();
+  sqe.addr = reinterpret_cast<uint64_t>( buffer ); // NOLINT(*-reinterpret-cast)
+  sqe.len = static_cast<uint32_t>( data.size() );
+  sqe.off = UINT64_MAX;
+  sqe.buf_index = op.buffer;
+  return data.size();
+}
+
+void IOUring::receive( const FileDescriptor& socket, DataCallback on_data )
+{
+  const uint32_t id = new_operation( Kind::Receive, socket.fd_num() );
+  operations_[id].on_data = move( on_data );
+  queue_receive( id );
+}
+
+void IOUring::queue_receive( const uint32_t operation )
+{
+  io_uring_sqe& sqe = next_sqe( operation );
+  sqe.opcode = IORING_OP_RECV;
+  sqe.fd = operations_[operation].fd;
+  sqe.ioprio = IORING_RECV_MULTISHOT;
+  sqe.flags = IOSQE_BUFFER_SELECT;
+  sqe.buf_group = 0;
+}
+
+int IOUring::enter( const unsigned min_complete )
+{
+  while ( true ) {
+    ++syscalls_;
+    const long submitted = syscall(
+      __NR_io_uring_enter, ring_fd_.fd_num(), to_submit_, min_complete, IORING_ENTER_GETEVENTS, nullptr, 0 );
+    if ( submitted >= 0 ) {
+      to_submit_ -= static_cast<unsigned>( submitted );
+      return static_cast<int>( submitted );
+    }
+    if ( errno != EINTR ) {
+      throw unix_error { "io_uring_enter" };
+    }
+  }
+}
+
+size_t IOUring::submit()
+{
+  if ( to_submit_ == 0 ) {
+    return 0;
+  }
+  store_release( sq_tail_, sq_queued_tail_ );
+  return enter( 0 );
+}
+
+size_t IOUring::wait( const size_t min_completions )
+{
+  store_release( sq_tail_, sq_queued_tail_ );
+  const unsigned available = load_acquire( cq_tail_ ) - *cq_head_;
+  if ( to_submit_ > 0 or available < min_completions ) {
+    enter( static_cast<unsigned>( min_completions > available ? min_completions - available : 0 ) );
+  }
+  return reap();
+}
+
+// Run the callback of every completion in the queue
+// NOLINTBEGIN(*-cognitive-complexity)
+size_t IOUring::reap()
+{
+  size_t handled = 0;
+  unsigned head = *cq_head_;
+  while ( head != load_acquire( cq_tail_ ) ) {
+    const io_uring_cqe& cqe = cqes_[head & cq_mask_]; // NOLINT(*-pointer-arithmetic)
+    const auto id = static_cast<uint32_t>( cqe.user_data );
+    const int result = cqe.res;
+    const unsigned flags = cqe.flags;
+    store_release( cq_head_, ++head );
+    ++handled;
+
+    Operation& op = operations_[id];
+    switch ( op.kind ) {
+      case Kind::Read: {
+        if ( result < 0 ) {
+          finish( id );
+          throw unix_error { "io_uring read", -result };
+        }
+        // the buffer goes back to the pool only after the callback, which may queue more reads
+        op.on_data( { fixed_buffers_.data() + op.buffer * buffer_size_, static_cast<size_t>( result ) } );
+        finish( id );
+        break;
+      }
+
+      case Kind::Write: {
+        WriteCallback callback = move( op.on_write );
+        finish( id );
+        if ( result < 0 ) {
+          throw unix_error { "io_uring write", -result };
+        }
+        callback( static_cast<size_t>( result ) );
+        break;
+      }
+
+      case Kind::Receive: {
+        const bool more = flags & IORING_CQE_F_MORE;
+        if ( result == -ENOBUFS ) {
+          queue_receive( id ); // out of provided buffers: receive again once this batch has returned some
+          break;
+        }
+        if ( result < 0 ) {
+          finish( id );
+          throw unix_error { "io_uring recv", -result };
+        }
+
+        if ( flags & IORING_CQE_F_BUFFER ) {
+          const auto buffer_id = static_cast<uint16_t>( flags >> IORING_CQE_BUFFER_SHIFT );
+          op.on_data( { provided_buffers_.data() + buffer_id * buffer_size_, static_cast<size_t>( result ) } );
+          provide_buffer( buffer_id );
+        }
+
+        if ( result == 0 ) {
+          DataCallback callback = move( op.on_data );
+          finish( id );
+          callback( {} );
+        } else if ( not more ) {
+          queue_receive( id ); // the kernel ended the multishot receive early
+        }
+        break;
+      }
+    }
+  }
+  return handled;
+}
+// NOLINTEND(*-cognitive-complexity)
@@ -0,0 +1,156 @@
+#pragma once
+
+#include "file_descriptor.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+struct io_uring_buf;
+
+//! \brief Asynchronous reads and writes through an [io_uring](\ref man7::io_uring)
+//! \details Reads and writes on any number of descriptors are queued, then handed to the kernel together by one
+//! io_uring_enter() call that also collects the completions of earlier ones, so a busy relay makes one syscall
+//! per batch instead of a poll() plus a read() or write() per descriptor. Reads and writes use a pool of buffers
+//! registered with the kernel once (sparing it from pinning pages on every operation), and a socket can have a
+//! multishot receive armed that keeps filling buffers the kernel takes from a provided-buffer ring, without
+//! being resubmitted.
+//!
+//! Completion callbacks run inside wait() and may queue more operations. The data they are given is only valid
+//! during the callback (push it into a ByteStream, or copy it). The descriptors must stay open while their
+//! operations are in flight.
+class IOUring
+{
+public:
+  using DataCallback = std::function<void( std::string_view data )>; //!< empty data means EOF
+  using WriteCallback = std::function<void( size_t bytes_written )>;
+
+private:
+  // An mmap()ed region, unmapped on destruction
+  class Mapping
+  {
+    void* address_ {};
+    size_t length_ {};
+
+  public:
+    Mapping() = default;
+    Mapping( void* address, size_t length ) : address_( address ), length_( length ) {}
+    ~Mapping();
+
+    char* data() const { return static_cast<char*>( address_ ); }
+    size_t size() const { return length_; }
+
+    Mapping( Mapping&& other ) noexcept;
+    Mapping& operator=( Mapping&& other ) noexcept;
+    Mapping( const Mapping& other ) = delete;
+    Mapping& operator=( const Mapping& other ) = delete;
+  };
+
+  enum class Kind : uint8_t
+  {
+    Read,
+    Write,
+    Receive
+  };
+
+  struct Operation
+  {
+    Kind kind {};
+    int fd {};
+    uint16_t buffer {}; // the fixed buffer used by a read or write
+    DataCallback on_data {};
+    WriteCallback on_write {};
+  };
+
+  FileDescriptor ring_fd_;
+  Mapping rings_ {};
+  Mapping sqe_mapping_ {};
+  Mapping cq_mapping_ {}; // only on kernels without IORING_FEAT_SINGLE_MMAP
+
+  unsigned* sq_head_ {};
+  unsigned* sq_tail_ {};
+  unsigned* sq_array_ {};
+  unsigned sq_entries_ {};
+  unsigned sq_mask_ {};
+  io_uring_sqe* sqes_ {};
+  unsigned* cq_head_ {};
+  unsigned* cq_tail_ {};
+  unsigned cq_mask_ {};
+  io_uring_cqe* cqes_ {};
+
+  unsigned sq_queued_tail_ {}; // the submission queue tail, including entries not yet published
+  unsigned to_submit_ {};
+  uint64_t syscalls_ {};
+
+  size_t buffer_size_;
+  Mapping fixed_buffers_ {}; // registered with IORING_REGISTER_BUFFERS, for reads and writes
+  std::vector<uint16_t> free_buffers_ {};
+  Mapping provided_buffers_ {}; // handed out by the kernel to multishot receives
+  Mapping provided_ring_mapping_ {};
+  io_uring_buf* provided_ring_ {}; // the ring's entries (the first entry's last field is the ring's tail)
+  unsigned provided_mask_ {};
+  uint16_t provided_tail_ {};
+
+  std::deque<Operation> operations_ {}; // a deque, so callbacks can queue operations without moving others
+  std::vector<uint32_t> free_operations_ {};
+  size_t in_flight_ {};
+
+  struct Setup; // the ring's fd, and the layout the kernel chose for it
+  static Setup create_ring( unsigned entries );
+  IOUring( const Setup& setup, size_t num_buffers, size_t buffer_size );
+
+  void map_rings( const Setup& setup );
+  void register_buffers( size_t num_buffers );
+  io_uring_sqe& next_sqe( uint32_t operation );
+  uint32_t new_operation( Kind kind, int fd );
+  void finish( uint32_t operation );
+  void provide_buffer( uint16_t id );
+  void queue_receive( uint32_t operation );
+  int enter( unsigned min_complete );
+  size_t reap();
+
+public:
+  //! \param[in] entries is the submission queue size (the most operations queued between submissions)
+  //! \param[in] num_buffers is the number of fixed buffers, and of buffers provided for receives (at most 32768)
+  //! \param[in] buffer_size is the size of each buffer, and the most one read, write or receive will move
+  explicit IOUring( unsigned entries = 256, size_t num_buffers = 64, size_t buffer_size = 16384 );
+
+  //! \brief Queue a read into a free fixed buffer
+  //! \returns false (without queueing) if every fixed buffer is in use
+  bool read( const FileDescriptor& fd, DataCallback on_data );
+
+  //! \brief Queue a write of (a prefix of) `data`, copied into a free fixed buffer
+  //! \returns the number of bytes queued: at most the buffer size, or 0 if every fixed buffer is in use
+  //! (`on_written` gets the number actually written, which like write(2) may be fewer)
+  size_t write( const FileDescriptor& fd, std::string_view data, WriteCallback on_written );
+
+  //! \brief Arm a multishot receive on a socket: `on_data` is called for every chunk received, until EOF
+  //! \details If the provided buffers run out, the receive is re-armed once completions have returned some.
+  void receive( const FileDescriptor& socket, DataCallback on_data );
+
+  //! Hand every queued operation to the kernel; returns the number submitted
+  size_t submit();
+
+  //! \brief Submit queued operations, wait until at least `min_completions` have completed, and run the
+  //! callbacks of every completion available
+  //! \returns the number of completions handled
+  size_t wait( size_t min_completions = 1 );
+
+  size_t in_flight() const { return in_flight_; }              //!< operations submitted or queued, not finished
+  size_t free_buffers() const { return free_buffers_.size(); } //!< fixed buffers available to read or write
+  size_t buffer_size() const { return buffer_size_; }          //!< most bytes moved by one operation
+  uint64_t syscalls() const { return syscalls_; }              //!< io_uring_enter() calls made so far
+
+  //! Closes the ring (the kernel cancels operations still in flight) before releasing the buffers
+  ~IOUring() { ring_fd_.close(); }
+
+  IOUring( const IOUring& other ) = delete;
+  IOUring& operator=( const IOUring& other ) = delete;
+  IOUring( IOUring&& other ) = delete;
+  IOUring& operator=( IOUring&& other ) = delete;
+};
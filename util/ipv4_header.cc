@@ -53,30 +53,48 @@ void IPv4Header::parse( Parser& parser )
   }
 }
 
-// Serialize the IPv4Header (does not recompute the checksum)
-void IPv4Header::serialize( Serializer& serializer ) const
+// Emit the header fields, either with the stored checksum or with a placeholder for Serializer to back-patch
+static void serialize_fields( const IPv4Header& header, Serializer& serializer, const bool fill_checksum )
 {
   // consistency checks
-  if ( ver != 4 ) {
+  if ( header.ver != 4 ) {
     throw runtime_error( "wrong IP version" );
   }
 
-  const uint8_t first_byte = ( static_cast<uint32_t>( ver ) << 4 ) | ( hlen & 0xfU );
+  const uint8_t first_byte = ( static_cast<uint32_t>( header.ver ) << 4 ) | ( header.hlen & 0xfU );
   serializer.integer( first_byte ); // version and header length
-  serializer.integer( tos );
-  serializer.integer( len );
-  serializer.integer( id );
+  serializer.integer( header.tos );
+  serializer.integer( header.len );
+  serializer.integer( header.id );
 
-  const uint16_t fo_val = ( df ? 0x4000U : 0 ) | ( mf ? 0x2000U : 0 ) | ( offset & 0x1fffU );
+  const uint16_t fo_val = ( header.df ? 0x4000U : 0 ) | ( header.mf ? 0x2000U : 0 ) | ( header.offset & 0x1fffU );
   serializer.integer( fo_val );
 
-  serializer.integer( ttl );
-  serializer.integer( proto );
+  serializer.integer( header.ttl );
+  serializer.integer( header.proto );
 
-  serializer.integer( cksum );
+  if ( fill_checksum ) {
+    serializer.checksum_field();
+  } else {
+    serializer.integer( header.cksum );
+  }
 
-  serializer.integer( src );
-  serializer.integer( dst );
+  serializer.integer( header.src );
+  serializer.integer( header.dst );
+}
+
+// Serialize the IPv4Header (does not recompute the checksum)
+void IPv4Header::serialize( Serializer& serializer ) const
+{
+  serialize_fields( *this, serializer, false );
+}
+
+// Serialize the IPv4Header, computing the checksum over the bytes as they are emitted
+uint16_t IPv4Header::serialize_with_checksum( Serializer& serializer ) const
+{
+  serializer.begin_checksum();
+  serialize_fields( *this, serializer, true );
+  return serializer.end_checksum();
 }
 
 uint16_t IPv4Header::payload_length() const
@@ -106,14 +124,9 @@ uint32_t IPv4Header::pseudo_checksum() const
 
 void IPv4Header::compute_checksum()
 {
-  cksum = 0;
-  Serializer s;
-  serialize( s );
-
   // calculate checksum -- taken over header only
-  InternetChecksum check;
-  check.add( s.output() );
-  cksum = check.value();
+  Serializer s;
+  cksum = serialize_with_checksum( s );
 }
 
 std::string IPv4Header::to_string() const
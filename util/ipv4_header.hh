@@ -62,4 +62,7 @@ struct IPv4Header
 
   void parse( Parser& parser );
   void serialize( Serializer& serializer ) const;
+
+  // Serialize with a freshly computed checksum in one pass (ignores `cksum`); returns the checksum written
+  uint16_t serialize_with_checksum( Serializer& serializer ) const;
 };
@@ -0,0 +1,84 @@
+#include "ipv4_header_batch.hh"
+#include "ipv4_header.hh"
+
+#include <cstring>
+#include <endian.h>
+
+using namespace std;
+
+static constexpr size_t WORDS = IPv4Header::LENGTH / sizeof( uint32_t ); // 32-bit words in the fixed header
+
+template<typename Frame>
+void IPv4HeaderBatch::parse_frames( span<const Frame> frames )
+{
+  const size_t n = frames.size();
+
+  // stage the fixed part of each header into a dense array. Frames that are too short (including options)
+  // stay zeroed, so they fail the version check below. Options are summed here, as they are rare.
+  staging_.assign( n * WORDS, 0 );
+  options_sum_.assign( n, 0 );
+  for ( size_t i = 0; i < n; ++i ) {
+    const string_view frame { frames[i] };
+    if ( frame.size() < IPv4Header::LENGTH ) {
+      continue;
+    }
+
+    const size_t header_len = static_cast<size_t>( static_cast<uint8_t>( frame.front() ) & 0x0fU ) * 4;
+    if ( frame.size() < header_len ) {
+      continue;
+    }
+
+    memcpy( &staging_[i * WORDS], frame.data(), IPv4Header::LENGTH );
+    for ( size_t offset = IPv4Header::LENGTH; offset < header_len; offset += sizeof( uint32_t ) ) {
+      uint32_t word {};
+      memcpy( &word, frame.data() + offset, sizeof( word ) );
+      options_sum_[i] += be32toh( word );
+    }
+  }
+
+  src.resize( n );
+  dst.resize( n );
+  proto.resize( n );
+  hlen.resize( n );
+  len.resize( n );
+  valid.resize( n );
+
+  // validate and extract every column, without branches so the loop vectorizes across packets
+  for ( size_t i = 0; i < n; ++i ) {
+    const uint32_t* row = &staging_[i * WORDS];
+    const uint32_t w0 = be32toh( row[0] ); // version, header length, type of service, total length
+    const uint32_t w1 = be32toh( row[1] ); // identification, flags, fragment offset
+    const uint32_t w2 = be32toh( row[2] ); // time to live, protocol, checksum
+    const uint32_t w3 = be32toh( row[3] ); // source address
+    const uint32_t w4 = be32toh( row[4] ); // destination address
+
+    // sum every 16-bit word except the checksum itself (2^16 = 1 mod 2^16 - 1, so 32-bit words sum the same)
+    uint64_t sum = uint64_t { w0 } + w1 + ( w2 & 0xffff0000U ) + w3 + w4 + options_sum_[i];
+    sum = ( sum & 0xffffU ) + ( sum >> 16 );
+    sum = ( sum & 0xffffU ) + ( sum >> 16 );
+    sum = ( sum & 0xffffU ) + ( sum >> 16 );
+    const uint16_t expected_cksum = ~static_cast<uint16_t>( sum );
+
+    const uint32_t ver = w0 >> 28;
+    const uint32_t header_len = ( w0 >> 24 ) & 0x0fU;
+    const bool ok = ( ver == 4 ) & ( header_len >= 5 ) & ( expected_cksum == ( w2 & 0xffffU ) );
+    const uint32_t mask = -static_cast<uint32_t>( ok );
+
+    src[i] = w3 & mask;
+    dst[i] = w4 & mask;
+    proto[i] = ( w2 >> 16 ) & 0xffU & mask;
+    hlen[i] = header_len & mask;
+    len[i] = w0 & 0xffffU & mask;
+    valid[i] = ok;
+  }
+}
+
+void IPv4HeaderBatch::parse( span<const string> frames )
+{
+  parse_frames( frames );
+}
+
+void IPv4HeaderBatch::parse( span<const string_view> frames )
+{
+  parse_frames( frames );
+}
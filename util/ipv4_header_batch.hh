@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//! \brief IPv4 headers of a batch of raw datagrams, parsed into structure-of-arrays columns
+//! \details Applies the same version, header-length and checksum checks as IPv4Header::parse (with the checksum
+//! also covering any options), but a whole batch at a time: the fixed part of every header is staged into a
+//! dense array, and the checks then run as one branch-free loop that the compiler can vectorize across packets.
+class IPv4HeaderBatch
+{
+  std::vector<uint32_t> staging_ {};     // fixed 20-byte headers, as five 32-bit words each
+  std::vector<uint64_t> options_sum_ {}; // sum of each header's options (usually zero)
+
+  template<typename Frame>
+  void parse_frames( std::span<const Frame> frames );
+
+public:
+  // Columns, indexed by position in the batch (fields are zero where `valid` is 0)
+  std::vector<uint32_t> src {};  // source address
+  std::vector<uint32_t> dst {};  // destination address
+  std::vector<uint8_t> proto {}; // protocol field
+  std::vector<uint8_t> hlen {};  // header length (multiples of 32 bits)
+  std::vector<uint16_t> len {};  // total length of packet
+  std::vector<uint8_t> valid {}; // 1 if the header parsed and its checksum verified
+
+  //! Parse the headers of `frames`, replacing the previous contents of every column
+  void parse( std::span<const std::string> frames );
+  void parse( std::span<const std::string_view> frames );
+
+  size_t size() const { return valid.size(); }
+};
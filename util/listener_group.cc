@@ -0,0 +1,106 @@
+#include "listener_group.hh"
+#include "exception.hh"
+
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+
+using namespace std;
+
+ListenerGroup::ListenerGroup( const Address& address, const size_t num_listeners, const int backlog )
+{
+  if ( num_listeners == 0 ) {
+    throw runtime_error( "ListenerGroup needs at least one listener" );
+  }
+
+  workers_.reserve( num_listeners );
+  for ( size_t i = 0; i < num_listeners; ++i ) {
+    auto worker = make_unique<Worker>( TCPSocket {},
+                                       FileDescriptor { CheckSystemCall( "eventfd", eventfd( 0, EFD_CLOEXEC ) ) } );
+    worker->listener.set_reuseaddr();
+    worker->listener.set_reuseport();
+    worker->listener.bind( i == 0 ? address : local_address() );
+    worker->listener.listen( backlog );
+    worker->listener.set_blocking( false );
+    workers_.push_back( move( worker ) );
+  }
+}
+
+ListenerGroup::~ListenerGroup()
+{
+  try {
+    stop();
+  } catch ( const exception& e ) {
+    cerr << "Exception stopping ListenerGroup: " << e.what() << endl;
+  }
+}
+
+// A = the receiving CPU; A %= number of listeners; return A
+void ListenerGroup::steer_by_cpu()
+{
+  const vector<sock_filter> program {
+    { BPF_LD | BPF_W | BPF_ABS, 0, 0, static_cast<uint32_t>( SKF_AD_OFF + SKF_AD_CPU ) }, // NOLINT(*-bitwise)
+    { BPF_ALU | BPF_MOD | BPF_K, 0, 0, static_cast<uint32_t>( workers_.size() ) },         // NOLINT(*-bitwise)
+    { BPF_RET | BPF_A, 0, 0, 0 },                                                          // NOLINT(*-bitwise)
+  };
+  workers_.front()->listener.attach_reuseport_filter( program );
+  steer_by_cpu_ = true;
+}
+
+void ListenerGroup::start( const Handler& handler )
+{
+  for ( size_t i = 0; i < workers_.size(); ++i ) {
+    Worker& worker = *workers_[i];
+    if ( not worker.thread.joinable() ) {
+      worker.thread
+        = thread( [i, &worker, handler, pin = steer_by_cpu_] { run( i, worker, handler, pin ); } );
+    }
+  }
+}
+
+void ListenerGroup::stop()
+{
+  static constexpr uint64_t one = 1;
+  const string_view increment { reinterpret_cast<const char*>( &one ), sizeof( one ) }; // NOLINT(*-cast)
+
+  for ( auto& worker : workers_ ) {
+    if ( worker->thread.joinable() ) {
+      worker->wakeup.write( increment );
+      worker->thread.join();
+    }
+  }
+}
+
+void ListenerGroup::run( const size_t index, Worker& worker, const Handler& handler, const bool pin_to_cpu )
+{
+  try {
+    if ( pin_to_cpu and index < static_cast<size_t>( CPU_SETSIZE ) ) {
+      cpu_set_t cpus;
+      CPU_ZERO( &cpus );
+      CPU_SET( index, &cpus );
+      // a CPU the machine doesn't have just leaves the thread unpinned
+      pthread_setaffinity_np( pthread_self(), sizeof( cpus ), &cpus );
+    }
+
+    EventLoop loop;
+    bool running = true;
+
+    loop.add_rule( "listener " + to_string( index ), worker.listener, Direction::In, [&] {
+      while ( auto connection = worker.listener.accept_nonblocking() ) {
+        worker.accepted.fetch_add( 1, memory_order_relaxed );
+        handler( index, loop, move( *connection ) );
+      }
+    } );
+
+    loop.add_rule( "stop", worker.wakeup, Direction::In, [&] {
+      string counter;
+      worker.wakeup.read( counter );
+      running = false;
+    } );
+
+    while ( running and loop.wait_next_event( -1 ) != EventLoop::Result::Exit ) {}
+  } catch ( const exception& e ) {
+    cerr << "Exception on listener " << index << ": " << e.what() << endl;
+  }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "eventloop.hh"
+#include "socket.hh"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+//! \brief Several listening sockets bound to one address with SO_REUSEPORT, each accepting on its own thread and
+//! EventLoop
+//! \details The kernel spreads incoming connections among the listeners, so there is no single accepting thread
+//! to hand connections off from: each connection is accepted, and can be served, on the worker that got it.
+//! Connections are accepted non-blocking, with one accept4() each.
+class ListenerGroup
+{
+public:
+  //! \brief Called on a worker's own thread with each connection it accepts
+  //! \details `loop` is the worker's EventLoop, to add rules for the connection to.
+  using Handler = std::function<void( size_t listener_index, EventLoop& loop, TCPSocket connection )>;
+
+private:
+  struct Worker
+  {
+    TCPSocket listener;
+    FileDescriptor wakeup; // eventfd that tells the thread to stop
+    std::thread thread {};
+    std::atomic<uint64_t> accepted {};
+  };
+
+  std::vector<std::unique_ptr<Worker>> workers_ {};
+  bool steer_by_cpu_ = false;
+
+  static void run( size_t index, Worker& worker, const Handler& handler, bool pin_to_cpu );
+
+public:
+  //! Bind `num_listeners` non-blocking listeners to `address` (if its port is 0, they all share the port the
+  //! first one is given)
+  ListenerGroup( const Address& address, size_t num_listeners, int backlog = 1024 );
+
+  //! Stops the threads, if they are running
+  ~ListenerGroup();
+
+  size_t size() const { return workers_.size(); }
+  TCPSocket& listener( size_t index ) { return workers_.at( index )->listener; }
+  Address local_address() const { return workers_.front()->listener.local_address(); }
+
+  //! Connections accepted by a listener so far
+  uint64_t accepted( size_t index ) const { return workers_.at( index )->accepted.load(); }
+
+  //! \brief Give each connection to the listener whose index is the CPU that received it (modulo the number of
+  //! listeners), with a classic BPF program, and pin each worker's thread to that CPU when it starts
+  //! \details The connection is then accepted and served on the core whose cache already holds its state.
+  void steer_by_cpu();
+
+  //! Start one thread per listener, each calling `handler` from its own EventLoop
+  void start( const Handler& handler );
+
+  //! Stop and join the threads (the listeners stay open)
+  void stop();
+
+  ListenerGroup( const ListenerGroup& other ) = delete;
+  ListenerGroup& operator=( const ListenerGroup& other ) = delete;
+  ListenerGroup( ListenerGroup&& other ) = delete;
+  ListenerGroup& operator=( ListenerGroup&& other ) = delete;
+};
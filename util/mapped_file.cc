@@ -0,0 +1,79 @@
+#include "mapped_file.hh"
+#include "exception.hh"
+
+#include <algorithm>
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace std;
+
+static size_t page_size()
+{
+  static const auto size = static_cast<size_t>( sysconf( _SC_PAGESIZE ) );
+  return size;
+}
+
+MappedFile::MappedFile( FileDescriptor file, const Options& options )
+  : file_( move( file ) ), size_( file_.size() ), options_( options )
+{
+  const size_t page = page_size();
+  options_.window_size = max( page, ( options_.window_size + page - 1 ) / page * page );
+}
+
+void MappedFile::unmap_window()
+{
+  if ( window_ ) {
+    munmap( window_, window_length_ );
+    window_ = nullptr;
+    window_length_ = 0;
+  }
+}
+
+// the window starts at the page holding `offset`
+void MappedFile::map_window( const uint64_t offset )
+{
+  unmap_window();
+
+  const uint64_t start = offset / page_size() * page_size();
+  const size_t length = min<uint64_t>( options_.window_size, size_ - start );
+  const int flags = MAP_SHARED | ( options_.prefault ? MAP_POPULATE : 0 ); // NOLINT(*-bitwise)
+  void* const address = mmap( nullptr, length, PROT_READ, flags, file_.fd_num(), static_cast<off_t>( start ) );
+  if ( address == MAP_FAILED ) {
+    throw unix_error { "mmap" };
+  }
+
+  window_ = static_cast<char*>( address );
+  window_offset_ = start;
+  window_length_ = length;
+  ++remaps_;
+
+  // both are only hints: a kernel or filesystem without support for one makes it fail, and nothing changes
+  if ( options_.sequential ) {
+    madvise( window_, window_length_, MADV_SEQUENTIAL );
+  }
+  if ( options_.huge_pages ) {
+    madvise( window_, window_length_, MADV_HUGEPAGE );
+  }
+}
+
+string_view MappedFile::view( const uint64_t offset, const size_t length )
+{
+  if ( offset >= size_ or length == 0 ) {
+    return {};
+  }
+
+  // a window starting at the page holding `offset` would hold this much of the view
+  const uint64_t wanted = min<uint64_t>( { length, options_.window_size - page_size(), size_ - offset } );
+  if ( not window_ or offset < window_offset_ or offset + wanted > window_offset_ + window_length_ ) {
+    map_window( offset );
+  }
+
+  const size_t start = offset - window_offset_;
+  return { window_ + start, min( length, window_length_ - start ) }; // NOLINT(*-pointer-arithmetic)
+}
+
+size_t MappedFile::write( FileDescriptor& out, const uint64_t offset, const size_t count )
+{
+  const string_view data = view( offset, count );
+  return data.empty() ? 0 : out.write( data );
+}
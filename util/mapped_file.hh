@@ -0,0 +1,65 @@
+#pragma once
+
+#include "file_descriptor.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+
+//! \brief Read-only access to a file through [mmap(2)](\ref man2::mmap), one sliding window at a time
+//! \details Views are taken straight from the page cache, so serving a file costs no read() calls and no copy
+//! into a user-space buffer: a view can be written to a socket as it is, or pushed into a ByteStream with a
+//! single copy. Only a window of the file is mapped at once, and asking for bytes outside it moves the window,
+//! so files larger than is comfortable to map whole work too.
+class MappedFile
+{
+public:
+  struct Options
+  {
+    size_t window_size = size_t { 64 } << 20; //!< bytes mapped at once (rounded up to whole pages)
+    bool sequential = true;                   //!< read ahead aggressively (MADV_SEQUENTIAL)
+    bool huge_pages = false;                  //!< ask for transparent huge pages (MADV_HUGEPAGE)
+    bool prefault = false;                    //!< fault in each window as it's mapped (MAP_POPULATE)
+  };
+
+private:
+  FileDescriptor file_;
+  uint64_t size_;
+  Options options_;
+
+  char* window_ {};           // the current mapping, or nullptr
+  uint64_t window_offset_ {}; // offset in the file of the start of the window (a multiple of the page size)
+  size_t window_length_ {};
+  uint64_t remaps_ {};
+
+  void map_window( uint64_t offset );
+  void unmap_window();
+
+public:
+  //! Map a regular file (opened for reading) of the size it has now
+  explicit MappedFile( FileDescriptor file, const Options& options );
+  explicit MappedFile( FileDescriptor file ) : MappedFile( std::move( file ), Options {} ) {}
+
+  ~MappedFile() { unmap_window(); }
+
+  //! \brief Up to `length` bytes starting at `offset`
+  //! \details The view stops early at the end of the file, or at the end of the window, but is always at least
+  //! min(`length`, window_size minus a page) long unless the file ends first: if the current window holds less,
+  //! it moves to start at the page holding `offset`. The view stays valid until the window moves, or the
+  //! MappedFile is destroyed.
+  std::string_view view( uint64_t offset, size_t length );
+
+  //! Write up to `count` bytes starting at `offset` to `out`, straight from the mapping; returns bytes written
+  size_t write( FileDescriptor& out, uint64_t offset, size_t count );
+
+  uint64_t size() const { return size_; }                     //!< bytes in the file
+  size_t window_size() const { return options_.window_size; } //!< bytes mapped at once
+  uint64_t remaps() const { return remaps_; }                 //!< windows mapped so far
+
+  // views refer into the mapping
+  MappedFile( const MappedFile& other ) = delete;
+  MappedFile& operator=( const MappedFile& other ) = delete;
+  MappedFile( MappedFile&& other ) = delete;
+  MappedFile& operator=( MappedFile&& other ) = delete;
+};
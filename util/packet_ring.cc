@@ -0,0 +1,37 @@
+#include "packet_ring.hh"
+
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+PacketRing::PacketRing( const size_t num_slots, const size_t slot_size )
+  : slot_size_( slot_size )
+  , num_slots_( num_slots )
+  , storage_( make_unique_for_overwrite<char[]>( num_slots * slot_size ) )
+  , lengths_( num_slots )
+{
+  if ( num_slots == 0 or slot_size == 0 ) {
+    throw runtime_error( "PacketRing: needs at least one slot of at least one byte" );
+  }
+  batch_.reserve( num_slots );
+}
+
+string_view PacketRing::frame( const size_t index ) const
+{
+  if ( index >= in_use() ) {
+    throw out_of_range( "PacketRing::frame: index " + to_string( index ) + " but only "
+                        + to_string( in_use() ) + " frames in use" );
+  }
+  const size_t sequence = tail_ + index;
+  const size_t position = sequence % num_slots_;
+  return { storage_.get() + position * slot_size_, lengths_[position] };
+}
+
+void PacketRing::release( const size_t count )
+{
+  if ( count > in_use() ) {
+    throw runtime_error( "PacketRing::release: releasing more frames than are in use" );
+  }
+  tail_ += count;
+}
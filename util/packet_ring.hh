@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+
+//! \brief A preallocated ring of fixed-size packet slots, filled a batch at a time from a packet fd
+//! \details receive() drains frames from a non-blocking TUN/TAP (or other datagram) fd straight into free slots
+//! and hands them back as views in one call, so receiving costs one read() per frame but no allocation or
+//! zero-filling. Slots stay valid until released, in the order they were received, so frames can be held by
+//! downstream stages (reassembly, queueing) while later batches arrive.
+class PacketRing
+{
+  size_t slot_size_;
+  size_t num_slots_;
+  std::unique_ptr<char[]> storage_; // left uninitialized: each slot is only ever read after a read() fills it
+  std::vector<size_t> lengths_;
+  std::vector<std::string_view> batch_ {};
+
+  size_t head_ = 0; // total frames received
+  size_t tail_ = 0; // total frames released
+
+  char* slot( size_t sequence ) { return storage_.get() + ( sequence % num_slots_ ) * slot_size_; }
+
+public:
+  //! \param[in] num_slots is the most frames that can be held at once
+  //! \param[in] slot_size is the largest frame (longer frames are truncated by the read)
+  explicit PacketRing( size_t num_slots, size_t slot_size = 65536 );
+
+  //! \brief Read up to `max_frames` frames from `fd` into free slots
+  //! \details Stops when the fd has nothing more to read (or is at EOF), or when every slot is in use. The fd
+  //! should be non-blocking; a blocking fd will wait for the first frame and then for each following one.
+  //! \returns views of the new frames, valid until they are released (the span itself until the next receive)
+  template<class FD>
+  std::span<const std::string_view> receive( FD& fd, size_t max_frames = std::numeric_limits<size_t>::max() );
+
+  //! The `index`th oldest frame not yet released
+  std::string_view frame( size_t index ) const;
+
+  //! Return the `count` oldest frames' slots to the ring
+  void release( size_t count );
+
+  size_t in_use() const { return head_ - tail_; }
+  size_t available() const { return num_slots_ - in_use(); }
+  size_t capacity() const { return num_slots_; }
+  size_t slot_size() const { return slot_size_; }
+};
+
+template<class FD>
+std::span<const std::string_view> PacketRing::receive( FD& fd, const size_t max_frames )
+{
+  batch_.clear();
+  while ( batch_.size() < max_frames and available() > 0 ) {
+    char* const buffer = slot( head_ );
+    const size_t length = fd.read( std::span<char> { buffer, slot_size_ } );
+    if ( length == 0 ) {
+      break; // would block, or EOF
+    }
+    lengths_[head_ % num_slots_] = length;
+    batch_.emplace_back( buffer, length );
+    ++head_;
+  }
+  return batch_;
+}
@@ -1,15 +1,19 @@
 #pragma once
 
+#include "checksum.hh"
+
 #include <algorithm>
 #include <concepts>
 #include <cstdint>
 #include <cstring>
 #include <deque>
 #include <numeric>
+#include <optional>
 #include <span>
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
 class Parser
@@ -174,6 +178,10 @@ class Serializer
   std::vector<std::string> output_ {};
   std::string buffer_ {};
 
+  // running checksum of the bytes emitted since begin_checksum(), and where to back-patch it
+  std::optional<InternetChecksum> checksum_ {};
+  std::optional<std::pair<size_t, size_t>> checksum_field_ {}; // (index into output_, offset within it)
+
 public:
   Serializer() = default;
   explicit Serializer( std::string&& buffer ) : buffer_( std::move( buffer ) ) {}
@@ -187,10 +195,17 @@ public:
       const uint8_t byte_val = val >> ( ( len - i - 1 ) * 8 );
       buffer_.push_back( byte_val );
     }
+
+    if ( checksum_.has_value() ) {
+      checksum_->add( std::string_view { buffer_ }.substr( buffer_.size() - len ) );
+    }
   }
 
   void buffer( std::string buf )
   {
+    if ( checksum_.has_value() ) {
+      checksum_->add( buf );
+    }
     flush();
     output_.push_back( std::move( buf ) );
   }
@@ -202,6 +217,41 @@ public:
     }
   }
 
+  // Start summing every byte emitted from now on (optionally seeded, e.g. with a pseudo-header's sum)
+  void begin_checksum( const uint32_t initial_sum = 0 )
+  {
+    checksum_.emplace( initial_sum );
+    checksum_field_.reset();
+  }
+
+  // Emit a 16-bit checksum field (as zero) whose value will be filled in by end_checksum()
+  void checksum_field()
+  {
+    checksum_field_.emplace( output_.size(), buffer_.size() );
+    integer( uint16_t {} );
+  }
+
+  // Stop summing, back-patch the checksum field (if any), and return the checksum
+  uint16_t end_checksum()
+  {
+    if ( not checksum_.has_value() ) {
+      throw std::runtime_error( "Serializer::end_checksum() without begin_checksum()" );
+    }
+
+    const uint16_t value = checksum_->value();
+    checksum_.reset();
+
+    if ( checksum_field_.has_value() ) {
+      const auto [index, offset] = *checksum_field_;
+      std::string& target = index == output_.size() ? buffer_ : output_.at( index );
+      target.at( offset ) = static_cast<char>( value >> 8 );
+      target.at( offset + 1 ) = static_cast<char>( value & 0xff );
+      checksum_field_.reset();
+    }
+
+    return value;
+  }
+
   void flush()
   {
     output_.emplace_back( std::move( buffer_ ) );
@@ -0,0 +1,254 @@
+#include "pcap_reader.hh"
+
+#include <byteswap.h>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+static constexpr uint32_t PCAP_MAGIC_MICROSECONDS = 0xa1b2c3d4;
+static constexpr uint32_t PCAP_MAGIC_NANOSECONDS = 0xa1b23c4d;
+static constexpr uint32_t PCAPNG_SECTION_HEADER_BLOCK = 0x0a0d0d0a;
+static constexpr uint32_t PCAPNG_BYTE_ORDER_MAGIC = 0x1a2b3c4d;
+static constexpr uint32_t PCAPNG_INTERFACE_DESCRIPTION_BLOCK = 1;
+static constexpr uint32_t PCAPNG_SIMPLE_PACKET_BLOCK = 3;
+static constexpr uint32_t PCAPNG_ENHANCED_PACKET_BLOCK = 6;
+static constexpr uint16_t PCAPNG_OPT_ENDOFOPT = 0;
+static constexpr uint16_t PCAPNG_OPT_IF_TSRESOL = 9;
+
+// Reads integers from a capture written in either byte order
+class FieldReader
+{
+  string_view data_;
+  bool swapped_;
+
+  void check( const size_t offset, const size_t length ) const
+  {
+    if ( offset > data_.size() or data_.size() - offset < length ) {
+      throw runtime_error( "PcapReader: truncated capture" );
+    }
+  }
+
+public:
+  FieldReader( string_view data, bool swapped ) : data_( data ), swapped_( swapped ) {}
+
+  uint16_t u16( const size_t offset ) const
+  {
+    check( offset, 2 );
+    uint16_t value {};
+    memcpy( &value, data_.data() + offset, sizeof( value ) );
+    return swapped_ ? bswap_16( value ) : value;
+  }
+
+  uint32_t u32( const size_t offset ) const
+  {
+    check( offset, 4 );
+    uint32_t value {};
+    memcpy( &value, data_.data() + offset, sizeof( value ) );
+    return swapped_ ? bswap_32( value ) : value;
+  }
+
+  string_view bytes( const size_t offset, const size_t length ) const
+  {
+    check( offset, length );
+    return data_.substr( offset, length );
+  }
+};
+
+// Convert a timestamp in units of 1/`units_per_second` seconds to nanoseconds
+static uint64_t to_nanoseconds( const uint64_t timestamp, const uint64_t units_per_second )
+{
+  static constexpr uint64_t ns_per_second = 1'000'000'000;
+  return timestamp / units_per_second * ns_per_second
+         + timestamp % units_per_second * ns_per_second / units_per_second;
+}
+
+static uint32_t native_magic( string_view contents )
+{
+  uint32_t magic {};
+  if ( contents.size() >= sizeof( magic ) ) {
+    memcpy( &magic, contents.data(), sizeof( magic ) );
+  }
+  return magic;
+}
+
+PcapReader::PcapReader( string contents ) : contents_( move( contents ) )
+{
+  const uint32_t magic = native_magic( contents_ );
+  if ( magic == PCAPNG_SECTION_HEADER_BLOCK ) {
+    parse_pcapng();
+  } else if ( magic == PCAP_MAGIC_MICROSECONDS or magic == PCAP_MAGIC_NANOSECONDS
+              or magic == bswap_32( PCAP_MAGIC_MICROSECONDS ) or magic == bswap_32( PCAP_MAGIC_NANOSECONDS ) ) {
+    parse_pcap();
+  } else {
+    throw runtime_error( "PcapReader: not a pcap or pcapng file" );
+  }
+}
+
+static string read_all( FileDescriptor& file )
+{
+  string contents( file.size(), 0 );
+  file.read( contents ); // normally the whole file at once
+  while ( not file.eof() ) {
+    string more;
+    file.read( more );
+    contents.append( more );
+  }
+  return contents;
+}
+
+PcapReader::PcapReader( FileDescriptor file ) : PcapReader( read_all( file ) ) {}
+
+void PcapReader::parse_pcap()
+{
+  const uint32_t magic = native_magic( contents_ );
+  const bool swapped = magic != PCAP_MAGIC_MICROSECONDS and magic != PCAP_MAGIC_NANOSECONDS;
+  const FieldReader file { contents_, swapped };
+  const bool nanoseconds = file.u32( 0 ) == PCAP_MAGIC_NANOSECONDS;
+  const auto link_type = static_cast<uint16_t>( file.u32( 20 ) );
+
+  static constexpr size_t file_header_length = 24;
+  static constexpr size_t record_header_length = 16;
+  for ( size_t offset = file_header_length; offset < contents_.size(); ) {
+    const uint64_t seconds = file.u32( offset );
+    const uint64_t fraction = file.u32( offset + 4 );
+    const uint32_t captured_length = file.u32( offset + 8 );
+    const uint32_t original_length = file.u32( offset + 12 );
+
+    frames_.push_back( { seconds * 1'000'000'000 + ( nanoseconds ? fraction : fraction * 1000 ),
+                         original_length,
+                         link_type,
+                         file.bytes( offset + record_header_length, captured_length ) } );
+    offset += record_header_length + captured_length;
+  }
+}
+
+void PcapReader::parse_pcapng()
+{
+  struct Interface
+  {
+    uint16_t link_type;
+    uint64_t units_per_second;
+  };
+
+  vector<Interface> interfaces;
+  bool swapped = false;
+
+  for ( size_t offset = 0; offset < contents_.size(); ) {
+    uint32_t type = FieldReader { contents_, false }.u32( offset );
+    if ( type == PCAPNG_SECTION_HEADER_BLOCK ) {
+      // each section sets its own byte order and has its own interfaces
+      const uint32_t magic = FieldReader { contents_, false }.u32( offset + 8 );
+      if ( magic != PCAPNG_BYTE_ORDER_MAGIC and magic != bswap_32( PCAPNG_BYTE_ORDER_MAGIC ) ) {
+        throw runtime_error( "PcapReader: bad pcapng byte-order magic" );
+      }
+      swapped = magic != PCAPNG_BYTE_ORDER_MAGIC;
+      interfaces.clear();
+    }
+
+    const FieldReader file { contents_, swapped };
+    type = file.u32( offset );
+    const uint32_t length = file.u32( offset + 4 );
+    if ( length < 12 or length % 4 or file.u32( offset + length - 4 ) != length ) {
+      throw runtime_error( "PcapReader: bad pcapng block length" );
+    }
+    const FieldReader block { file.bytes( offset, length - 4 ), swapped };
+
+    if ( type == PCAPNG_INTERFACE_DESCRIPTION_BLOCK ) {
+      Interface interface { block.u16( 8 ), 1'000'000 };
+      for ( size_t option = 16; option + 4 <= length - 4; ) {
+        const uint16_t code = block.u16( option );
+        const uint16_t option_length = block.u16( option + 2 );
+        if ( code == PCAPNG_OPT_ENDOFOPT ) {
+          break;
+        }
+        if ( code == PCAPNG_OPT_IF_TSRESOL and option_length == 1 ) {
+          // the high bit selects a power of two, otherwise a power of ten
+          const auto resolution = static_cast<uint8_t>( block.bytes( option + 4, 1 ).front() );
+          const uint64_t base = resolution & 0x80 ? 2 : 10;
+          interface.units_per_second = 1;
+          for ( uint8_t i = 0; i < ( resolution & 0x7f ); ++i ) {
+            interface.units_per_second *= base;
+          }
+        }
+        option += 4 + ( ( option_length + 3 ) & ~3U );
+      }
+      interfaces.push_back( interface );
+    } else if ( type == PCAPNG_ENHANCED_PACKET_BLOCK ) {
+      const Interface& interface = interfaces.at( block.u32( 8 ) );
+      const uint64_t timestamp = ( static_cast<uint64_t>( block.u32( 12 ) ) << 32 ) | block.u32( 16 );
+      frames_.push_back( { to_nanoseconds( timestamp, interface.units_per_second ),
+                           block.u32( 24 ),
+                           interface.link_type,
+                           block.bytes( 28, block.u32( 20 ) ) } );
+    } else if ( type == PCAPNG_SIMPLE_PACKET_BLOCK ) {
+      const uint32_t original_length = block.u32( 8 );
+      frames_.push_back( { 0,
+                           original_length,
+                           interfaces.at( 0 ).link_type,
+                           block.bytes( 12, min( original_length, length - 16 ) ) } );
+    }
+
+    offset += length;
+  }
+}
+
+optional<string_view> PcapReader::ipv4_datagram( const Frame& frame )
+{
+  string_view data = frame.data;
+
+  // the protocol field of a link-layer header, in network byte order
+  const auto protocol_at = [&]( const size_t offset ) -> optional<uint16_t> {
+    if ( data.size() < offset + 2 ) {
+      return {};
+    }
+    const auto high = static_cast<uint8_t>( data[offset] );
+    const auto low = static_cast<uint8_t>( data[offset + 1] );
+    return static_cast<uint16_t>( ( high << 8 ) | low );
+  };
+
+  static constexpr uint16_t ETHERTYPE_IPV4 = 0x0800;
+  static constexpr uint16_t ETHERTYPE_VLAN = 0x8100;
+
+  switch ( frame.link_type ) {
+    case LINKTYPE_ETHERNET: {
+      size_t header_length = 14;
+      auto ethertype = protocol_at( 12 );
+      if ( ethertype == ETHERTYPE_VLAN ) {
+        header_length = 18;
+        ethertype = protocol_at( 16 );
+      }
+      if ( ethertype != ETHERTYPE_IPV4 ) {
+        return {};
+      }
+      data.remove_prefix( header_length );
+      break;
+    }
+    case LINKTYPE_LINUX_SLL:
+      if ( protocol_at( 14 ) != ETHERTYPE_IPV4 ) {
+        return {};
+      }
+      data.remove_prefix( 16 );
+      break;
+    case LINKTYPE_NULL: {
+      // the address family, in the byte order of the machine that captured it (AF_INET is 2 everywhere)
+      static constexpr uint32_t family_inet = 2;
+      const FieldReader header { data, false };
+      if ( data.size() < 4 or ( header.u32( 0 ) != family_inet and header.u32( 0 ) != bswap_32( family_inet ) ) ) {
+        return {};
+      }
+      data.remove_prefix( 4 );
+      break;
+    }
+    case LINKTYPE_RAW:
+    case LINKTYPE_IPV4:
+      break;
+    default:
+      return {};
+  }
+
+  if ( data.empty() or ( static_cast<uint8_t>( data.front() ) >> 4 ) != 4 ) {
+    return {};
+  }
+  return data;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "file_descriptor.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+//! \brief Loads a packet capture (classic pcap or pcapng) into memory
+//! \details The whole file is read at once and each frame is a view into it, so replaying a capture involves
+//! no I/O and no copies. Both byte orders, microsecond and nanosecond pcap files, and pcapng files with several
+//! sections and interfaces are supported.
+class PcapReader
+{
+public:
+  static constexpr uint16_t LINKTYPE_NULL = 0;
+  static constexpr uint16_t LINKTYPE_ETHERNET = 1;
+  static constexpr uint16_t LINKTYPE_RAW = 101;
+  static constexpr uint16_t LINKTYPE_LINUX_SLL = 113;
+  static constexpr uint16_t LINKTYPE_IPV4 = 228;
+
+  struct Frame
+  {
+    uint64_t timestamp_ns;    // since the epoch
+    uint32_t original_length; // length on the wire (the frame may have been truncated when captured)
+    uint16_t link_type;       // LINKTYPE of the interface it was captured on
+    std::string_view data;    // the captured bytes
+  };
+
+private:
+  std::string contents_;
+  std::vector<Frame> frames_ {};
+
+  void parse_pcap();
+  void parse_pcapng();
+
+public:
+  //! Parse a capture that is already in memory
+  explicit PcapReader( std::string contents );
+
+  //! Read and parse a capture file
+  explicit PcapReader( FileDescriptor file );
+
+  const std::vector<Frame>& frames() const { return frames_; }
+
+  //! The IPv4 datagram in a frame (with any link-layer header removed), if it holds one
+  static std::optional<std::string_view> ipv4_datagram( const Frame& frame );
+
+  // frames refer into contents_, so a PcapReader stays put
+  PcapReader( const PcapReader& other ) = delete;
+  PcapReader& operator=( const PcapReader& other ) = delete;
+  PcapReader( PcapReader&& other ) = delete;
+  PcapReader& operator=( PcapReader&& other ) = delete;
+};
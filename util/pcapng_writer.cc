@@ -0,0 +1,219 @@
+#include "pcapng_writer.hh"
+
+#include <bit>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+using namespace std;
+
+// pcapng block types and option codes
+static constexpr uint32_t SECTION_HEADER_BLOCK = 0x0a0d0d0a;
+static constexpr uint32_t INTERFACE_DESCRIPTION_BLOCK = 1;
+static constexpr uint32_t ENHANCED_PACKET_BLOCK = 6;
+static constexpr uint32_t BYTE_ORDER_MAGIC = 0x1a2b3c4d;
+static constexpr uint16_t OPT_ENDOFOPT = 0;
+static constexpr uint16_t OPT_EPB_FLAGS = 2;
+static constexpr uint16_t OPT_IF_TSRESOL = 9;
+
+static constexpr size_t align_up( const size_t n, const size_t alignment )
+{
+  return ( n + alignment - 1 ) & ~( alignment - 1 );
+}
+
+// append an integer in host byte order (the section header's magic number tells readers which one that is)
+template<typename T>
+static void put( string& out, const T value )
+{
+  out.append( reinterpret_cast<const char*>( &value ), sizeof( value ) ); // NOLINT(*-reinterpret-cast)
+}
+
+PcapngWriter::PcapngWriter( FileDescriptor output,
+                            const uint16_t link_type,
+                            const uint32_t snaplen,
+                            const uint32_t sample_interval,
+                            const size_t ring_size )
+  : output_( move( output ) )
+  , snaplen_( snaplen )
+  , sample_interval_( sample_interval )
+  , ring_( bit_ceil( max( ring_size, 2 * align_up( sizeof( RecordHeader ) + snaplen, 8 ) ) ) )
+  , ring_mask_( ring_.size() - 1 )
+{
+  if ( sample_interval_ == 0 ) {
+    throw runtime_error( "PcapngWriter: sample_interval must be positive" );
+  }
+
+  output_buffer_.reserve( FLUSH_SIZE + align_up( snaplen, 4 ) + 64 );
+  write_header_blocks( link_type );
+  flush();
+
+  writer_ = thread( [this] { run(); } );
+}
+
+PcapngWriter::~PcapngWriter()
+{
+  stop_.store( true, memory_order_release );
+  writer_.join();
+}
+
+void PcapngWriter::write_header_blocks( const uint16_t link_type )
+{
+  static constexpr uint32_t shb_length = 28;
+  put( output_buffer_, SECTION_HEADER_BLOCK );
+  put( output_buffer_, shb_length );
+  put( output_buffer_, BYTE_ORDER_MAGIC );
+  put( output_buffer_, uint16_t { 1 } ); // major version
+  put( output_buffer_, uint16_t { 0 } ); // minor version
+  put( output_buffer_, int64_t { -1 } ); // section length not specified
+  put( output_buffer_, shb_length );
+
+  static constexpr uint32_t idb_length = 32;
+  put( output_buffer_, INTERFACE_DESCRIPTION_BLOCK );
+  put( output_buffer_, idb_length );
+  put( output_buffer_, link_type );
+  put( output_buffer_, uint16_t { 0 } ); // reserved
+  put( output_buffer_, snaplen_ );
+  put( output_buffer_, OPT_IF_TSRESOL ); // timestamps are in nanoseconds
+  put( output_buffer_, uint16_t { 1 } );
+  put( output_buffer_, uint32_t { 9 } ); // 10^-9, padded to four bytes
+  put( output_buffer_, OPT_ENDOFOPT );
+  put( output_buffer_, uint16_t { 0 } );
+  put( output_buffer_, idb_length );
+}
+
+void PcapngWriter::capture( const span<const string_view> frame, const Direction direction )
+{
+  if ( frames_seen_++ % sample_interval_ ) {
+    return;
+  }
+
+  size_t original_length = 0;
+  for ( const auto piece : frame ) {
+    original_length += piece.size();
+  }
+  const size_t captured_length = min( original_length, size_t { snaplen_ } );
+  const size_t record_size = align_up( sizeof( RecordHeader ) + captured_length, 8 );
+
+  // a record never wraps around the end of the ring, so skip whatever space is left there if it's too short
+  uint64_t head = head_.load( memory_order_relaxed );
+  const size_t offset = head & ring_mask_;
+  const size_t skip = ring_.size() - offset < record_size ? ring_.size() - offset : 0;
+
+  if ( head + skip + record_size - cached_tail_ > ring_.size() ) {
+    cached_tail_ = tail_.load( memory_order_acquire );
+    if ( head + skip + record_size - cached_tail_ > ring_.size() ) {
+      ++frames_dropped_;
+      return;
+    }
+  }
+
+  if ( skip ) {
+    memcpy( &ring_[offset], &WRAP, sizeof( WRAP ) );
+    head += skip;
+  }
+
+  const auto since_epoch = chrono::system_clock::now().time_since_epoch();
+  const auto timestamp = chrono::duration_cast<chrono::nanoseconds>( since_epoch );
+  const RecordHeader header { static_cast<uint32_t>( captured_length ),
+                              static_cast<uint32_t>( original_length ),
+                              static_cast<uint64_t>( timestamp.count() ),
+                              static_cast<uint32_t>( direction ),
+                              0 };
+  char* dest = &ring_[head & ring_mask_];
+  memcpy( dest, &header, sizeof( header ) );
+  dest += sizeof( header );
+
+  size_t remaining = captured_length;
+  for ( const auto piece : frame ) {
+    const size_t n = min( piece.size(), remaining );
+    memcpy( dest, piece.data(), n );
+    dest += n;
+    remaining -= n;
+  }
+
+  head_.store( head + record_size, memory_order_release );
+}
+
+// Format the records in the ring as Enhanced Packet Blocks; returns false if the ring was empty
+bool PcapngWriter::drain()
+{
+  uint64_t tail = tail_.load( memory_order_relaxed );
+  const uint64_t head = head_.load( memory_order_acquire );
+  if ( tail == head ) {
+    return false;
+  }
+
+  uint64_t written = 0;
+  while ( tail != head and output_buffer_.size() < FLUSH_SIZE ) {
+    const size_t offset = tail & ring_mask_;
+    RecordHeader header {};
+    memcpy( &header.captured_length, &ring_[offset], sizeof( header.captured_length ) );
+    if ( header.captured_length == WRAP ) {
+      tail += ring_.size() - offset;
+      continue;
+    }
+    memcpy( &header, &ring_[offset], sizeof( header ) );
+
+    const size_t padded_length = align_up( header.captured_length, 4 );
+    const auto block_length = static_cast<uint32_t>( 44 + padded_length );
+    put( output_buffer_, ENHANCED_PACKET_BLOCK );
+    put( output_buffer_, block_length );
+    put( output_buffer_, uint32_t { 0 } ); // interface ID
+    put( output_buffer_, static_cast<uint32_t>( header.timestamp_ns >> 32 ) );
+    put( output_buffer_, static_cast<uint32_t>( header.timestamp_ns ) );
+    put( output_buffer_, header.captured_length );
+    put( output_buffer_, header.original_length );
+    output_buffer_.append( &ring_[offset + sizeof( header )], header.captured_length );
+    output_buffer_.append( padded_length - header.captured_length, 0 );
+    put( output_buffer_, OPT_EPB_FLAGS );
+    put( output_buffer_, uint16_t { 4 } );
+    put( output_buffer_, header.flags );
+    put( output_buffer_, OPT_ENDOFOPT );
+    put( output_buffer_, uint16_t { 0 } );
+    put( output_buffer_, block_length );
+
+    tail += align_up( sizeof( header ) + header.captured_length, 8 );
+    ++written;
+  }
+
+  tail_.store( tail, memory_order_release );
+  frames_written_.fetch_add( written, memory_order_relaxed );
+  return true;
+}
+
+void PcapngWriter::flush()
+{
+  string_view remaining = output_buffer_;
+  while ( not remaining.empty() ) {
+    remaining.remove_prefix( output_.write( remaining ) );
+  }
+  output_buffer_.clear();
+}
+
+void PcapngWriter::run()
+{
+  static constexpr auto idle_interval = chrono::milliseconds( 1 );
+
+  try {
+    while ( true ) {
+      // everything captured before stop_ was set is in the ring by the time it is seen
+      const bool stopping = stop_.load( memory_order_acquire );
+      if ( drain() ) {
+        if ( output_buffer_.size() >= FLUSH_SIZE ) {
+          flush();
+        }
+        continue;
+      }
+
+      flush();
+      if ( stopping ) {
+        return;
+      }
+      this_thread::sleep_for( idle_interval );
+    }
+  } catch ( const exception& e ) {
+    // the capture is abandoned, but the I/O thread carries on (and its frames are counted as dropped)
+    cerr << "Exception in PcapngWriter: " << e.what() << endl;
+  }
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "file_descriptor.hh"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+//! \brief Writes captured frames to a [pcapng](https://www.ietf.org/archive/id/draft-ietf-opsawg-pcapng-02.html)
+//! file without slowing down the thread doing the I/O
+//! \details The I/O thread copies each frame (truncated to the snaplen) into a lock-free single-producer,
+//! single-consumer ring, and never blocks: if the ring is full, the frame is dropped from the capture and
+//! counted. A writer thread drains the ring, formats the records, and writes them to the output in large
+//! batches. Sampling keeps only one frame out of every `sample_interval`.
+//!
+//! capture() must only be called from one thread at a time.
+class PcapngWriter
+{
+public:
+  static constexpr uint16_t LINKTYPE_ETHERNET = 1; // frames from a TAP device
+  static constexpr uint16_t LINKTYPE_RAW = 101;    // IP datagrams (from a TUN device)
+
+  //! Direction of a captured frame, as recorded in its epb_flags option
+  enum class Direction : uint8_t
+  {
+    Inbound = 1,
+    Outbound = 2
+  };
+
+private:
+  // precedes each frame in the ring; a `captured_length` of WRAP means the next record starts at offset 0
+  struct RecordHeader
+  {
+    uint32_t captured_length;
+    uint32_t original_length;
+    uint64_t timestamp_ns;
+    uint32_t flags;
+    uint32_t padding;
+  };
+
+  static constexpr uint32_t WRAP = UINT32_MAX;
+  static constexpr size_t FLUSH_SIZE = 1 << 20; // write to the output in batches of about this many bytes
+
+  FileDescriptor output_;
+  uint32_t snaplen_;
+  uint32_t sample_interval_;
+
+  std::vector<char> ring_;
+  size_t ring_mask_;
+
+  // producer state
+  alignas( 64 ) std::atomic<uint64_t> head_ {}; // bytes ever pushed into the ring
+  uint64_t cached_tail_ {};                     // the producer's last view of tail_
+  uint64_t frames_seen_ {};
+  uint64_t frames_dropped_ {};
+
+  // consumer state
+  alignas( 64 ) std::atomic<uint64_t> tail_ {}; // bytes ever consumed from the ring
+  std::atomic<uint64_t> frames_written_ {};
+  std::atomic<bool> stop_ {};
+  std::string output_buffer_ {};
+
+  std::thread writer_ {};
+
+  void write_header_blocks( uint16_t link_type );
+  bool drain();
+  void flush();
+  void run();
+
+public:
+  //! \param[in] output is where the capture is written (typically a newly created file)
+  //! \param[in] link_type is the LINKTYPE of the captured frames
+  //! \param[in] snaplen is the most bytes kept of each frame
+  //! \param[in] sample_interval keeps one out of every `sample_interval` frames
+  //! \param[in] ring_size is the size of the buffer between capture() and the writer thread
+  PcapngWriter( FileDescriptor output,
+                uint16_t link_type,
+                uint32_t snaplen = 65535,
+                uint32_t sample_interval = 1,
+                size_t ring_size = 8 * 1024 * 1024 );
+
+  //! Writes out everything captured so far before returning
+  ~PcapngWriter();
+
+  //! Record a frame (given as consecutive pieces)
+  void capture( std::span<const std::string_view> frame, Direction direction );
+  void capture( std::string_view frame, Direction direction ) { capture( { &frame, 1 }, direction ); }
+
+  uint64_t frames_dropped() const { return frames_dropped_; }        // lost because the ring was full
+  uint64_t frames_written() const { return frames_written_.load(); } // handed to the output so far
+
+  PcapngWriter( const PcapngWriter& other ) = delete;
+  PcapngWriter& operator=( const PcapngWriter& other ) = delete;
+  PcapngWriter( PcapngWriter&& other ) = delete;
+  PcapngWriter& operator=( PcapngWriter&& other ) = delete;
+};
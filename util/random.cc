@@ -13,3 +13,9 @@ default_random_engine get_random_engine()
   seed_seq seed( seed_data.begin(), seed_data.end() );
   return default_random_engine( seed );
 }
+
+uint64_t random_seed()
+{
+  auto rd = get_random_engine();
+  return ( static_cast<uint64_t>( rd() ) << 32 ) ^ rd();
+}
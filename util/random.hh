@@ -1,5 +1,17 @@
 #pragma once
 
+#include <cstdint>
 #include <random>
 
 std::default_random_engine get_random_engine();
+
+// 64 random bits, e.g. to seed a hash function that peers must not be able to aim collisions at
+uint64_t random_seed();
+
+// splitmix64 finalizer: mixes every bit of `x` into every bit of the result
+inline uint64_t splitmix64( uint64_t x )
+{
+  x = ( x ^ ( x >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+  x = ( x ^ ( x >> 27 ) ) * 0x94d049bb133111ebULL;
+  return x ^ ( x >> 31 );
+}
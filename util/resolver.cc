@@ -0,0 +1,384 @@
+#include "resolver.hh"
+#include "dns_message.hh"
+#include "exception.hh"
+#include "random.hh"
+#include "socket.hh"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <netdb.h>
+#include <poll.h>
+#include <sstream>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+using namespace std;
+using namespace std::chrono;
+
+// DNS names are case-insensitive, and "example.com." is "example.com"
+static string normalized( const string& hostname )
+{
+  string name = hostname;
+  if ( not name.empty() and name.back() == '.' ) {
+    name.pop_back();
+  }
+  ranges::transform( name, name.begin(), []( const unsigned char c ) { return tolower( c ); } );
+  return name;
+}
+
+static Address make_address( const uint32_t ip, const uint16_t port )
+{
+  sockaddr_in address {};
+  address.sin_family = AF_INET;
+  address.sin_port = htons( port );
+  address.sin_addr.s_addr = htonl( ip );
+  return { reinterpret_cast<const sockaddr*>( &address ), sizeof( address ) }; // NOLINT(*-reinterpret-cast)
+}
+
+Resolver::Resolver( Backend backend, const Options& options )
+  : backend_( move( backend ) )
+  , options_( options )
+  , notifications_( CheckSystemCall( "eventfd", eventfd( 0, EFD_CLOEXEC | EFD_NONBLOCK ) ) ) // NOLINT(*-bitwise)
+{
+  if ( options_.threads == 0 ) {
+    throw runtime_error( "Resolver needs at least one thread" );
+  }
+  load_hosts( options_.hosts_file );
+
+  threads_.reserve( options_.threads );
+  for ( size_t i = 0; i < options_.threads; ++i ) {
+    threads_.emplace_back( [this] { run(); } );
+  }
+}
+
+Resolver::~Resolver()
+{
+  {
+    const lock_guard lock { mutex_ };
+    stopping_ = true;
+  }
+  work_available_.notify_all();
+  for ( auto& thread : threads_ ) {
+    thread.join();
+  }
+}
+
+// "address name [aliases...]" per line, with # comments; the first line naming a host wins, as for the system
+void Resolver::load_hosts( const string& path )
+{
+  if ( path.empty() ) {
+    return;
+  }
+  ifstream file { path };
+  string line;
+  while ( getline( file, line ) ) {
+    istringstream fields { line.substr( 0, line.find( '#' ) ) };
+    string ip;
+    in_addr address {};
+    if ( not( fields >> ip ) or inet_pton( AF_INET, ip.c_str(), &address ) != 1 ) {
+      continue; // blank, or IPv6
+    }
+    string name;
+    while ( fields >> name ) {
+      hosts_.emplace( normalized( name ), ntohl( address.s_addr ) );
+    }
+  }
+}
+
+uint16_t Resolver::port_of( const string& service )
+{
+  uint16_t port {};
+  const auto [end, error] = from_chars( service.data(), service.data() + service.size(), port );
+  if ( error == errc {} and end == service.data() + service.size() ) {
+    return port;
+  }
+
+  servent entry {};
+  servent* found = nullptr;
+  array<char, 1024> buffer {};
+  getservbyname_r( service.c_str(), "tcp", &entry, buffer.data(), buffer.size(), &found );
+  if ( not found ) {
+    throw runtime_error( "unknown service: " + service );
+  }
+  return ntohs( static_cast<uint16_t>( found->s_port ) );
+}
+
+Resolver::Result Resolver::result_for( const vector<uint32_t>& addresses,
+                                       const uint16_t port,
+                                       const string& hostname )
+{
+  if ( addresses.empty() ) {
+    return { {}, hostname + ": no such host" };
+  }
+  return { make_address( addresses.front(), port ), {} };
+}
+
+// the count is only ever read to clear the eventfd, so writing 1 per notification is enough
+void Resolver::notify()
+{
+  const uint64_t one = 1;
+  CheckSystemCall( "write (eventfd)", ::write( notifications_.fd_num(), &one, sizeof( one ) ) );
+}
+
+void Resolver::resolve( const string& hostname, const string& service, Callback callback )
+{
+  const uint16_t port = port_of( service );
+  const string name = normalized( hostname );
+
+  in_addr numeric {};
+  if ( inet_pton( AF_INET, name.c_str(), &numeric ) == 1 ) {
+    ++statistics_.numeric;
+    ready_.emplace_back( result_for( { ntohl( numeric.s_addr ) }, port, name ), move( callback ) );
+    notify();
+    return;
+  }
+
+  if ( const auto host = hosts_.find( name ); host != hosts_.end() ) {
+    ++statistics_.hosts;
+    ready_.emplace_back( result_for( { host->second }, port, name ), move( callback ) );
+    notify();
+    return;
+  }
+
+  if ( const auto entry = cache_.find( name ); entry != cache_.end() ) {
+    if ( entry->second.expires > steady_clock::now() ) {
+      ++statistics_.cached;
+      ready_.emplace_back( result_for( entry->second.addresses, port, name ), move( callback ) );
+      notify();
+      return;
+    }
+    cache_.erase( entry );
+  }
+
+  auto& requests = pending_[name];
+  requests.push_back( { port, move( callback ) } );
+  if ( requests.size() > 1 ) {
+    ++statistics_.coalesced;
+    return;
+  }
+
+  ++statistics_.lookups;
+  {
+    const lock_guard lock { mutex_ };
+    queries_.push_back( name );
+  }
+  work_available_.notify_one();
+}
+
+Address Resolver::resolve_blocking( const string& hostname, const string& service )
+{
+  optional<Result> answer;
+  resolve( hostname, service, [&answer]( const Result& result ) { answer = result; } );
+  while ( not answer.has_value() ) {
+    pollfd readable { notifications_.fd_num(), POLLIN, 0 };
+    CheckSystemCall( "poll", ::poll( &readable, 1, -1 ) );
+    deliver();
+  }
+  if ( not answer->address.has_value() ) {
+    throw runtime_error( answer->error );
+  }
+  return *answer->address;
+}
+
+// an expired entry is only found (and dropped) when its name is looked up, so a full cache sweeps them first
+void Resolver::remember( const string& hostname, const Answer& answer )
+{
+  const seconds ttl = min( answer.ttl.value_or( answer.addresses.empty() ? options_.negative_ttl
+                                                                         : options_.default_ttl ),
+                           options_.max_ttl );
+  if ( ttl <= seconds::zero() or options_.max_cache_entries == 0 ) {
+    return;
+  }
+
+  const auto now = steady_clock::now();
+  if ( cache_.size() >= options_.max_cache_entries ) {
+    erase_if( cache_, [now]( const auto& entry ) { return entry.second.expires <= now; } );
+    if ( cache_.size() >= options_.max_cache_entries ) {
+      cache_.erase( cache_.begin() );
+    }
+  }
+  cache_[hostname] = { answer.addresses, now + ttl };
+}
+
+void Resolver::deliver()
+{
+  string counter( sizeof( uint64_t ), 0 );
+  notifications_.read( counter );
+
+  vector<Completion> completions;
+  {
+    const lock_guard lock { mutex_ };
+    swap( completions, completions_ );
+  }
+  auto ready = move( ready_ );
+  ready_.clear();
+
+  // callbacks may resolve() again, adding to ready_ and pending_ (and notifying, for the next deliver())
+  for ( const auto& [result, callback] : ready ) {
+    callback( result );
+  }
+
+  for ( const auto& completion : completions ) {
+    auto requests = pending_.extract( completion.hostname );
+    if ( requests.empty() ) {
+      continue;
+    }
+    if ( completion.answer.has_value() ) {
+      remember( completion.hostname, *completion.answer );
+    } else {
+      ++statistics_.failures;
+    }
+    for ( const auto& request : requests.mapped() ) {
+      request.callback( completion.answer.has_value()
+                          ? result_for( completion.answer->addresses, request.port, completion.hostname )
+                          : Result { {}, completion.error } );
+    }
+  }
+}
+
+void Resolver::run()
+{
+  while ( true ) {
+    string hostname;
+    {
+      unique_lock lock { mutex_ };
+      work_available_.wait( lock, [this] { return stopping_ or not queries_.empty(); } );
+      if ( stopping_ ) {
+        return;
+      }
+      hostname = move( queries_.front() );
+      queries_.pop_front();
+    }
+
+    Completion completion { hostname, {}, {} };
+    try {
+      completion.answer = backend_( hostname );
+    } catch ( const exception& e ) {
+      completion.error = e.what();
+    }
+
+    {
+      const lock_guard lock { mutex_ };
+      completions_.push_back( move( completion ) );
+    }
+    notify();
+  }
+}
+
+Resolver::Backend Resolver::system_backend()
+{
+  return []( const string& hostname ) {
+    addrinfo hints {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM; // one result per address, not one per socket type
+
+    addrinfo* list = nullptr;
+    const int ret = getaddrinfo( hostname.c_str(), nullptr, &hints, &list );
+    if ( ret == EAI_NONAME or ret == EAI_NODATA ) {
+      return Answer {};
+    }
+    if ( ret != 0 ) {
+      throw runtime_error( "getaddrinfo(" + hostname + "): " + gai_strerror( ret ) );
+    }
+    const unique_ptr<addrinfo, decltype( &freeaddrinfo )> wrapped { list, freeaddrinfo };
+
+    Answer answer;
+    for ( const addrinfo* entry = list; entry; entry = entry->ai_next ) {
+      sockaddr_in address {};
+      memcpy( &address, entry->ai_addr, min<size_t>( entry->ai_addrlen, sizeof( address ) ) );
+      answer.addresses.push_back( ntohl( address.sin_addr.s_addr ) );
+    }
+    return answer;
+  };
+}
+
+// How long "no such name" may be cached (RFC 2308): the authority's SOA record's TTL, capped by its MINIMUM field
+// (the last four bytes of its data)
+static optional<seconds> negative_ttl( const DNSMessage& reply )
+{
+  for ( const auto& record : reply.authority ) {
+    if ( record.type == DNSMessage::TYPE_SOA and record.data.size() >= 4 ) {
+      uint32_t minimum {};
+      Parser parser { { record.data.substr( record.data.size() - 4 ) } };
+      parser.integer( minimum );
+      return seconds { min( record.ttl, minimum ) };
+    }
+  }
+  return {};
+}
+
+static Resolver::Answer answer_from( const DNSMessage& reply )
+{
+  if ( reply.truncated ) {
+    throw runtime_error( "DNS reply for " + reply.name + " was truncated" );
+  }
+  if ( reply.rcode == DNSMessage::RCODE_NAME_ERROR ) {
+    return { {}, negative_ttl( reply ) };
+  }
+  if ( reply.rcode != DNSMessage::RCODE_NO_ERROR ) {
+    throw runtime_error( "DNS server failed to resolve " + reply.name + " (rcode " + to_string( reply.rcode )
+                         + ")" );
+  }
+
+  Resolver::Answer answer { reply.addresses(), {} };
+  if ( answer.addresses.empty() ) {
+    answer.ttl = negative_ttl( reply ); // the name exists, but has no IPv4 address
+    return answer;
+  }
+  uint32_t ttl = numeric_limits<uint32_t>::max();
+  for ( const auto& record : reply.answers ) {
+    ttl = min( ttl, record.ttl );
+  }
+  answer.ttl = seconds { ttl };
+  return answer;
+}
+
+Resolver::Backend Resolver::dns_backend( const Address& nameserver,
+                                         const milliseconds timeout,
+                                         const unsigned attempts )
+{
+  return [nameserver, timeout, attempts]( const string& hostname ) {
+    UDPSocket socket;
+    socket.connect( nameserver );
+
+    auto engine = get_random_engine();
+    DNSMessage query;
+    query.id = uniform_int_distribution<uint16_t> {}( engine );
+    query.name = hostname;
+    string request;
+    for ( const auto& buffer : serialize( query ) ) {
+      request += buffer;
+    }
+
+    Address source { "0.0.0.0" };
+    string payload;
+    for ( unsigned attempt = 0; attempt < attempts; ++attempt ) {
+      socket.send( request );
+      const auto deadline = steady_clock::now() + timeout;
+      while ( true ) {
+        const auto remaining = duration_cast<milliseconds>( deadline - steady_clock::now() );
+        pollfd readable { socket.fd_num(), POLLIN, 0 };
+        if ( remaining <= milliseconds::zero()
+             or CheckSystemCall( "poll", ::poll( &readable, 1, static_cast<int>( remaining.count() ) ) ) == 0 ) {
+          break; // try again
+        }
+
+        socket.recv( source, payload );
+        DNSMessage reply;
+        if ( parse( reply, { payload } ) and reply.response and reply.id == query.id
+             and normalized( reply.name ) == normalized( hostname ) ) {
+          return answer_from( reply );
+        }
+        // anything else is stale or forged: keep waiting for the real reply
+      }
+    }
+    throw runtime_error( "DNS lookup of " + hostname + " timed out" );
+  };
+}
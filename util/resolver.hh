@@ -0,0 +1,160 @@
+#pragma once
+
+#include "address.hh"
+#include "file_descriptor.hh"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+//! \brief Resolves host names to IPv4 Addresses without blocking the thread that asks
+//! \details Lookups run on a pool of helper threads, and their answers come back through an eventfd: with an
+//! EventLoop, deliver() belongs in a rule for Direction::In on notifications(), and each callback then runs on
+//! the EventLoop's thread. Answers are cached, positive and negative, for as long as their TTL (capped) allows,
+//! and concurrent lookups of one name share a single query. Numeric addresses and the names in /etc/hosts are
+//! answered from memory, with no lookup at all.
+//!
+//! resolve(), resolve_blocking() and deliver() must all be called from the one thread that owns the Resolver.
+class Resolver
+{
+public:
+  //! What a backend found for a name
+  struct Answer
+  {
+    std::vector<uint32_t> addresses {};         //!< IPv4 addresses, in host byte order (none: no such name)
+    std::optional<std::chrono::seconds> ttl {}; //!< how long it may be cached (if the backend knows)
+  };
+
+  //! \brief Looks a name up, on a pool thread (so it may block)
+  //! \details Throws if the lookup failed (e.g. timed out), as opposed to finding there is no such name: a
+  //! failure is not cached.
+  using Backend = std::function<Answer( const std::string& hostname )>;
+
+  //! An address, or what went wrong
+  struct Result
+  {
+    std::optional<Address> address {};
+    std::string error {};
+  };
+
+  using Callback = std::function<void( const Result& result )>;
+
+  struct Options
+  {
+    size_t threads = 2;                       //!< lookups that can be in flight at once
+    std::chrono::seconds default_ttl { 60 };  //!< for answers whose backend has no TTL
+    std::chrono::seconds negative_ttl { 30 }; //!< for "no such name" without a TTL
+    std::chrono::seconds max_ttl { 3600 };    //!< no answer is kept longer
+    size_t max_cache_entries = 4096;          //!< names cached (expired ones go first)
+    std::string hosts_file = "/etc/hosts";    //!< read once, when constructed ("" for none)
+  };
+
+  //! Lookups counted by how they were answered
+  struct Statistics
+  {
+    uint64_t numeric {};   //!< dotted quads, parsed without a lookup
+    uint64_t hosts {};     //!< names found in the hosts file
+    uint64_t cached {};    //!< answered from the cache (positive or negative)
+    uint64_t coalesced {}; //!< joined a lookup of the same name already in flight
+    uint64_t lookups {};   //!< passed to the backend
+    uint64_t failures {};  //!< lookups whose backend threw
+  };
+
+private:
+  struct CacheEntry
+  {
+    std::vector<uint32_t> addresses {};
+    std::chrono::steady_clock::time_point expires {};
+  };
+
+  struct Request
+  {
+    uint16_t port {};
+    Callback callback {};
+  };
+
+  struct Completion
+  {
+    std::string hostname {};
+    std::optional<Answer> answer {}; // std::nullopt if the lookup failed
+    std::string error {};
+  };
+
+  Backend backend_;
+  Options options_;
+  FileDescriptor notifications_; // eventfd the pool threads signal when a completion is ready
+
+  std::unordered_map<std::string, uint32_t> hosts_ {};
+  std::unordered_map<std::string, CacheEntry> cache_ {};
+  std::unordered_map<std::string, std::vector<Request>> pending_ {}; // by hostname, while its lookup runs
+  std::deque<std::pair<Result, Callback>> ready_ {};                 // answered without a lookup
+  Statistics statistics_ {};
+
+  // shared with the pool threads
+  std::mutex mutex_ {};
+  std::condition_variable work_available_ {};
+  std::deque<std::string> queries_ {};
+  std::vector<Completion> completions_ {};
+  bool stopping_ = false;
+
+  std::vector<std::thread> threads_ {};
+
+  void run();
+  void notify();
+  void load_hosts( const std::string& path );
+  void remember( const std::string& hostname, const Answer& answer );
+  static uint16_t port_of( const std::string& service );
+  static Result result_for( const std::vector<uint32_t>& addresses, uint16_t port, const std::string& hostname );
+
+public:
+  Resolver( Backend backend, const Options& options );
+  explicit Resolver( Backend backend ) : Resolver( std::move( backend ), Options {} ) {}
+
+  //! With the system's resolver (getaddrinfo) as backend
+  Resolver() : Resolver( system_backend() ) {}
+
+  //! Stops and joins the pool threads; callbacks not yet delivered are dropped
+  ~Resolver();
+
+  //! \brief Resolve `hostname` (and `service`, a port number or a name from /etc/services) to an Address
+  //! \details `callback` always runs from deliver(), even when the answer is already known.
+  void resolve( const std::string& hostname, const std::string& service, Callback callback );
+
+  //! Resolve, waiting for the answer (for a thread that has nothing else to do); throws if there is none
+  Address resolve_blocking( const std::string& hostname, const std::string& service );
+
+  //! Readable when answers are waiting to be delivered
+  FileDescriptor& notifications() { return notifications_; }
+
+  //! Run the callbacks of every answer that has come back
+  void deliver();
+
+  const Statistics& statistics() const { return statistics_; }
+
+  //! Forget every cached answer (the hosts file stays)
+  void clear_cache() { cache_.clear(); }
+
+  //! \brief [getaddrinfo(3)](\ref man3::getaddrinfo), which knows no TTLs
+  static Backend system_backend();
+
+  //! \brief Ask a DNS server directly, over UDP, for A records (and their TTLs)
+  //! \details Each query is sent up to `attempts` times, waiting `timeout` for each reply.
+  static Backend dns_backend( const Address& nameserver,
+                              std::chrono::milliseconds timeout = std::chrono::milliseconds { 2000 },
+                              unsigned attempts = 2 );
+
+  // the pool threads refer to the Resolver
+  Resolver( const Resolver& other ) = delete;
+  Resolver& operator=( const Resolver& other ) = delete;
+  Resolver( Resolver&& other ) = delete;
+  Resolver& operator=( Resolver&& other ) = delete;
+};
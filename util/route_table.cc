@@ -0,0 +1,175 @@
+#include "route_table.hh"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+static uint32_t mask( const uint32_t address, const uint8_t prefix_length )
+{
+  return prefix_length == 0 ? 0 : address & ( UINT32_MAX << ( 32 - prefix_length ) );
+}
+
+// the route length + 1 recorded in an entry (0 if empty)
+static uint32_t stored_depth( const uint32_t entry )
+{
+  return ( entry >> 24 ) & 0x3fU;
+}
+
+// Overwrite entries filled by routes no longer than `depth` (or, if `exact`, by routes of exactly that length)
+static void rewrite( uint32_t* entries, const size_t count, const uint32_t entry, const uint32_t depth, bool exact )
+{
+  for ( size_t i = 0; i < count; ++i ) {
+    const uint32_t existing = stored_depth( entries[i] );
+    if ( exact ? existing == depth : existing <= depth ) {
+      entries[i] = entry;
+    }
+  }
+}
+
+RouteTable::RouteTable() : tbl24_( size_t { 1 } << 24 ) {}
+
+uint32_t RouteTable::allocate_group( const uint32_t fill )
+{
+  uint32_t group {};
+  if ( free_groups_.empty() ) {
+    group = tbl8_.size() / GROUP_SIZE;
+    if ( group > VALUE_MASK ) {
+      throw runtime_error( "RouteTable: out of groups" );
+    }
+    tbl8_.resize( tbl8_.size() + GROUP_SIZE );
+  } else {
+    group = free_groups_.back();
+    free_groups_.pop_back();
+  }
+
+  fill_n( tbl8_.begin() + group * GROUP_SIZE, GROUP_SIZE, fill );
+  return group;
+}
+
+// If every entry in a group is the same, store that entry directly in the /24 table instead. Entries from routes
+// longer than /24 stay in their group, even if they all agree, because erasing such a route expects to find one.
+void RouteTable::collapse_group( uint32_t& tbl24_entry )
+{
+  const uint32_t group = tbl24_entry & VALUE_MASK;
+  const auto first = tbl8_.begin() + group * GROUP_SIZE;
+  if ( stored_depth( *first ) <= 24 + 1
+       and all_of( first, first + GROUP_SIZE, [&]( const uint32_t x ) { return x == *first; } ) ) {
+    tbl24_entry = *first;
+    free_groups_.push_back( group );
+  }
+}
+
+void RouteTable::insert( uint32_t prefix, const uint8_t prefix_length, const uint32_t next_hop )
+{
+  if ( prefix_length > 32 or next_hop > MAX_NEXT_HOP ) {
+    throw runtime_error( "RouteTable::insert: invalid prefix length or next hop" );
+  }
+
+  prefix = mask( prefix, prefix_length );
+  num_routes_ += routes_.at( prefix_length ).insert_or_assign( prefix, next_hop ).second;
+
+  const uint32_t depth = prefix_length + 1;
+  const uint32_t entry = ( depth << 24 ) | next_hop;
+
+  if ( prefix_length <= 24 ) {
+    const size_t first = prefix >> 8;
+    const size_t count = size_t { 1 } << ( 24 - prefix_length );
+    for ( size_t i = first; i < first + count; ++i ) {
+      uint32_t& tbl24_entry = tbl24_[i];
+      if ( tbl24_entry & GROUP_FLAG ) {
+        rewrite( &tbl8_[( tbl24_entry & VALUE_MASK ) * GROUP_SIZE], GROUP_SIZE, entry, depth, false );
+      } else if ( stored_depth( tbl24_entry ) <= depth ) {
+        tbl24_entry = entry;
+      }
+    }
+    return;
+  }
+
+  uint32_t& tbl24_entry = tbl24_[prefix >> 8];
+  if ( not( tbl24_entry & GROUP_FLAG ) ) {
+    tbl24_entry = GROUP_FLAG | allocate_group( tbl24_entry );
+  }
+  const size_t first = ( tbl24_entry & VALUE_MASK ) * GROUP_SIZE + ( prefix & 0xffU );
+  rewrite( &tbl8_[first], size_t { 1 } << ( 32 - prefix_length ), entry, depth, false );
+}
+
+bool RouteTable::erase( uint32_t prefix, const uint8_t prefix_length )
+{
+  if ( prefix_length > 32 ) {
+    throw runtime_error( "RouteTable::erase: invalid prefix length " + to_string( prefix_length ) );
+  }
+
+  prefix = mask( prefix, prefix_length );
+  if ( routes_.at( prefix_length ).erase( prefix ) == 0 ) {
+    return false;
+  }
+  --num_routes_;
+
+  // the entries revert to the longest remaining route that covers the erased one (or to empty)
+  uint32_t replacement = 0;
+  for ( int len = prefix_length - 1; len >= 0; --len ) {
+    const auto& routes = routes_.at( len );
+    const auto it = routes.find( mask( prefix, len ) );
+    if ( it != routes.end() ) {
+      replacement = ( static_cast<uint32_t>( len + 1 ) << 24 ) | it->second;
+      break;
+    }
+  }
+
+  const uint32_t depth = prefix_length + 1;
+
+  if ( prefix_length <= 24 ) {
+    const size_t first = prefix >> 8;
+    const size_t count = size_t { 1 } << ( 24 - prefix_length );
+    for ( size_t i = first; i < first + count; ++i ) {
+      uint32_t& tbl24_entry = tbl24_[i];
+      if ( tbl24_entry & GROUP_FLAG ) {
+        rewrite( &tbl8_[( tbl24_entry & VALUE_MASK ) * GROUP_SIZE], GROUP_SIZE, replacement, depth, true );
+        collapse_group( tbl24_entry );
+      } else if ( stored_depth( tbl24_entry ) == depth ) {
+        tbl24_entry = replacement;
+      }
+    }
+    return true;
+  }
+
+  uint32_t& tbl24_entry = tbl24_[prefix >> 8];
+  const size_t first = ( tbl24_entry & VALUE_MASK ) * GROUP_SIZE + ( prefix & 0xffU );
+  rewrite( &tbl8_[first], size_t { 1 } << ( 32 - prefix_length ), replacement, depth, true );
+  collapse_group( tbl24_entry );
+  return true;
+}
+
+void RouteTable::lookup( span<const uint32_t> addresses, span<uint32_t> next_hops ) const
+{
+  if ( addresses.size() != next_hops.size() ) {
+    throw runtime_error( "RouteTable::lookup: addresses and next_hops differ in size" );
+  }
+
+  // first pass: start fetching every /24 entry, so the cache misses overlap instead of following one another
+  for ( const auto address : addresses ) {
+    __builtin_prefetch( &tbl24_[address >> 8] );
+  }
+
+  // second pass: the entries are (mostly) in cache by now
+  for ( size_t i = 0; i < addresses.size(); ++i ) {
+    uint32_t entry = tbl24_[addresses[i] >> 8];
+    if ( entry & GROUP_FLAG ) {
+      entry = tbl8_[( entry & VALUE_MASK ) * GROUP_SIZE + ( addresses[i] & 0xffU )];
+    }
+    next_hops[i] = entry == 0 ? NO_ROUTE : entry & VALUE_MASK;
+  }
+}
+
+size_t RouteTable::memory_usage() const
+{
+  size_t total = ( tbl24_.capacity() + tbl8_.capacity() + free_groups_.capacity() ) * sizeof( uint32_t );
+  for ( const auto& routes : routes_ ) {
+    // each node holds the key/value pair and a next pointer
+    total += routes.size() * ( sizeof( pair<const uint32_t, uint32_t> ) + sizeof( void* ) );
+    total += routes.bucket_count() * sizeof( void* );
+  }
+  return total;
+}
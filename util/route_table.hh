@@ -0,0 +1,71 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+//! \brief Longest-prefix-match table mapping IPv4 destinations to next-hop indices (DIR-24-8)
+//! \details The first 24 bits of an address index a table with one entry per /24. Entries covered by routes
+//! longer than /24 point to a 256-entry group indexed by the last 8 bits. Every lookup therefore takes at most
+//! two memory accesses, however many routes there are.
+//!
+//! Each entry records the length of the route that filled it, so inserting or erasing a route rewrites only the
+//! entries that route covers.
+//!
+//! The table is not thread-safe: updates must not run concurrently with lookups (or each other). An update may
+//! grow the group storage, moving every group, and a freed group is reused at once.
+class RouteTable
+{
+public:
+  static constexpr uint32_t MAX_NEXT_HOP = ( 1U << 24 ) - 1; // largest next-hop index that can be stored
+  static constexpr uint32_t NO_ROUTE = UINT32_MAX;            // batch lookup result when no route matches
+
+private:
+  // entry layout: [31] points to a group, [29:24] route length + 1 (0 if empty), [23:0] next hop or group
+  static constexpr uint32_t GROUP_FLAG = 1U << 31;
+  static constexpr uint32_t VALUE_MASK = MAX_NEXT_HOP;
+  static constexpr size_t GROUP_SIZE = 256;
+
+  std::vector<uint32_t> tbl24_;
+  std::vector<uint32_t> tbl8_ {};
+  std::vector<uint32_t> free_groups_ {};
+  std::array<std::unordered_map<uint32_t, uint32_t>, 33> routes_ {}; // prefix -> next hop, by prefix length
+  size_t num_routes_ {};
+
+  uint32_t allocate_group( uint32_t fill );
+  void collapse_group( uint32_t& tbl24_entry );
+
+public:
+  RouteTable();
+
+  //! Add a route (replacing any existing route with the same prefix and length)
+  void insert( uint32_t prefix, uint8_t prefix_length, uint32_t next_hop );
+
+  //! Remove a route; returns false if there was no such route
+  bool erase( uint32_t prefix, uint8_t prefix_length );
+
+  //! Next hop of the longest prefix matching `address`, if any
+  std::optional<uint32_t> lookup( uint32_t address ) const
+  {
+    uint32_t entry = tbl24_[address >> 8];
+    if ( entry & GROUP_FLAG ) {
+      entry = tbl8_[( entry & VALUE_MASK ) * GROUP_SIZE + ( address & 0xffU )];
+    }
+    if ( entry == 0 ) {
+      return std::nullopt;
+    }
+    return entry & VALUE_MASK;
+  }
+
+  //! Look up a batch of addresses at once (NO_ROUTE where none matches)
+  void lookup( std::span<const uint32_t> addresses, std::span<uint32_t> next_hops ) const;
+
+  size_t size() const { return num_routes_; }
+
+  //! Approximate bytes used by the tables and the route list
+  size_t memory_usage() const;
+};
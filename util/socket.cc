@@ -2,20 +2,34 @@
 
 #include "exception.hh"
 
+#include <algorithm>
+#include <array>
 #include <cstddef>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/errqueue.h>
+#include <linux/if_ether.h>
 #include <linux/if_packet.h>
+#include <linux/net_tstamp.h>
 #include <net/if.h>
+#include <netinet/udp.h>
 #include <stdexcept>
 #include <sys/ioctl.h>
 #include <unistd.h>
 
 using namespace std;
 
+static uint64_t nanoseconds( const timespec& time )
+{
+  return static_cast<uint64_t>( time.tv_sec ) * 1'000'000'000 + static_cast<uint64_t>( time.tv_nsec );
+}
+
 // default constructor for socket of (subclassed) domain and type
 //! \param[in] domain is as described in [socket(7)](\ref man7::socket), probably `AF_INET` or `AF_UNIX`
 //! \param[in] type is as described in [socket(7)](\ref man7::socket)
 Socket::Socket( const int domain, const int type, const int protocol )
-  : FileDescriptor( ::CheckSystemCall( "socket", socket( domain, type, protocol ) ) )
+  : FileDescriptor( ::CheckSystemCall( "socket", socket( domain, type, protocol ) ),
+                    type & SOCK_NONBLOCK ? O_RDWR | O_NONBLOCK : O_RDWR ) // NOLINT(*-bitwise)
 {}
 
 // construct from file descriptor
@@ -122,35 +136,180 @@ void DatagramSocket::recv( Address& source_address, string& payload )
   Address::Raw datagram_source_address;
   socklen_t fromlen = sizeof( datagram_source_address );
 
-  payload.clear();
-  payload.resize( kReadBufferSize );
+  const span<char> buffer = scratch_buffer().space();
+  const auto start = syscall_start();
+  const ssize_t result
+    = ::recvfrom( fd_num(), buffer.data(), buffer.size(), MSG_TRUNC, datagram_source_address, &fromlen );
+  account_read( result, 0, start );
+  const ssize_t recv_len = CheckSystemCall( "recvfrom", result );
 
-  const ssize_t recv_len = CheckSystemCall(
-    "recvfrom",
-    ::recvfrom( fd_num(), payload.data(), payload.size(), MSG_TRUNC, datagram_source_address, &fromlen ) );
-
-  if ( recv_len > static_cast<ssize_t>( payload.size() ) ) {
+  if ( recv_len > static_cast<ssize_t>( buffer.size() ) ) {
     throw runtime_error( "recvfrom (oversized datagram)" );
   }
 
   register_read();
   source_address = { datagram_source_address, fromlen };
-  payload.resize( recv_len );
+  payload.assign( buffer.data(), recv_len );
 }
 
 void DatagramSocket::sendto( const Address& destination, const string_view payload )
 {
-  CheckSystemCall(
-    "sendto", ::sendto( fd_num(), payload.data(), payload.length(), 0, destination.raw(), destination.size() ) );
+  const auto start = syscall_start();
+  const ssize_t result
+    = ::sendto( fd_num(), payload.data(), payload.length(), 0, destination.raw(), destination.size() );
+  account_write( result, payload.length(), start );
+  CheckSystemCall( "sendto", result );
   register_write();
 }
 
 void DatagramSocket::send( const string_view payload )
 {
-  CheckSystemCall( "send", ::send( fd_num(), payload.data(), payload.length(), 0 ) );
+  const auto start = syscall_start();
+  const ssize_t result = ::send( fd_num(), payload.data(), payload.length(), 0 );
+  account_write( result, payload.length(), start );
+  CheckSystemCall( "send", result );
+  register_write();
+}
+
+// sendmsg with a UDP_SEGMENT control message carrying the segment size
+static ssize_t send_segmented( const int fd,
+                               const sockaddr* destination,
+                               const socklen_t destination_size,
+                               const string_view payload,
+                               uint16_t segment_size )
+{
+  iovec iov { const_cast<char*>( payload.data() ), payload.size() }; // NOLINT(*-const-cast)
+  alignas( cmsghdr ) array<char, CMSG_SPACE( sizeof( segment_size ) )> control {};
+
+  msghdr message {};
+  message.msg_name = const_cast<sockaddr*>( destination ); // NOLINT(*-const-cast)
+  message.msg_namelen = destination_size;
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control.data();
+  message.msg_controllen = control.size();
+
+  cmsghdr* const header = CMSG_FIRSTHDR( &message );
+  header->cmsg_level = SOL_UDP;
+  header->cmsg_type = UDP_SEGMENT;
+  header->cmsg_len = CMSG_LEN( sizeof( segment_size ) );
+  memcpy( CMSG_DATA( header ), &segment_size, sizeof( segment_size ) );
+
+  return ::sendmsg( fd, &message, 0 );
+}
+
+void DatagramSocket::sendto( const Address& destination, const string_view payload, const uint16_t segment_size )
+{
+  const auto start = syscall_start();
+  const ssize_t result
+    = send_segmented( fd_num(), destination.raw(), destination.size(), payload, segment_size );
+  account_write( result, payload.size(), start );
+  CheckSystemCall( "sendmsg", result );
   register_write();
 }
 
+void DatagramSocket::send( const string_view payload, const uint16_t segment_size )
+{
+  const auto start = syscall_start();
+  const ssize_t result = send_segmented( fd_num(), nullptr, 0, payload, segment_size );
+  account_write( result, payload.size(), start );
+  CheckSystemCall( "sendmsg", result );
+  register_write();
+}
+
+// the segment size comes in a UDP_GRO control message, if the kernel coalesced anything
+SegmentedDatagram DatagramSocket::recv( Address& source_address, ReadBuffer& buffer )
+{
+  Address::Raw datagram_source_address;
+  alignas( cmsghdr ) array<char, CMSG_SPACE( sizeof( int ) ) + CMSG_SPACE( sizeof( scm_timestamping ) )> control {};
+  const span<char> space = buffer.space();
+  iovec iov { space.data(), space.size() };
+
+  msghdr message {};
+  message.msg_name = &datagram_source_address.storage;
+  message.msg_namelen = sizeof( datagram_source_address.storage );
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control.data();
+  message.msg_controllen = control.size();
+
+  const auto start = syscall_start();
+  const ssize_t result = ::recvmsg( fd_num(), &message, 0 );
+  account_read( result, 0, start );
+  const ssize_t received = CheckSystemCall( "recvmsg", result );
+  if ( result < 0 ) {
+    return {};
+  }
+
+  if ( message.msg_flags & MSG_TRUNC ) { // NOLINT(*-bitwise)
+    throw runtime_error( "recvmsg (oversized datagram)" );
+  }
+
+  register_read();
+  source_address = { datagram_source_address, message.msg_namelen };
+
+  const auto length = static_cast<size_t>( received );
+  SegmentedDatagram datagrams { { space.data(), length }, length };
+  for ( cmsghdr* header = CMSG_FIRSTHDR( &message ); header; header = CMSG_NXTHDR( &message, header ) ) {
+    if ( header->cmsg_level == SOL_UDP and header->cmsg_type == UDP_GRO ) {
+      int segment_size = 0;
+      memcpy( &segment_size, CMSG_DATA( header ), sizeof( segment_size ) );
+      datagrams.segment_size = segment_size;
+    } else if ( header->cmsg_level == SOL_SOCKET and header->cmsg_type == SCM_TIMESTAMPING ) {
+      scm_timestamping timestamps {};
+      memcpy( &timestamps, CMSG_DATA( header ), sizeof( timestamps ) );
+      datagrams.timestamp = nanoseconds( timestamps.ts[0] );
+    }
+  }
+  return datagrams;
+}
+
+// a blocking socket waits for the first datagram only (MSG_WAITFORONE), then takes what else is queued
+size_t DatagramSocket::recv( DatagramBatch& batch )
+{
+  batch.prepare_receive( batch.capacity() );
+  const auto start = syscall_start();
+  const int received = ::recvmmsg(
+    fd_num(), batch.headers_.data(), static_cast<unsigned int>( batch.capacity() ), MSG_WAITFORONE, nullptr );
+  batch.finish_receive( max( received, 0 ) );
+
+  size_t bytes = 0;
+  for ( size_t i = 0; i < batch.size(); ++i ) {
+    bytes += batch.payload( i ).size();
+  }
+  account_read( received < 0 ? received : static_cast<ssize_t>( bytes ), 0, start );
+  if ( CheckSystemCall( "recvmmsg", received ) > 0 ) {
+    register_read();
+  }
+  return batch.size();
+}
+
+// sendmmsg stops at the first datagram that fails; the rest are retried unless the socket would block
+size_t DatagramSocket::send( DatagramBatch& batch )
+{
+  size_t sent = 0;
+  while ( sent < batch.size() ) {
+    const auto start = syscall_start();
+    const int result = ::sendmmsg(
+      fd_num(), &batch.headers_.at( sent ), static_cast<unsigned int>( batch.size() - sent ), 0 );
+
+    size_t bytes = 0;
+    size_t requested = 0;
+    for ( size_t i = sent; i < batch.size(); ++i ) {
+      requested += batch.payload( i ).size();
+      bytes += i < sent + max( result, 0 ) ? batch.payload( i ).size() : 0;
+    }
+    account_write( result < 0 ? result : static_cast<ssize_t>( bytes ), requested, start );
+
+    if ( CheckSystemCall( "sendmmsg", result ) == 0 ) {
+      break;
+    }
+    register_write();
+    sent += result;
+  }
+  return sent;
+}
+
 // mark the socket as listening for incoming connections
 //! \param[in] backlog is the number of waiting connections to queue (see [listen(2)](\ref man2::listen))
 void TCPSocket::listen( const int backlog )
@@ -164,7 +323,92 @@ void TCPSocket::listen( const int backlog )
 TCPSocket TCPSocket::accept()
 {
   register_read();
-  return TCPSocket( FileDescriptor( CheckSystemCall( "accept", ::accept( fd_num(), nullptr, nullptr ) ) ) );
+  return TCPSocket(
+    FileDescriptor( CheckSystemCall( "accept4", ::accept4( fd_num(), nullptr, nullptr, SOCK_CLOEXEC ) ), O_RDWR ) );
+}
+
+optional<TCPSocket> TCPSocket::accept_nonblocking()
+{
+  const int fd = ::accept4( fd_num(), nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC ); // NOLINT(*-bitwise)
+  if ( fd < 0 ) {
+    if ( errno == EAGAIN or errno == ECONNABORTED ) {
+      return {};
+    }
+    throw unix_error { "accept4" };
+  }
+  register_read();
+  return TCPSocket( FileDescriptor( fd, O_RDWR | O_NONBLOCK ) ); // NOLINT(*-bitwise)
+}
+
+void TCPSocket::set_zerocopy( const bool enabled )
+{
+  setsockopt( SOL_SOCKET, SO_ZEROCOPY, int { enabled } );
+}
+
+// ENOBUFS means the socket's option memory is full of unread completions
+size_t TCPSocket::send_zerocopy( const string_view data )
+{
+  const auto start = syscall_start();
+  const ssize_t result = ::send( fd_num(), data.data(), data.size(), MSG_ZEROCOPY );
+  account_write( result, data.size(), start );
+  if ( result < 0 and errno == ENOBUFS ) {
+    return 0;
+  }
+  const ssize_t bytes_sent = CheckSystemCall( "send", result );
+  if ( bytes_sent > 0 ) {
+    register_write();
+  }
+  return bytes_sent;
+}
+
+// each notification on the error queue covers a range of sends
+optional<ZeroCopyCompletion> TCPSocket::read_zerocopy_completion()
+{
+  sock_extended_err error {};
+  scm_timestamping timestamps {};
+  if ( not read_error_queue( error, timestamps ) ) {
+    return {};
+  }
+  if ( error.ee_origin != SO_EE_ORIGIN_ZEROCOPY or error.ee_errno != 0 ) {
+    throw unix_error( "error queue", static_cast<int>( error.ee_errno ) );
+  }
+  return ZeroCopyCompletion {
+    error.ee_info, error.ee_data, static_cast<bool>( error.ee_code & SO_EE_CODE_ZEROCOPY_COPIED ) };
+}
+
+bool Socket::read_error_queue( sock_extended_err& error, scm_timestamping& timestamps )
+{
+  alignas( cmsghdr ) array<char,
+                           CMSG_SPACE( sizeof( scm_timestamping ) )
+                             + CMSG_SPACE( sizeof( sock_extended_err ) + sizeof( sockaddr_in6 ) )>
+    control {};
+  msghdr message {};
+  message.msg_control = control.data();
+  message.msg_controllen = control.size();
+
+  if ( ::recvmsg( fd_num(), &message, MSG_ERRQUEUE | MSG_DONTWAIT ) < 0 ) {
+    if ( errno == EAGAIN ) {
+      throw_if_error(); // the queue was empty: was POLLERR a pending socket error?
+      return false;
+    }
+    throw unix_error { "recvmsg (MSG_ERRQUEUE)" };
+  }
+  register_read();
+
+  bool found_error = false;
+  for ( cmsghdr* header = CMSG_FIRSTHDR( &message ); header; header = CMSG_NXTHDR( &message, header ) ) {
+    if ( ( header->cmsg_level == SOL_IP and header->cmsg_type == IP_RECVERR )
+         or ( header->cmsg_level == SOL_IPV6 and header->cmsg_type == IPV6_RECVERR ) ) {
+      memcpy( &error, CMSG_DATA( header ), sizeof( error ) );
+      found_error = true;
+    } else if ( header->cmsg_level == SOL_SOCKET and header->cmsg_type == SCM_TIMESTAMPING ) {
+      memcpy( &timestamps, CMSG_DATA( header ), sizeof( timestamps ) );
+    }
+  }
+  if ( not found_error ) {
+    throw runtime_error( "recvmsg (MSG_ERRQUEUE): no extended error" );
+  }
+  return true;
 }
 
 // get socket option
@@ -200,6 +444,18 @@ void Socket::set_reuseaddr()
   setsockopt( SOL_SOCKET, SO_REUSEADDR, int { true } );
 }
 
+void Socket::set_reuseport()
+{
+  setsockopt( SOL_SOCKET, SO_REUSEPORT, int { true } );
+}
+
+void Socket::attach_reuseport_filter( const vector<sock_filter>& program )
+{
+  const sock_fprog fprog { static_cast<unsigned short>( program.size() ),
+                           const_cast<sock_filter*>( program.data() ) }; // NOLINT(*-const-cast)
+  setsockopt( SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, fprog );
+}
+
 void Socket::throw_if_error() const
 {
   int socket_error = 0;
@@ -219,3 +475,59 @@ void PacketSocket::set_promiscuous()
               PACKET_ADD_MEMBERSHIP,
               packet_mreq { local_address().as<sockaddr_ll>()->sll_ifindex, PACKET_MR_PROMISC, {}, {} } );
 }
+
+void PacketSocket::bind_to_interface( const string& interface_name )
+{
+  sockaddr_ll address {};
+  address.sll_family = AF_PACKET;
+  address.sll_protocol = htons( ETH_P_ALL );
+  address.sll_ifindex = static_cast<int>( if_nametoindex( interface_name.c_str() ) );
+  if ( address.sll_ifindex == 0 ) {
+    throw unix_error { "if_nametoindex " + interface_name };
+  }
+  bind( Address { reinterpret_cast<const sockaddr*>( &address ), sizeof( address ) } ); // NOLINT(*-cast)
+}
+
+void PacketSocket::set_tpacket_v3_rings( const tpacket_req3& rx, const tpacket_req3& tx )
+{
+  setsockopt( SOL_PACKET, PACKET_VERSION, int { TPACKET_V3 } );
+  if ( rx.tp_block_nr > 0 ) {
+    setsockopt( SOL_PACKET, PACKET_RX_RING, rx );
+  }
+  if ( tx.tp_block_nr > 0 ) {
+    setsockopt( SOL_PACKET, PACKET_TX_RING, tx );
+  }
+}
+
+tpacket_stats PacketSocket::statistics()
+{
+  tpacket_stats stats {}; // the first two fields of tpacket_stats_v3 too
+  getsockopt( SOL_PACKET, PACKET_STATISTICS, stats );
+  return stats;
+}
+
+// software timestamps only (ts[0]), with an id on each transmit timestamp and no copy of the datagram with it
+void DatagramSocket::set_timestamping( const bool enabled )
+{
+  const int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_TX_SOFTWARE // NOLINT(*-bitwise)
+                    | SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY;
+  setsockopt( SOL_SOCKET, SO_TIMESTAMPING, enabled ? flags : 0 );
+}
+
+optional<TransmitTimestamp> DatagramSocket::read_transmit_timestamp()
+{
+  sock_extended_err error {};
+  scm_timestamping timestamps {};
+  if ( not read_error_queue( error, timestamps ) ) {
+    return {};
+  }
+  if ( error.ee_origin != SO_EE_ORIGIN_TIMESTAMPING or error.ee_errno != ENOMSG ) {
+    throw unix_error( "error queue", static_cast<int>( error.ee_errno ) );
+  }
+  return TransmitTimestamp { error.ee_data, nanoseconds( timestamps.ts[0] ) };
+}
+
+void UDPSocket::set_gro( const bool enabled )
+{
+  setsockopt( SOL_UDP, UDP_GRO, int { enabled } );
+}
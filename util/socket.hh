@@ -1,11 +1,17 @@
 #pragma once
 
 #include "address.hh"
+#include "datagram_batch.hh"
 #include "file_descriptor.hh"
 
 #include <cstdint>
 #include <functional>
+#include <linux/errqueue.h>
+#include <linux/filter.h>
+#include <linux/if_packet.h>
+#include <optional>
 #include <sys/socket.h>
+#include <vector>
 
 //! \brief Base class for network sockets (TCP, UDP, etc.)
 //! \details Socket is generally used via a subclass. See TCPSocket and UDPSocket for usage examples.
@@ -23,6 +29,9 @@ protected:
   //! Construct from a file descriptor.
   Socket( FileDescriptor&& fd, int domain, int type, int protocol = 0 );
 
+  //! Adopt a file descriptor known to be of the right domain and type (e.g. just accepted), without checking
+  explicit Socket( FileDescriptor&& fd ) : FileDescriptor( std::move( fd ) ) {}
+
   //! Wrapper around [getsockopt(2)](\ref man2::getsockopt)
   template<typename option_type>
   socklen_t getsockopt( int level, int option, option_type& option_value ) const;
@@ -33,6 +42,11 @@ protected:
 
   void setsockopt( int level, int option, std::string_view option_val );
 
+  //! \brief Take the oldest entry off the socket's error queue ([MSG_ERRQUEUE](\ref man7::ip)) without blocking
+  //! \details `timestamps` is left alone unless the entry carries kernel timestamps (SCM_TIMESTAMPING).
+  //! \returns false if the queue was empty
+  bool read_error_queue( sock_extended_err& error, scm_timestamping& timestamps );
+
 public:
   //! Bind a socket to a specified address with [bind(2)](\ref man2::bind), usually for listen/accept
   void bind( const Address& address );
@@ -54,10 +68,39 @@ public:
   //! Allow local address to be reused sooner via [SO_REUSEADDR](\ref man7::socket)
   void set_reuseaddr();
 
+  //! Allow several sockets to bind the same address via [SO_REUSEPORT](\ref man7::socket), with the kernel
+  //! spreading connections (or datagrams) among them
+  void set_reuseport();
+
+  //! \brief Choose which socket of this socket's SO_REUSEPORT group gets each connection or datagram with a
+  //! classic BPF program, which returns the index of the socket (in the order they were bound)
+  //! \details An index past the end of the group falls back to the kernel's hash.
+  void attach_reuseport_filter( const std::vector<sock_filter>& program );
+
   //! Check for errors (will be seen on non-blocking sockets)
   void throw_if_error() const;
 };
 
+//! \brief A buffer of datagrams received together (coalesced by UDP GRO), each segment_size bytes long except
+//! perhaps the last; a datagram received alone is one segment
+struct SegmentedDatagram
+{
+  std::string_view data {}; //!< the datagrams, back to back (empty if a non-blocking socket had none)
+  size_t segment_size {};   //!< length of every datagram but the last
+  uint64_t timestamp {};    //!< when the kernel received it, in ns since the epoch (0 without timestamping)
+
+  size_t count() const { return segment_size ? ( data.size() + segment_size - 1 ) / segment_size : 0; }
+  std::string_view segment( size_t index ) const { return data.substr( index * segment_size, segment_size ); }
+};
+
+//! \brief When the kernel handed a datagram sent with timestamping on to the device
+//! (see DatagramSocket::set_timestamping)
+struct TransmitTimestamp
+{
+  uint32_t id;        //!< which send it was, counting each send since timestamping was turned on from 0
+  uint64_t timestamp; //!< in ns since the epoch
+};
+
 class DatagramSocket : public Socket
 {
   using Socket::Socket;
@@ -71,6 +114,36 @@ public:
 
   //! Send datagram to the socket's connected address (must call connect() first)
   void send( std::string_view payload );
+
+  //! \brief Receive up to batch.capacity() datagrams and their senders with one
+  //! [recvmmsg(2)](\ref man2::recvmmsg)
+  //! \returns datagrams received (0 if the socket is non-blocking and has none); longer ones are truncated
+  size_t recv( DatagramBatch& batch );
+
+  //! \brief Send `payload` as datagrams of `segment_size` bytes each (the last may be shorter) with one call,
+  //! which the kernel segments as late as it can ([UDP GSO](\ref man7::udp), UDP_SEGMENT)
+  //! \details At most 64 KiB, in at most 64 segments.
+  void sendto( const Address& destination, std::string_view payload, uint16_t segment_size );
+  void send( std::string_view payload, uint16_t segment_size );
+
+  //! \brief Receive a datagram, or several the kernel coalesced (see UDPSocket::set_gro), into `buffer`
+  //! \returns views of the datagrams, valid until the next read into `buffer`
+  SegmentedDatagram recv( Address& source_address, ReadBuffer& buffer );
+
+  //! \brief Send the batch's datagrams with [sendmmsg(2)](\ref man2::sendmmsg)
+  //! \returns datagrams sent: all of them, unless the socket is non-blocking and its send buffer fills
+  size_t send( DatagramBatch& batch );
+
+  //! \brief Ask the kernel for software timestamps ([SO_TIMESTAMPING](\ref man7::socket)): one on each
+  //! datagram received (see SegmentedDatagram::timestamp), and one on the error queue for each datagram sent
+  //! (see read_transmit_timestamp())
+  //! \details Turning it on restarts the count of sends that TransmitTimestamp::id is taken from. The kernel's
+  //! clock is CLOCK_REALTIME.
+  void set_timestamping( bool enabled );
+
+  //! \brief Read a transmit timestamp from the socket's error queue (std::nullopt if it's empty)
+  //! \details The socket polls POLLERR while one is waiting: read them from a rule for Direction::ErrQueue.
+  std::optional<TransmitTimestamp> read_transmit_timestamp();
 };
 
 //! A wrapper around [UDP sockets](\ref man7::udp)
@@ -82,15 +155,28 @@ class UDPSocket : public DatagramSocket
 public:
   //! Default: construct an unbound, unconnected UDP socket
   UDPSocket() : DatagramSocket( AF_INET, SOCK_DGRAM ) {}
+
+  //! Let the kernel coalesce received datagrams of a flow into one buffer ([UDP GRO](\ref man7::udp))
+  void set_gro( bool enabled );
+};
+
+//! Sends with MSG_ZEROCOPY that the kernel has finished with: sequence numbers `first` through `last` (counting
+//! each send that sent anything from 0)
+struct ZeroCopyCompletion
+{
+  uint32_t first;
+  uint32_t last;
+  bool copied; //!< whether the kernel copied the data after all (e.g. over loopback)
 };
 
 //! A wrapper around [TCP sockets](\ref man7::tcp)
 class TCPSocket : public Socket
 {
 private:
-  //! \brief Construct from FileDescriptor (used by accept())
+  //! \brief Construct from FileDescriptor (used by accept(): a connection accepted from a TCP listener needs no
+  //! checking)
   //! \param[in] fd is the FileDescriptor from which to construct
-  explicit TCPSocket( FileDescriptor&& fd ) : Socket( std::move( fd ), AF_INET, SOCK_STREAM, IPPROTO_TCP ) {}
+  explicit TCPSocket( FileDescriptor&& fd ) : Socket( std::move( fd ) ) {}
 
 public:
   //! Default: construct an unbound, unconnected TCP socket
@@ -101,15 +187,43 @@ public:
 
   //! Accept a new incoming connection
   TCPSocket accept();
+
+  //! \brief Accept a connection if one is waiting (on a non-blocking listener), as a non-blocking socket
+  //! \details A single [accept4(2)](\ref man2::accept4), with no fcntl() or checks on the new socket afterwards.
+  //! \returns the connection, or std::nullopt if none was waiting
+  std::optional<TCPSocket> accept_nonblocking();
+
+  //! Allow sends with MSG_ZEROCOPY ([SO_ZEROCOPY](\ref man7::socket))
+  void set_zerocopy( bool enabled );
+
+  //! \brief Send `data` with MSG_ZEROCOPY: the kernel pins its pages and transmits from them, so they must stay
+  //! alive and unchanged until a completion covering this send is read (see ZeroCopySender)
+  //! \returns bytes sent (0 if a non-blocking socket would block, or too many completions are unread)
+  size_t send_zerocopy( std::string_view data );
+
+  //! Read a completion from the socket's error queue (std::nullopt if it's empty)
+  std::optional<ZeroCopyCompletion> read_zerocopy_completion();
 };
 
 //! A wrapper around [packet sockets](\ref man7:packet)
 class PacketSocket : public DatagramSocket
 {
+  friend class TPacketRing; // taking a block from the ring counts as a read, for EventLoop's busy-wait check
+
 public:
   PacketSocket( const int type, const int protocol ) : DatagramSocket( AF_PACKET, type, protocol ) {}
 
   void set_promiscuous();
+
+  //! Receive only from the named interface (e.g. "lo"), with [bind(2)](\ref man2::bind)
+  void bind_to_interface( const std::string& interface_name );
+
+  //! \brief Switch to TPACKET_V3 and set up the rings that mmap() will map, receive ring first (see TPacketRing)
+  //! \details A ring with no blocks is left out. Once set up, the rings last as long as the socket.
+  void set_tpacket_v3_rings( const tpacket_req3& rx, const tpacket_req3& tx );
+
+  //! Frames seen (`tp_packets`, including those dropped) and dropped since the last call
+  tpacket_stats statistics();
 };
 
 //! A wrapper around [Unix-domain stream sockets](\ref man7::unix)
@@ -0,0 +1,60 @@
+#include "splice_pipe.hh"
+#include "exception.hh"
+
+#include <algorithm>
+#include <array>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+static pair<FileDescriptor, FileDescriptor> make_pipe()
+{
+  array<int, 2> fds {};
+  CheckSystemCall( "pipe2", pipe2( fds.data(), O_CLOEXEC | O_NONBLOCK ) );
+  return { FileDescriptor { fds[0] }, FileDescriptor { fds[1] } };
+}
+
+SplicePipe::SplicePipe( const size_t capacity ) : SplicePipe( make_pipe(), capacity ) {}
+
+SplicePipe::SplicePipe( pair<FileDescriptor, FileDescriptor> ends, const size_t capacity )
+  : read_end_( move( ends.first ) ), write_end_( move( ends.second ) )
+{
+  if ( capacity ) {
+    CheckSystemCall( "fcntl F_SETPIPE_SZ",
+                     fcntl( write_end_.fd_num(), F_SETPIPE_SZ, static_cast<int>( capacity ) ) ); // NOLINT(*-vararg)
+  }
+  // the kernel rounds the size up to a power-of-two number of pages
+  const int size = fcntl( write_end_.fd_num(), F_GETPIPE_SZ ); // NOLINT(*-vararg)
+  capacity_ = CheckSystemCall( "fcntl F_GETPIPE_SZ", size );
+}
+
+size_t SplicePipe::fill( FileDescriptor& in, const size_t count )
+{
+  const size_t room = capacity_ - buffered_;
+  if ( room == 0 or count == 0 ) {
+    return 0;
+  }
+  const size_t moved = write_end_.splice( in, min( count, room ) );
+  buffered_ += moved;
+  return moved;
+}
+
+size_t SplicePipe::drain( FileDescriptor& out )
+{
+  if ( buffered_ == 0 ) {
+    return 0;
+  }
+  const size_t moved = out.splice( read_end_, buffered_ );
+  buffered_ -= moved;
+  return moved;
+}
+
+size_t SplicePipe::relay( FileDescriptor& in, FileDescriptor& out, const size_t count )
+{
+  size_t written = drain( out );
+  if ( fill( in, count ) ) {
+    written += drain( out );
+  }
+  return written;
+}
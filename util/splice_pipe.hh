@@ -0,0 +1,38 @@
+#pragma once
+
+#include "file_descriptor.hh"
+
+#include <cstddef>
+#include <utility>
+
+//! \brief Relays bytes between two descriptors that need not be pipes (e.g. two sockets) through a pipe, with
+//! [splice(2)](\ref man2::splice)
+//! \details Bytes are spliced from the source into the pipe, then from the pipe to the destination, so they
+//! only move between kernel buffers and are never copied through user space. Bytes the destination could not
+//! take yet stay in the pipe until the next relay() or drain(). Both ends of the pipe are non-blocking.
+class SplicePipe
+{
+  FileDescriptor read_end_;
+  FileDescriptor write_end_;
+  size_t capacity_ {};
+  size_t buffered_ {};
+
+  SplicePipe( std::pair<FileDescriptor, FileDescriptor> ends, size_t capacity );
+
+public:
+  //! \param[in] capacity is the size of the pipe (0 keeps the kernel's default, usually 64 KiB)
+  explicit SplicePipe( size_t capacity = 0 );
+
+  //! Splice up to `count` bytes (at most the room in the pipe) from `in` into the pipe; returns bytes moved
+  size_t fill( FileDescriptor& in, size_t count );
+
+  //! Splice as much of the pipe's contents as `out` will take; returns bytes moved
+  size_t drain( FileDescriptor& out );
+
+  //! \brief Drain what is already in the pipe, fill it from `in`, and drain it again
+  //! \returns bytes written to `out` (in.eof() tells whether `in` has finished)
+  size_t relay( FileDescriptor& in, FileDescriptor& out, size_t count );
+
+  size_t buffered() const { return buffered_; } //!< bytes in the pipe, read from `in` but not yet written out
+  size_t capacity() const { return capacity_; } //!< most bytes the pipe holds
+};
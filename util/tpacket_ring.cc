@@ -0,0 +1,156 @@
+#include "tpacket_ring.hh"
+#include "exception.hh"
+
+#include <atomic>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Ownership of a block or slot passes between kernel and application through its status word
+static uint32_t load_status( uint32_t& status )
+{
+  return atomic_ref<uint32_t> { status }.load( memory_order_acquire );
+}
+
+static void store_status( uint32_t& status, const uint32_t value )
+{
+  atomic_ref<uint32_t> { status }.store( value, memory_order_release );
+}
+
+// transmit frames start right after the (aligned) header; the kernel expects them there without PACKET_TX_HAS_OFF
+static constexpr size_t TX_DATA_OFFSET = TPACKET_ALIGN( sizeof( tpacket3_hdr ) );
+
+TPacketRing::TPacketRing( PacketSocket& socket, const Options& options ) : socket_( socket ), options_( options )
+{
+  const auto page = static_cast<size_t>( sysconf( _SC_PAGESIZE ) );
+  if ( options_.block_size == 0 or options_.block_size % page != 0 ) {
+    throw runtime_error( "TPacketRing block size must be a multiple of the page size" );
+  }
+  if ( options_.tx_blocks > 0
+       and ( options_.tx_frame_size <= TX_DATA_OFFSET or options_.tx_frame_size % TPACKET_ALIGNMENT != 0
+             or options_.tx_frame_size > options_.block_size ) ) {
+    throw runtime_error( "TPacketRing transmit slots must be aligned and fit a header and a block" );
+  }
+
+  tpacket_req3 rx {};
+  rx.tp_block_size = options_.block_size;
+  rx.tp_block_nr = options_.rx_blocks;
+  rx.tp_frame_size = 2048; // only checked for alignment and size: V3 packs frames of any length
+  rx.tp_frame_nr = options_.block_size / rx.tp_frame_size * options_.rx_blocks;
+  rx.tp_retire_blk_tov = options_.block_timeout_ms;
+
+  tpacket_req3 tx {}; // the kernel wants the receive-only fields left zero
+  tx.tp_block_size = options_.block_size;
+  tx.tp_block_nr = options_.tx_blocks;
+  tx.tp_frame_size = options_.tx_frame_size;
+  tx.tp_frame_nr = options_.block_size / options_.tx_frame_size * options_.tx_blocks;
+  tx_slots_ = tx.tp_frame_nr;
+
+  socket_.set_tpacket_v3_rings( rx, tx );
+
+  map_length_ = options_.block_size * ( options_.rx_blocks + options_.tx_blocks );
+  void* const address
+    = mmap( nullptr, map_length_, PROT_READ | PROT_WRITE, MAP_SHARED, socket_.fd_num(), 0 ); // NOLINT(*-bitwise)
+  if ( address == MAP_FAILED ) {
+    throw unix_error { "mmap" };
+  }
+  map_ = static_cast<char*>( address );
+}
+
+TPacketRing::~TPacketRing()
+{
+  munmap( map_, map_length_ );
+}
+
+char* TPacketRing::rx_block( const size_t index ) const
+{
+  return map_ + index * options_.block_size; // NOLINT(*-pointer-arithmetic)
+}
+
+// slots never straddle blocks, so a block's leftover bytes (if any) are skipped
+char* TPacketRing::tx_slot( const size_t index ) const
+{
+  const size_t per_block = options_.block_size / options_.tx_frame_size;
+  return rx_block( options_.rx_blocks + index / per_block )
+         + index % per_block * options_.tx_frame_size; // NOLINT(*-pointer-arithmetic)
+}
+
+span<const TPacketRing::Frame> TPacketRing::next_block()
+{
+  release_block();
+  if ( options_.rx_blocks == 0 ) {
+    return {};
+  }
+
+  auto* const block = reinterpret_cast<tpacket_block_desc*>( rx_block( rx_block_ ) ); // NOLINT(*-cast)
+  tpacket_hdr_v1& header = block->hdr.bh1;
+  if ( not( load_status( header.block_status ) & TP_STATUS_USER ) ) { // NOLINT(*-bitwise)
+    return {};
+  }
+
+  const char* frame = reinterpret_cast<const char*>( block ) + header.offset_to_first_pkt; // NOLINT(*-cast)
+  for ( uint32_t i = 0; i < header.num_pkts; ++i ) {
+    const auto* const packet = reinterpret_cast<const tpacket3_hdr*>( frame ); // NOLINT(*-cast)
+    frames_.push_back( { { frame + packet->tp_mac, packet->tp_snaplen }, // NOLINT(*-pointer-arithmetic)
+                         packet->tp_len,
+                         uint64_t { packet->tp_sec } * 1'000'000'000 + packet->tp_nsec } );
+    frame += packet->tp_next_offset; // NOLINT(*-pointer-arithmetic)
+  }
+
+  holding_ = true;
+  socket_.register_read();
+  ++blocks_received_;
+  frames_received_ += frames_.size();
+  return frames_;
+}
+
+void TPacketRing::release_block()
+{
+  if ( not holding_ ) {
+    return;
+  }
+  auto* const block = reinterpret_cast<tpacket_block_desc*>( rx_block( rx_block_ ) ); // NOLINT(*-cast)
+  store_status( block->hdr.bh1.block_status, TP_STATUS_KERNEL );
+  frames_.clear();
+  holding_ = false;
+  rx_block_ = ( rx_block_ + 1 ) % options_.rx_blocks;
+}
+
+bool TPacketRing::push( const string_view frame )
+{
+  if ( tx_slots_ == 0 ) {
+    throw runtime_error( "TPacketRing has no transmit ring" );
+  }
+  if ( frame.size() > options_.tx_frame_size - TX_DATA_OFFSET ) {
+    throw runtime_error( "frame too long for a TPacketRing transmit slot" );
+  }
+
+  char* const slot = tx_slot( tx_slot_ );
+  auto* const header = reinterpret_cast<tpacket3_hdr*>( slot ); // NOLINT(*-cast)
+  const uint32_t status = load_status( header->tp_status );
+  if ( status == TP_STATUS_SEND_REQUEST or status == TP_STATUS_SENDING ) {
+    return false;
+  }
+
+  memcpy( slot + TX_DATA_OFFSET, frame.data(), frame.size() ); // NOLINT(*-pointer-arithmetic)
+  header->tp_len = frame.size();
+  header->tp_next_offset = 0;
+  store_status( header->tp_status, TP_STATUS_SEND_REQUEST );
+
+  tx_slot_ = ( tx_slot_ + 1 ) % tx_slots_;
+  ++tx_queued_;
+  return true;
+}
+
+void TPacketRing::flush()
+{
+  if ( tx_queued_ == 0 ) {
+    return;
+  }
+  // with no data, send() just starts transmission of every slot marked for sending
+  CheckSystemCall( "send (TX ring)", ::send( socket_.fd_num(), nullptr, 0, MSG_DONTWAIT ) );
+  tx_queued_ = 0;
+}
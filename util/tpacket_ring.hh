@@ -0,0 +1,89 @@
+#pragma once
+
+#include "socket.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <vector>
+
+//! \brief A PacketSocket's TPACKET_V3 receive ring (and optional transmit ring), mapped into user space
+//! \details The kernel writes captured frames straight into shared blocks, so capturing costs no recvfrom() and
+//! no copy: frames are read in place, a whole block at a time, and each block goes back to the kernel when the
+//! application is done with its frames. A block is handed over when it fills up, or when block_timeout_ms passes
+//! with frames in it, and the socket polls readable while one is waiting. Frames to send are written straight
+//! into transmit slots and sent together by flush().
+class TPacketRing
+{
+public:
+  struct Options
+  {
+    size_t block_size = size_t { 1 } << 20; //!< bytes per block (a multiple of the page size)
+    size_t rx_blocks = 64;                  //!< blocks in the receive ring
+    size_t tx_blocks = 0;                   //!< blocks in the transmit ring (0 for none)
+    size_t tx_frame_size = 2048;            //!< bytes per transmit slot, header included
+    unsigned block_timeout_ms = 10;         //!< hand over a block that isn't full after this long
+  };
+
+  //! A captured frame, pointing into the ring
+  struct Frame
+  {
+    std::string_view data; //!< the bytes captured (all of the frame, or the first snaplen)
+    uint32_t length;       //!< the frame's length on the wire
+    uint64_t timestamp;    //!< when the kernel received it, in nanoseconds since the epoch
+  };
+
+private:
+  PacketSocket& socket_;
+  Options options_;
+
+  char* map_ {};
+  size_t map_length_ {};
+
+  size_t rx_block_ {}; // the next receive block to look at
+  bool holding_ {};    // whether the application still has rx_block_'s frames
+  std::vector<Frame> frames_ {};
+
+  size_t tx_slot_ {}; // the next transmit slot to fill
+  size_t tx_slots_ {};
+  size_t tx_queued_ {}; // slots filled since the last flush
+
+  uint64_t blocks_received_ {};
+  uint64_t frames_received_ {};
+
+  char* rx_block( size_t index ) const;
+  char* tx_slot( size_t index ) const;
+
+public:
+  //! Set up and map the rings on `socket`, which must outlive the TPacketRing and can only have them once
+  TPacketRing( PacketSocket& socket, const Options& options );
+  explicit TPacketRing( PacketSocket& socket ) : TPacketRing( socket, Options {} ) {}
+
+  ~TPacketRing();
+
+  //! \brief The frames of the next block the kernel has handed over (empty if there is none yet)
+  //! \details Releases the block returned by the previous call first. The views stay valid until the block is
+  //! released.
+  std::span<const Frame> next_block();
+
+  //! Give the block returned by next_block() back to the kernel
+  void release_block();
+
+  //! \brief Copy `frame` (a whole link-layer frame) into a free transmit slot, to be sent by flush()
+  //! \returns false if every slot is still waiting to be sent
+  bool push( std::string_view frame );
+
+  //! Ask the kernel to send the frames pushed since the last flush
+  void flush();
+
+  uint64_t blocks_received() const { return blocks_received_; } //!< blocks handed over so far
+  uint64_t frames_received() const { return frames_received_; } //!< frames in those blocks
+  size_t tx_slots() const { return tx_slots_; }                 //!< frames the transmit ring holds
+
+  // frames point into the mapping
+  TPacketRing( const TPacketRing& other ) = delete;
+  TPacketRing& operator=( const TPacketRing& other ) = delete;
+  TPacketRing( TPacketRing&& other ) = delete;
+  TPacketRing& operator=( TPacketRing&& other ) = delete;
+};
@@ -1,11 +1,17 @@
 #include "tun.hh"
 #include "exception.hh"
+#include "virtio_net_header.hh"
 
+#include <algorithm>
 #include <cstring>
 #include <fcntl.h>
 #include <linux/if.h>
 #include <linux/if_tun.h>
+#include <memory>
+#include <span>
+#include <string_view>
 #include <sys/ioctl.h>
+#include <vector>
 
 static constexpr const char* CLONEDEV = "/dev/net/tun";
 
@@ -14,6 +20,7 @@ using namespace std;
 //! \param[in] devname is the name of the TUN or TAP device, specified at its creation.
 //! \param[in] is_tun is `true` for a TUN device (expects IP datagrams), or `false` for a TAP device (expects
 //! Ethernet frames)
+//! \param[in] extra_flags are further IFF_ flags for TUNSETIFF (e.g. IFF_MULTI_QUEUE to open another queue)
 //!
 //! To create a TUN device, you should already have run
 //!
@@ -21,13 +28,14 @@ using namespace std;
 //!
 //! as root before calling this function.
 
-TunTapFD::TunTapFD( const string& devname, const bool is_tun )
+TunTapFD::TunTapFD( const string& devname, const bool is_tun, const int extra_flags )
   : FileDescriptor( ::CheckSystemCall( "open", open( CLONEDEV, O_RDWR | O_CLOEXEC ) ) )
 {
   struct ifreq tun_req
   {};
 
-  tun_req.ifr_flags = static_cast<int16_t>( ( is_tun ? IFF_TUN : IFF_TAP ) | IFF_NO_PI ); // no packetinfo
+  // no packetinfo
+  tun_req.ifr_flags = static_cast<int16_t>( ( is_tun ? IFF_TUN : IFF_TAP ) | IFF_NO_PI | extra_flags );
 
   // copy devname to ifr_name, making sure to null terminate
 
@@ -35,4 +43,72 @@ TunTapFD::TunTapFD( const string& devname, const bool is_tun )
   tun_req.ifr_name[IFNAMSIZ - 1] = '\0';
 
   CheckSystemCall( "ioctl", ioctl( fd_num(), TUNSETIFF, static_cast<void*>( &tun_req ) ) );
+
+  if ( extra_flags & IFF_VNET_HDR ) {
+    vnet_header_length_ = VirtioNetHeader::LENGTH;
+  }
+}
+
+void TunTapFD::set_offload( const unsigned int offloads )
+{
+  if ( not vnet_header_length_ ) {
+    throw runtime_error( "TunTapFD::set_offload: device was not opened with IFF_VNET_HDR" );
+  }
+  CheckSystemCall( "ioctl", ioctl( fd_num(), TUNSETOFFLOAD, static_cast<unsigned long>( offloads ) ) );
+}
+
+static void set_queue( const int fd, const int16_t flags )
+{
+  struct ifreq queue_req
+  {};
+
+  queue_req.ifr_flags = flags;
+  CheckSystemCall( "ioctl", ioctl( fd, TUNSETQUEUE, static_cast<void*>( &queue_req ) ) );
+}
+
+void TunTapFD::attach_queue()
+{
+  set_queue( fd_num(), IFF_ATTACH_QUEUE );
+}
+
+void TunTapFD::detach_queue()
+{
+  set_queue( fd_num(), IFF_DETACH_QUEUE );
+}
+
+// Captures each frame read or written, without the virtio-net header in front of it
+class CaptureTap : public IOTap
+{
+  shared_ptr<PcapngWriter> writer_;
+  size_t vnet_header_length_;
+
+  void capture( span<const string_view> frame, const PcapngWriter::Direction direction ) const
+  {
+    if ( not vnet_header_length_ ) {
+      writer_->capture( frame, direction );
+      return;
+    }
+
+    vector<string_view> pieces { frame.begin(), frame.end() };
+    size_t skip = vnet_header_length_;
+    for ( auto& piece : pieces ) {
+      const size_t n = min( skip, piece.size() );
+      piece.remove_prefix( n );
+      skip -= n;
+    }
+    writer_->capture( pieces, direction );
+  }
+
+public:
+  CaptureTap( shared_ptr<PcapngWriter> writer, const size_t vnet_header_length )
+    : writer_( move( writer ) ), vnet_header_length_( vnet_header_length )
+  {}
+
+  void on_read( span<const string_view> data ) override { capture( data, PcapngWriter::Direction::Inbound ); }
+  void on_write( span<const string_view> data ) override { capture( data, PcapngWriter::Direction::Outbound ); }
+};
+
+void TunTapFD::set_capture( shared_ptr<PcapngWriter> capture )
+{
+  set_tap( capture ? make_shared<CaptureTap>( move( capture ), vnet_header_length_ ) : nullptr );
 }
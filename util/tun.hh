@@ -1,16 +1,42 @@
 #pragma once
 
 #include "file_descriptor.hh"
+#include "pcapng_writer.hh"
 
+#include <memory>
 #include <string>
 
 //! A FileDescriptor to a [Linux TUN/TAP](https://www.kernel.org/doc/Documentation/networking/tuntap.txt) device
 class TunTapFD : public FileDescriptor
 {
+  size_t vnet_header_length_ {}; // bytes of virtio-net header before each frame (with IFF_VNET_HDR)
+
+protected:
+  //! Wrap an fd that already behaves like a TUN/TAP device (one frame per read or write), e.g. FakeTun
+  explicit TunTapFD( FileDescriptor fd ) : FileDescriptor( std::move( fd ) ) {}
+
 public:
   //! Open an existing persistent [TUN or TAP
   //! device](https://www.kernel.org/doc/Documentation/networking/tuntap.txt).
-  explicit TunTapFD( const std::string& devname, bool is_tun );
+  explicit TunTapFD( const std::string& devname, bool is_tun, int extra_flags = 0 );
+
+  //! \name Queues of a device opened with IFF_MULTI_QUEUE
+  //! \details Each fd opened on a multi-queue device is one queue. The kernel spreads received traffic over the
+  //! attached queues by flow, so every queue can be served by its own thread.
+  //!@{
+  void attach_queue(); //!< Start receiving this queue's share of the traffic (queues start out attached)
+  void detach_queue(); //!< Stop receiving traffic on this queue, without closing it
+  //!@}
+
+  //! \brief Enable checksum and segmentation offloads ([TUNSETOFFLOAD](\ref man2::ioctl_tun))
+  //! \details The fd must have been opened with IFF_VNET_HDR, so that every frame read or written starts with a
+  //! VirtioNetHeader. \param[in] offloads is a combination of TUN_F_CSUM, TUN_F_TSO4, TUN_F_USO4, etc.
+  void set_offload( unsigned int offloads );
+
+  //! \brief Record every frame read or written from now on (or stop capturing, given nullptr)
+  //! \details Capture is an IOTap on the descriptor, so it sees the reads and writes of every duplicate, and of
+  //! any code that only has a FileDescriptor& (such as an EventLoop rule).
+  void set_capture( std::shared_ptr<PcapngWriter> capture );
 };
 
 //! A FileDescriptor to a [Linux TUN](https://www.kernel.org/doc/Documentation/networking/tuntap.txt) device
@@ -18,7 +44,7 @@ class TunFD : public TunTapFD
 {
 public:
   //! Open an existing persistent [TUN device](https://www.kernel.org/doc/Documentation/networking/tuntap.txt).
-  explicit TunFD( const std::string& devname ) : TunTapFD( devname, true ) {}
+  explicit TunFD( const std::string& devname, int extra_flags = 0 ) : TunTapFD( devname, true, extra_flags ) {}
 };
 
 //! A FileDescriptor to a [Linux TAP](https://www.kernel.org/doc/Documentation/networking/tuntap.txt) device
@@ -26,5 +52,5 @@ class TapFD : public TunTapFD
 {
 public:
   //! Open an existing persistent [TAP device](https://www.kernel.org/doc/Documentation/networking/tuntap.txt).
-  explicit TapFD( const std::string& devname ) : TunTapFD( devname, false ) {}
+  explicit TapFD( const std::string& devname, int extra_flags = 0 ) : TunTapFD( devname, false, extra_flags ) {}
 };
@@ -0,0 +1,79 @@
+#include "tun_queue_group.hh"
+#include "eventloop.hh"
+#include "exception.hh"
+
+#include <cstdint>
+#include <iostream>
+#include <linux/if_tun.h>
+#include <sys/eventfd.h>
+
+using namespace std;
+
+TunQueueGroup::TunQueueGroup( const string& devname, const size_t num_queues )
+{
+  if ( num_queues == 0 ) {
+    throw runtime_error( "TunQueueGroup needs at least one queue" );
+  }
+
+  workers_.reserve( num_queues );
+  for ( size_t i = 0; i < num_queues; ++i ) {
+    auto worker = make_unique<Worker>( TunFD { devname, IFF_MULTI_QUEUE },
+                                       FileDescriptor { CheckSystemCall( "eventfd", eventfd( 0, EFD_CLOEXEC ) ) } );
+    worker->queue.set_blocking( false );
+    workers_.push_back( move( worker ) );
+  }
+}
+
+TunQueueGroup::~TunQueueGroup()
+{
+  try {
+    stop();
+  } catch ( const exception& e ) {
+    cerr << "Exception stopping TunQueueGroup: " << e.what() << endl;
+  }
+}
+
+void TunQueueGroup::start( const Handler& handler )
+{
+  for ( size_t i = 0; i < workers_.size(); ++i ) {
+    Worker& worker = *workers_[i];
+    if ( not worker.thread.joinable() ) {
+      worker.thread = thread( [i, &worker, handler] { run( i, worker, handler ); } );
+    }
+  }
+}
+
+void TunQueueGroup::stop()
+{
+  static constexpr uint64_t one = 1;
+  const string_view increment { reinterpret_cast<const char*>( &one ), sizeof( one ) }; // NOLINT(*-cast)
+
+  for ( auto& worker : workers_ ) {
+    if ( worker->thread.joinable() ) {
+      worker->wakeup.write( increment );
+      worker->thread.join();
+    }
+  }
+}
+
+void TunQueueGroup::run( const size_t index, Worker& worker, const Handler& handler )
+{
+  try {
+    EventLoop loop;
+    bool running = true;
+
+    loop.add_rule( "TUN queue " + to_string( index ), worker.queue, Direction::In, [&] {
+      handler( index, worker.queue );
+    } );
+
+    loop.add_rule( "stop", worker.wakeup, Direction::In, [&] {
+      string counter;
+      worker.wakeup.read( counter );
+      running = false;
+    } );
+
+    while ( running and loop.wait_next_event( -1 ) != EventLoop::Result::Exit ) {}
+  } catch ( const exception& e ) {
+    cerr << "Exception on TUN queue " << index << ": " << e.what() << endl;
+  }
+}
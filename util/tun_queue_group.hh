@@ -0,0 +1,56 @@
+#pragma once
+
+#include "tun.hh"
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+//! \brief All the queues of a multi-queue TUN device, each served by its own thread and EventLoop
+//! \details The kernel steers each flow to one attached queue, so packet processing for different flows runs in
+//! parallel without any locking between the threads.
+class TunQueueGroup
+{
+public:
+  //! Called on a queue's own thread whenever that queue is readable (it must read from the queue)
+  using Handler = std::function<void( size_t queue_index, TunFD& queue )>;
+
+private:
+  struct Worker
+  {
+    TunFD queue;
+    FileDescriptor wakeup; // eventfd that tells the thread to stop
+    std::thread thread {};
+  };
+
+  std::vector<std::unique_ptr<Worker>> workers_ {};
+
+  static void run( size_t index, Worker& worker, const Handler& handler );
+
+public:
+  //! Open `num_queues` non-blocking queues on the (new or existing) TUN device `devname`
+  TunQueueGroup( const std::string& devname, size_t num_queues );
+
+  //! Stops the threads, if they are running
+  ~TunQueueGroup();
+
+  size_t size() const { return workers_.size(); }
+  TunFD& queue( size_t index ) { return workers_.at( index )->queue; }
+
+  //! Start one thread per queue, each calling `handler` from its own EventLoop
+  void start( const Handler& handler );
+
+  //! Stop and join the threads (the queues stay open)
+  void stop();
+
+  void attach( size_t index ) { queue( index ).attach_queue(); } //!< Resume steering traffic to a queue
+  void detach( size_t index ) { queue( index ).detach_queue(); } //!< Stop steering traffic to a queue
+
+  TunQueueGroup( const TunQueueGroup& other ) = delete;
+  TunQueueGroup& operator=( const TunQueueGroup& other ) = delete;
+  TunQueueGroup( TunQueueGroup&& other ) = delete;
+  TunQueueGroup& operator=( TunQueueGroup&& other ) = delete;
+};
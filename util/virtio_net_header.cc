@@ -0,0 +1,205 @@
+#include "virtio_net_header.hh"
+#include "checksum.hh"
+
+#include <byteswap.h>
+#include <stdexcept>
+
+using namespace std;
+
+static constexpr uint8_t PROTO_UDP = 17;
+static constexpr size_t TCP_CHECKSUM_OFFSET = 16;
+static constexpr size_t UDP_CHECKSUM_OFFSET = 6;
+static constexpr size_t UDP_HEADER_LENGTH = 8;
+static constexpr uint8_t TCP_FIN = 0x01;
+static constexpr uint8_t TCP_PSH = 0x08;
+static constexpr uint8_t TCP_CWR = 0x80;
+
+// Parser and Serializer work in network byte order, but the header is little-endian
+static uint16_t swap( const uint16_t value )
+{
+  return bswap_16( value );
+}
+
+void VirtioNetHeader::parse( Parser& parser )
+{
+  parser.integer( flags );
+  parser.integer( gso_type );
+  for ( uint16_t* field : { &hdr_len, &gso_size, &csum_start, &csum_offset } ) {
+    parser.integer( *field );
+    *field = swap( *field );
+  }
+}
+
+void VirtioNetHeader::serialize( Serializer& serializer ) const
+{
+  serializer.integer( flags );
+  serializer.integer( gso_type );
+  for ( const uint16_t field : { hdr_len, gso_size, csum_start, csum_offset } ) {
+    serializer.integer( swap( field ) );
+  }
+}
+
+static uint16_t get16( const string& data, const size_t offset )
+{
+  return static_cast<uint16_t>( ( static_cast<uint8_t>( data.at( offset ) ) << 8 )
+                                | static_cast<uint8_t>( data.at( offset + 1 ) ) );
+}
+
+static void put16( string& data, const size_t offset, const uint16_t value )
+{
+  data.at( offset ) = static_cast<char>( value >> 8 );
+  data.at( offset + 1 ) = static_cast<char>( value );
+}
+
+static uint32_t get32( const string& data, const size_t offset )
+{
+  return ( static_cast<uint32_t>( get16( data, offset ) ) << 16 ) | get16( data, offset + 2 );
+}
+
+static void put32( string& data, const size_t offset, const uint32_t value )
+{
+  put16( data, offset, static_cast<uint16_t>( value >> 16 ) );
+  put16( data, offset + 2, static_cast<uint16_t>( value ) );
+}
+
+// The transport header and payload as one buffer
+static string concatenate( const vector<string>& buffers )
+{
+  if ( buffers.size() == 1 ) {
+    return buffers.front();
+  }
+  string result;
+  for ( const auto& buf : buffers ) {
+    result += buf;
+  }
+  return result;
+}
+
+VirtioNetHeader VirtioNetHeader::offload_tcp( IPv4Datagram& dgram, const uint16_t mss )
+{
+  if ( dgram.header.proto != IPv4Header::PROTO_TCP or dgram.header.hlen != IPv4Header::LENGTH / 4 ) {
+    throw runtime_error( "VirtioNetHeader::offload_tcp: not a TCP datagram without IP options" );
+  }
+
+  string segment = concatenate( dgram.payload );
+  const size_t tcp_header_length = 4 * ( static_cast<uint8_t>( segment.at( 12 ) ) >> 4 );
+  if ( tcp_header_length < 20 or tcp_header_length > segment.size() ) {
+    throw runtime_error( "VirtioNetHeader::offload_tcp: bad TCP header length" );
+  }
+
+  // the field holds the (uncomplemented) pseudo-header sum until the checksum is completed
+  const InternetChecksum pseudo_header { dgram.header.pseudo_checksum() };
+  put16( segment, TCP_CHECKSUM_OFFSET, static_cast<uint16_t>( ~pseudo_header.value() ) );
+  dgram.payload = { move( segment ) };
+
+  VirtioNetHeader vnet;
+  vnet.flags = FLAG_NEEDS_CSUM;
+  vnet.hdr_len = IPv4Header::LENGTH + tcp_header_length;
+  vnet.csum_start = IPv4Header::LENGTH;
+  vnet.csum_offset = TCP_CHECKSUM_OFFSET;
+  if ( dgram.header.payload_length() - tcp_header_length > mss ) {
+    vnet.gso_type = GSO_TCPV4;
+    vnet.gso_size = mss;
+  }
+  return vnet;
+}
+
+// Compute a transport checksum from scratch
+static void fill_checksum( const IPv4Header& header, string& segment, const size_t checksum_offset )
+{
+  put16( segment, checksum_offset, 0 );
+  InternetChecksum checksum { header.pseudo_checksum() };
+  checksum.add( segment );
+  uint16_t value = checksum.value();
+  if ( header.proto == PROTO_UDP and value == 0 ) {
+    value = 0xffff; // zero means "no checksum" in UDP
+  }
+  put16( segment, checksum_offset, value );
+}
+
+// NOLINTBEGIN(*-cognitive-complexity)
+vector<IPv4Datagram> segment_datagram( const VirtioNetHeader& vnet, const IPv4Datagram& dgram )
+{
+  const IPv4Header& header = dgram.header;
+  const size_t ip_header_length = 4 * header.hlen;
+
+  if ( not vnet.is_gso() ) {
+    if ( not( vnet.flags & VirtioNetHeader::FLAG_NEEDS_CSUM ) ) {
+      return { dgram };
+    }
+
+    // checksum from csum_start to the end, starting from the partial sum already in the checksum field
+    if ( vnet.csum_start < ip_header_length ) {
+      throw runtime_error( "segment_datagram: checksum starts inside the IP header" );
+    }
+    string segment = concatenate( dgram.payload );
+    const size_t start = vnet.csum_start - ip_header_length;
+    const size_t field = start + vnet.csum_offset;
+    if ( start > segment.size() or field + 2 > segment.size() ) {
+      throw runtime_error( "segment_datagram: checksum field past the end of the datagram" );
+    }
+    InternetChecksum checksum;
+    checksum.add( string_view { segment }.substr( start ) );
+    put16( segment, field, checksum.value() );
+
+    IPv4Datagram result { header, { move( segment ) } };
+    return { move( result ) };
+  }
+
+  const uint8_t type = vnet.gso_type & ~VirtioNetHeader::GSO_ECN;
+  const bool tcp = type == VirtioNetHeader::GSO_TCPV4;
+  if ( ( not tcp and type != VirtioNetHeader::GSO_UDP_L4 ) or vnet.gso_size == 0
+       or header.proto != ( tcp ? IPv4Header::PROTO_TCP : PROTO_UDP ) ) {
+    throw runtime_error( "segment_datagram: unsupported GSO type " + to_string( vnet.gso_type ) );
+  }
+
+  const string segment = concatenate( dgram.payload );
+  const size_t transport_header_length
+    = tcp ? 4 * ( static_cast<uint8_t>( segment.at( 12 ) ) >> 4 ) : UDP_HEADER_LENGTH;
+  if ( transport_header_length > segment.size() ) {
+    throw runtime_error( "segment_datagram: truncated transport header" );
+  }
+
+  const string_view data = string_view { segment }.substr( transport_header_length );
+  const uint32_t first_seqno = tcp ? get32( segment, 4 ) : 0;
+  const uint8_t tcp_flags = tcp ? static_cast<uint8_t>( segment.at( 13 ) ) : 0;
+
+  vector<IPv4Datagram> segments;
+  segments.reserve( ( data.size() + vnet.gso_size - 1 ) / vnet.gso_size );
+  for ( size_t offset = 0; offset < data.size(); offset += vnet.gso_size ) {
+    const bool first = offset == 0;
+    const bool last = offset + vnet.gso_size >= data.size();
+
+    string piece = segment.substr( 0, transport_header_length );
+    piece.append( data.substr( offset, vnet.gso_size ) );
+
+    IPv4Datagram result;
+    result.header = header;
+    result.header.id = static_cast<uint16_t>( header.id + segments.size() );
+    result.header.len = ip_header_length + piece.size();
+    result.header.compute_checksum();
+
+    if ( tcp ) {
+      // FIN and PSH belong on the last segment only, CWR on the first
+      uint8_t flags = tcp_flags;
+      if ( not last ) {
+        flags &= ~( TCP_FIN | TCP_PSH );
+      }
+      if ( not first ) {
+        flags &= ~TCP_CWR;
+      }
+      put32( piece, 4, first_seqno + offset );
+      piece.at( 13 ) = static_cast<char>( flags );
+      fill_checksum( result.header, piece, TCP_CHECKSUM_OFFSET );
+    } else {
+      put16( piece, 4, static_cast<uint16_t>( piece.size() ) );
+      fill_checksum( result.header, piece, UDP_CHECKSUM_OFFSET );
+    }
+
+    result.payload.push_back( move( piece ) );
+    segments.push_back( move( result ) );
+  }
+
+  return segments;
+}
+// NOLINTEND(*-cognitive-complexity)
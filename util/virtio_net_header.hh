@@ -0,0 +1,50 @@
+#pragma once
+
+#include "ipv4_datagram.hh"
+#include "parser.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//! \brief The header (struct virtio_net_hdr) before every frame on a TUN/TAP fd opened with IFF_VNET_HDR
+//! \details It carries segmentation (GSO) and checksum offload metadata. Once offloads are enabled with
+//! TunTapFD::set_offload(), the kernel may hand over TCP and UDP "super-segments" of up to 64 KiB with their
+//! checksums left to be completed, and accepts the same from us, so a bulk flow costs one syscall and one pass of
+//! header processing per 64 KiB rather than per MTU. The fields are little-endian, as the kernel uses by default
+//! on a little-endian host.
+struct VirtioNetHeader
+{
+  static constexpr size_t LENGTH = 10;
+
+  static constexpr uint8_t FLAG_NEEDS_CSUM = 1; // the checksum at csum_start + csum_offset is incomplete
+  static constexpr uint8_t FLAG_DATA_VALID = 2; // the checksum has already been verified
+
+  static constexpr uint8_t GSO_NONE = 0;
+  static constexpr uint8_t GSO_TCPV4 = 1;
+  static constexpr uint8_t GSO_UDP_L4 = 5;
+  static constexpr uint8_t GSO_ECN = 0x80; // flag: the TCP super-segment has CWR set
+
+  uint8_t flags = 0;
+  uint8_t gso_type = GSO_NONE;
+  uint16_t hdr_len = 0;     // length of the IP and transport headers
+  uint16_t gso_size = 0;    // payload bytes per segment (the MSS)
+  uint16_t csum_start = 0;  // where checksumming starts (the transport header)
+  uint16_t csum_offset = 0; // where the checksum goes, relative to csum_start
+
+  bool is_gso() const { return ( gso_type & ~GSO_ECN ) != GSO_NONE; }
+
+  void parse( Parser& parser );
+  void serialize( Serializer& serializer ) const;
+
+  //! \brief Prepare a TCP datagram to be written with checksum and segmentation offload
+  //! \details Leaves the pseudo-header sum in the TCP checksum field (for the kernel or NIC to complete) and
+  //! returns the header asking for the payload to be cut into `mss`-sized segments.
+  static VirtioNetHeader offload_tcp( IPv4Datagram& dgram, uint16_t mss );
+};
+
+//! \brief Software fallback for segmentation and checksum offload
+//! \details Splits a TCP or UDP super-segment into datagrams of at most `vnet.gso_size` payload bytes, fixing up
+//! the IP length, ID and checksum, the TCP sequence number and flags (or UDP length), and computing each complete
+//! transport checksum. A datagram that isn't GSO is returned whole, with its checksum completed if needed.
+std::vector<IPv4Datagram> segment_datagram( const VirtioNetHeader& vnet, const IPv4Datagram& dgram );
@@ -0,0 +1,84 @@
+#include "zero_copy_sender.hh"
+
+#include <algorithm>
+
+using namespace std;
+
+ZeroCopySender::ZeroCopySender( TCPSocket& socket ) : socket_( socket )
+{
+  socket_.set_zerocopy( true );
+}
+
+void ZeroCopySender::push( shared_ptr<const string> data )
+{
+  if ( data->empty() ) {
+    return;
+  }
+  bytes_unsent_ += data->size();
+  buffers_.push_back( { move( data ), 0, 0 } );
+}
+
+// the kernel numbers every send that sent anything, in order
+size_t ZeroCopySender::send()
+{
+  size_t total = 0;
+  while ( first_unsent_ < buffers_.size() ) {
+    Buffer& buffer = buffers_[first_unsent_];
+    const size_t sent = socket_.send_zerocopy( string_view { *buffer.data }.substr( buffer.sent ) );
+    if ( sent == 0 ) {
+      break;
+    }
+
+    buffer.sent += sent;
+    buffer.last_sequence = next_sequence_++;
+    bytes_unsent_ -= sent;
+    bytes_pinned_ += sent;
+    total += sent;
+    if ( buffer.sent == buffer.data->size() ) {
+      ++first_unsent_;
+    }
+  }
+  return total;
+}
+
+// completions carry the low 32 bits of the sequence numbers, which are extended relative to the oldest open one
+void ZeroCopySender::read_completions()
+{
+  const auto extend = [this]( const uint32_t sequence ) {
+    return completed_below_ + static_cast<uint32_t>( sequence - static_cast<uint32_t>( completed_below_ ) );
+  };
+
+  while ( const auto completion = socket_.read_zerocopy_completion() ) {
+    const uint64_t first = extend( completion->first );
+    const uint64_t last = extend( completion->last );
+    if ( completion->copied ) {
+      copied_ += last - first + 1;
+    }
+    complete( first, last );
+  }
+  release();
+}
+
+void ZeroCopySender::complete( const uint64_t first, const uint64_t last )
+{
+  if ( first > completed_below_ ) {
+    completed_[first] = last;
+    return;
+  }
+
+  completed_below_ = max( completed_below_, last + 1 );
+  while ( not completed_.empty() and completed_.begin()->first <= completed_below_ ) {
+    completed_below_ = max( completed_below_, completed_.begin()->second + 1 );
+    completed_.erase( completed_.begin() );
+  }
+}
+
+// a buffer is released once it's been sent in full and every send from it has completed
+void ZeroCopySender::release()
+{
+  while ( first_unsent_ > 0 and buffers_.front().last_sequence < completed_below_ ) {
+    bytes_pinned_ -= buffers_.front().sent;
+    buffers_.pop_front();
+    --first_unsent_;
+  }
+}
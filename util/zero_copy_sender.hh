@@ -0,0 +1,59 @@
+#pragma once
+
+#include "socket.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+
+//! \brief Sends buffers on a TCPSocket with MSG_ZEROCOPY, keeping each alive until the kernel is done with it
+//! \details Buffers are reference-counted, so the caller can drop its own references right after push(). A
+//! buffer stays pinned after it is sent, until completions for every send that took bytes from it have been read
+//! from the socket's error queue. With an EventLoop, read_completions() belongs in a rule for
+//! Direction::ErrQueue, and send() in one for Direction::Out.
+class ZeroCopySender
+{
+  struct Buffer
+  {
+    std::shared_ptr<const std::string> data;
+    size_t sent;            // bytes of `data` sent so far
+    uint64_t last_sequence; // the last send that took bytes from it
+  };
+
+  TCPSocket& socket_;
+  std::deque<Buffer> buffers_ {}; // pinned buffers, then those with bytes to send
+  size_t first_unsent_ {};        // index in buffers_ of the first buffer with bytes to send
+
+  uint64_t next_sequence_ {};                 // the sequence number the kernel gives the next send
+  uint64_t completed_below_ {};               // every send before this has completed
+  std::map<uint64_t, uint64_t> completed_ {}; // completed ranges (first -> last) after the first gap
+
+  size_t bytes_unsent_ {};
+  size_t bytes_pinned_ {};
+  uint64_t copied_ {};
+
+  void complete( uint64_t first, uint64_t last );
+  void release();
+
+public:
+  //! Enables zero-copy sends on `socket`, which must outlive the sender
+  explicit ZeroCopySender( TCPSocket& socket );
+
+  //! Queue a buffer to send
+  void push( std::shared_ptr<const std::string> data );
+  void push( std::string data ) { push( std::make_shared<const std::string>( std::move( data ) ) ); }
+
+  //! Send as much of the queued data as the socket takes; returns bytes sent
+  size_t send();
+
+  //! Read every completion on the socket's error queue, releasing the buffers they finish
+  void read_completions();
+
+  size_t bytes_unsent() const { return bytes_unsent_; } //!< bytes queued but not yet sent
+  size_t bytes_pinned() const { return bytes_pinned_; } //!< bytes of buffers still held for the kernel
+  bool awaiting_completions() const { return completed_below_ < next_sequence_; } //!< sends not yet completed
+  uint64_t copied() const { return copied_; } //!< sends the kernel reported copying after all
+};